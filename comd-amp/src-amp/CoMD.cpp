@@ -90,6 +90,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "mycommand.h"
 #include "timestep.h"
 #include "constants.h"
+#include "deviceState.h"
+#include "neighborList.h"
+#include "checkpoint.h"
 
 #define REDIRECT_OUTPUT 0
 #define   MIN(A,B) ((A) < (B) ? (A) : (B))
@@ -101,7 +104,8 @@ static void initSubsystems(void);
 static void finalizeSubsystems(void);
 
 static BasePotential* initPotential(
-   int doeam, const char* potDir, const char* potName, const char* potType);
+   int doeam, int halfShell, int soa, int overlap, int fusedEam,
+   const char* potDir, const char* potName, const char* potType);
 static SpeciesData* initSpecies(BasePotential* pot);
 static Validate* initValidate(SimFlat* s);
 static void validateResult(const Validate* val, SimFlat *sim);
@@ -136,10 +140,14 @@ int main(int argc, char** argv)
 
    timestampBarrier("Starting simulation\n");
 
+   Checkpoint* checkpoint = NULL;
+   if (cmd.checkpointRate > 0)
+      checkpoint = initCheckpoint(cmd.checkpointName);
+
    // This is the CoMD main loop
    const int nSteps = sim->nSteps;
    const int printRate = sim->printRate;
-   int iStep = 0;
+   int iStep = sim->startStep;
    profileStart(loopTimer);
    for (; iStep<nSteps;)
    {
@@ -154,7 +162,15 @@ int main(int argc, char** argv)
       stopTimer(timestepTimer);
 
       iStep += printRate;
+
+      if (checkpoint && iStep % cmd.checkpointRate == 0)
+      {
+         startTimer(checkpointTimer);
+         writeCheckpoint(checkpoint, sim, iStep);
+         stopTimer(checkpointTimer);
+      }
    }
+   destroyCheckpoint(&checkpoint);
    profileStop(loopTimer);
 
    sumAtoms(sim);
@@ -194,6 +210,7 @@ SimFlat* initSimulation(Command cmd)
    SimFlat* sim = (SimFlat *) comdMalloc(sizeof(SimFlat));
    sim->nSteps = cmd.nSteps;
    sim->printRate = cmd.printRate;
+   sim->startStep = 0;
    sim->dt = cmd.dt;
    sim->domain = NULL;
    sim->boxes = NULL;
@@ -201,14 +218,20 @@ SimFlat* initSimulation(Command cmd)
    sim->ePotential = 0.0;
    sim->eKinetic = 0.0;
    sim->atomExchange = NULL;
+   sim->positionExchange = NULL;
+   sim->nbrList = NULL;
+   sim->device = NULL;
 
-   sim->pot = initPotential(cmd.doeam, cmd.potDir, cmd.potName, cmd.potType);
+   sim->pot = initPotential(cmd.doeam, cmd.halfShell, cmd.soa, cmd.overlap, cmd.fusedEam,
+                            cmd.potDir, cmd.potName, cmd.potType);
    real_t latticeConstant = cmd.lat;
    if (cmd.lat < 0.0)
       latticeConstant = sim->pot->lat;
 
-   // ensure input parameters make sense.
-   sanityChecks(cmd, sim->pot->cutoff, latticeConstant, sim->pot->latticeType);
+   // ensure input parameters make sense.  With a Verlet list the link
+   // cells and the halo have to cover the list radius.
+   real_t cutoff = sim->pot->cutoff + cmd.skin;
+   sanityChecks(cmd, cutoff, latticeConstant, sim->pot->latticeType);
 
    sim->species = initSpecies(sim->pot);
 
@@ -220,15 +243,36 @@ SimFlat* initSimulation(Command cmd)
    sim->domain = initDecomposition(
       cmd.xproc, cmd.yproc, cmd.zproc, globalExtent);
 
-   sim->boxes = initLinkCells(sim->domain, sim->pot->cutoff);
+   // the FCC lattice has four atoms per unit cell
+   real_t density = 4.0/(latticeConstant*latticeConstant*latticeConstant);
+   sim->boxes = initLinkCells(sim->domain, cutoff, density, cmd.boxOrder);
    sim->atoms = initAtoms(sim->boxes);
+   if (cmd.soa)
+      initAtomsSoa(sim->atoms, sim->boxes);
 
-   // create lattice with desired temperature and displacement.
-   createFccLattice(cmd.nx, cmd.ny, cmd.nz, latticeConstant, sim);
-   setTemperature(sim, cmd.temperature);
-   randomDisplacements(sim, cmd.initialDelta);
+   // create lattice with desired temperature and displacement, or
+   // continue from a checkpoint.
+   if (cmd.restart[0] != '\0')
+   {
+      sim->startStep = readCheckpoint(cmd.restart, sim);
+   }
+   else
+   {
+      createFccLattice(cmd.nx, cmd.ny, cmd.nz, latticeConstant, sim);
+      setTemperature(sim, cmd.temperature);
+      randomDisplacements(sim, cmd.initialDelta);
+   }
 
    sim->atomExchange = initAtomHaloExchange(sim->domain, sim->boxes);
+   if (cmd.skin > 0.0)
+   {
+      sim->positionExchange = initPositionHaloExchange(sim->domain, sim->boxes);
+      sim->nbrList = initNeighborList(sim->boxes, sim->pot->cutoff,
+                                      cmd.skin, cmd.halfShell);
+   }
+   // the half shell forces run on the host and need no device copies
+   if (! cmd.halfShell)
+      sim->device = initDeviceState(sim);
 
    // Forces must be computed before we call the time stepper.
    startTimer(redistributeTimer);
@@ -257,6 +301,10 @@ void destroySimulation(SimFlat** ps)
    destroyLinkCells(&(s->boxes));
    destroyAtoms(s->atoms);
    destroyHaloExchange(&(s->atomExchange));
+   if (s->positionExchange)
+      destroyHaloExchange(&(s->positionExchange));
+   destroyNeighborList(&(s->nbrList));
+   destroyDeviceState(&(s->device));
    comdFree(s->species);
    comdFree(s->domain);
    comdFree(s);
@@ -284,14 +332,15 @@ void finalizeSubsystems(void)
 
 /// decide whether to get LJ or EAM potentials
 BasePotential* initPotential(
-   int doeam, const char* potDir, const char* potName, const char* potType)
+   int doeam, int halfShell, int soa, int overlap, int fusedEam,
+   const char* potDir, const char* potName, const char* potType)
 {
    BasePotential* pot = NULL;
 
    if (doeam) 
-      pot = initEamPot(potDir, potName, potType);
+      pot = initEamPot(potDir, potName, potType, halfShell, soa, overlap, fusedEam);
    else 
-      pot = initLjPot();
+      pot = initLjPot(halfShell, soa);
    assert(pot);
    return pot;
 }
@@ -437,7 +486,7 @@ void printSimulationDataYaml(FILE* file, SimFlat* s)
            s->boxes->boxSize[1]/s->pot->cutoff,
            s->boxes->boxSize[2]/s->pot->cutoff);
    fprintf(file, "  Max Link Cell Occupancy: %d of %d\n",
-           maxOcc, MAXATOMS);
+           maxOcc, s->boxes->maxCapacity);
    printSeparator(file);
    fprintf(file,"Potential data: \n");
    s->pot->print(file, s->pot);
@@ -448,10 +497,9 @@ void printSimulationDataYaml(FILE* file, SimFlat* s)
    float totalMemLocal = (float)(perAtomSize*s->atoms->nLocal)/1024/1024;
    float totalMemGlobal = (float)(perAtomSize*s->atoms->nGlobal)/1024/1024;
 
-   int nLocalBoxes = s->boxes->gridSize[0]*s->boxes->gridSize[1]*s->boxes->gridSize[2];
-   int nTotalBoxes = (s->boxes->gridSize[0]+2)*(s->boxes->gridSize[1]+2)*(s->boxes->gridSize[2]+2);
-   float paddedMemLocal = (float) nLocalBoxes*(perAtomSize*MAXATOMS)/1024/1024;
-   float paddedMemTotal = (float) nTotalBoxes*(perAtomSize*MAXATOMS)/1024/1024;
+   // the link cells hold the atoms plus the slack of every box
+   float paddedMemLocal = (float) s->boxes->nLocalSlots*perAtomSize/1024/1024;
+   float paddedMemTotal = (float) s->boxes->nTotalSlots*perAtomSize/1024/1024;
 
    printSeparator(file);
    fprintf(file,"Memory data: \n");
@@ -505,6 +553,32 @@ void sanityChecks(Command cmd, double cutoff, double latticeConst, char latticeT
                  "\nOnly FCC Lattice type supported, not %s. Fatal Error.\n",
                  latticeType);
    }
+
+   // Check that the Verlet list skin is not negative (fail code 8)
+   if (cmd.skin < 0.0)
+   {
+      failCode |= 8;
+      if (printRank())
+         fprintf(screenOut, "\nThe skin must not be negative.\n");
+   }
+
+   // Check for a known link cell order (fail code 16)
+   if (cmd.boxOrder < BOX_ORDER_LEX || cmd.boxOrder > BOX_ORDER_HILBERT)
+   {
+      failCode |= 16;
+      if (printRank())
+         fprintf(screenOut, "\nThe box order must be 0, 1 or 2.\n");
+   }
+
+   // Check that checkpoints fall on output steps (fail code 32)
+   if (cmd.checkpointRate < 0 ||
+       (cmd.checkpointRate > 0 && cmd.checkpointRate % cmd.printRate != 0))
+   {
+      failCode |= 32;
+      if (printRank())
+         fprintf(screenOut,
+                 "\nThe checkpoint rate must be a multiple of the print rate.\n");
+   }
    int checkCode = failCode;
    bcastParallel(&checkCode, sizeof(int), 0);
    // This assertion can only fail if different tasks failed different
@@ -570,12 +644,13 @@ void sanityChecks(Command cmd, double cutoff, double latticeConst, char latticeT
 /// cutoff threshold. However, it does not affect the long-term energy
 /// conservation of the code.
 ///
-/// #MAXATOMS in linkCells.h
+/// #CAPACITY_SLACK in linkCells.cpp
 /// 
-/// The default value is 64, which allows ample padding of the linkCell
-/// structure to allow for density fluctuations. Reducing it may improve
-/// the efficiency of the code via improved thread utilization and
-/// reduced memory footprint.
+/// The link cells have no fixed maximum number of atoms.  Each box
+/// starts with room for the atoms the lattice density puts in it, plus
+/// this fraction of slack for density fluctuations, and grows when an
+/// atom arrives at a full box.  A larger value means fewer regrowths
+/// for systems that compress, at the cost of memory footprint.
 
 // --------------------------------------------------------------
 
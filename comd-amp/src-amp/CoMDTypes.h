@@ -57,13 +57,14 @@ typedef struct ValidateSt
 } Validate;
 
 /// 
-/// The fundamental simulation data structure with MAXATOMS in every
+/// The fundamental simulation data structure, with the atoms stored by
 /// link cell.
 /// 
 typedef struct SimFlatSt
 {
    int nSteps;            //<! number of time steps to run
    int printRate;         //<! number of steps between output
+   int startStep;         //<! first step, non-zero after a restart
    double dt;             //<! time step
    
    Domain* domain;        //<! domain decomposition data
@@ -80,6 +81,11 @@ typedef struct SimFlatSt
    BasePotential *pot;	  //!< the potential
 
    HaloExchange* atomExchange;
+   HaloExchange* positionExchange; //!< halo positions between list builds
+
+   struct NeighborListSt* nbrList; //!< Verlet list, NULL without a skin
+
+   struct DeviceStateSt* device; //!< device copies of the atom arrays
    
 } SimFlat;
 
@@ -0,0 +1,533 @@
+/*******************************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. 
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/// \file
+/// Binary checkpoint and restart.
+///
+/// The checkpoint of step n is a set of files name.n.0, name.n.1, ...,
+/// one per rank that wrote it.  Each file holds a CheckpointHeader
+/// followed by the gid, iSpecies, r and p arrays of the atoms of that
+/// rank, in the native byte order and precision.  The positions are
+/// wrapped into the global box and the header records their bounding
+/// box.
+///
+/// The small text file name.latest holds the step and the number of
+/// files of the last complete checkpoint, and a restart only reads the
+/// files it names.  It is replaced by rank 0, by writing a temporary
+/// file and renaming it, once all ranks have written their files of a
+/// new checkpoint.  Only then are the files of the previous checkpoint
+/// removed, so a run that dies at any point leaves a complete
+/// checkpoint behind.  The one exception is a new checkpoint of the
+/// same step as the one in name.latest, from an earlier run: its files
+/// are overwritten, so name.latest is removed before they are.  The commit needs MPI, which the writer threads
+/// can't call, so it is done on the main thread by the next
+/// writeCheckpoint or by destroyCheckpoint.
+///
+/// The previous checkpoint is the one name.latest named when the run
+/// started, which may have been written by more ranks; all its files
+/// are removed.  Files of a checkpoint that was never committed, left
+/// by a run that died while writing, are not named by name.latest and
+/// can be deleted by hand.
+///
+/// A restart can use a different number of ranks than the writer.
+/// Rank 0 checks the headers of all files and broadcasts them.  Each
+/// rank then reads only the files whose bounding box overlaps its
+/// domain and keeps the atoms that are inside it.  With the same
+/// decomposition that is one file per rank.  The atoms are binned with
+/// putAtomInBox, which is O(n), and sorted by the redistributeAtoms
+/// call in initSimulation.
+
+#include "checkpoint.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "CoMDTypes.h"
+#include "decomposition.h"
+#include "linkCells.h"
+#include "parallel.h"
+#include "memUtils.h"
+
+#define CHECKPOINT_MAGIC "COMDCKPT"
+#define CHECKPOINT_VERSION 1
+
+/// The header at the start of every checkpoint file.
+typedef struct CheckpointHeaderSt
+{
+   char magic[8];          //!< CHECKPOINT_MAGIC
+   int version;            //!< CHECKPOINT_VERSION
+   int realSize;           //!< sizeof(real_t) of the writer
+   int nRanks;             //!< number of files in the checkpoint
+   int rank;               //!< rank that wrote this file
+   int step;               //!< time step of the checkpoint
+   int nAtoms;             //!< number of atoms in this file
+   int nGlobal;            //!< number of atoms in all files
+   int pad;
+   double globalExtent[3]; //!< size of the global box
+   double boundsMin[3];    //!< lower corner of the positions in this file
+   double boundsMax[3];    //!< upper corner of the positions in this file
+} CheckpointHeader;
+
+struct CheckpointSt
+{
+   char name[1024];         //!< checkpoint name
+   char fileName[1040];     //!< name.<step>.<rank> of the checkpoint being written
+   CheckpointHeader header; //!< header of the checkpoint being written
+   int capacity;            //!< number of atoms the buffers can hold
+   int* gid;
+   int* iSpecies;
+   real_t* r;
+   real_t* p;
+   pthread_t writer;        //!< thread that writes the buffers
+   int pending;             //!< non-zero until writer is joined
+   int failed;              //!< set by writer if the write failed
+   int written;             //!< non-zero until the checkpoint is committed
+   int latestStep;          //!< step of the checkpoint in name.latest, -1 if none
+   int latestRanks;         //!< number of files of that checkpoint
+};
+
+static void* writeCheckpointFile(void* arg);
+static void waitCheckpoint(Checkpoint* ckpt);
+static void commitCheckpoint(Checkpoint* ckpt);
+static int readLatest(const char* name, int* step, int* nFiles);
+static int writeLatest(const char* name, int step, int nFiles);
+static void removeLatest(const char* name);
+static real_t wrapCoord(real_t x, real_t xMin, real_t extent);
+static FILE* openCheckpointFile(const char* name, int step, int iFile, CheckpointHeader* header);
+static void checkpointError(const char* name, int step, int iFile, const char* msg);
+
+/// \details
+/// Rank 0 reads name.latest, if there is one, so the first commit can
+/// remove the checkpoint it names.
+Checkpoint* initCheckpoint(const char* name)
+{
+   Checkpoint* ckpt = (Checkpoint*) comdMalloc(sizeof(Checkpoint));
+   assert(ckpt);
+
+   snprintf(ckpt->name, sizeof(ckpt->name), "%s", name);
+   ckpt->fileName[0] = '\0';
+   memset(&ckpt->header, 0, sizeof(CheckpointHeader));
+   ckpt->capacity = 0;
+   ckpt->gid = NULL;
+   ckpt->iSpecies = NULL;
+   ckpt->r = NULL;
+   ckpt->p = NULL;
+   ckpt->pending = 0;
+   ckpt->failed = 0;
+   ckpt->written = 0;
+
+   int latest[2] = {-1, 0};
+   if (getMyRank() == 0 && ! readLatest(name, latest, latest+1))
+      latest[0] = -1;
+   bcastParallel(latest, sizeof(latest), 0);
+   ckpt->latestStep = latest[0];
+   ckpt->latestRanks = latest[1];
+
+   return ckpt;
+}
+
+void destroyCheckpoint(Checkpoint** ckpt)
+{
+   if (! ckpt) return;
+   if (! *ckpt) return;
+
+   commitCheckpoint(*ckpt);
+   comdFree((*ckpt)->gid);
+   comdFree((*ckpt)->iSpecies);
+   comdFree((*ckpt)->r);
+   comdFree((*ckpt)->p);
+   comdFree(*ckpt);
+   *ckpt = NULL;
+}
+
+/// \details
+/// The copy into the buffers is the only part the time step waits
+/// for, apart from the previous write if it has not finished yet.  The
+/// writer thread makes no MPI calls, so MPI needs no thread support.
+void writeCheckpoint(Checkpoint* ckpt, SimFlat* s, int iStep)
+{
+   commitCheckpoint(ckpt);
+
+   LinkCell* boxes = s->boxes;
+   Atoms* atoms = s->atoms;
+   const real_t* globalMin = s->domain->globalMin;
+   const real_t* globalExtent = s->domain->globalExtent;
+
+   int nLocal = 0;
+   for (int iBox=0; iBox<boxes->nLocalBoxes; iBox++)
+      nLocal += boxes->nAtoms[iBox];
+
+   if (nLocal > ckpt->capacity)
+   {
+      ckpt->capacity = nLocal;
+      ckpt->gid =      (int*)    comdRealloc(ckpt->gid,      nLocal*sizeof(int));
+      ckpt->iSpecies = (int*)    comdRealloc(ckpt->iSpecies, nLocal*sizeof(int));
+      ckpt->r =        (real_t*) comdRealloc(ckpt->r,        nLocal*sizeof(real3));
+      ckpt->p =        (real_t*) comdRealloc(ckpt->p,        nLocal*sizeof(real3));
+      assert(ckpt->gid && ckpt->iSpecies && ckpt->r && ckpt->p);
+   }
+
+   CheckpointHeader* header = &ckpt->header;
+   memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+   header->version = CHECKPOINT_VERSION;
+   header->realSize = sizeof(real_t);
+   header->nRanks = getNRanks();
+   header->rank = getMyRank();
+   header->step = iStep;
+   header->nAtoms = nLocal;
+   snprintf(ckpt->fileName, sizeof(ckpt->fileName), "%s.%d.%d", ckpt->name, iStep, getMyRank());
+   // The files of a checkpoint of the same step, from an earlier run,
+   // are about to be overwritten.  The reduction keeps every rank from
+   // starting to write before name.latest is gone.
+   if (iStep == ckpt->latestStep && getMyRank() == 0)
+      removeLatest(ckpt->name);
+   addIntParallel(&nLocal, &header->nGlobal, 1);
+   for (int ii=0; ii<3; ++ii)
+   {
+      header->globalExtent[ii] = globalExtent[ii];
+      header->boundsMin[ii] = DBL_MAX;
+      header->boundsMax[ii] = -DBL_MAX;
+   }
+
+   int n = 0;
+   for (int iBox=0; iBox<boxes->nLocalBoxes; iBox++)
+   {
+      int iOff = boxes->boxOffset[iBox];
+      int nInBox = boxes->nAtoms[iBox];
+      memcpy(ckpt->gid+n,      atoms->gid+iOff,      nInBox*sizeof(int));
+      memcpy(ckpt->iSpecies+n, atoms->iSpecies+iOff, nInBox*sizeof(int));
+      memcpy(ckpt->p+3*n,      atoms->p+3*iOff,      nInBox*sizeof(real3));
+      for (int ii=0; ii<nInBox; ++ii, ++n)
+      {
+         for (int jj=0; jj<3; ++jj)
+         {
+            real_t x = wrapCoord(atoms->r[3*(iOff+ii)+jj], globalMin[jj], globalExtent[jj]);
+            ckpt->r[3*n+jj] = x;
+            if (x < header->boundsMin[jj]) header->boundsMin[jj] = x;
+            if (x > header->boundsMax[jj]) header->boundsMax[jj] = x;
+         }
+      }
+   }
+   assert(n == nLocal);
+
+   ckpt->failed = 0;
+   ckpt->written = 1;
+   if (pthread_create(&ckpt->writer, NULL, writeCheckpointFile, ckpt) == 0)
+      ckpt->pending = 1;
+   else
+      writeCheckpointFile(ckpt);
+}
+
+/// \details
+/// Rank 0 finds the checkpoint in name.latest and validates the
+/// headers of its files.  The extent of the global box has to match the
+/// one set up from the command line, the lattice itself is not checked.
+/// The checkpoint step must be before nSteps.
+int readCheckpoint(const char* name, SimFlat* s)
+{
+   Domain* domain = s->domain;
+
+   int nFiles = 0;
+   CheckpointHeader* headers = NULL;
+   if (getMyRank() == 0)
+   {
+      int step;
+      if (! readLatest(name, &step, &nFiles))
+      {
+         fprintf(screenOut, "readCheckpoint: File %s.latest is missing or unreadable.  Fatal Error.\n",
+                 name);
+         exit(-1);
+      }
+      headers = (CheckpointHeader*) comdMalloc(nFiles*sizeof(CheckpointHeader));
+      for (int iFile=0; iFile<nFiles; ++iFile)
+         fclose(openCheckpointFile(name, step, iFile, headers+iFile));
+
+      for (int iFile=0; iFile<nFiles; ++iFile)
+      {
+         if (headers[iFile].nRanks != nFiles || headers[iFile].rank != iFile ||
+             headers[iFile].step != step)
+            checkpointError(name, step, iFile, "belongs to another checkpoint");
+      }
+      for (int ii=0; ii<3; ++ii)
+      {
+         double diff = headers[0].globalExtent[ii] - domain->globalExtent[ii];
+         if (diff > 1e-10*domain->globalExtent[ii] || -diff > 1e-10*domain->globalExtent[ii])
+            checkpointError(name, step, 0, "has a different global extent");
+      }
+      if (step >= s->nSteps)
+         checkpointError(name, step, 0, "is at or past nSteps, which leaves nothing to run");
+   }
+   bcastParallel(&nFiles, sizeof(int), 0);
+   if (getMyRank() != 0)
+      headers = (CheckpointHeader*) comdMalloc(nFiles*sizeof(CheckpointHeader));
+   bcastParallel(headers, nFiles*sizeof(CheckpointHeader), 0);
+
+   // the last rank in each direction also owns rounding at the upper edge
+   real3 localMax;
+   for (int ii=0; ii<3; ++ii)
+   {
+      localMax[ii] = domain->localMax[ii];
+      if (domain->procCoord[ii] == domain->procGrid[ii]-1)
+         localMax[ii] = domain->globalMax[ii];
+   }
+
+   int capacity = 0;
+   int* gid = NULL;
+   int* iSpecies = NULL;
+   real_t* r = NULL;
+   real_t* p = NULL;
+   for (int iFile=0; iFile<nFiles; ++iFile)
+   {
+      const CheckpointHeader* header = headers+iFile;
+      int n = header->nAtoms;
+      if (n == 0)
+         continue;
+      int overlap = 1;
+      for (int ii=0; ii<3; ++ii)
+         if (header->boundsMax[ii] < domain->localMin[ii] || header->boundsMin[ii] >= localMax[ii])
+            overlap = 0;
+      if (! overlap)
+         continue;
+
+      if (n > capacity)
+      {
+         capacity = n;
+         gid =      (int*)    comdRealloc(gid,      n*sizeof(int));
+         iSpecies = (int*)    comdRealloc(iSpecies, n*sizeof(int));
+         r =        (real_t*) comdRealloc(r,        n*sizeof(real3));
+         p =        (real_t*) comdRealloc(p,        n*sizeof(real3));
+         assert(gid && iSpecies && r && p);
+      }
+
+      CheckpointHeader check;
+      FILE* file = openCheckpointFile(name, header->step, iFile, &check);
+      if (check.step != header->step || check.nAtoms != n)
+         checkpointError(name, header->step, iFile, "changed during the restart");
+      if (fread(gid,      sizeof(int),   n, file) != (size_t) n ||
+          fread(iSpecies, sizeof(int),   n, file) != (size_t) n ||
+          fread(r,        sizeof(real3), n, file) != (size_t) n ||
+          fread(p,        sizeof(real3), n, file) != (size_t) n)
+         checkpointError(name, header->step, iFile, "is truncated");
+      fclose(file);
+
+      for (int iAtom=0; iAtom<n; ++iAtom)
+      {
+         const real_t* ri = r+3*iAtom;
+         const real_t* pi = p+3*iAtom;
+         int inside = 1;
+         for (int ii=0; ii<3; ++ii)
+            if (ri[ii] < domain->localMin[ii] || ri[ii] >= localMax[ii])
+               inside = 0;
+         if (inside)
+            putAtomInBox(s->boxes, s->atoms, gid[iAtom], iSpecies[iAtom],
+                         ri[0], ri[1], ri[2], pi[0], pi[1], pi[2]);
+      }
+   }
+   comdFree(gid);
+   comdFree(iSpecies);
+   comdFree(r);
+   comdFree(p);
+
+   int step = headers[0].step;
+   int nGlobal = headers[0].nGlobal;
+   comdFree(headers);
+
+   addIntParallel(&s->atoms->nLocal, &s->atoms->nGlobal, 1);
+   if (s->atoms->nGlobal != nGlobal)
+   {
+      if (printRank())
+         fprintf(screenOut, "readCheckpoint: placed %d of the %d atoms in %s.  Fatal Error.\n",
+                 s->atoms->nGlobal, nGlobal, name);
+      exit(-1);
+   }
+
+   return step;
+}
+
+void* writeCheckpointFile(void* arg)
+{
+   Checkpoint* ckpt = (Checkpoint*) arg;
+   size_t n = ckpt->header.nAtoms;
+
+   FILE* file = fopen(ckpt->fileName, "wb");
+   if (! file)
+   {
+      ckpt->failed = 1;
+      return NULL;
+   }
+
+   int ok = fwrite(&ckpt->header, sizeof(CheckpointHeader), 1, file) == 1 &&
+            fwrite(ckpt->gid,      sizeof(int),   n, file) == n &&
+            fwrite(ckpt->iSpecies, sizeof(int),   n, file) == n &&
+            fwrite(ckpt->r,        sizeof(real3), n, file) == n &&
+            fwrite(ckpt->p,        sizeof(real3), n, file) == n;
+   if (fclose(file) != 0)
+      ok = 0;
+   ckpt->failed = ! ok;
+
+   return NULL;
+}
+
+void waitCheckpoint(Checkpoint* ckpt)
+{
+   if (ckpt->pending)
+   {
+      pthread_join(ckpt->writer, NULL);
+      ckpt->pending = 0;
+   }
+}
+
+/// Makes the checkpoint written last the one named by name.latest, if
+/// every rank wrote its file, and removes the files of the previous
+/// one.  Called by all ranks.  A failed checkpoint is reported and its
+/// files removed, but the run goes on and name.latest keeps naming the
+/// previous checkpoint.
+void commitCheckpoint(Checkpoint* ckpt)
+{
+   waitCheckpoint(ckpt);
+   if (! ckpt->written)
+      return;
+   ckpt->written = 0;
+
+   int step = ckpt->header.step;
+   int nRanks = getNRanks();
+   int failed = 0;
+   maxIntParallel(&ckpt->failed, &failed, 1);
+   if (! failed && getMyRank() == 0)
+      failed = ! writeLatest(ckpt->name, step, nRanks);
+   bcastParallel(&failed, sizeof(int), 0);
+   if (failed)
+   {
+      if (ckpt->failed)
+         fprintf(screenOut, "Rank %d: writing checkpoint %s failed.\n",
+                 getMyRank(), ckpt->fileName);
+      if (printRank())
+         fprintf(screenOut, "Checkpoint for step %d was not committed.\n", step);
+      ckpt->failed = 0;
+      remove(ckpt->fileName);
+      return;
+   }
+
+   // the files of the previous checkpoint that were not overwritten
+   for (int iFile=getMyRank(); iFile<ckpt->latestRanks; iFile+=nRanks)
+   {
+      if (ckpt->latestStep == step && iFile < nRanks)
+         continue;
+      char fileName[1040];
+      snprintf(fileName, sizeof(fileName), "%s.%d.%d", ckpt->name, ckpt->latestStep, iFile);
+      remove(fileName);
+   }
+   ckpt->latestStep = step;
+   ckpt->latestRanks = nRanks;
+}
+
+/// Reads the step and the number of files of the checkpoint named by
+/// name.latest.  Returns 0 if there is none.
+int readLatest(const char* name, int* step, int* nFiles)
+{
+   char fileName[1040];
+   snprintf(fileName, sizeof(fileName), "%s.latest", name);
+   FILE* file = fopen(fileName, "r");
+   if (! file)
+      return 0;
+   int ok = fscanf(file, "%d %d", step, nFiles) == 2 && *step >= 0 && *nFiles > 0;
+   fclose(file);
+   return ok;
+}
+
+/// Replaces name.latest.  Returns 0 if it could not be written.
+int writeLatest(const char* name, int step, int nFiles)
+{
+   char fileName[1040];
+   char tmpName[1048];
+   snprintf(fileName, sizeof(fileName), "%s.latest", name);
+   snprintf(tmpName, sizeof(tmpName), "%s.tmp", fileName);
+   FILE* file = fopen(tmpName, "w");
+   if (! file)
+      return 0;
+   int ok = fprintf(file, "%d %d\n", step, nFiles) > 0;
+   if (fclose(file) != 0)
+      ok = 0;
+   if (ok && rename(tmpName, fileName) != 0)
+      ok = 0;
+   if (! ok)
+      remove(tmpName);
+   return ok;
+}
+
+void removeLatest(const char* name)
+{
+   char fileName[1040];
+   snprintf(fileName, sizeof(fileName), "%s.latest", name);
+   remove(fileName);
+}
+
+/// Maps a coordinate into [xMin, xMin+extent).  Atoms can be outside
+/// the global box between redistributions with a Verlet list skin.
+real_t wrapCoord(real_t x, real_t xMin, real_t extent)
+{
+   if (x < xMin)
+      x += extent;
+   else if (x >= xMin + extent)
+      x -= extent;
+   // x+extent can round up to the upper edge
+   if (x >= xMin + extent)
+      x = xMin;
+   return x;
+}
+
+/// Opens file iFile of the checkpoint name of the given step and reads
+/// its header.
+FILE* openCheckpointFile(const char* name, int step, int iFile, CheckpointHeader* header)
+{
+   char fileName[1040];
+   snprintf(fileName, sizeof(fileName), "%s.%d.%d", name, step, iFile);
+   FILE* file = fopen(fileName, "rb");
+   if (! file)
+      checkpointError(name, step, iFile, "can't be opened");
+   if (fread(header, sizeof(CheckpointHeader), 1, file) != 1 ||
+       memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0 ||
+       header->version != CHECKPOINT_VERSION)
+      checkpointError(name, step, iFile, "is not a checkpoint file");
+   if (header->realSize != sizeof(real_t))
+      checkpointError(name, step, iFile, "was written in another precision");
+   return file;
+}
+
+void checkpointError(const char* name, int step, int iFile, const char* msg)
+{
+   fprintf(screenOut, "readCheckpoint: File %s.%d.%d %s.  Fatal Error.\n", name, step, iFile, msg);
+   exit(-1);
+}
@@ -0,0 +1,66 @@
+/*******************************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. 
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/// \file
+/// Binary checkpoint and restart.
+
+#ifndef __CHECKPOINT_H_
+#define __CHECKPOINT_H_
+
+#include "mytype.h"
+
+struct SimFlatSt;
+
+/// State of the checkpoint writer of this rank.  Each rank writes its
+/// local atoms of step n to the file name.n.<rank>, and name.latest
+/// names the last checkpoint all ranks completed.  The atoms are copied
+/// into a buffer that a background thread writes, so the time step only
+/// waits for the copy.
+typedef struct CheckpointSt Checkpoint;
+
+/// Sets up checkpoints named name.  Called by all ranks.
+Checkpoint* initCheckpoint(const char* name);
+
+/// Waits for the last write to finish, commits it and frees the
+/// writer.  Called by all ranks.
+void destroyCheckpoint(Checkpoint** ckpt);
+
+/// Copies the local atoms and writes them in the background.  Waits
+/// for the previous checkpoint and commits it first.  Called by all
+/// ranks.
+void writeCheckpoint(Checkpoint* ckpt, struct SimFlatSt* s, int iStep);
+
+/// Places the atoms of the checkpoint named by name.latest in the link
+/// cells.  The checkpoint may have been written by any number of ranks.
+/// Returns the step at which it was written.
+int readCheckpoint(const char* name, struct SimFlatSt* s);
+
+#endif
@@ -0,0 +1,180 @@
+/*******************************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. 
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/// \file
+/// Device resident copies of the atom and link cell arrays.
+///
+/// Before this state existed the force routines wrapped every host
+/// array in a new HCC_ARRAY_STRUC on each call, which moved all of r,
+/// f, U, nAtoms and nbrBoxes across the bus every timestep whether it
+/// had changed or not.  Now the arrays are created once and only the
+/// sections that are known to be stale are synced:
+///
+///  - r and nAtoms for every box after redistributeAtoms, since atoms
+///    have moved, changed boxes and arrived in the halo boxes.
+///  - f and U for the local boxes after the force kernels.  Halo forces
+///    are never used on the host.
+///  - the Verlet list, if there is one, after it has been rebuilt.
+///
+/// The force kernels write every atom slot of the local boxes, so the
+/// device arrays never need to be zeroed from the host.
+///
+/// When the link cells grow every atom has a new slot, so the arrays
+/// indexed by slot are created again at the new size and the new box
+/// offsets uploaded before the positions and the list are.
+
+#include "deviceState.h"
+
+#include <assert.h>
+
+#include "CoMDTypes.h"
+#include "memUtils.h"
+#include "neighborList.h"
+
+static void deviceResize(SimFlat* sim);
+
+DeviceState* initDeviceState(SimFlat* sim)
+{
+   LinkCell* boxes = sim->boxes;
+
+   DeviceState* dev = (DeviceState*) comdMalloc(sizeof(DeviceState));
+   assert(dev);
+
+   dev->nLocalAtoms = 0;
+   dev->nTotalAtoms = 0;
+   dev->r = NULL;
+   dev->f = NULL;
+   dev->U = NULL;
+   dev->boxOffset = NULL;
+   dev->nAtoms = newDeviceArray(boxes->nTotalBoxes, boxes->nAtoms);
+   dev->nbrBoxes = newDeviceArray(boxes->nLocalBoxes*27, boxes->nbrBoxes);
+   dev->boundary = newDeviceArray(boxes->nLocalBoxes, boxes->boundary);
+
+   deviceUpload(*dev->nbrBoxes, boxes->nbrBoxes, 0, boxes->nLocalBoxes*27);
+   deviceUpload(*dev->boundary, boxes->boundary, 0, boxes->nLocalBoxes);
+
+   // the list itself is allocated on the first upload, once its
+   // capacity is known
+   dev->maxNbrs = 0;
+   dev->nNbrs = NULL;
+   dev->nbrList = NULL;
+
+   sim->device = dev;
+   deviceResize(sim);
+
+   return dev;
+}
+
+/// Create the arrays indexed by atom slot if the link cells have a
+/// different number of slots than they were made for.
+void deviceResize(SimFlat* sim)
+{
+   DeviceState* dev = sim->device;
+   LinkCell* boxes = sim->boxes;
+   Atoms* atoms = sim->atoms;
+   if (dev->nTotalAtoms == boxes->nTotalSlots) return;
+
+   delete dev->r;
+   delete dev->f;
+   delete dev->U;
+   delete dev->boxOffset;
+   delete dev->nNbrs;
+   delete dev->nbrList;
+
+   dev->nLocalAtoms = boxes->nLocalSlots;
+   dev->nTotalAtoms = boxes->nTotalSlots;
+   dev->r = newDeviceArray(dev->nTotalAtoms*3, atoms->r);
+   dev->f = newDeviceArray(dev->nTotalAtoms*3, atoms->f);
+   dev->U = newDeviceArray(dev->nTotalAtoms, atoms->U);
+   dev->boxOffset = newDeviceArray(boxes->nTotalBoxes+1, boxes->boxOffset);
+   deviceUpload(*dev->boxOffset, boxes->boxOffset, 0, boxes->nTotalBoxes+1);
+
+   dev->maxNbrs = 0;
+   dev->nNbrs = NULL;
+   dev->nbrList = NULL;
+   if (sim->nbrList)
+      dev->nNbrs = newDeviceArray(dev->nLocalAtoms, sim->nbrList->nNbrs);
+}
+
+void destroyDeviceState(DeviceState** dev)
+{
+   if (! dev) return;
+   if (! *dev) return;
+
+   delete (*dev)->r;
+   delete (*dev)->f;
+   delete (*dev)->U;
+   delete (*dev)->nAtoms;
+   delete (*dev)->boxOffset;
+   delete (*dev)->nbrBoxes;
+   delete (*dev)->boundary;
+   delete (*dev)->nNbrs;
+   delete (*dev)->nbrList;
+   comdFree(*dev);
+   *dev = NULL;
+}
+
+void deviceUploadAtoms(SimFlat* sim)
+{
+   DeviceState* dev = sim->device;
+   if (! dev) return;
+
+   deviceResize(sim);
+   deviceUpload(*dev->r, sim->atoms->r, 0, dev->nTotalAtoms*3);
+   deviceUpload(*dev->nAtoms, sim->boxes->nAtoms, 0, sim->boxes->nTotalBoxes);
+}
+
+void deviceUploadNeighborList(SimFlat* sim)
+{
+   DeviceState* dev = sim->device;
+   NeighborList* nbrList = sim->nbrList;
+   if (! dev || ! nbrList) return;
+
+   deviceResize(sim);
+   int size = nbrList->maxNbrs*dev->nLocalAtoms;
+   if (dev->maxNbrs != nbrList->maxNbrs)
+   {
+      delete dev->nbrList;
+      dev->nbrList = newDeviceArray(size, nbrList->list);
+      dev->maxNbrs = nbrList->maxNbrs;
+   }
+
+   deviceUpload(*dev->nNbrs, nbrList->nNbrs, 0, dev->nLocalAtoms);
+   deviceUpload(*dev->nbrList, nbrList->list, 0, size);
+}
+
+void deviceDownloadForces(SimFlat* sim)
+{
+   DeviceState* dev = sim->device;
+
+   deviceDownload(*dev->f, sim->atoms->f, 0, dev->nLocalAtoms*3);
+   deviceDownload(*dev->U, sim->atoms->U, 0, dev->nLocalAtoms);
+}
@@ -0,0 +1,143 @@
+/*******************************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. 
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/// \file
+/// Device resident copies of the atom and link cell arrays.
+
+#ifndef __DEVICE_STATE_H_
+#define __DEVICE_STATE_H_
+
+#include <hc.hpp>
+
+#include "mytype.h"
+#include "linkCells.h"
+
+struct SimFlatSt;
+
+/// Device arrays used by the force kernels.  They are created once when
+/// the simulation is initialized and live for the whole run, so a
+/// timestep only moves the data that actually changed: positions and
+/// box counts after the atoms are redistributed, and the forces and
+/// energies of the local atoms after the force kernels.  The neighbor
+/// box table and the boundary flags never change and are uploaded once.
+/// The arrays indexed by atom slot, and the box offsets, are created
+/// again when the link cells have grown.
+///
+/// With ARRAY_VIEW the arrays are views of the host arrays and the
+/// syncs refresh or synchronize the dirty sections.  Otherwise they are
+/// device arrays and the syncs copy the dirty sections.
+///
+/// \see deviceUploadAtoms
+/// \see deviceDownloadForces
+typedef struct DeviceStateSt
+{
+   int nLocalAtoms;                 //!< atom slots in local boxes
+   int nTotalAtoms;                 //!< atom slots in local and halo boxes
+   HCC_ARRAY_TYPE(real_t)* r;       //!< positions
+   HCC_ARRAY_TYPE(real_t)* f;       //!< forces
+   HCC_ARRAY_TYPE(real_t)* U;       //!< per atom potential energy
+   HCC_ARRAY_TYPE(int)* nAtoms;     //!< number of atoms in each box
+   HCC_ARRAY_TYPE(int)* boxOffset;  //!< first atom slot of each box
+   HCC_ARRAY_TYPE(int)* nbrBoxes;   //!< neighbor boxes of each local box
+   HCC_ARRAY_TYPE(int)* boundary;   //!< boundary flag of each local box
+   int maxNbrs;                     //!< capacity of the device Verlet list
+   HCC_ARRAY_TYPE(int)* nNbrs;      //!< Verlet list counts, NULL without a list
+   HCC_ARRAY_TYPE(int)* nbrList;    //!< Verlet list, see NeighborList
+} DeviceState;
+
+DeviceState* initDeviceState(struct SimFlatSt* sim);
+void destroyDeviceState(DeviceState** dev);
+
+/// Upload positions and box counts after the atoms have moved.  Does
+/// nothing when the forces are computed on the host (sim->device is
+/// NULL).
+void deviceUploadAtoms(struct SimFlatSt* sim);
+
+/// Upload the Verlet list after it has been rebuilt.  The device list is
+/// reallocated when the host list has grown.
+void deviceUploadNeighborList(struct SimFlatSt* sim);
+
+/// Download the forces and energies of the local atoms.
+void deviceDownloadForces(struct SimFlatSt* sim);
+
+/// Allocate a device array of n elements that mirrors host.  The
+/// contents are not copied.
+template <typename T>
+HCC_ARRAY_TYPE(T)* newDeviceArray(int n, T* host)
+{
+#ifdef ARRAY_VIEW
+   return new hc::array_view<T>(n, host);
+#else
+   (void) host;
+   return new hc::array<T>(n);
+#endif
+}
+
+/// Allocate a device array of n elements that only the kernels use and
+/// that has no host copy.
+template <typename T>
+HCC_ARRAY_TYPE(T)* newDeviceScratch(int n)
+{
+#ifdef ARRAY_VIEW
+   return new hc::array_view<T>(n);
+#else
+   return new hc::array<T>(n);
+#endif
+}
+
+/// Copy host[first, first+count) to the device.
+template <typename T>
+void deviceUpload(HCC_ARRAY_TYPE(T)& dev, T* host, int first, int count)
+{
+   if (count <= 0) return;
+#ifdef ARRAY_VIEW
+   (void) host;
+   dev.section(hc::index<1>(first), hc::extent<1>(count)).refresh();
+#else
+   hc::copy(host+first, host+first+count,
+            dev.section(hc::index<1>(first), hc::extent<1>(count)));
+#endif
+}
+
+/// Copy device[first, first+count) back to host.
+template <typename T>
+void deviceDownload(HCC_ARRAY_TYPE(T)& dev, T* host, int first, int count)
+{
+   if (count <= 0) return;
+#ifdef ARRAY_VIEW
+   (void) host;
+   dev.section(hc::index<1>(first), hc::extent<1>(count)).synchronize();
+#else
+   hc::copy(dev.section(hc::index<1>(first), hc::extent<1>(count)), host+first);
+#endif
+}
+
+#endif
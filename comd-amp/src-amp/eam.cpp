@@ -122,32 +122,89 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <math.h>
 #include <assert.h>
+#include <limits.h>
 
 #include "constants.h"
 #include "memUtils.h"
+#include "initAtoms.h"
 #include "parallel.h"
 #include "linkCells.h"
 #include "performanceTimers.h"
 #include "haloExchange.h"
+#include "deviceState.h"
+#include "neighborList.h"
 
 #include <hc.hpp>
 #include <hc_math.hpp>
 using namespace hc;
 using namespace precise_math;
 
+#define MIN(A,B) ((A) < (B) ? (A) : (B))
 #define MAX(A,B) ((A) > (B) ? (A) : (B))
 
+/// Fraction of spare room in the pair cache of eamForceFused on top of
+/// the expected number of neighbors inside the cutoff.
+#define PAIR_SLACK 0.25
+
+/// Number of consecutive local boxes that share a pair cache budget in
+/// eamForceFused.
+#define PAIR_BLOCK 8
+
+/// Most pair cache entries of one block of PAIR_BLOCK boxes.  This
+/// holds all the pairs of about 18 copper atoms per box at the default
+/// cutoff.
+#define PAIR_BLOCK_PAIRS 8192
+
+/// Most pair cache entries of a rank, 28 bytes each in double
+/// precision.  When the blocks of a large domain would need more, each
+/// block gets a smaller share.
+#define PAIR_CACHE_PAIRS (1 << 22)
+
+/// Alignment of the interpolation coefficients, so the four of an
+/// interval are one aligned load.
+#define INTERP_ALIGN 32
+
+/// Device copies of the EAM per atom storage and interpolation tables.
+/// The tables are uploaded once.  rhobar never leaves the device and
+/// dfEmbed is only synced around the force halo exchange.
+/// \see DeviceState
+typedef struct EamDeviceSt
+{
+	HCC_ARRAY_TYPE(real_t)* rhobar;  //!< per atom rhobar
+	HCC_ARRAY_TYPE(real_t)* dfEmbed; //!< per atom derivative of embedding
+	HCC_ARRAY_TYPE(real_t)* phi;     //!< pair energy table coefficients
+	HCC_ARRAY_TYPE(real_t)* rho;     //!< electron density table coefficients
+	HCC_ARRAY_TYPE(real_t)* f;       //!< embedding energy table coefficients
+	HCC_ARRAY_TYPE(int)* nPairs;     //!< pairs of each local atom, eamForceFused only
+	HCC_ARRAY_TYPE(int)* pairJ;      //!< slot of the other atom of each cached pair
+	HCC_ARRAY_TYPE(real_t)* pairGx;  //!< x of rho'(r) dr/r of each cached pair
+	HCC_ARRAY_TYPE(real_t)* pairGy;  //!< y of rho'(r) dr/r of each cached pair
+	HCC_ARRAY_TYPE(real_t)* pairGz;  //!< z of rho'(r) dr/r of each cached pair
+} EamDevice;
+
 
 // EAM functionality
 static int eamForce(SimFlat* s);
+static int eamForceFused(SimFlat* s);
+static int eamForceHalf(SimFlat* s);
+static int eamForceList(SimFlat* s);
+static int eamForceHalfList(SimFlat* s);
+static int eamForceHalfSoa(SimFlat* s);
+static void eamInitStorage(SimFlat* s, EamPotential* pot);
 static void eamPrint(FILE* file, BasePotential* pot);
 static void eamDestroy(BasePotential** pot); 
 static void eamBcastPotential(EamPotential* pot);
+static EamDevice* initEamDevice(EamPotential* pot, int maxTotalAtoms, int maxLocalAtoms,
+                                 int nLocalBoxes);
+static void destroyEamDevice(EamDevice** dev);
+static int eamStartExchange(EamPotential* pot);
+static void eamProgressExchange(EamPotential* pot, int iStep);
 
 
 // Table interpolation functionality
 static InterpolationObject* initInterpolationObject(
 		int n, real_t x0, real_t dx, real_t* data);
+static void initInterpolationCoef(InterpolationObject* table);
 static void destroyInterpolationObject(InterpolationObject** table);
 static void interpolate(InterpolationObject* table, real_t r, real_t* f, real_t* df);
 static void bcastInterpolationObject(InterpolationObject** table);
@@ -167,11 +224,23 @@ static void typeNotSupported(const char* callSite, const char* type);
 /// \param [in] dir   The directory in which potential table files are found.
 /// \param [in] file  The name of the potential table file.
 /// \param [in] type  The file format of the potential file (setfl or funcfl).
-BasePotential* initEamPot(const char* dir, const char* file, const char* type)
+/// \param [in] halfShell Compute the forces on the CPU with a half
+///                       neighbor shell instead of on the device.
+/// \param [in] soa       Use the vectorized version of the half shell
+///                       forces on the structure of arrays copies.
+/// \param [in] overlap   Compute the embedding force of the interior
+///                       boxes while the exchange of dfEmbed is in flight.
+/// \param [in] fused     Compute the device forces with eamForceFused.
+BasePotential* initEamPot(const char* dir, const char* file, const char* type,
+                          int halfShell, int soa, int overlap, int fused)
 {
 	EamPotential* pot = (EamPotential *) comdMalloc(sizeof(EamPotential));
 	assert(pot);
-	pot->force = eamForce;
+	pot->force = halfShell ? eamForceHalf : eamForce;
+	if (fused && ! halfShell)
+		pot->force = eamForceFused;
+	if (soa)
+		pot->force = eamForceHalfSoa;
 	pot->print = eamPrint;
 	pot->destroy = eamDestroy;
 	pot->phi = NULL;
@@ -184,7 +253,13 @@ BasePotential* initEamPot(const char* dir, const char* file, const char* type)
 	// initialization until the first time we call the force routine.
 	pot->dfEmbed = NULL;
 	pot->rhobar  = NULL;
+	pot->nSlots = 0;
+	pot->maxPairs = 0;
+	pot->pairAtoms = 0;
+	pot->blockPairs = 0;
 	pot->forceExchange = NULL;
+	pot->device = NULL;
+	pot->overlap = overlap;
 
 	if (getMyRank() == 0)
 	{
@@ -202,8 +277,6 @@ BasePotential* initEamPot(const char* dir, const char* file, const char* type)
 
 void interpolateAMP(InterpolationObject* table, real_t r, real_t* f, real_t* df) restrict(amp)
 {
-	const real_t* tt = table->values; // alias
-
 	if ( r < table->x0 ) r = table->x0;
 
 	r = (r-table->x0)*(table->invDx) ;
@@ -216,18 +289,15 @@ void interpolateAMP(InterpolationObject* table, real_t r, real_t* f, real_t* df)
 	// reset r to fractional distance
 	r = r - floor(r);
 
-	real_t g1 = tt[ii+1] - tt[ii-1];
-	real_t g2 = tt[ii+2] - tt[ii];
-
-	*f = tt[ii] + 0.5*r*(g1 + r*(tt[ii+1] + tt[ii-1] - 2.0*tt[ii]) );
-
-	*df = 0.5*(g1 + r*(g2-g1))*table->invDx;
+	const real_t* c = table->coef + 4*ii;
+	*f = c[0] + r*(c[1] + r*c[2]);
+	*df = (c[1] + r*c[3])*table->invDx;
 }
 
-void interpolateAMP(const HCC_ARRAY_OBJECT(real_t, tt), real_t x0, real_t invDx, int n, real_t r, real_t *f, real_t *df) restrict(amp)
+/// Device version of interpolate.  cc mirrors the coefficients of the
+/// table, four per interval.
+void interpolateAMP(const HCC_ARRAY_OBJECT(real_t, cc), real_t x0, real_t invDx, int n, real_t r, real_t *f, real_t *df) restrict(amp)
 {
-  //const real_t* tt = table->values; // alias
-
 	if ( r < x0 ) r = x0;
 
 	r = (r-x0)*(invDx) ;
@@ -239,12 +309,9 @@ void interpolateAMP(const HCC_ARRAY_OBJECT(real_t, tt), real_t x0, real_t invDx,
 	// reset r to fractional distance
 	r = r - floor(r);
 
-	real_t g1 = tt[ii+1] - tt[ii-1];
-	real_t g2 = tt[ii+2] - tt[ii];
-
-	*f = tt[ii] + 0.5*r*(g1 + r*(tt[ii+1] + tt[ii-1] - 2.0*tt[ii]) );
-
-	*df = 0.5*(g1 + r*(g2-g1))*invDx;
+	int ic = 4*ii;
+	*f = cc[ic] + r*(cc[ic+1] + r*cc[ic+2]);
+	*df = (cc[ic+1] + r*cc[ic+3])*invDx;
 }
 
 
@@ -263,37 +330,29 @@ void interpolateAMP(const HCC_ARRAY_OBJECT(real_t, tt), real_t x0, real_t invDx,
 
 int eamForce(SimFlat* s)
 {
+	if (s->nbrList)
+		return eamForceList(s);
 
 	EamPotential* pot = (EamPotential*) s->pot;
 	assert(pot);
 
 	// set up halo exchange and internal storage on first call to forces.
-	if (pot->forceExchange == NULL) {
-	  int maxTotalAtoms = MAXATOMS*s->boxes->nTotalBoxes;
-	  pot->dfEmbed = (real_t *) comdMalloc(maxTotalAtoms*sizeof(real_t));
-	  pot->rhobar  = (real_t *) comdMalloc(maxTotalAtoms*sizeof(real_t));
-	  pot->forceExchange = initForceHaloExchange(s->domain, s->boxes);
-	  pot->forceExchangeData = (ForceExchangeData *) comdMalloc(sizeof(ForceExchangeData));
-	  pot->forceExchangeData->dfEmbed = pot->dfEmbed;
-	  pot->forceExchangeData->boxes = s->boxes;
-	}
+	if (pot->nSlots != s->boxes->nTotalSlots)
+	  eamInitStorage(s, pot);
 
 	real_t rCut2 = pot->cutoff*pot->cutoff;
 
-	// zero forces / energy / rho /rhoprime
+	// zero energy; forces, energies and rhobar are zeroed by the first kernel
 	real_t etot = 0.0;
-	memset(s->atoms->f,  0, s->boxes->nTotalBoxes*MAXATOMS*sizeof(real3));
-	memset(s->atoms->U,  0, s->boxes->nTotalBoxes*MAXATOMS*sizeof(real_t));
-	memset(pot->dfEmbed, 0, s->boxes->nTotalBoxes*MAXATOMS*sizeof(real_t));
-	memset(pot->rhobar,  0, s->boxes->nTotalBoxes*MAXATOMS*sizeof(real_t));
 
 	int nNbrBoxes = 27;
-	int fSize = s->boxes->nTotalBoxes*MAXATOMS;
-	int nBoxes = s->boxes->nTotalBoxes;	
+	int nLocalAtoms = s->boxes->nLocalSlots;
+	int nHaloAtoms = s->boxes->nTotalSlots - nLocalAtoms;
 	/* With tiling, each i-th box works in one tile each with several threads. 
 	 * Each thread in the tile works on each i-th atom.
-	 * Number of threads in a tile is equal to MAXATOMS. This means that some
-	 * threads can be left ideal if an i-th box does not contain #MAXATOMS atoms.
+	 * Number of threads in a tile is equal to BOX_TILE. This means that some
+	 * threads can be left ideal if an i-th box does not contain #BOX_TILE atoms,
+	 * and that the threads go through a box with more atoms BOX_TILE at a time.
 	 * Important to mention that no data-copy is required with CPP AMP and 
 	 * host pointers are directly passed to the GPU without the need to create 
 	 * different data containers.
@@ -302,8 +361,8 @@ int eamForce(SimFlat* s)
 	 * boxes can be computed within a wavefront.
 	 */
 
-	extent<1> boxesExt(s->boxes->nLocalBoxes * MAXATOMS);
-	tiled_extent<1> tBoxesExt(boxesExt, MAXATOMS);
+	extent<1> boxesExt(s->boxes->nLocalBoxes * BOX_TILE);
+	tiled_extent<1> tBoxesExt(boxesExt, BOX_TILE);
 
 	completion_future fut;
 	
@@ -319,16 +378,19 @@ int eamForce(SimFlat* s)
 	real_t f_x0 = pot->f->x0;
 	real_t f_invDx = pot->f->invDx;
 
-	HCC_ARRAY_STRUC(real_t, U, fSize, s->atoms->U);
-	HCC_ARRAY_STRUC(real_t, rhobar, fSize, pot->rhobar);
-	HCC_ARRAY_STRUC(real_t, dfEmbed, fSize, pot->dfEmbed);
-	HCC_ARRAY_STRUC(real_t, f, fSize*3, s->atoms->f);
-	HCC_ARRAY_STRUC(real_t, r, fSize*3, s->atoms->r);
-	HCC_ARRAY_STRUC(int, nAtoms, nBoxes, s->boxes->nAtoms);
-	HCC_ARRAY_STRUC(int, nbrBoxes, nBoxes * nNbrBoxes, s->boxes->nbrBoxes);
-	HCC_ARRAY_STRUC(real_t, phi_values, phi_n + 3, pot->phi->values);
-	HCC_ARRAY_STRUC(real_t, rho_values, rho_n + 3, pot->rho->values);
-	HCC_ARRAY_STRUC(real_t, f_values, f_n + 3, pot->f->values);	
+	// persistent device copies, see deviceState.h
+	HCC_ARRAY_OBJECT(real_t, U) = *s->device->U;
+	HCC_ARRAY_OBJECT(real_t, rhobar) = *pot->device->rhobar;
+	HCC_ARRAY_OBJECT(real_t, dfEmbed) = *pot->device->dfEmbed;
+	HCC_ARRAY_OBJECT(real_t, f) = *s->device->f;
+	HCC_ARRAY_OBJECT(real_t, r) = *s->device->r;
+	HCC_ARRAY_OBJECT(int, nAtoms) = *s->device->nAtoms;
+	HCC_ARRAY_OBJECT(int, boxOffset) = *s->device->boxOffset;
+	HCC_ARRAY_OBJECT(int, nbrBoxes) = *s->device->nbrBoxes;
+	HCC_ARRAY_OBJECT(int, boundary) = *s->device->boundary;
+	HCC_ARRAY_OBJECT(real_t, phi_values) = *pot->device->phi;
+	HCC_ARRAY_OBJECT(real_t, rho_values) = *pot->device->rho;
+	HCC_ARRAY_OBJECT(real_t, f_values) = *pot->device->f;
 	
 	
 	
@@ -338,15 +400,20 @@ int eamForce(SimFlat* s)
 					    HCC_ID(f)
 					    HCC_ID(r)
 					    HCC_ID(nAtoms)
+					    HCC_ID(boxOffset)
 					    HCC_ID(nbrBoxes)
 					    HCC_ID(phi_values)
 					    HCC_ID(rho_values)](tiled_index<1> t_idx) restrict(amp)
 	{
 
 	  int iBox = t_idx.tile[0];
-	  int ii = t_idx.local[0];
-	  int iOff = iBox * MAXATOMS;
+	  int iOff = boxOffset[iBox];
+	  int nSlots = boxOffset[iBox+1] - iOff;
 	  int nIBox = nAtoms[iBox];
+	  for (int ii=t_idx.local[0]; ii<nSlots; ii+=BOX_TILE){
+	  real_t fi[3] = {0.0, 0.0, 0.0};
+	  real_t ui = 0.0;
+	  real_t rhoi = 0.0;
 
 	  // loop over neighbor boxes of iBox (some may be halo boxes)
 	  for (int jTmp=0; jTmp<nNbrBoxes; jTmp++){
@@ -356,7 +423,7 @@ int eamForce(SimFlat* s)
 	    // loop over atoms in iBox
 	    if(ii < nIBox){
 	      // loop over atoms in jBox
-	      for (int jOff=MAXATOMS*jBox,ij=0; ij<nJBox; ij++,jOff++){
+	      for (int jOff=boxOffset[jBox],ij=0; ij<nJBox; ij++,jOff++){
 		double r2 = 0.0;
 		real3 dr;
 		for (int k=0; k<3; k++){
@@ -372,25 +439,34 @@ int eamForce(SimFlat* s)
 		  interpolateAMP(rho_values, rho_x0, rho_invDx, rho_n, rsq, &rhoTmp, &dRho);  
 
 		  for (int k=0; k<3; k++){
-		    f[(iOff + ii)*3 + k] -= dPhi*dr[k]/rsq;
+		    fi[k] -= dPhi*dr[k]/rsq;
 		  }
 
-		  U[iOff + ii] += 0.5*phiTmp;
+		  ui += 0.5*phiTmp;
 
 		  // accumulate rhobar for each atom
-		  rhobar[iOff + ii] += rhoTmp;
+		  rhoi += rhoTmp;
 		}
 	      } // loop over atoms in jBox
 	    } // loop over atoms in iBox
 	  } // loop over neighbor boxes
+
+	  // every slot of the box is written, empty ones with zero
+	  for (int k=0; k<3; k++){
+	    f[(iOff + ii)*3 + k] = fi[k];
+	  }
+	  U[iOff + ii] = ui;
+	  rhobar[iOff + ii] = rhoi;
+	  } // loop over slots of iBox
 	} // loop over local boxes
 	);
 	//fut.wait();
 	
 	/* With tiling, each i-th box works in one tile each with several threads. 
 	 * Each thread in the tile works on each i-th atom.
-	 * Number of threads in a tile is equal to MAXATOMS. This means that some
-	 * threads can be left ideal if an i-th box does not contain #MAXATOMS atoms.
+	 * Number of threads in a tile is equal to BOX_TILE. This means that some
+	 * threads can be left ideal if an i-th box does not contain #BOX_TILE atoms,
+	 * and that the threads go through a box with more atoms BOX_TILE at a time.
 	 * Important to mention that no data-copy is required with CPP AMP and 
 	 * host pointers are directly passed to the GPU without the need to create 
 	 * different data containers.
@@ -404,15 +480,15 @@ int eamForce(SimFlat* s)
 					    HCC_ID(rhobar)
 					    HCC_ID(dfEmbed)
 					    HCC_ID(nAtoms)
+					    HCC_ID(boxOffset)
 					    HCC_ID(f_values)](tiled_index<1> t_idx) restrict(amp)
 	{
 
 	  int iBox = t_idx.tile[0];
-	  int ii = t_idx.local[0];
-	  int iOff = iBox * MAXATOMS;
+	  int iOff = boxOffset[iBox];
 	  int nIBox = nAtoms[iBox];
 
-	  if(ii < nIBox){
+	  for (int ii=t_idx.local[0]; ii<nIBox; ii+=BOX_TILE){
 	    real_t fEmbed, tempdfEmbed;
 	    real_t rhoTmp = rhobar[iOff + ii];
 	    interpolateAMP(f_values, f_x0, f_invDx, f_n, rhoTmp, &fEmbed, &tempdfEmbed);  
@@ -424,15 +500,18 @@ int eamForce(SimFlat* s)
 	);
 	//fut.wait();
 
-	// exchange derivative of the embedding energy with repsect to rhobar
-	startTimer(eamHaloTimer);
-	haloExchange(pot->forceExchange, pot->forceExchangeData);
-	stopTimer(eamHaloTimer);
+	// exchange derivative of the embedding energy with repsect to rhobar.
+	// Only the local values go to the host and only the halo values
+	// come back.
+	fut.wait();
+	deviceDownload(dfEmbed, pot->dfEmbed, 0, nLocalAtoms);
+	int nPhases = eamStartExchange(pot);
 
 	/* With tiling, each i-th box works in one tile each with several threads. 
 	 * Each thread in the tile works on each i-th atom.
-	 * Number of threads in a tile is equal to MAXATOMS. This means that some
-	 * threads can be left ideal if an i-th box does not contain #MAXATOMS atoms.
+	 * Number of threads in a tile is equal to BOX_TILE. This means that some
+	 * threads can be left ideal if an i-th box does not contain #BOX_TILE atoms,
+	 * and that the threads go through a box with more atoms BOX_TILE at a time.
 	 * Important to mention that no data-copy is required with CPP AMP and 
 	 * host pointers are directly passed to the GPU without the need to create 
 	 * different data containers.
@@ -441,19 +520,36 @@ int eamForce(SimFlat* s)
 	 * boxes can be computed within a wavefront.
 	 */
 
+	// With overlap the interior boxes run while the exchange is in
+	// flight and the boundary boxes after the halo values are uploaded.
+	for (int iPhase=0; iPhase<nPhases; iPhase++)
+	{
+	if (iPhase == nPhases-1)
+	{
+		eamProgressExchange(pot, NBOXCOLORS);
+		deviceUpload(dfEmbed, pot->dfEmbed, nLocalAtoms, nHaloAtoms);
+	}
 	fut = parallel_for_each(tBoxesExt, [=
 					    HCC_ID(f)
 					    HCC_ID(r)
 					    HCC_ID(dfEmbed)
 					    HCC_ID(nAtoms)
+					    HCC_ID(boxOffset)
 					    HCC_ID(nbrBoxes)
+					    HCC_ID(boundary)
 					    HCC_ID(rho_values)](tiled_index<1> t_idx) restrict(amp)
         {
 
 	  int iBox = t_idx.tile[0];
-	  int ii = t_idx.local[0];
-	  int iOff = iBox * MAXATOMS;
+	  if (nPhases > 1 && boundary[iBox] != iPhase) return;
+	  int iOff = boxOffset[iBox];
+	  int nSlots = boxOffset[iBox+1] - iOff;
 	  int nIBox = nAtoms[iBox];
+	  for (int ii=t_idx.local[0]; ii<nSlots; ii+=BOX_TILE){
+	  real_t fi[3];
+	  for (int k=0; k<3; k++){
+	    fi[k] = f[(iOff + ii)*3 + k];
+	  }
 
 	  // loop over neighbor boxes of iBox (some may be halo boxes)
 	  for (int jTmp=0; jTmp<nNbrBoxes; jTmp++){
@@ -464,7 +560,7 @@ int eamForce(SimFlat* s)
 	    // loop over atoms in iBox
 	    if(ii < nIBox){
 	      // loop over atoms in jBox
-	      for (int jOff=MAXATOMS*jBox,ij=0; ij<nJBox; ij++,jOff++){ 
+	      for (int jOff=boxOffset[jBox],ij=0; ij<nJBox; ij++,jOff++){ 
 		double r2 = 0.0;
 		real3 dr;
 		for (int k=0; k<3; k++){
@@ -478,39 +574,1103 @@ int eamForce(SimFlat* s)
 		  interpolateAMP(rho_values, rho_x0, rho_invDx, rho_n, r_t, &rhoTmp, &dRho);   
 
 		  for (int k=0; k<3; k++){
-		    f[(iOff + ii)*3 + k] -= (dfEmbed[iOff + ii] + dfEmbed[jOff])*dRho*dr[k]/r_t;
+		    fi[k] -= (dfEmbed[iOff + ii] + dfEmbed[jOff])*dRho*dr[k]/r_t;
 		  }
 		}
 	      } // loop over atoms in jBox
 	    } // loop over atoms in iBox
 	  } // loop over neighbor boxes
+
+	  for (int k=0; k<3; k++){
+	    f[(iOff + ii)*3 + k] = fi[k];
+	  }
+	  } // loop over slots of iBox
 	} // loop over local boxes
 	);
+	} // loop over phases
 	fut.wait();
 
-	HCC_SYNC(U, s->atoms->U);
-	HCC_SYNC(f, s->atoms->f);
-	HCC_SYNC(rhobar, pot->rhobar);
-	HCC_SYNC(dfEmbed, pot->dfEmbed);	
+	deviceDownloadForces(s);
 	
 	/* A loop over all the atoms is requrired to reduce the ePot value.
 	 * Otherwise, update to ePot is required to be atomic which will 
 	 * lead to slow performance. 
 	 */
-	for (int iBox=0; iBox<s->boxes->nLocalBoxes; iBox++){
-	  int iOff;
-	  int nIBox =  s->boxes->nAtoms[iBox];
+	etot = sumLocalAtoms(s->boxes, s->atoms->U);
+
+	s->ePotential = (real_t) etot;
+	return 0;
+}
+
+/// Version of eamForce with two kernels instead of three.  The first
+/// computes the pair terms and rhobar of an atom as before, and then,
+/// since the same thread has the complete rhobar, its embedding energy
+/// and dfEmbed, which removes the embedding kernel.  It also keeps the
+/// pairs inside the cutoff: the slot of the other atom and
+/// rho'(r) dr/r.  After the exchange of dfEmbed the second kernel
+/// computes the embedding force from the kept pairs without touching
+/// the neighbor boxes, the positions or the rho table again.
+///
+/// The cache has a fixed budget of blockPairs entries for each block of
+/// PAIR_BLOCK consecutive local boxes, room for maxPairs pairs of the
+/// first pairAtoms atoms of the block (see eamInitStorage).  An atom
+/// that is c-th in its block keeps pair p at entry
+/// block*blockPairs + p*pairAtoms + c, so the threads of a tile
+/// read consecutive entries.  The atoms past the budget, and any atom
+/// with more than maxPairs pairs, keep none of them and the second
+/// kernel searches their neighbor boxes like eamForce does.  Both paths
+/// evaluate the same expressions, so the forces do not depend on which
+/// atoms are cached.
+///
+/// \see eamForce
+int eamForceFused(SimFlat* s)
+{
+	if (s->nbrList)
+		return eamForceList(s);
+
+	EamPotential* pot = (EamPotential*) s->pot;
+	assert(pot);
+
+	// set up halo exchange and internal storage on first call to forces.
+	if (pot->nSlots != s->boxes->nTotalSlots)
+	  eamInitStorage(s, pot);
+
+	real_t rCut2 = pot->cutoff*pot->cutoff;
+	real_t etot = 0.0;
+
+	int nNbrBoxes = 27;
+	int nLocalAtoms = s->boxes->nLocalSlots;
+	int nHaloAtoms = s->boxes->nTotalSlots - nLocalAtoms;
+	int maxPairs = pot->maxPairs;
+	int pairAtoms = pot->pairAtoms;
+	int blockPairs = pot->blockPairs;
+
+	extent<1> boxesExt(s->boxes->nLocalBoxes * BOX_TILE);
+	tiled_extent<1> tBoxesExt(boxesExt, BOX_TILE);
+
+	completion_future fut;
+
+	int phi_n = pot->phi->n;
+	real_t phi_x0 = pot->phi->x0;
+	real_t phi_invDx = pot->phi->invDx;
+
+	int rho_n = pot->rho->n;
+	real_t rho_x0 = pot->rho->x0;
+	real_t rho_invDx = pot->rho->invDx;
+
+	int f_n = pot->f->n;
+	real_t f_x0 = pot->f->x0;
+	real_t f_invDx = pot->f->invDx;
+
+	// persistent device copies, see deviceState.h
+	HCC_ARRAY_OBJECT(real_t, U) = *s->device->U;
+	HCC_ARRAY_OBJECT(real_t, dfEmbed) = *pot->device->dfEmbed;
+	HCC_ARRAY_OBJECT(real_t, f) = *s->device->f;
+	HCC_ARRAY_OBJECT(real_t, r) = *s->device->r;
+	HCC_ARRAY_OBJECT(int, nAtoms) = *s->device->nAtoms;
+	HCC_ARRAY_OBJECT(int, boxOffset) = *s->device->boxOffset;
+	HCC_ARRAY_OBJECT(int, nbrBoxes) = *s->device->nbrBoxes;
+	HCC_ARRAY_OBJECT(int, boundary) = *s->device->boundary;
+	HCC_ARRAY_OBJECT(real_t, phi_values) = *pot->device->phi;
+	HCC_ARRAY_OBJECT(real_t, rho_values) = *pot->device->rho;
+	HCC_ARRAY_OBJECT(real_t, f_values) = *pot->device->f;
+	HCC_ARRAY_OBJECT(int, nPairs) = *pot->device->nPairs;
+	HCC_ARRAY_OBJECT(int, pairJ) = *pot->device->pairJ;
+	HCC_ARRAY_OBJECT(real_t, pairGx) = *pot->device->pairGx;
+	HCC_ARRAY_OBJECT(real_t, pairGy) = *pot->device->pairGy;
+	HCC_ARRAY_OBJECT(real_t, pairGz) = *pot->device->pairGz;
+
+	fut = parallel_for_each(tBoxesExt, [=
+					    HCC_ID(U)
+					    HCC_ID(dfEmbed)
+					    HCC_ID(f)
+					    HCC_ID(r)
+					    HCC_ID(nAtoms)
+					    HCC_ID(boxOffset)
+					    HCC_ID(nbrBoxes)
+					    HCC_ID(phi_values)
+					    HCC_ID(rho_values)
+					    HCC_ID(f_values)
+					    HCC_ID(nPairs)
+					    HCC_ID(pairJ)
+					    HCC_ID(pairGx)
+					    HCC_ID(pairGy)
+					    HCC_ID(pairGz)](tiled_index<1> t_idx) restrict(amp)
+	{
+	  int iBox = t_idx.tile[0];
+	  int iOff = boxOffset[iBox];
+	  int nSlots = boxOffset[iBox+1] - iOff;
+	  int nIBox = nAtoms[iBox];
+	  // atoms of the boxes before iBox in its block
+	  int iBlock = iBox / PAIR_BLOCK;
+	  int nBefore = 0;
+	  for (int kBox=iBlock*PAIR_BLOCK; kBox<iBox; kBox++)
+	    nBefore += nAtoms[kBox];
+	  for (int ii=t_idx.local[0]; ii<nSlots; ii+=BOX_TILE){
+	  int i = iOff + ii;
+	  real_t fi[3] = {0.0, 0.0, 0.0};
+	  real_t ui = 0.0;
+	  real_t rhoi = 0.0;
+	  real_t dfi = 0.0;
+	  int np = 0;
+	  // pairs beyond maxPairs are not kept
+	  int nKeep = (nBefore + ii < pairAtoms) ? maxPairs : 0;
+	  size_t p0 = (size_t) iBlock*blockPairs + nBefore + ii;
+
+	  if (ii < nIBox){
+	    // loop over neighbor boxes of iBox (some may be halo boxes)
+	    for (int jTmp=0; jTmp<nNbrBoxes; jTmp++){
+	      int jBox = nbrBoxes[iBox*nNbrBoxes + jTmp];
+	      int nJBox = nAtoms[jBox];
+	      for (int jOff=boxOffset[jBox],ij=0; ij<nJBox; ij++,jOff++){
+		double r2 = 0.0;
+		real3 dr;
+		for (int k=0; k<3; k++){
+		  dr[k] = r[i*3 + k] - r[jOff*3 + k];
+		  r2+=dr[k]*dr[k];
+		}
+		if ( r2 <= rCut2 && r2 > 0.0){
+		  double rsq = sqrt(r2);
+		  real_t phiTmp, dPhi, rhoTmp, dRho;
+
+		  interpolateAMP(phi_values, phi_x0, phi_invDx, phi_n, rsq, &phiTmp, &dPhi);
+		  interpolateAMP(rho_values, rho_x0, rho_invDx, rho_n, rsq, &rhoTmp, &dRho);
+
+		  for (int k=0; k<3; k++){
+		    fi[k] -= dPhi*dr[k]/rsq;
+		  }
+		  ui += 0.5*phiTmp;
+		  rhoi += rhoTmp;
+
+		  if (np < nKeep){
+		    size_t p = p0 + (size_t) np*pairAtoms;
+		    pairJ[p] = jOff;
+		    pairGx[p] = dRho*dr[0]/rsq;
+		    pairGy[p] = dRho*dr[1]/rsq;
+		    pairGz[p] = dRho*dr[2]/rsq;
+		  }
+		  ++np;
+		}
+	      } // loop over atoms in jBox
+	    } // loop over neighbor boxes
+
+	    // the embedding energy needs only this atom's rhobar
+	    real_t fEmbed;
+	    interpolateAMP(f_values, f_x0, f_invDx, f_n, rhoi, &fEmbed, &dfi);
+	    ui += fEmbed;
+	  }
 
-	  // loop over atoms in iBox
-	  for (int iOff=MAXATOMS*iBox,ii=0; ii<nIBox; ii++,iOff++){
-	    etot += s->atoms->U[iOff]; 
+	  // every slot of the box is written, empty ones with zero
+	  for (int k=0; k<3; k++){
+	    f[i*3 + k] = fi[k];
 	  }
+	  U[i] = ui;
+	  dfEmbed[i] = dfi;
+	  // -1 sends the atom to the box search in the second kernel
+	  nPairs[i] = (np <= nKeep) ? np : -1;
+	  } // loop over slots of iBox
+	} // loop over local boxes
+	);
+
+	// exchange derivative of the embedding energy with repsect to rhobar.
+	fut.wait();
+	deviceDownload(dfEmbed, pot->dfEmbed, 0, nLocalAtoms);
+	int nPhases = eamStartExchange(pot);
+
+	for (int iPhase=0; iPhase<nPhases; iPhase++)
+	{
+	if (iPhase == nPhases-1)
+	{
+		eamProgressExchange(pot, NBOXCOLORS);
+		deviceUpload(dfEmbed, pot->dfEmbed, nLocalAtoms, nHaloAtoms);
+	}
+	fut = parallel_for_each(tBoxesExt, [=
+					    HCC_ID(f)
+					    HCC_ID(r)
+					    HCC_ID(dfEmbed)
+					    HCC_ID(nAtoms)
+					    HCC_ID(boxOffset)
+					    HCC_ID(nbrBoxes)
+					    HCC_ID(boundary)
+					    HCC_ID(rho_values)
+					    HCC_ID(nPairs)
+					    HCC_ID(pairJ)
+					    HCC_ID(pairGx)
+					    HCC_ID(pairGy)
+					    HCC_ID(pairGz)](tiled_index<1> t_idx) restrict(amp)
+	{
+	  int iBox = t_idx.tile[0];
+	  if (nPhases > 1 && boundary[iBox] != iPhase) return;
+	  int iOff = boxOffset[iBox];
+	  int nIBox = nAtoms[iBox];
+	  int iBlock = iBox / PAIR_BLOCK;
+	  int nBefore = 0;
+	  for (int kBox=iBlock*PAIR_BLOCK; kBox<iBox; kBox++)
+	    nBefore += nAtoms[kBox];
+	  for (int ii=t_idx.local[0]; ii<nIBox; ii+=BOX_TILE){
+	  int i = iOff + ii;
+	  real_t fi[3];
+	  for (int k=0; k<3; k++){
+	    fi[k] = f[i*3 + k];
+	  }
+	  real_t dfi = dfEmbed[i];
+	  int np = nPairs[i];
+
+	  if (np >= 0){
+	    size_t p = (size_t) iBlock*blockPairs + nBefore + ii;
+	    for (int ip=0; ip<np; ip++,p+=pairAtoms){
+	      real_t dfij = dfi + dfEmbed[pairJ[p]];
+	      fi[0] -= dfij*pairGx[p];
+	      fi[1] -= dfij*pairGy[p];
+	      fi[2] -= dfij*pairGz[p];
+	    }
+	  }
+	  else{
+	    // the pairs did not fit, search the neighbor boxes
+	    for (int jTmp=0; jTmp<nNbrBoxes; jTmp++){
+	      int jBox = nbrBoxes[iBox*nNbrBoxes + jTmp];
+	      int nJBox = nAtoms[jBox];
+	      for (int jOff=boxOffset[jBox],ij=0; ij<nJBox; ij++,jOff++){
+		double r2 = 0.0;
+		real3 dr;
+		for (int k=0; k<3; k++){
+		  dr[k] = r[i*3 + k] - r[jOff*3 + k];
+		  r2+=dr[k]*dr[k];
+		}
+		if ( r2 <= rCut2 && r2 > 0.0){
+		  // same arithmetic as a cached pair
+		  double rsq = sqrt(r2);
+		  real_t rhoTmp, dRho;
+		  interpolateAMP(rho_values, rho_x0, rho_invDx, rho_n, rsq, &rhoTmp, &dRho);
+		  real_t dfij = dfi + dfEmbed[jOff];
+		  for (int k=0; k<3; k++){
+		    real_t g = dRho*dr[k]/rsq;
+		    fi[k] -= dfij*g;
+		  }
+		}
+	      } // loop over atoms in jBox
+	    } // loop over neighbor boxes
+	  }
+
+	  for (int k=0; k<3; k++){
+	    f[i*3 + k] = fi[k];
+	  }
+	  } // loop over atoms of iBox
+	} // loop over local boxes
+	);
+	} // loop over phases
+	fut.wait();
+
+	deviceDownloadForces(s);
+
+	etot = sumLocalAtoms(s->boxes, s->atoms->U);
+
+	s->ePotential = (real_t) etot;
+	return 0;
+}
+
+/// CPU version of eamForce that evaluates every pair of local atoms
+/// once.  The pair terms phi and rho and the embedding force term
+/// (F'(rhobar_i) + F'(rhobar_j)) rho'(r) are symmetric in i and j, so
+/// the first and third passes visit the same half shell as ljForceHalf
+/// and apply each pair to both atoms.  Pairs with halo atoms are only
+/// applied to the local atom.
+///
+/// \see ljForceHalf for the neighbor shell and the box coloring.
+int eamForceHalf(SimFlat* s)
+{
+	if (s->nbrList)
+		return eamForceHalfList(s);
+
+	EamPotential* pot = (EamPotential*) s->pot;
+	assert(pot);
+
+	// set up halo exchange and internal storage on first call to forces.
+	if (pot->nSlots != s->boxes->nTotalSlots)
+		eamInitStorage(s, pot);
+
+	real_t rCut2 = pot->cutoff*pot->cutoff;
+	int nNbrBoxes = 27;
+
+	LinkCell* boxes = s->boxes;
+	int nLocalBoxes = boxes->nLocalBoxes;
+	real_t* r = s->atoms->r;
+	real_t* f = s->atoms->f;
+	real_t* U = s->atoms->U;
+	real_t* rhobar = pot->rhobar;
+	real_t* dfEmbed = pot->dfEmbed;
+
+	// zero forces / energy / rho /rhoprime
+	real_t etot = 0.0;
+	memset(f,       0, boxes->nLocalSlots*sizeof(real3));
+	memset(U,       0, boxes->nLocalSlots*sizeof(real_t));
+	memset(rhobar,  0, boxes->nLocalSlots*sizeof(real_t));
+
+	// pair energy, pair force and rhobar
+	for (int iColor=0; iColor<NBOXCOLORS; iColor++)
+	{
+		#pragma omp parallel for
+		for (int iC=boxes->colorStart[iColor]; iC<boxes->colorStart[iColor+1]; iC++)
+		{
+			int iBox = boxes->colorBoxes[iC];
+			int nIBox = boxes->nAtoms[iBox];
+
+			for (int jTmp=0; jTmp<nNbrBoxes; jTmp++)
+			{
+				int jBox = boxes->nbrBoxes[iBox*nNbrBoxes + jTmp];
+				int newton = (jBox < nLocalBoxes);
+				// a local box behind iBox finds these pairs from its side
+				if (newton && jTmp < nNbrBoxes/2) continue;
+				int nJBox = boxes->nAtoms[jBox];
+
+				for (int iOff=boxes->boxOffset[iBox],ii=0; ii<nIBox; ii++,iOff++)
+				{
+					int ij = (jBox == iBox) ? ii+1 : 0;
+					for (int jOff=boxes->boxOffset[jBox]+ij; ij<nJBox; ij++,jOff++)
+					{
+						real_t r2 = 0.0;
+						real3 dr;
+						for (int k=0; k<3; k++)
+						{
+							dr[k] = r[iOff*3 + k] - r[jOff*3 + k];
+							r2+=dr[k]*dr[k];
+						}
+						if ( r2 > rCut2 || r2 <= 0.0) continue;
+
+						real_t rr = sqrt(r2);
+						real_t phiTmp, dPhi, rhoTmp, dRho;
+						interpolate(pot->phi, rr, &phiTmp, &dPhi);
+						interpolate(pot->rho, rr, &rhoTmp, &dRho);
+
+						for (int k=0; k<3; k++)
+							f[iOff*3 + k] -= dPhi*dr[k]/rr;
+						U[iOff] += 0.5*phiTmp;
+						rhobar[iOff] += rhoTmp;
+
+						if (newton)
+						{
+							for (int k=0; k<3; k++)
+								f[jOff*3 + k] += dPhi*dr[k]/rr;
+							U[jOff] += 0.5*phiTmp;
+							rhobar[jOff] += rhoTmp;
+						}
+					} // loop over atoms in jBox
+				} // loop over atoms in iBox
+			} // loop over neighbor boxes
+		} // loop over boxes of one color
+	} // loop over colors
+
+	// embedding energy and its derivative
+	#pragma omp parallel for
+	for (int iBox=0; iBox<nLocalBoxes; iBox++)
+	{
+		for (int iOff=boxes->boxOffset[iBox],ii=0; ii<boxes->nAtoms[iBox]; ii++,iOff++)
+		{
+			real_t fEmbed;
+			interpolate(pot->f, rhobar[iOff], &fEmbed, &dfEmbed[iOff]);
+			U[iOff] += fEmbed;
+		}
 	}
 
+	// exchange derivative of the embedding energy with repsect to rhobar
+	int nPhases = eamStartExchange(pot);
+
+	// embedding force, in two phases with overlap (see eamStartExchange)
+	for (int iStep=0; iStep<nPhases*NBOXCOLORS; iStep++)
+	{
+		int iPhase = iStep / NBOXCOLORS;
+		int iColor = iStep % NBOXCOLORS;
+		eamProgressExchange(pot, iStep);
+		#pragma omp parallel for
+		for (int iC=boxes->colorStart[iColor]; iC<boxes->colorStart[iColor+1]; iC++)
+		{
+			int iBox = boxes->colorBoxes[iC];
+			if (nPhases > 1 && boxes->boundary[iBox] != iPhase) continue;
+			int nIBox = boxes->nAtoms[iBox];
+
+			for (int jTmp=0; jTmp<nNbrBoxes; jTmp++)
+			{
+				int jBox = boxes->nbrBoxes[iBox*nNbrBoxes + jTmp];
+				int newton = (jBox < nLocalBoxes);
+				if (newton && jTmp < nNbrBoxes/2) continue;
+				int nJBox = boxes->nAtoms[jBox];
+
+				for (int iOff=boxes->boxOffset[iBox],ii=0; ii<nIBox; ii++,iOff++)
+				{
+					int ij = (jBox == iBox) ? ii+1 : 0;
+					for (int jOff=boxes->boxOffset[jBox]+ij; ij<nJBox; ij++,jOff++)
+					{
+						real_t r2 = 0.0;
+						real3 dr;
+						for (int k=0; k<3; k++)
+						{
+							dr[k] = r[iOff*3 + k] - r[jOff*3 + k];
+							r2+=dr[k]*dr[k];
+						}
+						if ( r2 > rCut2 || r2 <= 0.0) continue;
+
+						real_t rr = sqrt(r2);
+						real_t rhoTmp, dRho;
+						interpolate(pot->rho, rr, &rhoTmp, &dRho);
+
+						real_t fr = (dfEmbed[iOff] + dfEmbed[jOff])*dRho/rr;
+						for (int k=0; k<3; k++)
+							f[iOff*3 + k] -= fr*dr[k];
+						if (newton)
+							for (int k=0; k<3; k++)
+								f[jOff*3 + k] += fr*dr[k];
+					} // loop over atoms in jBox
+				} // loop over atoms in iBox
+			} // loop over neighbor boxes
+		} // loop over boxes of one color
+	} // loop over colors
+
+	etot = sumLocalAtoms(boxes, U);
+
 	s->ePotential = (real_t) etot;
 	return 0;
 }
 
+/// Branch free version of interpolate for the vectorized loops of
+/// eamForceHalfSoa.  The index is clamped with selects, and truncation
+/// replaces floor since the shifted argument is never negative.  In
+/// the vector loops the four coefficient loads become gathers from the
+/// same aligned interval.
+static inline void interpolateSoa(const real_t* cc, real_t x0, real_t invDx, int n,
+                                  real_t r, real_t* f, real_t* df)
+{
+	r = (r < x0) ? x0 : r;
+
+	r = (r-x0)*invDx;
+	int ii = (int)r;
+	int over = (ii > n);
+	ii = over ? n : ii;
+	r = over ? n / invDx : r;
+	// reset r to fractional distance
+	r = r - (int)r;
+
+	const real_t* c = cc + 4*ii;
+	*f = c[0] + r*(c[1] + r*c[2]);
+	*df = (c[1] + r*c[3])*invDx;
+}
+
+/// Version of eamForceHalf that works on the structure of arrays copies
+/// of the positions and forces (see initAtomsSoa).  As in ljForceHalfSoa
+/// the neighbors of atom i inside the cutoff are packed into index lists
+/// by packSoaNeighbors and both pair passes are vector loops over them.
+///
+/// \see eamForceHalf
+int eamForceHalfSoa(SimFlat* s)
+{
+	if (s->nbrList)
+		return eamForceHalfList(s);
+
+	EamPotential* pot = (EamPotential*) s->pot;
+	assert(pot);
+
+	// set up halo exchange and internal storage on first call to forces.
+	if (pot->nSlots != s->boxes->nTotalSlots)
+		eamInitStorage(s, pot);
+
+	real_t rCut2 = pot->cutoff*pot->cutoff;
+
+	LinkCell* boxes = s->boxes;
+	Atoms* atoms = s->atoms;
+	int nLocalBoxes = boxes->nLocalBoxes;
+	real_t* rx = atoms->rx;
+	real_t* ry = atoms->ry;
+	real_t* rz = atoms->rz;
+	real_t* fx = atoms->fx;
+	real_t* fy = atoms->fy;
+	real_t* fz = atoms->fz;
+	real_t* U = atoms->U;
+	real_t* rhobar = pot->rhobar;
+	real_t* dfEmbed = pot->dfEmbed;
+
+	const real_t* phiTable = pot->phi->coef;
+	real_t phiX0 = pot->phi->x0;
+	real_t phiInvDx = pot->phi->invDx;
+	int phiN = pot->phi->n;
+	const real_t* rhoTable = pot->rho->coef;
+	real_t rhoX0 = pot->rho->x0;
+	real_t rhoInvDx = pot->rho->invDx;
+	int rhoN = pot->rho->n;
+
+	gatherSoaPositions(atoms, boxes);
+
+	// zero forces / energy / rho /rhoprime
+	real_t etot = 0.0;
+	memset(fx,      0, boxes->nLocalSlots*sizeof(real_t));
+	memset(fy,      0, boxes->nLocalSlots*sizeof(real_t));
+	memset(fz,      0, boxes->nLocalSlots*sizeof(real_t));
+	memset(U,       0, boxes->nLocalSlots*sizeof(real_t));
+	memset(rhobar,  0, boxes->nLocalSlots*sizeof(real_t));
+
+	// pair energy, pair force and rhobar
+	for (int iColor=0; iColor<NBOXCOLORS; iColor++)
+	{
+		#pragma omp parallel for
+		for (int iC=boxes->colorStart[iColor]; iC<boxes->colorStart[iColor+1]; iC++)
+		{
+			int iBox = boxes->colorBoxes[iC];
+			int nIBox = boxes->nAtoms[iBox];
+			int jNewton[27*boxes->maxCapacity];
+			int jHalo[27*boxes->maxCapacity];
+
+			for (int iOff=boxes->boxOffset[iBox],ii=0; ii<nIBox; ii++,iOff++)
+			{
+				int nNewton, nHalo;
+				packSoaNeighbors(atoms, boxes, iBox, iOff, rCut2,
+				                 jNewton, &nNewton, jHalo, &nHalo);
+
+				real_t xi = rx[iOff];
+				real_t yi = ry[iOff];
+				real_t zi = rz[iOff];
+				real_t fxi = 0.0;
+				real_t fyi = 0.0;
+				real_t fzi = 0.0;
+				real_t ui = 0.0;
+				real_t rhoi = 0.0;
+
+					#pragma omp simd reduction(+:fxi,fyi,fzi,ui,rhoi)
+					for (int k=0; k<nNewton; k++)
+					{
+						int jOff = jNewton[k];
+						real_t dx = xi - rx[jOff];
+						real_t dy = yi - ry[jOff];
+						real_t dz = zi - rz[jOff];
+						real_t rr = sqrt(dx*dx + dy*dy + dz*dz);
+						real_t phiTmp, dPhi, rhoTmp, dRho;
+						interpolateSoa(phiTable, phiX0, phiInvDx, phiN, rr, &phiTmp, &dPhi);
+						interpolateSoa(rhoTable, rhoX0, rhoInvDx, rhoN, rr, &rhoTmp, &dRho);
+						real_t fr = dPhi/rr;
+
+						fxi -= fr*dx;
+						fyi -= fr*dy;
+						fzi -= fr*dz;
+						ui += 0.5*phiTmp;
+						rhoi += rhoTmp;
+						fx[jOff] += fr*dx;
+						fy[jOff] += fr*dy;
+						fz[jOff] += fr*dz;
+						U[jOff] += 0.5*phiTmp;
+						rhobar[jOff] += rhoTmp;
+					}
+
+					#pragma omp simd reduction(+:fxi,fyi,fzi,ui,rhoi)
+					for (int k=0; k<nHalo; k++)
+					{
+						int jOff = jHalo[k];
+						real_t dx = xi - rx[jOff];
+						real_t dy = yi - ry[jOff];
+						real_t dz = zi - rz[jOff];
+						real_t rr = sqrt(dx*dx + dy*dy + dz*dz);
+						real_t phiTmp, dPhi, rhoTmp, dRho;
+						interpolateSoa(phiTable, phiX0, phiInvDx, phiN, rr, &phiTmp, &dPhi);
+						interpolateSoa(rhoTable, rhoX0, rhoInvDx, rhoN, rr, &rhoTmp, &dRho);
+						real_t fr = dPhi/rr;
+
+						fxi -= fr*dx;
+						fyi -= fr*dy;
+						fzi -= fr*dz;
+						ui += 0.5*phiTmp;
+						rhoi += rhoTmp;
+					}
+
+				fx[iOff] += fxi;
+				fy[iOff] += fyi;
+				fz[iOff] += fzi;
+				U[iOff] += ui;
+				rhobar[iOff] += rhoi;
+			} // loop over atoms in iBox
+		} // loop over boxes of one color
+	} // loop over colors
+
+	// embedding energy and its derivative
+	#pragma omp parallel for
+	for (int iBox=0; iBox<nLocalBoxes; iBox++)
+	{
+		for (int iOff=boxes->boxOffset[iBox],ii=0; ii<boxes->nAtoms[iBox]; ii++,iOff++)
+		{
+			real_t fEmbed;
+			interpolate(pot->f, rhobar[iOff], &fEmbed, &dfEmbed[iOff]);
+			U[iOff] += fEmbed;
+		}
+	}
+
+	// exchange derivative of the embedding energy with repsect to rhobar
+	int nPhases = eamStartExchange(pot);
+
+	// embedding force, in two phases with overlap (see eamStartExchange)
+	for (int iStep=0; iStep<nPhases*NBOXCOLORS; iStep++)
+	{
+		int iPhase = iStep / NBOXCOLORS;
+		int iColor = iStep % NBOXCOLORS;
+		eamProgressExchange(pot, iStep);
+		#pragma omp parallel for
+		for (int iC=boxes->colorStart[iColor]; iC<boxes->colorStart[iColor+1]; iC++)
+		{
+			int iBox = boxes->colorBoxes[iC];
+			if (nPhases > 1 && boxes->boundary[iBox] != iPhase) continue;
+			int nIBox = boxes->nAtoms[iBox];
+			int jNewton[27*boxes->maxCapacity];
+			int jHalo[27*boxes->maxCapacity];
+
+			for (int iOff=boxes->boxOffset[iBox],ii=0; ii<nIBox; ii++,iOff++)
+			{
+				int nNewton, nHalo;
+				packSoaNeighbors(atoms, boxes, iBox, iOff, rCut2,
+				                 jNewton, &nNewton, jHalo, &nHalo);
+
+				real_t xi = rx[iOff];
+				real_t yi = ry[iOff];
+				real_t zi = rz[iOff];
+				real_t dfi = dfEmbed[iOff];
+				real_t fxi = 0.0;
+				real_t fyi = 0.0;
+				real_t fzi = 0.0;
+
+					#pragma omp simd reduction(+:fxi,fyi,fzi)
+					for (int k=0; k<nNewton; k++)
+					{
+						int jOff = jNewton[k];
+						real_t dx = xi - rx[jOff];
+						real_t dy = yi - ry[jOff];
+						real_t dz = zi - rz[jOff];
+						real_t rr = sqrt(dx*dx + dy*dy + dz*dz);
+						real_t rhoTmp, dRho;
+						interpolateSoa(rhoTable, rhoX0, rhoInvDx, rhoN, rr, &rhoTmp, &dRho);
+						real_t fr = (dfi + dfEmbed[jOff])*dRho/rr;
+
+						fxi -= fr*dx;
+						fyi -= fr*dy;
+						fzi -= fr*dz;
+						fx[jOff] += fr*dx;
+						fy[jOff] += fr*dy;
+						fz[jOff] += fr*dz;
+					}
+
+					#pragma omp simd reduction(+:fxi,fyi,fzi)
+					for (int k=0; k<nHalo; k++)
+					{
+						int jOff = jHalo[k];
+						real_t dx = xi - rx[jOff];
+						real_t dy = yi - ry[jOff];
+						real_t dz = zi - rz[jOff];
+						real_t rr = sqrt(dx*dx + dy*dy + dz*dz);
+						real_t rhoTmp, dRho;
+						interpolateSoa(rhoTable, rhoX0, rhoInvDx, rhoN, rr, &rhoTmp, &dRho);
+						real_t fr = (dfi + dfEmbed[jOff])*dRho/rr;
+
+						fxi -= fr*dx;
+						fyi -= fr*dy;
+						fzi -= fr*dz;
+					}
+
+				fx[iOff] += fxi;
+				fy[iOff] += fyi;
+				fz[iOff] += fzi;
+			} // loop over atoms in iBox
+		} // loop over boxes of one color
+	} // loop over colors
+
+	scatterSoaForces(atoms, boxes);
+
+	etot = sumLocalAtoms(boxes, U);
+
+	s->ePotential = (real_t) etot;
+	return 0;
+}
+
+/// Version of eamForce that reads the neighbors of each atom from the
+/// Verlet list.  The pair passes run one thread per atom slot; the
+/// embedding pass and the force halo exchange are unchanged.
+///
+/// \see NeighborListSt
+int eamForceList(SimFlat* s)
+{
+	EamPotential* pot = (EamPotential*) s->pot;
+	assert(pot);
+
+	// set up halo exchange and internal storage on first call to forces.
+	if (pot->nSlots != s->boxes->nTotalSlots)
+	  eamInitStorage(s, pot);
+
+	real_t rCut2 = pot->cutoff*pot->cutoff;
+
+	real_t etot = 0.0;
+
+	int nLocalBoxes = s->boxes->nLocalBoxes;
+	int nLocalAtoms = s->boxes->nLocalSlots;
+	int nHaloAtoms = s->boxes->nTotalSlots - nLocalAtoms;
+
+	extent<1> atomsExt(nLocalAtoms);
+	extent<1> boxesExt(nLocalBoxes * BOX_TILE);
+	tiled_extent<1> tBoxesExt(boxesExt, BOX_TILE);
+
+	completion_future fut;
+
+	int phi_n = pot->phi->n;
+	real_t phi_x0 = pot->phi->x0;
+	real_t phi_invDx = pot->phi->invDx;
+
+	int rho_n = pot->rho->n;
+	real_t rho_x0 = pot->rho->x0;
+	real_t rho_invDx = pot->rho->invDx;
+
+	int f_n = pot->f->n;
+	real_t f_x0 = pot->f->x0;
+	real_t f_invDx = pot->f->invDx;
+
+	// persistent device copies, see deviceState.h
+	HCC_ARRAY_OBJECT(real_t, U) = *s->device->U;
+	HCC_ARRAY_OBJECT(real_t, rhobar) = *pot->device->rhobar;
+	HCC_ARRAY_OBJECT(real_t, dfEmbed) = *pot->device->dfEmbed;
+	HCC_ARRAY_OBJECT(real_t, f) = *s->device->f;
+	HCC_ARRAY_OBJECT(real_t, r) = *s->device->r;
+	HCC_ARRAY_OBJECT(int, nAtoms) = *s->device->nAtoms;
+	HCC_ARRAY_OBJECT(int, boxOffset) = *s->device->boxOffset;
+	HCC_ARRAY_OBJECT(int, nNbrs) = *s->device->nNbrs;
+	HCC_ARRAY_OBJECT(int, boundary) = *s->device->boundary;
+	HCC_ARRAY_OBJECT(int, nbrList) = *s->device->nbrList;
+	HCC_ARRAY_OBJECT(real_t, phi_values) = *pot->device->phi;
+	HCC_ARRAY_OBJECT(real_t, rho_values) = *pot->device->rho;
+	HCC_ARRAY_OBJECT(real_t, f_values) = *pot->device->f;
+
+	// pair energy, pair force and rhobar
+	fut = parallel_for_each(atomsExt, [=
+					   HCC_ID(U)
+					   HCC_ID(rhobar)
+					   HCC_ID(f)
+					   HCC_ID(r)
+					   HCC_ID(nNbrs)
+					   HCC_ID(nbrList)
+					   HCC_ID(phi_values)
+					   HCC_ID(rho_values)](index<1> idx) restrict(amp)
+	{
+	  int iOff = idx[0];
+	  real_t fi[3] = {0.0, 0.0, 0.0};
+	  real_t ui = 0.0;
+	  real_t rhoi = 0.0;
+
+	  for (int k=0; k<nNbrs[iOff]; k++){
+	    int jOff = nbrList[k*nLocalAtoms + iOff];
+	    double r2 = 0.0;
+	    real3 dr;
+	    for (int m=0; m<3; m++){
+	      dr[m] = r[iOff*3 + m] - r[jOff*3 + m];
+	      r2+=dr[m]*dr[m];
+	    }
+	    // the list holds pairs out to the cutoff plus the skin
+	    if ( r2 <= rCut2){
+	      double rsq = sqrt(r2);
+	      real_t phiTmp, dPhi, rhoTmp, dRho;
+
+	      interpolateAMP(phi_values, phi_x0, phi_invDx, phi_n, rsq, &phiTmp, &dPhi);
+	      interpolateAMP(rho_values, rho_x0, rho_invDx, rho_n, rsq, &rhoTmp, &dRho);
+
+	      for (int m=0; m<3; m++){
+		fi[m] -= dPhi*dr[m]/rsq;
+	      }
+	      ui += 0.5*phiTmp;
+	      rhoi += rhoTmp;
+	    }
+	  } // loop over neighbors
+
+	  // empty slots have no neighbors and are written with zero
+	  for (int m=0; m<3; m++){
+	    f[iOff*3 + m] = fi[m];
+	  }
+	  U[iOff] = ui;
+	  rhobar[iOff] = rhoi;
+	}
+	);
+
+	// embedding energy and its derivative
+	fut = parallel_for_each(tBoxesExt, [=
+					    HCC_ID(U)
+					    HCC_ID(rhobar)
+					    HCC_ID(dfEmbed)
+					    HCC_ID(nAtoms)
+					    HCC_ID(boxOffset)
+					    HCC_ID(f_values)](tiled_index<1> t_idx) restrict(amp)
+	{
+	  int iBox = t_idx.tile[0];
+	  int iOff = boxOffset[iBox];
+
+	  for (int ii=t_idx.local[0]; ii<nAtoms[iBox]; ii+=BOX_TILE){
+	    real_t fEmbed, tempdfEmbed;
+	    interpolateAMP(f_values, f_x0, f_invDx, f_n, rhobar[iOff + ii], &fEmbed, &tempdfEmbed);
+
+	    dfEmbed[iOff + ii] = tempdfEmbed;
+	    U[iOff + ii] += fEmbed;
+	  }
+	}
+	);
+
+	fut.wait();
+	deviceDownload(dfEmbed, pot->dfEmbed, 0, nLocalAtoms);
+	int nPhases = eamStartExchange(pot);
+
+	// embedding force
+	// With overlap the interior boxes run while the exchange is in
+	// flight and the boundary boxes after the halo values are uploaded.
+	for (int iPhase=0; iPhase<nPhases; iPhase++)
+	{
+	if (iPhase == nPhases-1)
+	{
+		eamProgressExchange(pot, NBOXCOLORS);
+		deviceUpload(dfEmbed, pot->dfEmbed, nLocalAtoms, nHaloAtoms);
+	}
+	fut = parallel_for_each(atomsExt, [=
+					   HCC_ID(f)
+					   HCC_ID(r)
+					   HCC_ID(dfEmbed)
+					   HCC_ID(nNbrs)
+					   HCC_ID(nbrList)
+					   HCC_ID(boundary)
+					   HCC_ID(boxOffset)
+					   HCC_ID(rho_values)](index<1> idx) restrict(amp)
+	{
+	  int iOff = idx[0];
+	  if (nPhases > 1){
+	    // the box of the slot, by bisection of the box offsets
+	    int lo = 0;
+	    int hi = nLocalBoxes;
+	    while (hi - lo > 1){
+	      int mid = (lo + hi)/2;
+	      if (boxOffset[mid] <= iOff) lo = mid;
+	      else hi = mid;
+	    }
+	    if (boundary[lo] != iPhase) return;
+	  }
+	  real_t fi[3];
+	  for (int m=0; m<3; m++){
+	    fi[m] = f[iOff*3 + m];
+	  }
+
+	  for (int k=0; k<nNbrs[iOff]; k++){
+	    int jOff = nbrList[k*nLocalAtoms + iOff];
+	    double r2 = 0.0;
+	    real3 dr;
+	    for (int m=0; m<3; m++){
+	      dr[m] = r[iOff*3 + m] - r[jOff*3 + m];
+	      r2+=dr[m]*dr[m];
+	    }
+	    if ( r2 <= rCut2){
+	      real_t r_t = sqrt(r2);
+	      real_t rhoTmp, dRho;
+	      interpolateAMP(rho_values, rho_x0, rho_invDx, rho_n, r_t, &rhoTmp, &dRho);
+
+	      for (int m=0; m<3; m++){
+		fi[m] -= (dfEmbed[iOff] + dfEmbed[jOff])*dRho*dr[m]/r_t;
+	      }
+	    }
+	  } // loop over neighbors
+
+	  for (int m=0; m<3; m++){
+	    f[iOff*3 + m] = fi[m];
+	  }
+	}
+	);
+	} // loop over phases
+	fut.wait();
+
+	deviceDownloadForces(s);
+
+	etot = sumLocalAtoms(s->boxes, s->atoms->U);
+
+	s->ePotential = (real_t) etot;
+	return 0;
+}
+
+/// Version of eamForceHalf that reads the neighbors of each atom from a
+/// half Verlet list.
+///
+/// \see ljForceHalfList
+int eamForceHalfList(SimFlat* s)
+{
+	EamPotential* pot = (EamPotential*) s->pot;
+	assert(pot);
+
+	// set up halo exchange and internal storage on first call to forces.
+	if (pot->nSlots != s->boxes->nTotalSlots)
+		eamInitStorage(s, pot);
+
+	real_t rCut2 = pot->cutoff*pot->cutoff;
+
+	LinkCell* boxes = s->boxes;
+	int nLocalBoxes = boxes->nLocalBoxes;
+	int nLocalAtoms = s->nbrList->nLocalAtoms;
+	int* nNbrs = s->nbrList->nNbrs;
+	int* list = s->nbrList->list;
+	real_t* r = s->atoms->r;
+	real_t* f = s->atoms->f;
+	real_t* U = s->atoms->U;
+	real_t* rhobar = pot->rhobar;
+	real_t* dfEmbed = pot->dfEmbed;
+
+	// zero forces / energy / rho /rhoprime
+	real_t etot = 0.0;
+	memset(f,       0, boxes->nLocalSlots*sizeof(real3));
+	memset(U,       0, boxes->nLocalSlots*sizeof(real_t));
+	memset(rhobar,  0, boxes->nLocalSlots*sizeof(real_t));
+
+	// pair energy, pair force and rhobar
+	for (int iColor=0; iColor<NBOXCOLORS; iColor++)
+	{
+		#pragma omp parallel for
+		for (int iC=boxes->colorStart[iColor]; iC<boxes->colorStart[iColor+1]; iC++)
+		{
+			int iBox = boxes->colorBoxes[iC];
+			for (int iOff=boxes->boxOffset[iBox],ii=0; ii<boxes->nAtoms[iBox]; ii++,iOff++)
+			{
+				for (int k=0; k<nNbrs[iOff]; k++)
+				{
+					int jOff = list[k*nLocalAtoms + iOff];
+					real_t r2 = 0.0;
+					real3 dr;
+					for (int m=0; m<3; m++)
+					{
+						dr[m] = r[iOff*3 + m] - r[jOff*3 + m];
+						r2+=dr[m]*dr[m];
+					}
+					if ( r2 > rCut2) continue;
+
+					real_t rr = sqrt(r2);
+					real_t phiTmp, dPhi, rhoTmp, dRho;
+					interpolate(pot->phi, rr, &phiTmp, &dPhi);
+					interpolate(pot->rho, rr, &rhoTmp, &dRho);
+
+					for (int m=0; m<3; m++)
+						f[iOff*3 + m] -= dPhi*dr[m]/rr;
+					U[iOff] += 0.5*phiTmp;
+					rhobar[iOff] += rhoTmp;
+
+					if (jOff < nLocalAtoms)
+					{
+						for (int m=0; m<3; m++)
+							f[jOff*3 + m] += dPhi*dr[m]/rr;
+						U[jOff] += 0.5*phiTmp;
+						rhobar[jOff] += rhoTmp;
+					}
+				} // loop over neighbors
+			} // loop over atoms in iBox
+		} // loop over boxes of one color
+	} // loop over colors
+
+	// embedding energy and its derivative
+	#pragma omp parallel for
+	for (int iBox=0; iBox<nLocalBoxes; iBox++)
+	{
+		for (int iOff=boxes->boxOffset[iBox],ii=0; ii<boxes->nAtoms[iBox]; ii++,iOff++)
+		{
+			real_t fEmbed;
+			interpolate(pot->f, rhobar[iOff], &fEmbed, &dfEmbed[iOff]);
+			U[iOff] += fEmbed;
+		}
+	}
+
+	// exchange derivative of the embedding energy with repsect to rhobar
+	int nPhases = eamStartExchange(pot);
+
+	// embedding force, in two phases with overlap (see eamStartExchange)
+	for (int iStep=0; iStep<nPhases*NBOXCOLORS; iStep++)
+	{
+		int iPhase = iStep / NBOXCOLORS;
+		int iColor = iStep % NBOXCOLORS;
+		eamProgressExchange(pot, iStep);
+		#pragma omp parallel for
+		for (int iC=boxes->colorStart[iColor]; iC<boxes->colorStart[iColor+1]; iC++)
+		{
+			int iBox = boxes->colorBoxes[iC];
+			if (nPhases > 1 && boxes->boundary[iBox] != iPhase) continue;
+			for (int iOff=boxes->boxOffset[iBox],ii=0; ii<boxes->nAtoms[iBox]; ii++,iOff++)
+			{
+				for (int k=0; k<nNbrs[iOff]; k++)
+				{
+					int jOff = list[k*nLocalAtoms + iOff];
+					real_t r2 = 0.0;
+					real3 dr;
+					for (int m=0; m<3; m++)
+					{
+						dr[m] = r[iOff*3 + m] - r[jOff*3 + m];
+						r2+=dr[m]*dr[m];
+					}
+					if ( r2 > rCut2) continue;
+
+					real_t rr = sqrt(r2);
+					real_t rhoTmp, dRho;
+					interpolate(pot->rho, rr, &rhoTmp, &dRho);
+
+					real_t fr = (dfEmbed[iOff] + dfEmbed[jOff])*dRho/rr;
+					for (int m=0; m<3; m++)
+						f[iOff*3 + m] -= fr*dr[m];
+					if (jOff < nLocalAtoms)
+						for (int m=0; m<3; m++)
+							f[jOff*3 + m] += fr*dr[m];
+				} // loop over neighbors
+			} // loop over atoms in iBox
+		} // loop over boxes of one color
+	} // loop over colors
+
+	etot = sumLocalAtoms(boxes, U);
+
+	s->ePotential = (real_t) etot;
+	return 0;
+}
+
+/// Allocate the per atom storage and the force halo exchange.  This
+/// needs the link cells, which don't exist yet when the potential is
+/// initialized, so it is done on the first call to the force routine.
+/// It is called again whenever the link cells have grown, to resize
+/// the per atom storage to the new slot count.  The device copies are
+/// only made when the forces run on the device.
+///
+/// maxPairs is the number of neighbors inside the cutoff at the
+/// density of the local atoms, plus PAIR_SLACK.  The pair cache of
+/// eamForceFused keeps maxPairs pairs for pairAtoms atoms of each block
+/// of PAIR_BLOCK boxes, in blockPairs entries per block.  blockPairs is
+/// PAIR_BLOCK_PAIRS, or less when the blocks would need more than
+/// PAIR_CACHE_PAIRS in all, so the cache never exceeds PAIR_CACHE_PAIRS
+/// entries however many atoms the rank holds.
+void eamInitStorage(SimFlat* s, EamPotential* pot)
+{
+	int maxTotalAtoms = s->boxes->nTotalSlots;
+	if (pot->force == eamForceFused && pot->maxPairs == 0)
+	{
+		real_t volume = 1.0;
+		for (int i=0; i<3; i++)
+			volume *= s->boxes->localMax[i] - s->boxes->localMin[i];
+		real_t rc = pot->cutoff;
+		real_t nNbrs = s->atoms->nLocal/volume * 4.0/3.0*3.14159265358979*rc*rc*rc;
+		pot->maxPairs = (int) ceil(nNbrs*(1.0 + PAIR_SLACK)) + 1;
+		int nBlocks = (s->boxes->nLocalBoxes + PAIR_BLOCK - 1) / PAIR_BLOCK;
+		pot->blockPairs = PAIR_BLOCK_PAIRS;
+		if ((size_t) nBlocks*PAIR_BLOCK_PAIRS > PAIR_CACHE_PAIRS)
+			pot->blockPairs = PAIR_CACHE_PAIRS / nBlocks;
+		pot->pairAtoms = pot->blockPairs / pot->maxPairs;
+	}
+	comdFree(pot->dfEmbed);
+	comdFree(pot->rhobar);
+	pot->dfEmbed = (real_t *) comdCalloc(maxTotalAtoms, sizeof(real_t));
+	pot->rhobar  = (real_t *) comdCalloc(maxTotalAtoms, sizeof(real_t));
+	pot->nSlots = maxTotalAtoms;
+	if (pot->forceExchange == NULL)
+	{
+		pot->forceExchange = initForceHaloExchange(s->domain, s->boxes);
+		pot->forceExchangeData = (ForceExchangeData *) comdMalloc(sizeof(ForceExchangeData));
+		pot->forceExchangeData->boxes = s->boxes;
+	}
+	pot->forceExchangeData->dfEmbed = pot->dfEmbed;
+	if (s->device)
+	{
+		destroyEamDevice(&(pot->device));
+		pot->device = initEamDevice(pot, maxTotalAtoms, s->boxes->nLocalSlots,
+		                            s->boxes->nLocalBoxes);
+	}
+}
+
 void eamPrint(FILE* file, BasePotential* pot)
 {
 	EamPotential *eamPot = (EamPotential*) pot;
@@ -532,12 +1692,106 @@ void eamDestroy(BasePotential** pPot)
 	destroyInterpolationObject(&(pot->rho));
 	destroyInterpolationObject(&(pot->f));
 	destroyHaloExchange(&(pot->forceExchange));
+	destroyEamDevice(&(pot->device));
 	comdFree(pot);
 	*pPot = NULL;
 
 	return;
 }
 
+/// Create the device copies of the per atom storage and upload the
+/// interpolation tables.  The tables never change so this is the only
+/// time they are copied.  The pair cache of eamForceFused lives on the
+/// device only.
+EamDevice* initEamDevice(EamPotential* pot, int maxTotalAtoms, int maxLocalAtoms,
+                         int nLocalBoxes)
+{
+	EamDevice* dev = (EamDevice*) comdMalloc(sizeof(EamDevice));
+	assert(dev);
+
+	dev->rhobar  = newDeviceArray(maxTotalAtoms, pot->rhobar);
+	dev->dfEmbed = newDeviceArray(maxTotalAtoms, pot->dfEmbed);
+	// the interpolation coefficients, four per interval
+	dev->phi = newDeviceArray(4*(pot->phi->n+1), pot->phi->coef);
+	dev->rho = newDeviceArray(4*(pot->rho->n+1), pot->rho->coef);
+	dev->f   = newDeviceArray(4*(pot->f->n+1), pot->f->coef);
+
+	deviceUpload(*dev->phi, pot->phi->coef, 0, 4*(pot->phi->n+1));
+	deviceUpload(*dev->rho, pot->rho->coef, 0, 4*(pot->rho->n+1));
+	deviceUpload(*dev->f, pot->f->coef, 0, 4*(pot->f->n+1));
+
+	dev->nPairs = NULL;
+	dev->pairJ = NULL;
+	dev->pairGx = NULL;
+	dev->pairGy = NULL;
+	dev->pairGz = NULL;
+	if (pot->maxPairs > 0)
+	{
+		// one entry is allocated even without any cached atom
+		size_t nBlocks = (nLocalBoxes + PAIR_BLOCK - 1) / PAIR_BLOCK;
+		size_t nEntries = (pot->pairAtoms > 0) ? nBlocks*pot->blockPairs : 1;
+		assert(nEntries <= INT_MAX);
+		dev->nPairs = newDeviceScratch<int>(maxLocalAtoms);
+		dev->pairJ  = newDeviceScratch<int>((int) nEntries);
+		dev->pairGx = newDeviceScratch<real_t>((int) nEntries);
+		dev->pairGy = newDeviceScratch<real_t>((int) nEntries);
+		dev->pairGz = newDeviceScratch<real_t>((int) nEntries);
+	}
+
+	return dev;
+}
+
+void destroyEamDevice(EamDevice** dev)
+{
+	if ( ! dev ) return;
+	if ( ! *dev ) return;
+	delete (*dev)->rhobar;
+	delete (*dev)->dfEmbed;
+	delete (*dev)->phi;
+	delete (*dev)->rho;
+	delete (*dev)->f;
+	delete (*dev)->nPairs;
+	delete (*dev)->pairJ;
+	delete (*dev)->pairGx;
+	delete (*dev)->pairGy;
+	delete (*dev)->pairGz;
+	comdFree(*dev);
+	*dev = NULL;
+}
+
+/// Starts the exchange of dfEmbed before the embedding force pass.
+///
+/// With overlap the pass runs in two phases: phase 0 visits the
+/// interior boxes, whose neighbor boxes are all local and so need no
+/// halo values, while the exchange is in flight; phase 1 visits the
+/// boundary boxes once eamProgressExchange has completed it.  Without
+/// overlap the exchange is completed here and there is one phase.
+///
+/// \return The number of phases of the embedding force pass.
+int eamStartExchange(EamPotential* pot)
+{
+	startTimer(eamHaloTimer);
+	startHaloExchange(pot->forceExchange, pot->forceExchangeData);
+	if (! pot->overlap)
+		finishHaloExchange(pot->forceExchange, pot->forceExchangeData);
+	stopTimer(eamHaloTimer);
+	return pot->overlap ? 2 : 1;
+}
+
+/// Called before each color (or device phase) iStep of the embedding
+/// force pass.  Gives the exchange a chance to progress during phase 0
+/// and completes it before the first step of phase 1.
+void eamProgressExchange(EamPotential* pot, int iStep)
+{
+	if (! pot->overlap || iStep > NBOXCOLORS) return;
+	startTimer(eamHaloTimer);
+	if (iStep < NBOXCOLORS)
+		testHaloExchange(pot->forceExchange, pot->forceExchangeData);
+	else
+		finishHaloExchange(pot->forceExchange, pot->forceExchangeData);
+	stopTimer(eamHaloTimer);
+}
+
 /// Broadcasts an EamPotential from rank 0 to all other ranks.
 /// If the table coefficients are read from a file only rank 0 does the
 /// read.  Hence we need to broadcast the potential to all other ranks.
@@ -607,6 +1861,8 @@ InterpolationObject* initInterpolationObject(
 	table->values[-1] = table->values[0];
 	table->values[n+1] = table->values[n] = table->values[n-1];
 
+	initInterpolationCoef(table);
+
 	return table;
 }
 
@@ -619,12 +1875,48 @@ void destroyInterpolationObject(InterpolationObject** a)
 		(*a)->values--;
 		comdFree((*a)->values);
 	}
+	comdFree((*a)->coef);
 	comdFree(*a);
 	*a = NULL;
 
 	return;
 }
 
+/// Converts the table values into four coefficients per interval, so
+/// that a lookup is one aligned load of four values and two short
+/// Horner evaluations.  For the fractional distance r into interval ii
+///
+///   f  = c0 + r*(c1 + r*c2)
+///   df = (c1 + r*c3)*invDx
+///
+/// with c0 = t[ii], c1 = (t[ii+1] - t[ii-1])/2,
+/// c2 = (t[ii+1] + t[ii-1] - 2 t[ii])/2 and c3 = (g2 - g1)/2 in the
+/// notation of interpolate.  These are the quadratic value and the 4
+/// point finite difference derivative of interpolate, and since the
+/// factors of 1/2 are exact the results are the same to the last bit.
+/// Interval n, used for r beyond the table, repeats the last value.
+///
+/// \see interpolate
+void initInterpolationCoef(InterpolationObject* table)
+{
+	int n = table->n;
+	const real_t* tt = table->values; // alias
+
+	table->coef = (real_t*) comdAlignedMalloc(INTERP_ALIGN, 4*(n+1)*sizeof(real_t));
+	assert(table->coef);
+
+	for (int ii=0; ii<=n; ++ii)
+	{
+		real_t g1 = tt[ii+1] - tt[ii-1];
+		real_t g2 = tt[MIN(ii+2, n+1)] - tt[ii];
+		real_t* c = table->coef + 4*ii;
+		c[0] = tt[ii];
+		c[1] = 0.5*g1;
+		c[2] = 0.5*(tt[ii+1] + tt[ii-1] - 2.0*tt[ii]);
+		c[3] = 0.5*(g2-g1);
+	}
+}
+
 /// Interpolate a table to determine f(r) and its derivative f'(r).
 ///
 /// The forces on the particle are much more sensitive to the derivative
@@ -633,14 +1925,17 @@ void destroyInterpolationObject(InterpolationObject** a)
 /// and continuous.  This function uses simple quadratic interpolation
 /// to find f(r).  Since quadric interpolants don't have smooth
 /// derivatives, f'(r) is computed using a 4 point finite difference
-/// stencil.
+/// stencil:
+///
+///   g1 = t[ii+1] - t[ii-1],  g2 = t[ii+2] - t[ii]
+///   f  = t[ii] + r/2 (g1 + r (t[ii+1] + t[ii-1] - 2 t[ii]))
+///   df = (g1 + r (g2 - g1))/2 invDx
 ///
 /// Interpolation is used heavily by the EAM force routine so this
-/// function is a potential performance hot spot.  Feel free to
-/// reimplement this function (and initInterpolationObject if necessay)
-/// with any higher performing implementation of interpolation, as long
-/// as the alternate implmentation that has the required smoothness
-/// properties.  Cubic splines are one common alternate choice.
+/// function is a potential performance hot spot.  The polynomials are
+/// evaluated from per interval coefficients that are computed when the
+/// table is built (initInterpolationCoef) instead of from the table
+/// values.
 ///
 /// \param [in] table Interpolation table.
 /// \param [in] r Point where function value is needed.
@@ -648,8 +1943,6 @@ void destroyInterpolationObject(InterpolationObject** a)
 /// \param [out] df The interpolated value of df(r)/dr.
 void interpolate(InterpolationObject* table, real_t r, real_t* f, real_t* df)
 {
-  const real_t* tt = table->values; // alias
-
   if ( r < table->x0 ) r = table->x0;
   
   r = (r-table->x0)*(table->invDx) ;
@@ -660,13 +1953,10 @@ void interpolate(InterpolationObject* table, real_t r, real_t* f, real_t* df)
   }
   // reset r to fractional distance
   r = r - precise_math::floor(r);
-  
-  real_t g1 = tt[ii+1] - tt[ii-1];
-  real_t g2 = tt[ii+2] - tt[ii];
 
-  *f = tt[ii] + 0.5*r*(g1 + r*(tt[ii+1] + tt[ii-1] - 2.0*tt[ii]) );
-  
-  *df = 0.5*(g1 + r*(g2-g1))*table->invDx;
+  const real_t* c = table->coef + 4*ii;
+  *f = c[0] + r*(c[1] + r*c[2]);
+  *df = (c[1] + r*c[3])*table->invDx;
 }
 
 /// Broadcasts an InterpolationObject from rank 0 to all other ranks.
@@ -706,6 +1996,9 @@ void bcastInterpolationObject(InterpolationObject** table)
 
 	int valuesSize = sizeof(real_t) * ((*table)->n+3);
 	bcastParallel((*table)->values-1, valuesSize, 0);
+
+	if (getMyRank() != 0)
+		initInterpolationCoef(*table);
 }
 
 void printTableData(InterpolationObject* table, const char* fileName)
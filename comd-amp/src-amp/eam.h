@@ -31,6 +31,7 @@ typedef struct InterpolationObjectSt
    real_t x0;      //!< the starting ordinate range
    real_t invDx;   //!< the inverse of the table spacing
    real_t* values; //!< the abscissa values
+   real_t* coef;   //!< four interpolation coefficients per interval
 } InterpolationObject;
 
 /// Derived struct for an EAM potential.
@@ -54,9 +55,16 @@ typedef struct EamPotentialSt
 
    real_t* rhobar;        //!< per atom storage for rhobar
    real_t* dfEmbed;       //!< per atom storage for derivative of Embedding
+   int nSlots;            //!< atom slots the per atom storage is sized for
    HaloExchange* forceExchange;
    ForceExchangeData* forceExchangeData;
+   struct EamDeviceSt* device; //!< device copies of the per atom storage and tables
+   int overlap;           //!< overlap the embedding force with the force exchange
+   int maxPairs;          //!< pairs cached per atom by eamForceFused
+   int pairAtoms;         //!< atoms cached per block of boxes by eamForceFused
+   int blockPairs;        //!< pair cache entries per block of boxes
 } EamPotential;
 
-struct BasePotentialSt* initEamPot(const char* dir, const char* file, const char* type);
+struct BasePotentialSt* initEamPot(const char* dir, const char* file, const char* type,
+                                   int halfShell, int soa, int overlap, int fused);
 #endif
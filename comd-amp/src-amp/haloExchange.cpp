@@ -73,6 +73,15 @@ typedef struct ForceExchangeParmsSt
 }
 ForceExchangeParms;
 
+typedef struct PositionExchangeParmsSt
+{
+   int nCells[6];        //!< Number of cells to send/recv for each face.
+   int* sendCells[6];    //!< List of link cells to send for each face.
+   int* recvCells[6];    //!< List of link cells to recv for each face.
+   real_t* pbcFactor[6]; //!< Whether this face is a periodic boundary.
+}
+PositionExchangeParms;
+
 /// A structure to package data for a single atom to pack into a
 /// send/recv buffer.  Also used for sorting atoms within link cells.
 typedef struct AtomMsgSt
@@ -91,20 +100,37 @@ typedef struct ForceMsgSt
 }
 ForceMsg;
 
+typedef struct PositionMsgSt
+{
+   real_t rx, ry, rz;
+}
+PositionMsg;
+
 static HaloExchange* initHaloExchange(Domain* domain);
-static void exchangeData(HaloExchange* haloExchange, void* data, int iAxis);
+static void startAxis(HaloExchange* haloExchange, void* data, int iAxis);
+static void finishAxis(HaloExchange* haloExchange, void* data);
+
+static int countAtoms(LinkCell* boxes, int nCells, const int* cellList);
 
 static int* mkAtomCellList(LinkCell* boxes, enum HaloFaceOrder iFace, const int nCells);
+static int atomsBufferSize(void* vparms, void* data, int face, int recv);
 static int loadAtomsBuffer(void* vparms, void* data, int face, char* charBuf);
 static void unloadAtomsBuffer(void* vparms, void* data, int face, int bufSize, char* charBuf);
 static void destroyAtomsExchange(void* vparms);
 
 static int* mkForceSendCellList(LinkCell* boxes, int face, int nCells);
 static int* mkForceRecvCellList(LinkCell* boxes, int face, int nCells);
+static int forceBufferSize(void* vparms, void* data, int face, int recv);
 static int loadForceBuffer(void* vparms, void* data, int face, char* charBuf);
 static void unloadForceBuffer(void* vparms, void* data, int face, int bufSize, char* charBuf);
 static void destroyForceExchange(void* vparms);
-static int sortAtomsById(const void* a, const void* b);
+
+static int positionBufferSize(void* vparms, void* data, int face, int recv);
+static int loadPositionBuffer(void* vparms, void* data, int face, char* charBuf);
+static void unloadPositionBuffer(void* vparms, void* data, int face, int bufSize, char* charBuf);
+static void destroyPositionExchange(void* vparms);
+
+static void initPbcFactor(Domain* domain, real_t* pbcFactor[6]);
 
 /// \details
 /// When called in proper sequence by redistributeAtoms, the atom halo
@@ -121,9 +147,9 @@ static int sortAtomsById(const void* a, const void* b);
 ///
 /// This constructor does the following:
 ///
-/// - Sets the bufCapacity to hold the largest possible number of atoms
-///   that can be sent across a face.
-/// - Initialize function pointers to the atom-specific versions
+/// - Initialize function pointers to the atom-specific versions.  The
+///   receiver can't know how many atoms will arrive, so the sizes of
+///   the messages are exchanged first (see startAxis).
 /// - Sets the number of link cells to send across each face.
 /// - Builds the list of link cells to send across each face.  As
 ///   explained in the comments for mkAtomCellList, this list must
@@ -146,13 +172,7 @@ HaloExchange* initAtomHaloExchange(Domain* domain, LinkCell* boxes)
 {
    HaloExchange* hh = initHaloExchange(domain);
    
-   int size0 = (boxes->gridSize[1]+2)*(boxes->gridSize[2]+2);
-   int size1 = (boxes->gridSize[0]+2)*(boxes->gridSize[2]+2);
-   int size2 = (boxes->gridSize[0]+2)*(boxes->gridSize[1]+2);
-   int maxSize = MAX(size0, size1);
-   maxSize = MAX(size1, size2);
-   hh->bufCapacity = maxSize*2*MAXATOMS*sizeof(AtomMsg);
-   
+   hh->bufferSize = atomsBufferSize;
    hh->loadBuffer = loadAtomsBuffer;
    hh->unloadBuffer = unloadAtomsBuffer;
    hh->destroy = destroyAtomsExchange;
@@ -169,20 +189,7 @@ HaloExchange* initAtomHaloExchange(Domain* domain, LinkCell* boxes)
    for (int ii=0; ii<6; ++ii)
       parms->cellList[ii] = mkAtomCellList(boxes, (HaloFaceOrder) ii, parms->nCells[ii]);
 
-   for (int ii=0; ii<6; ++ii)
-   {
-      parms->pbcFactor[ii] = (real_t *) comdMalloc(3*sizeof(real_t));
-      for (int jj=0; jj<3; ++jj)
-         parms->pbcFactor[ii][jj] = 0.0;
-   }
-   int* procCoord = domain->procCoord; //alias
-   int* procGrid  = domain->procGrid; //alias
-   if (procCoord[HALO_X_AXIS] == 0)                       parms->pbcFactor[HALO_X_MINUS][HALO_X_AXIS] = +1.0;
-   if (procCoord[HALO_X_AXIS] == procGrid[HALO_X_AXIS]-1) parms->pbcFactor[HALO_X_PLUS][HALO_X_AXIS]  = -1.0;
-   if (procCoord[HALO_Y_AXIS] == 0)                       parms->pbcFactor[HALO_Y_MINUS][HALO_Y_AXIS] = +1.0;
-   if (procCoord[HALO_Y_AXIS] == procGrid[HALO_Y_AXIS]-1) parms->pbcFactor[HALO_Y_PLUS][HALO_Y_AXIS]  = -1.0;
-   if (procCoord[HALO_Z_AXIS] == 0)                       parms->pbcFactor[HALO_Z_MINUS][HALO_Z_AXIS] = +1.0;
-   if (procCoord[HALO_Z_AXIS] == procGrid[HALO_Z_AXIS]-1) parms->pbcFactor[HALO_Z_PLUS][HALO_Z_AXIS]  = -1.0;
+   initPbcFactor(domain, parms->pbcFactor);
    
    hh->parms = parms;
    return hh;
@@ -207,17 +214,11 @@ HaloExchange* initForceHaloExchange(Domain* domain, LinkCell* boxes)
 {
    HaloExchange* hh = initHaloExchange(domain);
 
+   hh->bufferSize = forceBufferSize;
    hh->loadBuffer = loadForceBuffer;
    hh->unloadBuffer = unloadForceBuffer;
    hh->destroy = destroyForceExchange;
 
-   int size0 = (boxes->gridSize[1])*(boxes->gridSize[2]);
-   int size1 = (boxes->gridSize[0]+2)*(boxes->gridSize[2]);
-   int size2 = (boxes->gridSize[0]+2)*(boxes->gridSize[1]+2);
-   int maxSize = MAX(size0, size1);
-   maxSize = MAX(size1, size2);
-   hh->bufCapacity = (maxSize)*MAXATOMS*sizeof(ForceMsg);
-
    ForceExchangeParms* parms = (ForceExchangeParms *) comdMalloc(sizeof(ForceExchangeParms));
 
    parms->nCells[HALO_X_MINUS] = (boxes->gridSize[1]  )*(boxes->gridSize[2]  );
@@ -237,18 +238,95 @@ HaloExchange* initForceHaloExchange(Domain* domain, LinkCell* boxes)
    return hh;
 }
 
+/// The position exchange refreshes the coordinates of the halo atoms
+/// without moving any atom between link cells.  It is only valid while
+/// every link cell holds the same atoms in the same order as after the
+/// last atom exchange, which is the case between rebuilds of the
+/// neighbor list (see redistributeAtoms).  Like the force exchange it
+/// sends the atoms of the local cells, plus the halo cells already
+/// filled along the previous axes, and the receiver writes them into
+/// the corresponding halo cells in order.  Coordinates sent across a
+/// periodic boundary are shifted as in the atom exchange.
+///
+/// \see initForceHaloExchange
+/// \see initAtomHaloExchange
+HaloExchange* initPositionHaloExchange(Domain* domain, LinkCell* boxes)
+{
+   HaloExchange* hh = initHaloExchange(domain);
+
+   hh->bufferSize = positionBufferSize;
+   hh->loadBuffer = loadPositionBuffer;
+   hh->unloadBuffer = unloadPositionBuffer;
+   hh->destroy = destroyPositionExchange;
+
+   PositionExchangeParms* parms = (PositionExchangeParms *) comdMalloc(sizeof(PositionExchangeParms));
+
+   parms->nCells[HALO_X_MINUS] = (boxes->gridSize[1]  )*(boxes->gridSize[2]  );
+   parms->nCells[HALO_Y_MINUS] = (boxes->gridSize[0]+2)*(boxes->gridSize[2]  );
+   parms->nCells[HALO_Z_MINUS] = (boxes->gridSize[0]+2)*(boxes->gridSize[1]+2);
+   parms->nCells[HALO_X_PLUS]  = parms->nCells[HALO_X_MINUS];
+   parms->nCells[HALO_Y_PLUS]  = parms->nCells[HALO_Y_MINUS];
+   parms->nCells[HALO_Z_PLUS]  = parms->nCells[HALO_Z_MINUS];
+
+   for (int ii=0; ii<6; ++ii)
+   {
+      parms->sendCells[ii] = mkForceSendCellList(boxes, ii, parms->nCells[ii]);
+      parms->recvCells[ii] = mkForceRecvCellList(boxes, ii, parms->nCells[ii]);
+   }
+   initPbcFactor(domain, parms->pbcFactor);
+
+   hh->parms = parms;
+   return hh;
+}
+
 void destroyHaloExchange(HaloExchange** haloExchange)
 {
-   (*haloExchange)->destroy((*haloExchange)->parms);
-   comdFree((*haloExchange)->parms);
-   comdFree(*haloExchange);
+   HaloExchange* hh = *haloExchange;
+   assert(hh->axis == 3);
+   hh->destroy(hh->parms);
+   comdFree(hh->parms);
+   for (int ii=0; ii<2; ++ii)
+   {
+      comdFree(hh->sendBuf[ii]);
+      comdFree(hh->recvBuf[ii]);
+   }
+   destroyCommRequests(&hh->requests);
+   comdFree(hh);
    *haloExchange = NULL;
 }
 
 void haloExchange(HaloExchange* haloExchange, void* data)
 {
-   for (int iAxis=0; iAxis<3; ++iAxis)
-      exchangeData(haloExchange, data, iAxis);
+   startHaloExchange(haloExchange, data);
+   finishHaloExchange(haloExchange, data);
+}
+
+/// The axes are still exchanged one after the other, since an axis
+/// forwards data received along the previous ones.  Calling
+/// testHaloExchange from time to time while other work is done lets an
+/// axis start as soon as the previous one has arrived.
+void startHaloExchange(HaloExchange* haloExchange, void* data)
+{
+   assert(haloExchange->axis == 3);
+   startAxis(haloExchange, data, 0);
+}
+
+int testHaloExchange(HaloExchange* haloExchange, void* data)
+{
+   while (haloExchange->axis < 3 && testAllParallel(haloExchange->requests))
+      finishAxis(haloExchange, data);
+   return haloExchange->axis == 3;
+}
+
+void finishHaloExchange(HaloExchange* haloExchange, void* data)
+{
+   while (haloExchange->axis < 3)
+   {
+      startTimer(commHaloTimer);
+      waitAllParallel(haloExchange->requests);
+      stopTimer(commHaloTimer);
+      finishAxis(haloExchange, data);
+   }
 }
 
 /// Base class constructor.
@@ -263,48 +341,138 @@ HaloExchange* initHaloExchange(Domain* domain)
    hh->nbrRank[HALO_Y_PLUS]  = processorNum(domain,  0, +1,  0);
    hh->nbrRank[HALO_Z_MINUS] = processorNum(domain,  0,  0, -1);
    hh->nbrRank[HALO_Z_PLUS]  = processorNum(domain,  0,  0, +1);
-   hh->bufCapacity = 0; // will be set by sub-class.
+   hh->bufCapacity = 0; // grown by startAxis
+   for (int ii=0; ii<2; ++ii)
+   {
+      hh->sendBuf[ii] = NULL;
+      hh->recvBuf[ii] = NULL;
+   }
+   hh->requests = initCommRequests(4);
+   hh->axis = 3;
 
    return hh;
 }
 
-/// This is the function that does the heavy lifting for the
-/// communication of halo data.  It is called once for each axis and
-/// sends and receives two message.  Loading and unloading of the
-/// buffers is in the hands of the sub-class virtual functions.
+/// Loads the send buffers of both faces of an axis and posts both
+/// receives and both sends at once.  Each message is tagged with the
+/// face it is sent across, so the two messages of an axis cannot be
+/// mixed up when both neighbors are the same task.  Loading and
+/// unloading of the buffers is in the hands of the sub-class virtual
+/// functions.
+///
+/// The buffers are sized from the messages of the axis, since the link
+/// cells have no fixed capacity.  When the receiver can't work out the
+/// size of a message the two neighbors swap the sizes first, which
+/// costs one more round trip per axis.
 ///
 /// \param [in] iAxis     Axis index.
 /// \param [in, out] data Pointer to data that will be passed to the load and
 ///                       unload functions
-void exchangeData(HaloExchange* haloExchange, void* data, int iAxis)
+void startAxis(HaloExchange* haloExchange, void* data, int iAxis)
 {
    enum HaloFaceOrder faceM = (HaloFaceOrder) (2*iAxis);
    enum HaloFaceOrder faceP = (HaloFaceOrder) (faceM+1);
+   void* parms = haloExchange->parms;
 
-   char* sendBufM = (char *) comdMalloc(haloExchange->bufCapacity);
-   char* sendBufP = (char *) comdMalloc(haloExchange->bufCapacity);
-   char* recvBufM = (char *) comdMalloc(haloExchange->bufCapacity);
-   char* recvBufP = (char *) comdMalloc(haloExchange->bufCapacity);
+   int sizeSendM = haloExchange->bufferSize(parms, data, faceM, 0);
+   int sizeSendP = haloExchange->bufferSize(parms, data, faceP, 0);
+   int sizeRecvM = haloExchange->bufferSize(parms, data, faceM, 1);
+   int sizeRecvP = haloExchange->bufferSize(parms, data, faceP, 1);
+   if (sizeRecvM < 0 || sizeRecvP < 0)
+   {
+      startTimer(commHaloTimer);
+      sendReceiveParallel(&sizeSendM, sizeof(int), haloExchange->nbrRank[faceM],
+                          &sizeRecvP, sizeof(int), haloExchange->nbrRank[faceP]);
+      sendReceiveParallel(&sizeSendP, sizeof(int), haloExchange->nbrRank[faceP],
+                          &sizeRecvM, sizeof(int), haloExchange->nbrRank[faceM]);
+      stopTimer(commHaloTimer);
+   }
 
-   int nSendM = haloExchange->loadBuffer(haloExchange->parms, data, faceM, sendBufM);
-   int nSendP = haloExchange->loadBuffer(haloExchange->parms, data, faceP, sendBufP);
+   int needed = MAX(MAX(sizeSendM, sizeSendP), MAX(sizeRecvM, sizeRecvP));
+   if (haloExchange->sendBuf[0] == NULL || needed > haloExchange->bufCapacity)
+   {
+      haloExchange->bufCapacity = MAX(needed, 1);
+      for (int ii=0; ii<2; ++ii)
+      {
+         comdFree(haloExchange->sendBuf[ii]);
+         comdFree(haloExchange->recvBuf[ii]);
+         haloExchange->sendBuf[ii] = (char *) comdMalloc(haloExchange->bufCapacity);
+         haloExchange->recvBuf[ii] = (char *) comdMalloc(haloExchange->bufCapacity);
+      }
+   }
+   char* sendBufM = haloExchange->sendBuf[0];
+   char* sendBufP = haloExchange->sendBuf[1];
+   char* recvBufM = haloExchange->recvBuf[0];
+   char* recvBufP = haloExchange->recvBuf[1];
+
+   int nSendM = haloExchange->loadBuffer(parms, data, faceM, sendBufM);
+   int nSendP = haloExchange->loadBuffer(parms, data, faceP, sendBufP);
+   assert(nSendM == sizeSendM && nSendP == sizeSendP);
 
    int nbrRankM = haloExchange->nbrRank[faceM];
    int nbrRankP = haloExchange->nbrRank[faceP];
+   CommRequests* requests = haloExchange->requests;
 
-   int nRecvM, nRecvP;
-
+   // the plus neighbor sends across its minus face and vice versa
    startTimer(commHaloTimer);
-   nRecvP = sendReceiveParallel(sendBufM, nSendM, nbrRankM, recvBufP, haloExchange->bufCapacity, nbrRankP);
-   nRecvM = sendReceiveParallel(sendBufP, nSendP, nbrRankP, recvBufM, haloExchange->bufCapacity, nbrRankM);
+   irecvParallel(recvBufM, sizeRecvM, nbrRankM, faceP, requests, 0);
+   irecvParallel(recvBufP, sizeRecvP, nbrRankP, faceM, requests, 1);
+   isendParallel(sendBufM, nSendM, nbrRankM, faceM, requests, 2);
+   isendParallel(sendBufP, nSendP, nbrRankP, faceP, requests, 3);
    stopTimer(commHaloTimer);
-   
-   haloExchange->unloadBuffer(haloExchange->parms, data, faceM, nRecvM, recvBufM);
-   haloExchange->unloadBuffer(haloExchange->parms, data, faceP, nRecvP, recvBufP);
-   comdFree(recvBufP);
-   comdFree(recvBufM);
-   comdFree(sendBufP);
-   comdFree(sendBufM);
+
+   haloExchange->axis = iAxis;
+}
+
+/// Unloads the receive buffers of the axis in flight, whose messages
+/// must have completed, and starts the next axis.
+void finishAxis(HaloExchange* haloExchange, void* data)
+{
+   int iAxis = haloExchange->axis;
+   enum HaloFaceOrder faceM = (HaloFaceOrder) (2*iAxis);
+   enum HaloFaceOrder faceP = (HaloFaceOrder) (faceM+1);
+
+   int nRecvM = recvCountParallel(haloExchange->requests, 0);
+   int nRecvP = recvCountParallel(haloExchange->requests, 1);
+
+   haloExchange->unloadBuffer(haloExchange->parms, data, faceM, nRecvM, haloExchange->recvBuf[0]);
+   haloExchange->unloadBuffer(haloExchange->parms, data, faceP, nRecvP, haloExchange->recvBuf[1]);
+
+   haloExchange->axis = 3;
+   if (iAxis < 2)
+      startAxis(haloExchange, data, iAxis+1);
+}
+
+/// \return The number of atoms in the link cells of cellList.
+int countAtoms(LinkCell* boxes, int nCells, const int* cellList)
+{
+   int n = 0;
+   for (int iCell=0; iCell<nCells; ++iCell)
+      n += boxes->nAtoms[cellList[iCell]];
+   return n;
+}
+
+/// Allocate and set the periodic boundary factors of each face.  The
+/// factor is zero except along the axis of a face that is on the
+/// boundary of the simulation domain.
+///
+/// \see initAtomHaloExchange
+void initPbcFactor(Domain* domain, real_t* pbcFactor[6])
+{
+   for (int ii=0; ii<6; ++ii)
+   {
+      pbcFactor[ii] = (real_t *) comdMalloc(3*sizeof(real_t));
+      for (int jj=0; jj<3; ++jj)
+         pbcFactor[ii][jj] = 0.0;
+   }
+   int* procCoord = domain->procCoord; //alias
+   int* procGrid  = domain->procGrid; //alias
+   if (procCoord[HALO_X_AXIS] == 0)                       pbcFactor[HALO_X_MINUS][HALO_X_AXIS] = +1.0;
+   if (procCoord[HALO_X_AXIS] == procGrid[HALO_X_AXIS]-1) pbcFactor[HALO_X_PLUS][HALO_X_AXIS]  = -1.0;
+   if (procCoord[HALO_Y_AXIS] == 0)                       pbcFactor[HALO_Y_MINUS][HALO_Y_AXIS] = +1.0;
+   if (procCoord[HALO_Y_AXIS] == procGrid[HALO_Y_AXIS]-1) pbcFactor[HALO_Y_PLUS][HALO_Y_AXIS]  = -1.0;
+   if (procCoord[HALO_Z_AXIS] == 0)                       pbcFactor[HALO_Z_MINUS][HALO_Z_AXIS] = +1.0;
+   if (procCoord[HALO_Z_AXIS] == procGrid[HALO_Z_AXIS]-1) pbcFactor[HALO_Z_PLUS][HALO_Z_AXIS]  = -1.0;
 }
 
 /// Make a list of link cells that need to be sent across the specified
@@ -352,6 +520,20 @@ int* mkAtomCellList(LinkCell* boxes, enum HaloFaceOrder iFace, const int nCells)
    return list;
 }
 
+/// The bufferSize function for a halo exchange of atom data.  The atoms
+/// that arrive depend on where they have moved on the sending task, so
+/// the size of a receive is unknown.
+///
+/// \see HaloExchangeSt::bufferSize
+int atomsBufferSize(void* vparms, void* data, int face, int recv)
+{
+   AtomExchangeParms* parms = (AtomExchangeParms*) vparms;
+   SimFlat* s = (SimFlat*) data;
+   if (recv)
+      return -1;
+   return countAtoms(s->boxes, parms->nCells[face], parms->cellList[face])*sizeof(AtomMsg);
+}
+
 /// The loadBuffer function for a halo exchange of atom data.  Iterates
 /// link cells in the cellList and load any atoms into the send buffer.
 /// This function also shifts coordinates of the atoms by an appropriate
@@ -377,7 +559,7 @@ int loadAtomsBuffer(void* vparms, void* data, int face, char* charBuf)
    for (int iCell=0; iCell<nCells; ++iCell)
    {
       int iBox = cellList[iCell];
-      int iOff = iBox*MAXATOMS;
+      int iOff = s->boxes->boxOffset[iBox];
       for (int ii=iOff; ii<iOff+s->boxes->nAtoms[iBox]; ++ii)
       {
          buf[nBuf].gid  = s->atoms->gid[ii];
@@ -535,6 +717,19 @@ int* mkForceRecvCellList(LinkCell* boxes, int face, int nCells)
    return list;
 }
 
+/// The bufferSize function for a force exchange.  The halo cells hold
+/// the same atoms as the cells that are sent to them, so both sizes are
+/// known locally.
+///
+/// \see HaloExchangeSt::bufferSize
+int forceBufferSize(void* vparms, void* vdata, int face, int recv)
+{
+   ForceExchangeParms* parms = (ForceExchangeParms*) vparms;
+   ForceExchangeData* data = (ForceExchangeData*) vdata;
+   int* cellList = recv ? parms->recvCells[face] : parms->sendCells[face];
+   return countAtoms(data->boxes, parms->nCells[face], cellList)*sizeof(ForceMsg);
+}
+
 /// The loadBuffer function for a force exchange.
 /// Iterate the send list and load the derivative of the embedding
 /// energy with respect to the local density into the send buffer.
@@ -553,7 +748,7 @@ int loadForceBuffer(void* vparms, void* vdata, int face, char* charBuf)
    for (int iCell=0; iCell<nCells; ++iCell)
    {
       int iBox = cellList[iCell];
-      int iOff = iBox*MAXATOMS;
+      int iOff = data->boxes->boxOffset[iBox];
       for (int ii=iOff; ii<iOff+data->boxes->nAtoms[iBox]; ++ii)
       {
          buf[nBuf].dfEmbed = data->dfEmbed[ii];
@@ -582,7 +777,7 @@ void unloadForceBuffer(void* vparms, void* vdata, int face, int bufSize, char* c
    for (int iCell=0; iCell<nCells; ++iCell)
    {
       int iBox = cellList[iCell];
-      int iOff = iBox*MAXATOMS;
+      int iOff = data->boxes->boxOffset[iBox];
       for (int ii=iOff; ii<iOff+data->boxes->nAtoms[iBox]; ++ii)
       {
          data->dfEmbed[ii] = buf[iBuf].dfEmbed;
@@ -603,61 +798,90 @@ void destroyForceExchange(void* vparms)
    }
 }
 
-/// \details
-/// The force exchange assumes that the atoms are in the same order in
-/// both a given local link cell and the corresponding remote cell(s).
-/// However, the atom exchange does not guarantee this property,
-/// especially when atoms cross a domain decomposition boundary and move
-/// from one task to another.  Trying to maintain the atom order during
-/// the atom exchange would immensely complicate that code.  Instead, we
-/// just sort the atoms after the atom exchange.
-void sortAtomsInCell(Atoms* atoms, LinkCell* boxes, int iBox)
-{
-   int nAtoms = boxes->nAtoms[iBox];
-
-   AtomMsg tmp[nAtoms];
-
-   int begin = iBox*MAXATOMS;
-   int end = begin + nAtoms;
-   for (int ii=begin, iTmp=0; ii<end; ++ii, ++iTmp)
+/// The bufferSize function for a position exchange, see
+/// forceBufferSize.
+int positionBufferSize(void* vparms, void* data, int face, int recv)
+{
+   PositionExchangeParms* parms = (PositionExchangeParms*) vparms;
+   SimFlat* s = (SimFlat*) data;
+   int* cellList = recv ? parms->recvCells[face] : parms->sendCells[face];
+   return countAtoms(s->boxes, parms->nCells[face], cellList)*sizeof(PositionMsg);
+}
+
+/// The loadBuffer function for a position exchange.  Iterates the send
+/// list and loads the shifted coordinates of the atoms.
+///
+/// \see HaloExchangeSt::loadBuffer for an explanation of the loadBuffer
+/// parameters.
+int loadPositionBuffer(void* vparms, void* data, int face, char* charBuf)
+{
+   PositionExchangeParms* parms = (PositionExchangeParms*) vparms;
+   SimFlat* s = (SimFlat*) data;
+   PositionMsg* buf = (PositionMsg*) charBuf;
+
+   real_t* pbcFactor = parms->pbcFactor[face];
+   real3 shift;
+   shift[0] = pbcFactor[0] * s->domain->globalExtent[0];
+   shift[1] = pbcFactor[1] * s->domain->globalExtent[1];
+   shift[2] = pbcFactor[2] * s->domain->globalExtent[2];
+
+   int nCells = parms->nCells[face];
+   int* cellList = parms->sendCells[face];
+   int nBuf = 0;
+   for (int iCell=0; iCell<nCells; ++iCell)
    {
-      tmp[iTmp].gid  = atoms->gid[ii];
-      tmp[iTmp].type = atoms->iSpecies[ii];
-      tmp[iTmp].rx =   atoms->r[ii*3 + 0];
-      tmp[iTmp].ry =   atoms->r[ii*3 + 1];
-      tmp[iTmp].rz =   atoms->r[ii*3 + 2];
-      tmp[iTmp].px =   atoms->p[ii*3 + 0];
-      tmp[iTmp].py =   atoms->p[ii*3 + 1];
-      tmp[iTmp].pz =   atoms->p[ii*3 + 2];
+      int iBox = cellList[iCell];
+      int iOff = s->boxes->boxOffset[iBox];
+      for (int ii=iOff; ii<iOff+s->boxes->nAtoms[iBox]; ++ii)
+      {
+         buf[nBuf].rx = s->atoms->r[ii*3 + 0] + shift[0];
+         buf[nBuf].ry = s->atoms->r[ii*3 + 1] + shift[1];
+         buf[nBuf].rz = s->atoms->r[ii*3 + 2] + shift[2];
+         ++nBuf;
+      }
    }
-   qsort(&tmp, nAtoms, sizeof(AtomMsg), sortAtomsById);
-   for (int ii=begin, iTmp=0; ii<end; ++ii, ++iTmp)
+   return nBuf*sizeof(PositionMsg);
+}
+
+/// The unloadBuffer function for a position exchange.  As with the
+/// force exchange the data arrives in the order of the atom storage.
+///
+/// \see HaloExchangeSt::unloadBuffer for an explanation of the
+/// unloadBuffer parameters.
+void unloadPositionBuffer(void* vparms, void* data, int face, int bufSize, char* charBuf)
+{
+   PositionExchangeParms* parms = (PositionExchangeParms*) vparms;
+   SimFlat* s = (SimFlat*) data;
+   PositionMsg* buf = (PositionMsg*) charBuf;
+   assert(bufSize % sizeof(PositionMsg) == 0);
+
+   int nCells = parms->nCells[face];
+   int* cellList = parms->recvCells[face];
+   int iBuf = 0;
+   for (int iCell=0; iCell<nCells; ++iCell)
    {
-      atoms->gid[ii]   = tmp[iTmp].gid;
-      atoms->iSpecies[ii] = tmp[iTmp].type;
-      atoms->r[ii*3 + 0]  = tmp[iTmp].rx;
-      atoms->r[ii*3 + 1]  = tmp[iTmp].ry;
-      atoms->r[ii*3 + 2]  = tmp[iTmp].rz;
-      atoms->p[ii*3 + 0]  = tmp[iTmp].px;
-      atoms->p[ii*3 + 1]  = tmp[iTmp].py;
-      atoms->p[ii*3 + 2]  = tmp[iTmp].pz;
+      int iBox = cellList[iCell];
+      int iOff = s->boxes->boxOffset[iBox];
+      for (int ii=iOff; ii<iOff+s->boxes->nAtoms[iBox]; ++ii)
+      {
+         s->atoms->r[ii*3 + 0] = buf[iBuf].rx;
+         s->atoms->r[ii*3 + 1] = buf[iBuf].ry;
+         s->atoms->r[ii*3 + 2] = buf[iBuf].rz;
+         ++iBuf;
+      }
    }
-   
+   assert((size_t) iBuf == bufSize/ sizeof(PositionMsg));
 }
 
-///  A function suitable for passing to qsort to sort atoms by gid.
-///  Because every atom in the simulation is supposed to have a unique
-///  id, this function checks that the atoms have different gids.  If
-///  that assertion ever fails it is a sign that something has gone
-///  wrong elsewhere in the code.
-int sortAtomsById(const void* a, const void* b)
+void destroyPositionExchange(void* vparms)
 {
-   int aId = ((AtomMsg*) a)->gid;
-   int bId = ((AtomMsg*) b)->gid;
-   assert(aId != bId);
+   PositionExchangeParms* parms = (PositionExchangeParms*) vparms;
 
-   if (aId < bId)
-      return -1;
-   return 1;
+   for (int ii=0; ii<6; ++ii)
+   {
+      comdFree(parms->pbcFactor[ii]);
+      comdFree(parms->sendCells[ii]);
+      comdFree(parms->recvCells[ii]);
+   }
 }
 
@@ -29,9 +29,24 @@ typedef struct HaloExchangeSt
    /// The MPI ranks of the six face neighbors of the local domain.
    /// Ranks are stored in the order specified in HaloFaceOrder.
    int nbrRank[6];
-   /// The maximum send/recv buffer size (in bytes) that will be needed
-   /// for this halo exchange.
+   /// The size (in bytes) of each send/recv buffer.  Grown when an axis
+   /// needs more.
    int bufCapacity;
+   /// Send and recv buffers of bufCapacity bytes for the minus and plus
+   /// face of an axis.  Allocated on the first exchange, reallocated
+   /// when they are too small and kept until the HaloExchange is
+   /// destroyed.
+   char* sendBuf[2];
+   char* recvBuf[2];
+   /// The two sends and two receives of the axis in flight.
+   struct CommRequestsSt* requests;
+   /// The axis whose messages are in flight, 3 when none are.
+   int axis;
+   /// Pointer to a sub-class specific function that returns the size (in
+   /// bytes) of the message sent across a face, or with recv set of the
+   /// message received across it.  A receive whose size only the sender
+   /// knows returns -1, and the sizes are sent ahead of the messages.
+   int  (*bufferSize)(void* parms, void* data, int face, int recv);
    /// Pointer to a sub-class specific function to load the send buffer.
    /// \param [in] parms The parms member of the structure.  This is a
    ///                   pointer to a sub-class specific structure that can
@@ -75,13 +90,23 @@ HaloExchange* initAtomHaloExchange(struct DomainSt* domain, struct LinkCellSt* b
 /// Create a HaloExchange for force data.
 HaloExchange* initForceHaloExchange(struct DomainSt* domain, struct LinkCellSt* boxes);
 
+/// Create a HaloExchange that refreshes the halo atom positions only.
+HaloExchange* initPositionHaloExchange(struct DomainSt* domain, struct LinkCellSt* boxes);
+
 /// HaloExchange destructor.
 void destroyHaloExchange(HaloExchange** haloExchange);
 
 /// Execute a halo exchange.
 void haloExchange(HaloExchange* haloExchange, void* data);
 
-/// Sort the atoms by gid in the specified link cell.
-void sortAtomsInCell(struct AtomsSt* atoms, struct LinkCellSt* boxes, int iBox);
+/// Start a halo exchange: load and post the messages of the x axis.
+void startHaloExchange(HaloExchange* haloExchange, void* data);
+
+/// Unload the axis in flight if its messages have arrived and post the
+/// next axis.  Returns non-zero once the whole exchange is complete.
+int testHaloExchange(HaloExchange* haloExchange, void* data);
+
+/// Complete a halo exchange started by startHaloExchange.
+void finishHaloExchange(HaloExchange* haloExchange, void* data);
 
 #endif
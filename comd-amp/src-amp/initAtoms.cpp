@@ -35,6 +35,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "initAtoms.h"
 
 #include <math.h>
+#include <string.h>
 #include <assert.h>
 
 #include "constants.h"
@@ -46,6 +47,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "memUtils.h"
 #include "performanceTimers.h"
 
+/// Alignment of the structure of arrays copies.  Box capacities are
+/// multiples of BOX_ALIGN slots, so every link cell starts on a vector
+/// boundary.
+#define SOA_ALIGN 64
+
 static void computeVcm(SimFlat* s, real_t vcm[3]);
 
 /// \details
@@ -55,7 +61,32 @@ Atoms* initAtoms(LinkCell* boxes)
 {
    Atoms* atoms = (Atoms *) comdMalloc(sizeof(Atoms));
 
-   int maxTotalAtoms = MAXATOMS*boxes->nTotalBoxes;
+   allocAtomArrays(atoms, boxes);
+
+   atoms->rx = NULL;
+   atoms->ry = NULL;
+   atoms->rz = NULL;
+   atoms->fx = NULL;
+   atoms->fy = NULL;
+   atoms->fz = NULL;
+
+   atoms->nLocal = 0;
+   atoms->nGlobal = 0;
+
+   return atoms;
+}
+
+/// \details
+/// Memory pages are placed on the NUMA node of the thread that first
+/// writes them.  The arrays are zeroed here box by box, in the same
+/// statically scheduled loop over boxes as the integrator and the
+/// energy sums, so each thread's boxes end up on its own socket.  With
+/// a space filling curve box order (see initLinkCells) a thread's boxes
+/// are also close together in space, and most of their neighbor boxes
+/// are on the same socket.
+void allocAtomArrays(Atoms* atoms, LinkCell* boxes)
+{
+   int maxTotalAtoms = boxes->nTotalSlots;
 
    atoms->gid =      (int*)    comdMalloc(maxTotalAtoms*sizeof(int));
    atoms->iSpecies = (int*)    comdMalloc(maxTotalAtoms*sizeof(int));
@@ -64,25 +95,29 @@ Atoms* initAtoms(LinkCell* boxes)
    atoms->f =        (real_t*) comdMalloc(maxTotalAtoms*sizeof(real_t)*3);
    atoms->U =        (real_t*) comdMalloc(maxTotalAtoms*sizeof(real_t));
 
-   atoms->nLocal = 0;
-   atoms->nGlobal = 0;
+   atoms->gidSpare =      (int*)    comdMalloc(maxTotalAtoms*sizeof(int));
+   atoms->iSpeciesSpare = (int*)    comdMalloc(maxTotalAtoms*sizeof(int));
+   atoms->rSpare =        (real_t*) comdMalloc(maxTotalAtoms*sizeof(real_t)*3);
+   atoms->pSpare =        (real_t*) comdMalloc(maxTotalAtoms*sizeof(real_t)*3);
+   assert(atoms->gid && atoms->iSpecies && atoms->r && atoms->p && atoms->f && atoms->U);
+   assert(atoms->gidSpare && atoms->iSpeciesSpare && atoms->rSpare && atoms->pSpare);
 
-   for (int iOff = 0; iOff < maxTotalAtoms; iOff++)
+   #pragma omp parallel for
+   for (int iBox=0; iBox<boxes->nTotalBoxes; iBox++)
    {
-      atoms->gid[iOff] = 0;
-      atoms->iSpecies[iOff] = 0;
-      //zeroReal3(atoms->r[iOff]);
-      //zeroReal3(atoms->p[iOff]);
-      //zeroReal3(atoms->f[iOff]);
-      atoms->U[iOff] = 0.;
-      for(int i = 0; i < 3; ++i){
-	atoms->r[iOff+i] = 0.;
-	atoms->p[iOff+i] = 0.;
-	atoms->f[iOff+i] = 0.;
-      }
+      int iOff = boxes->boxOffset[iBox];
+      int n = boxes->boxOffset[iBox+1] - iOff;
+      memset(atoms->gid+iOff,      0, n*sizeof(int));
+      memset(atoms->iSpecies+iOff, 0, n*sizeof(int));
+      memset(atoms->r+iOff*3,      0, n*sizeof(real3));
+      memset(atoms->p+iOff*3,      0, n*sizeof(real3));
+      memset(atoms->f+iOff*3,      0, n*sizeof(real3));
+      memset(atoms->U+iOff,        0, n*sizeof(real_t));
+      memset(atoms->gidSpare+iOff,      0, n*sizeof(int));
+      memset(atoms->iSpeciesSpare+iOff, 0, n*sizeof(int));
+      memset(atoms->rSpare+iOff*3,      0, n*sizeof(real3));
+      memset(atoms->pSpare+iOff*3,      0, n*sizeof(real3));
    }
-
-   return atoms;
 }
 
 void destroyAtoms(Atoms *atoms)
@@ -93,9 +128,136 @@ void destroyAtoms(Atoms *atoms)
    freeMe(atoms,p);
    freeMe(atoms,f);
    freeMe(atoms,U);
+   freeMe(atoms,gidSpare);
+   freeMe(atoms,iSpeciesSpare);
+   freeMe(atoms,rSpare);
+   freeMe(atoms,pSpare);
+   freeMe(atoms,rx);
+   freeMe(atoms,ry);
+   freeMe(atoms,rz);
+   freeMe(atoms,fx);
+   freeMe(atoms,fy);
+   freeMe(atoms,fz);
    comdFree(atoms);
 }
 
+/// The copies have the same slots per link cell as the other atom
+/// arrays, so an atom has the same index in both layouts.
+/// reserveLinkCells allocates them again when the link cells grow.
+void initAtomsSoa(Atoms* atoms, LinkCell* boxes)
+{
+   size_t size = boxes->nTotalSlots*sizeof(real_t);
+
+   atoms->rx = (real_t*) comdAlignedMalloc(SOA_ALIGN, size);
+   atoms->ry = (real_t*) comdAlignedMalloc(SOA_ALIGN, size);
+   atoms->rz = (real_t*) comdAlignedMalloc(SOA_ALIGN, size);
+   atoms->fx = (real_t*) comdAlignedMalloc(SOA_ALIGN, size);
+   atoms->fy = (real_t*) comdAlignedMalloc(SOA_ALIGN, size);
+   atoms->fz = (real_t*) comdAlignedMalloc(SOA_ALIGN, size);
+   assert(atoms->rx && atoms->ry && atoms->rz);
+   assert(atoms->fx && atoms->fy && atoms->fz);
+
+   // first touch by the threads that own the boxes, see allocAtomArrays
+   #pragma omp parallel for
+   for (int iBox=0; iBox<boxes->nTotalBoxes; iBox++)
+   {
+      int iOff = boxes->boxOffset[iBox];
+      int n = boxes->boxOffset[iBox+1] - iOff;
+      memset(atoms->rx+iOff, 0, n*sizeof(real_t));
+      memset(atoms->ry+iOff, 0, n*sizeof(real_t));
+      memset(atoms->rz+iOff, 0, n*sizeof(real_t));
+      memset(atoms->fx+iOff, 0, n*sizeof(real_t));
+      memset(atoms->fy+iOff, 0, n*sizeof(real_t));
+      memset(atoms->fz+iOff, 0, n*sizeof(real_t));
+   }
+}
+
+void gatherSoaPositions(Atoms* atoms, LinkCell* boxes)
+{
+   #pragma omp parallel for
+   for (int iBox=0; iBox<boxes->nTotalBoxes; iBox++)
+   {
+      for (int iOff=boxes->boxOffset[iBox],ii=0; ii<boxes->nAtoms[iBox]; ii++,iOff++)
+      {
+         atoms->rx[iOff] = atoms->r[iOff*3 + 0];
+         atoms->ry[iOff] = atoms->r[iOff*3 + 1];
+         atoms->rz[iOff] = atoms->r[iOff*3 + 2];
+      }
+   }
+}
+
+void scatterSoaForces(Atoms* atoms, LinkCell* boxes)
+{
+   #pragma omp parallel for
+   for (int iBox=0; iBox<boxes->nLocalBoxes; iBox++)
+   {
+      for (int iOff=boxes->boxOffset[iBox],ii=0; ii<boxes->nAtoms[iBox]; ii++,iOff++)
+      {
+         atoms->f[iOff*3 + 0] = atoms->fx[iOff];
+         atoms->f[iOff*3 + 1] = atoms->fy[iOff];
+         atoms->f[iOff*3 + 2] = atoms->fz[iOff];
+      }
+   }
+}
+
+/// Only about a sixth of the atoms in the neighbor boxes are inside the
+/// cutoff, so the SIMD force loops run over these lists instead of
+/// masking the atoms of each box.  The distances to the atoms of a box
+/// are computed in a vector loop.  The packing after it writes every
+/// atom and advances past the ones inside the cutoff, which avoids a
+/// mispredicted branch per atom.
+///
+/// The neighbor boxes are the half shell of ljForceHalf.  Atoms of
+/// local boxes, which get the equal and opposite force, go to jNewton
+/// and halo atoms go to jHalo.  Both lists need room for the atoms of
+/// 27 boxes, 27*maxCapacity entries.
+void packSoaNeighbors(Atoms* atoms, LinkCell* boxes, int iBox, int iOff,
+                      real_t rCut2, int* jNewton, int* nNewton,
+                      int* jHalo, int* nHalo)
+{
+   const int nNbrBoxes = 27;
+   real_t xi = atoms->rx[iOff];
+   real_t yi = atoms->ry[iOff];
+   real_t zi = atoms->rz[iOff];
+   real_t r2[boxes->maxCapacity];
+
+   *nNewton = 0;
+   *nHalo = 0;
+   for (int jTmp=0; jTmp<nNbrBoxes; jTmp++)
+   {
+      int jBox = boxes->nbrBoxes[iBox*nNbrBoxes + jTmp];
+      int newton = (jBox < boxes->nLocalBoxes);
+      // a local box behind iBox finds these pairs from its side
+      if (newton && jTmp < nNbrBoxes/2) continue;
+      int jBegin = (jBox == iBox) ? iOff+1 : boxes->boxOffset[jBox];
+      int nJ = boxes->boxOffset[jBox] + boxes->nAtoms[jBox] - jBegin;
+      const real_t* rx = atoms->rx + jBegin;
+      const real_t* ry = atoms->ry + jBegin;
+      const real_t* rz = atoms->rz + jBegin;
+
+      #pragma omp simd
+      for (int jj=0; jj<nJ; jj++)
+      {
+         real_t dx = xi - rx[jj];
+         real_t dy = yi - ry[jj];
+         real_t dz = zi - rz[jj];
+         r2[jj] = dx*dx + dy*dy + dz*dz;
+      }
+
+      int* jList = newton ? jNewton : jHalo;
+      int n = newton ? *nNewton : *nHalo;
+      for (int jj=0; jj<nJ; jj++)
+      {
+         jList[n] = jBegin + jj;
+         n += (r2[jj] <= rCut2 && r2[jj] > 0.0);
+      }
+      if (newton)
+         *nNewton = n;
+      else
+         *nHalo = n;
+   }
+}
+
 /// Creates atom positions on a face centered cubic (FCC) lattice with
 /// nx * ny * nz unit cells and lattice constant lat.
 /// Set momenta to zero.
@@ -158,7 +320,7 @@ void setVcm(SimFlat* s, real_t newVcm[3])
 
    for (int iBox=0; iBox<s->boxes->nLocalBoxes; ++iBox)
    {
-      for (int iOff=MAXATOMS*iBox, ii=0; ii<s->boxes->nAtoms[iBox]; ++ii, ++iOff)
+      for (int iOff=s->boxes->boxOffset[iBox], ii=0; ii<s->boxes->nAtoms[iBox]; ++ii, ++iOff)
       {
          int iSpecies = s->atoms->iSpecies[iOff];
          real_t mass = s->species[iSpecies].mass;
@@ -185,7 +347,7 @@ void setTemperature(SimFlat* s, real_t temperature)
    // set initial velocities for the distribution
    for (int iBox=0; iBox<s->boxes->nLocalBoxes; ++iBox)
    {
-      for (int iOff=MAXATOMS*iBox, ii=0; ii<s->boxes->nAtoms[iBox]; ++ii, ++iOff)
+      for (int iOff=s->boxes->boxOffset[iBox], ii=0; ii<s->boxes->nAtoms[iBox]; ++ii, ++iOff)
       {
          int iType = s->atoms->iSpecies[iOff];
          real_t mass = s->species[iType].mass;
@@ -207,7 +369,7 @@ void setTemperature(SimFlat* s, real_t temperature)
    real_t scaleFactor = sqrt(temperature/temp);
    for (int iBox=0; iBox<s->boxes->nLocalBoxes; ++iBox)
    {
-      for (int iOff=MAXATOMS*iBox, ii=0; ii<s->boxes->nAtoms[iBox]; ++ii, ++iOff)
+      for (int iOff=s->boxes->boxOffset[iBox], ii=0; ii<s->boxes->nAtoms[iBox]; ++ii, ++iOff)
       {
          s->atoms->p[iOff*3 + 0] *= scaleFactor;
          s->atoms->p[iOff*3 + 1] *= scaleFactor;
@@ -226,7 +388,7 @@ void randomDisplacements(SimFlat* s, real_t delta)
 {
    for (int iBox=0; iBox<s->boxes->nLocalBoxes; ++iBox)
    {
-      for (int iOff=MAXATOMS*iBox, ii=0; ii<s->boxes->nAtoms[iBox]; ++ii, ++iOff)
+      for (int iOff=s->boxes->boxOffset[iBox], ii=0; ii<s->boxes->nAtoms[iBox]; ++ii, ++iOff)
       {
          uint64_t seed = mkSeed(s->atoms->gid[iOff], 457);
          s->atoms->r[iOff*3 + 0] += (2.0*lcg61(&seed)-1.0) * delta;
@@ -245,7 +407,7 @@ void computeVcm(SimFlat* s, real_t vcm[3])
    // sum the momenta and particle masses 
    for (int iBox=0; iBox<s->boxes->nLocalBoxes; ++iBox)
    {
-      for (int iOff=MAXATOMS*iBox, ii=0; ii<s->boxes->nAtoms[iBox]; ++ii, ++iOff)
+      for (int iOff=s->boxes->boxOffset[iBox], ii=0; ii<s->boxes->nAtoms[iBox]; ++ii, ++iOff)
       {
          vcmLocal[0] += s->atoms->p[iOff*3 + 0];
          vcmLocal[1] += s->atoms->p[iOff*3 + 1];
@@ -54,12 +54,42 @@ typedef struct AtomsSt
    real_t* p;     //!< momenta of atoms
    real_t* f;     //!< forces 
    real_t* U;     //!< potential energy per atom
+
+   // Staging copies of the arrays that are moved when the atoms are
+   // rebinned.  updateLinkCells and sortAtomsByGid scatter the atoms
+   // that change slots into them and copy them back.
+   int* gidSpare;      //!< spare gid
+   int* iSpeciesSpare; //!< spare iSpecies
+   real_t* rSpare;     //!< spare r
+   real_t* pSpare;     //!< spare p
+
+   // Structure of arrays copies for the SIMD force loops.  NULL unless
+   // initAtomsSoa has been called.
+   real_t* rx;    //!< x positions
+   real_t* ry;    //!< y positions
+   real_t* rz;    //!< z positions
+   real_t* fx;    //!< x forces
+   real_t* fy;    //!< y forces
+   real_t* fz;    //!< z forces
 } Atoms;
 
 
 /// Allocates memory to store atom data.
 Atoms* initAtoms(struct LinkCellSt* boxes);
 void destroyAtoms(struct AtomsSt* atoms);
+/// Allocates the per slot atom arrays and places them by first touch.
+void allocAtomArrays(struct AtomsSt* atoms, struct LinkCellSt* boxes);
+
+/// Allocates the structure of arrays copies of the positions and forces.
+void initAtomsSoa(struct AtomsSt* atoms, struct LinkCellSt* boxes);
+/// Copies the positions of all atoms, local and halo, into rx, ry, rz.
+void gatherSoaPositions(struct AtomsSt* atoms, struct LinkCellSt* boxes);
+/// Copies fx, fy, fz of the local atoms back into f.
+void scatterSoaForces(struct AtomsSt* atoms, struct LinkCellSt* boxes);
+/// Lists the half shell neighbors of one atom that are inside a cutoff.
+void packSoaNeighbors(struct AtomsSt* atoms, struct LinkCellSt* boxes,
+                      int iBox, int iOff, real_t rCut2,
+                      int* jNewton, int* nNewton, int* jHalo, int* nHalo);
 
 void createFccLattice(int nx, int ny, int nz, real_t lat, struct SimFlatSt* s);
 
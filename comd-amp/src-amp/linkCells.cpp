@@ -69,26 +69,35 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /// cells we use the conventional mapping ix + iy*nx + iz*nx*ny.  This
 /// keeps all of the local cells in a contiguous region of memory
 /// starting from the beginning of any relevant array and makes it easy
-/// to iterate the local cells in a single loop.  Halo cells are mapped
-/// differently.  After the local cells, the two planes of link cells
-/// that are face neighbors with local cells across the -x or +x axis
-/// are next.  These are followed by face neighbors across the -y and +y
+/// to iterate the local cells in a single loop.  The local cells can
+/// instead be numbered along a Morton or Hilbert curve (boxOrder, see
+/// initBoxOrder), which keeps neighboring cells closer in memory; they
+/// still come first.  Halo cells are mapped differently.  After the
+/// local cells, the two planes of link cells that are face neighbors
+/// with local cells across the -x or +x axis are next.  These are followed by face neighbors across the -y and +y
 /// axis (including cells that are y-face neighbors with an x-plane of
 /// halo cells), followed by all remaining cells in the -z and +z planes
 /// of halo cells.  The total number of link cells (on each rank) is
 /// nTotalBoxes.
 ///
-/// Data storage arrays that are used in association with link cells
-/// should be allocated to store nTotalBoxes*MAXATOMS items.  Data for
-/// the first atom in linkCell iBox is stored at index iBox*MAXATOMS.
-/// Data for subsequent atoms in the same link cell are stored
-/// sequentially, and the number of atoms in link cell iBox is
-/// nAtoms[iBox].
+/// The atoms of each link cell are stored contiguously, in the same
+/// order as the link cells.  Link cell iBox owns the atom slots
+/// [boxOffset[iBox], boxOffset[iBox+1]); its first nAtoms[iBox] slots
+/// hold atoms and the rest are slack.  Data storage arrays that are
+/// used in association with link cells should be allocated to store
+/// nTotalSlots items, and the local atoms are the first nLocalSlots of
+/// them.  The capacity of a box starts from the expected number of
+/// atoms in it plus some slack and grows when an atom arrives at a full
+/// box (see reserveLinkCells), so very dense or very sparse regions
+/// don't need a fixed worst case size for every box.
 ///
 /// \see getBoxFromTuple is the 3D->1D mapping for link cell indices.
 /// \see getTuple is the 1D->3D mapping
 ///
-/// \param [in] cutoff The cutoff distance of the potential.
+/// \param [in] cutoff  The cutoff distance of the potential.
+/// \param [in] density The expected number of atoms per unit volume,
+///                     used for the initial capacity of the boxes.
+/// \param [in] boxOrder The numbering of the local cells, a BoxOrder.
 
 #include "linkCells.h"
 
@@ -96,6 +105,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <assert.h>
 #include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
 
 #include "parallel.h"
 #include "memUtils.h"
@@ -106,13 +117,32 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define   MIN(A,B) ((A) < (B) ? (A) : (B))
 #define   MAX(A,B) ((A) > (B) ? (A) : (B))
 
-static void copyAtom(LinkCell* boxes, Atoms* atoms, int iAtom, int iBox, int jAtom, int jBox);
+/// Bits of the gid sorted per pass of sortAtomsByGid.
+#define RADIX_BITS 11
+
+/// Fraction of spare slots a box gets on top of the atoms it must hold
+/// when its capacity is set.
+#define CAPACITY_SLACK 0.25
+
 static int getBoxFromCoord(LinkCell* boxes, real_t rr[3]);
 static int getBoxFromCoord(LinkCell* boxes, real_t x, real_t y, real_t z);
 static void emptyHaloCells(LinkCell* boxes);
+static void relocateAtoms(Atoms* atoms, int n, const int* from, const int* to);
+static int slackCapacity(real_t nAtoms);
+static void setBoxOffsets(LinkCell* boxes, int* boxOffset);
+static int reserveLinkCells(LinkCell* boxes, Atoms* atoms, const int* need);
+static void makeRoom(LinkCell* boxes, Atoms* atoms, int iBox);
+static int getBoxFromSlot(LinkCell* boxes, int iOff);
+static void findDestBoxes(LinkCell* boxes, Atoms* atoms, int* dest);
 static void getTuple(LinkCell* boxes, int iBox, int* ixp, int* iyp, int* izp);
+static void initBoxColors(LinkCell* boxes);
+static void initBoxOrder(LinkCell* boxes, int boxOrder);
+static uint64_t mortonKey(int ix, int iy, int iz, int nBits);
+static uint64_t hilbertKey(int ix, int iy, int iz, int nBits);
+static int compareBoxKeys(const void* a, const void* b);
 
-LinkCell* initLinkCells(const Domain* domain, real_t cutoff)
+LinkCell* initLinkCells(const Domain* domain, real_t cutoff, real_t density,
+                        int boxOrder)
 {
    assert(domain);
    LinkCell* ll = (LinkCell *) comdMalloc(sizeof(LinkCell));
@@ -133,11 +163,20 @@ LinkCell* initLinkCells(const Domain* domain, real_t cutoff)
                          (ll->gridSize[1] * ll->gridSize[2]));
 
    ll->nTotalBoxes = ll->nLocalBoxes + ll->nHaloBoxes;
+
+   initBoxOrder(ll, boxOrder);
    
    ll->nAtoms = (int *) comdMalloc(ll->nTotalBoxes*sizeof(int));
    for (int iBox=0; iBox<ll->nTotalBoxes; ++iBox)
       ll->nAtoms[iBox] = 0;
 
+   real_t boxVolume = ll->boxSize[0]*ll->boxSize[1]*ll->boxSize[2];
+   int capacity = slackCapacity(density*boxVolume);
+   int* boxOffset = (int *) comdMalloc((ll->nTotalBoxes+1)*sizeof(int));
+   for (int iBox=0; iBox<=ll->nTotalBoxes; ++iBox)
+      boxOffset[iBox] = iBox*capacity;
+   setBoxOffsets(ll, boxOffset);
+
    assert ( (ll->gridSize[0] >= 2) && (ll->gridSize[1] >= 2) && (ll->gridSize[2] >= 2) );
 
    // Added creating neighbors once
@@ -157,6 +196,20 @@ LinkCell* initLinkCells(const Domain* domain, real_t cutoff)
       int nNbrBoxes = getNeighborBoxes(ll, iBox, ll->nbrBoxes[iBox]);
       }*/
 
+   initBoxColors(ll);
+
+   // boxes on the faces of the local domain are the ones that need halo
+   // data; the others can be computed while the halo is exchanged
+   ll->boundary = (int *) comdMalloc(ll->nLocalBoxes*sizeof(int));
+   for (int iBox=0; iBox<ll->nLocalBoxes; ++iBox)
+   {
+      int ix, iy, iz;
+      getTuple(ll, iBox, &ix, &iy, &iz);
+      ll->boundary[iBox] = (ix == 0 || ix == ll->gridSize[0]-1 ||
+                            iy == 0 || iy == ll->gridSize[1]-1 ||
+                            iz == 0 || iz == ll->gridSize[2]-1);
+   }
+
    return ll;
 }
 
@@ -166,6 +219,11 @@ void destroyLinkCells(LinkCell** boxes)
    if (! *boxes) return;
 
    comdFree((*boxes)->nAtoms);
+   comdFree((*boxes)->boxOffset);
+   comdFree((*boxes)->colorBoxes);
+   comdFree((*boxes)->boundary);
+   comdFree((*boxes)->lexToBox);
+   comdFree((*boxes)->boxToLex);
    //comdFree((*boxes)->nbrBoxes);
    comdFree(*boxes);
    *boxes = NULL;
@@ -173,11 +231,153 @@ void destroyLinkCells(LinkCell** boxes)
    return;
 }
 
+/// \details
+/// Groups the local boxes by the color (ix%3, iy%3, iz%3).  Any two
+/// boxes of one color are at least three boxes apart along some axis,
+/// so the 27 box neighborhoods of a color are disjoint and the boxes of
+/// a color can be processed concurrently by force loops that also write
+/// to neighbor boxes.
+void initBoxColors(LinkCell* boxes)
+{
+   boxes->colorBoxes = (int *) comdMalloc(boxes->nLocalBoxes*sizeof(int));
+
+   int count[NBOXCOLORS];
+   for (int iColor=0; iColor<NBOXCOLORS; ++iColor)
+      count[iColor] = 0;
+
+   for (int iBox=0; iBox<boxes->nLocalBoxes; ++iBox)
+   {
+      int ix, iy, iz;
+      getTuple(boxes, iBox, &ix, &iy, &iz);
+      ++count[ix%3 + 3*(iy%3) + 9*(iz%3)];
+   }
+
+   boxes->colorStart[0] = 0;
+   for (int iColor=0; iColor<NBOXCOLORS; ++iColor)
+      boxes->colorStart[iColor+1] = boxes->colorStart[iColor] + count[iColor];
+
+   for (int iColor=0; iColor<NBOXCOLORS; ++iColor)
+      count[iColor] = boxes->colorStart[iColor];
+   for (int iBox=0; iBox<boxes->nLocalBoxes; ++iBox)
+   {
+      int ix, iy, iz;
+      getTuple(boxes, iBox, &ix, &iy, &iz);
+      boxes->colorBoxes[count[ix%3 + 3*(iy%3) + 9*(iz%3)]++] = iBox;
+   }
+}
+
+/// \details
+/// Numbers the local boxes along a space filling curve instead of
+/// lexicographically.  The 27 neighbors of a box are then mostly a few
+/// boxes away in memory instead of on three planes nx*ny boxes apart,
+/// and a contiguous range of boxes, such as the share of one thread, is
+/// a compact region of space.  The boxes are sorted by the Morton or
+/// Hilbert key of their grid coordinates in the smallest power of two
+/// cube that holds the grid, so any grid size works.  The halo boxes
+/// keep their numbering, after the local ones.  Lexicographic order
+/// needs no tables and leaves lexToBox and boxToLex NULL.
+void initBoxOrder(LinkCell* boxes, int boxOrder)
+{
+   boxes->lexToBox = NULL;
+   boxes->boxToLex = NULL;
+   if (boxOrder == BOX_ORDER_LEX)
+      return;
+
+   const int* gridSize = boxes->gridSize; // alias
+   int nLocalBoxes = boxes->nLocalBoxes;
+   int nBits = 1;
+   while ((1 << nBits) < MAX(gridSize[0], MAX(gridSize[1], gridSize[2])))
+      ++nBits;
+
+   uint64_t* keys = (uint64_t*) comdMalloc(2*nLocalBoxes*sizeof(uint64_t));
+   for (int iLex=0; iLex<nLocalBoxes; ++iLex)
+   {
+      int ix = iLex % gridSize[0];
+      int iy = (iLex / gridSize[0]) % gridSize[1];
+      int iz = iLex / (gridSize[0]*gridSize[1]);
+      if (boxOrder == BOX_ORDER_HILBERT)
+         keys[2*iLex] = hilbertKey(ix, iy, iz, nBits);
+      else
+         keys[2*iLex] = mortonKey(ix, iy, iz, nBits);
+      keys[2*iLex+1] = iLex;
+   }
+   qsort(keys, nLocalBoxes, 2*sizeof(uint64_t), compareBoxKeys);
+
+   boxes->lexToBox = (int*) comdMalloc(nLocalBoxes*sizeof(int));
+   boxes->boxToLex = (int*) comdMalloc(nLocalBoxes*sizeof(int));
+   for (int iBox=0; iBox<nLocalBoxes; ++iBox)
+   {
+      int iLex = (int) keys[2*iBox+1];
+      boxes->boxToLex[iBox] = iLex;
+      boxes->lexToBox[iLex] = iBox;
+   }
+   comdFree(keys);
+}
+
+/// Interleaves the bits of the grid coordinates, x lowest.
+uint64_t mortonKey(int ix, int iy, int iz, int nBits)
+{
+   uint64_t key = 0;
+   for (int b=nBits-1; b>=0; --b)
+      key = (key << 3) | (((iz >> b) & 1) << 2) | (((iy >> b) & 1) << 1) | ((ix >> b) & 1);
+   return key;
+}
+
+/// The distance along the Hilbert curve, from J. Skilling,
+/// "Programming the Hilbert curve", AIP Conf. Proc. 707, 381 (2004):
+/// the coordinates are transformed in place and their bits interleaved.
+uint64_t hilbertKey(int ix, int iy, int iz, int nBits)
+{
+   unsigned int x[3] = {(unsigned int) iz, (unsigned int) iy, (unsigned int) ix};
+   unsigned int m = 1u << (nBits-1);
+
+   // inverse undo
+   for (unsigned int q=m; q>1; q>>=1)
+   {
+      unsigned int p = q - 1;
+      for (int i=0; i<3; ++i)
+      {
+         if (x[i] & q)
+            x[0] ^= p;
+         else
+         {
+            unsigned int t = (x[0] ^ x[i]) & p;
+            x[0] ^= t;
+            x[i] ^= t;
+         }
+      }
+   }
+
+   // Gray encode
+   for (int i=1; i<3; ++i)
+      x[i] ^= x[i-1];
+   unsigned int t = 0;
+   for (unsigned int q=m; q>1; q>>=1)
+      if (x[2] & q)
+         t ^= q - 1;
+   for (int i=0; i<3; ++i)
+      x[i] ^= t;
+
+   uint64_t key = 0;
+   for (int b=nBits-1; b>=0; --b)
+      for (int i=0; i<3; ++i)
+         key = (key << 1) | ((x[i] >> b) & 1);
+   return key;
+}
+
+int compareBoxKeys(const void* a, const void* b)
+{
+   uint64_t ka = *(const uint64_t*) a;
+   uint64_t kb = *(const uint64_t*) b;
+   return (ka > kb) - (ka < kb);
+}
+
 /// \details
 /// Populates the nbrBoxes array with the 27 boxes that are adjacent to
 /// iBox.  The count is 27 instead of 26 because iBox is included in the
-/// list (as neighbor 13).  Caller is responsible to alloc and free
-/// nbrBoxes.
+/// list (as neighbor 13).  Neighbors 14 to 26 are the forward half
+/// shell: their offsets (dx,dy,dz) are lexicographically greater than
+/// (0,0,0).  Caller is responsible to alloc and free nbrBoxes.
 /// \return The number of nbr boxes (always 27 in this implementation).
 int getNeighborBoxes(LinkCell* boxes, int iBox, int* nbrBoxes)
 {
@@ -213,8 +413,8 @@ void putAtomInBox(LinkCell* boxes, Atoms* atoms,
    
    // Find correct box.
    int iBox = getBoxFromCoord(boxes, xyz);
-   int iOff = iBox*MAXATOMS;
-   iOff += boxes->nAtoms[iBox];
+   makeRoom(boxes, atoms, iBox);
+   int iOff = boxes->boxOffset[iBox] + boxes->nAtoms[iBox];
    
    // assign values to array elements
    if (iBox < boxes->nLocalBoxes)
@@ -281,6 +481,8 @@ int getBoxFromTuple(LinkCell* boxes, int ix, int iy, int iz)
    else
    {
       iBox = ix + gridSize[0]*iy + gridSize[0]*gridSize[1]*iz;
+      if (boxes->lexToBox)
+         iBox = boxes->lexToBox[iBox];
    }
    assert(iBox >= 0);
    assert(iBox < boxes->nTotalBoxes);
@@ -288,28 +490,6 @@ int getBoxFromTuple(LinkCell* boxes, int ix, int iy, int iz)
    return iBox;
 }
 
-/// Move an atom from one link cell to another.
-/// \param iId [in]  The index with box iBox of the atom to be moved.
-/// \param iBox [in] The index of the link cell the particle is moving from.
-/// \param jBox [in] The index of the link cell the particle is moving to.
-void moveAtom(LinkCell* boxes, Atoms* atoms, int iId, int iBox, int jBox)
-{
-   int nj = boxes->nAtoms[jBox];
-   copyAtom(boxes, atoms, iId, iBox, nj, jBox);
-   boxes->nAtoms[jBox]++;
-
-   assert(boxes->nAtoms[jBox] < MAXATOMS);
-
-   boxes->nAtoms[iBox]--;
-   int ni = boxes->nAtoms[iBox];
-   if (ni) copyAtom(boxes, atoms, ni, iBox, iId, iBox);
-
-   if (jBox > boxes->nLocalBoxes)
-      --atoms->nLocal;
-   
-   return;
-}
-
 /// \details
 /// This is the first step in returning data structures to a consistent
 /// state after the atoms move each time step.  First we discard all
@@ -322,25 +502,219 @@ void moveAtom(LinkCell* boxes, Atoms* atoms, int iId, int iBox, int jBox)
 /// cells at the end of this routine have just transitioned from local
 /// to halo atoms.  Such atom must be sent to other tasks by a halo
 /// exchange to avoid being lost.
+///
+/// The atoms are rebinned with a counting sort.  The new link cell of
+/// every local atom is found in parallel.  A pass in cell and slot
+/// order then counts the atoms of each new cell, which gives every atom
+/// its slot in that cell; the atoms keep their relative order, so the
+/// result does not depend on the number of threads.  Only the cells
+/// that lose or gain atoms change, usually a small fraction of them,
+/// and only the atoms of those cells whose slot changes are moved, by
+/// relocateAtoms.
 /// \see redistributeAtoms
 void updateLinkCells(LinkCell* boxes, Atoms* atoms)
 {
    emptyHaloCells(boxes);
-   
-   for (int iBox=0; iBox<boxes->nLocalBoxes; ++iBox)
+
+   int nLocalBoxes = boxes->nLocalBoxes;
+   int nTotalBoxes = boxes->nTotalBoxes;
+   int* dest = (int*) comdMalloc(boxes->nLocalSlots*sizeof(int));
+   int* count = (int*) comdCalloc(nTotalBoxes, sizeof(int));
+   char* dirty = (char*) comdCalloc(nTotalBoxes, sizeof(char));
+
+   findDestBoxes(boxes, atoms, dest);
+
+   for (int iBox=0; iBox<nLocalBoxes; ++iBox)
    {
-      int iOff = iBox*MAXATOMS;
-      int ii=0;
-      while (ii < boxes->nAtoms[iBox])
+      for (int iOff=boxes->boxOffset[iBox],ii=0; ii<boxes->nAtoms[iBox]; ii++,iOff++)
       {
-	int jBox = getBoxFromCoord(boxes, atoms->r[(iOff+ii)*3 +0],
-				   atoms->r[(iOff+ii)*3 + 1], atoms->r[(iOff+ii)*3 + 2]);
-         if (jBox != iBox)
-            moveAtom(boxes, atoms, ii, iBox, jBox);
-         else
-            ++ii;
+         ++count[dest[iOff]];
+         if (dest[iOff] != iBox)
+            dirty[iBox] = dirty[dest[iOff]] = 1;
       }
    }
+
+   // Make room in the boxes that get too full before any atom moves.
+   // The slots of the atoms change, so the destinations are found again.
+   if (reserveLinkCells(boxes, atoms, count))
+   {
+      comdFree(dest);
+      dest = (int*) comdMalloc(boxes->nLocalSlots*sizeof(int));
+      findDestBoxes(boxes, atoms, dest);
+   }
+   memset(count, 0, nTotalBoxes*sizeof(int));
+
+   int nMoves = 0;
+   int* from = (int*) comdMalloc(boxes->nLocalSlots*sizeof(int));
+   int* to   = (int*) comdMalloc(boxes->nLocalSlots*sizeof(int));
+   for (int iBox=0; iBox<nLocalBoxes; ++iBox)
+   {
+      for (int iOff=boxes->boxOffset[iBox],ii=0; ii<boxes->nAtoms[iBox]; ii++,iOff++)
+      {
+         int jBox = dest[iOff];
+         int jOff = boxes->boxOffset[jBox] + count[jBox]++;
+         if (dirty[jBox] && jOff != iOff)
+         {
+            from[nMoves] = iOff;
+            to[nMoves] = jOff;
+            ++nMoves;
+         }
+      }
+   }
+   relocateAtoms(atoms, nMoves, from, to);
+
+   atoms->nLocal = 0;
+   for (int iBox=0; iBox<nTotalBoxes; ++iBox)
+   {
+      boxes->nAtoms[iBox] = count[iBox];
+      if (iBox < nLocalBoxes)
+         atoms->nLocal += count[iBox];
+   }
+
+   comdFree(to);
+   comdFree(from);
+   comdFree(dirty);
+   comdFree(count);
+   comdFree(dest);
+}
+
+/// \details
+/// The force exchange assumes that the atoms are in the same order in
+/// both a given local link cell and the corresponding remote cell(s).
+/// However, the atom exchange does not guarantee this property,
+/// especially when atoms cross a domain decomposition boundary and move
+/// from one task to another.  Trying to maintain the atom order during
+/// the atom exchange would immensely complicate that code.  Instead, we
+/// just sort the atoms after the atom exchange.
+///
+/// Instead of sorting each link cell, the cells that are out of order
+/// are found in parallel and all of their atoms are put in gid order
+/// together by a radix sort with the gids as keys (RADIX_BITS per
+/// pass, as many passes as the largest gid needs).  Giving each atom
+/// in that order the next slot of its own cell is a stable counting
+/// sort by cell, so every cell ends up sorted by gid.  Everything is
+/// linear in the number of atoms.  Since updateLinkCells keeps the
+/// order of the atoms that stay, only cells that gained atoms are
+/// usually out of order.
+void sortAtomsByGid(LinkCell* boxes, Atoms* atoms)
+{
+   int nTotalBoxes = boxes->nTotalBoxes;
+   char* dirty = (char*) comdMalloc(nTotalBoxes*sizeof(char));
+
+   #pragma omp parallel for
+   for (int iBox=0; iBox<nTotalBoxes; ++iBox)
+   {
+      dirty[iBox] = 0;
+      for (int iOff=boxes->boxOffset[iBox]+1,ii=1; ii<boxes->nAtoms[iBox]; ii++,iOff++)
+      {
+         assert(atoms->gid[iOff] != atoms->gid[iOff-1]);
+         if (atoms->gid[iOff] < atoms->gid[iOff-1])
+            dirty[iBox] = 1;
+      }
+   }
+
+   int nAtoms = 0;
+   for (int iBox=0; iBox<nTotalBoxes; ++iBox)
+      if (dirty[iBox])
+         nAtoms += boxes->nAtoms[iBox];
+   if (nAtoms == 0)
+   {
+      comdFree(dirty);
+      return;
+   }
+
+   int* key   = (int*) comdMalloc(nAtoms*sizeof(int));
+   int* order = (int*) comdMalloc(nAtoms*sizeof(int));
+   int* keyTmp   = (int*) comdMalloc(nAtoms*sizeof(int));
+   int* orderTmp = (int*) comdMalloc(nAtoms*sizeof(int));
+   int* count = (int*) comdMalloc(MAX(1<<RADIX_BITS, nTotalBoxes)*sizeof(int));
+
+   int maxGid = 0;
+   for (int iBox=0,kk=0; iBox<nTotalBoxes; ++iBox)
+   {
+      if (! dirty[iBox]) continue;
+      for (int iOff=boxes->boxOffset[iBox],ii=0; ii<boxes->nAtoms[iBox]; ii++,iOff++,kk++)
+      {
+         key[kk] = atoms->gid[iOff];
+         order[kk] = iOff;
+         maxGid = MAX(maxGid, key[kk]);
+      }
+   }
+
+   // The keys travel with the slots so every pass reads them in order.
+   const int mask = (1<<RADIX_BITS) - 1;
+   for (int shift=0; (maxGid >> shift) > 0; shift+=RADIX_BITS)
+   {
+      memset(count, 0, (1<<RADIX_BITS)*sizeof(int));
+      for (int kk=0; kk<nAtoms; ++kk)
+         ++count[(key[kk] >> shift) & mask];
+      for (int dd=0, sum=0; dd<=mask; ++dd)
+      {
+         int nDigit = count[dd];
+         count[dd] = sum;
+         sum += nDigit;
+      }
+      for (int kk=0; kk<nAtoms; ++kk)
+      {
+         int jj = count[(key[kk] >> shift) & mask]++;
+         keyTmp[jj] = key[kk];
+         orderTmp[jj] = order[kk];
+      }
+      int* swap;
+      swap = key;   key = keyTmp;     keyTmp = swap;
+      swap = order; order = orderTmp; orderTmp = swap;
+   }
+
+   // Reuse the key arrays for the moves.
+   int* from = key;
+   int* to = keyTmp;
+   int nMoves = 0;
+   memset(count, 0, nTotalBoxes*sizeof(int));
+   for (int kk=0; kk<nAtoms; ++kk)
+   {
+      int iOff = order[kk];
+      int iBox = getBoxFromSlot(boxes, iOff);
+      int jOff = boxes->boxOffset[iBox] + count[iBox]++;
+      if (jOff != iOff)
+      {
+         from[nMoves] = iOff;
+         to[nMoves] = jOff;
+         ++nMoves;
+      }
+   }
+   relocateAtoms(atoms, nMoves, from, to);
+
+   comdFree(count);
+   comdFree(orderTmp);
+   comdFree(keyTmp);
+   comdFree(order);
+   comdFree(key);
+   comdFree(dirty);
+}
+
+/// Sum a per atom quantity over the local atoms.  The cells are summed
+/// in parallel and the cell sums are added in cell order, so the result
+/// does not depend on the number of threads.
+real_t sumLocalAtoms(LinkCell* boxes, const real_t* data)
+{
+   int nLocalBoxes = boxes->nLocalBoxes;
+   real_t* boxSum = (real_t*) comdMalloc(nLocalBoxes*sizeof(real_t));
+
+   #pragma omp parallel for
+   for (int iBox=0; iBox<nLocalBoxes; ++iBox)
+   {
+      real_t sum = 0.0;
+      for (int iOff=boxes->boxOffset[iBox],ii=0; ii<boxes->nAtoms[iBox]; ii++,iOff++)
+         sum += data[iOff];
+      boxSum[iBox] = sum;
+   }
+
+   real_t total = 0.0;
+   for (int iBox=0; iBox<nLocalBoxes; ++iBox)
+      total += boxSum[iBox];
+
+   comdFree(boxSum);
+   return total;
 }
 
 /// \return The largest number of atoms in any link cell.
@@ -359,19 +733,175 @@ int maxOccupancy(LinkCell* boxes)
    return globalMax;
 }
 
-/// Copy atom iAtom in link cell iBox to atom jAtom in link cell jBox.
-/// Any data at jAtom, jBox is overwritten.  This routine can be used to
-/// re-order atoms within a link cell.
-void copyAtom(LinkCell* boxes, Atoms* atoms, int iAtom, int iBox, int jAtom, int jBox)
+/// Move the atoms in slots from[0,n) to slots to[0,n) at once.  The
+/// destination slots must be distinct; they may be source slots of
+/// other moves.  The atoms are staged in the spare atom arrays.  Only
+/// the ids, species, positions and momenta are moved: the forces and
+/// energies are recomputed after every redistribution.
+void relocateAtoms(Atoms* atoms, int n, const int* from, const int* to)
+{
+   #pragma omp parallel for
+   for (int kk=0; kk<n; ++kk)
+   {
+      int iOff = from[kk];
+      int jOff = to[kk];
+      atoms->gidSpare[jOff] = atoms->gid[iOff];
+      atoms->iSpeciesSpare[jOff] = atoms->iSpecies[iOff];
+      memcpy(atoms->rSpare+jOff*3, atoms->r+iOff*3, sizeof(real_t)*3);
+      memcpy(atoms->pSpare+jOff*3, atoms->p+iOff*3, sizeof(real_t)*3);
+   }
+
+   #pragma omp parallel for
+   for (int kk=0; kk<n; ++kk)
+   {
+      int jOff = to[kk];
+      atoms->gid[jOff] = atoms->gidSpare[jOff];
+      atoms->iSpecies[jOff] = atoms->iSpeciesSpare[jOff];
+      memcpy(atoms->r+jOff*3, atoms->rSpare+jOff*3, sizeof(real_t)*3);
+      memcpy(atoms->p+jOff*3, atoms->pSpare+jOff*3, sizeof(real_t)*3);
+   }
+}
+
+/// \return The capacity, rounded up to whole BOX_ALIGN slots, of a box
+/// that should hold nAtoms atoms.
+int slackCapacity(real_t nAtoms)
+{
+   int capacity = (int) ceil(nAtoms*(1.0 + CAPACITY_SLACK)) + 1;
+   return BOX_ALIGN*((capacity + BOX_ALIGN - 1)/BOX_ALIGN);
+}
+
+/// Make boxOffset the slot offsets of the boxes and update the slot
+/// counts that go with them.  The link cells take ownership of the
+/// array; the caller frees the old one.
+void setBoxOffsets(LinkCell* boxes, int* boxOffset)
+{
+   boxes->boxOffset = boxOffset;
+   boxes->nLocalSlots = boxOffset[boxes->nLocalBoxes];
+   boxes->nTotalSlots = boxOffset[boxes->nTotalBoxes];
+   boxes->maxCapacity = 0;
+   for (int iBox=0; iBox<boxes->nTotalBoxes; ++iBox)
+      boxes->maxCapacity = MAX(boxes->maxCapacity, boxOffset[iBox+1] - boxOffset[iBox]);
+}
+
+/// Give every box room for at least need[iBox] atoms.  A box that is
+/// too small gets the capacity of slackCapacity, the others keep
+/// theirs.  The atom arrays are allocated again with allocAtomArrays,
+/// so the pages keep their first touch placement, and the atoms of
+/// every box are copied to its new slots.  Anything else that is
+/// indexed by atom slot (the structure of arrays copies here, and the
+/// EAM storage, the neighbor list and the device arrays elsewhere) is
+/// sized from nTotalSlots and has to be reallocated when it changes.
+///
+/// \return 1 if any box has grown, else 0.
+int reserveLinkCells(LinkCell* boxes, Atoms* atoms, const int* need)
+{
+   int nTotalBoxes = boxes->nTotalBoxes;
+   int* oldOffset = boxes->boxOffset;
+   int* newOffset = (int*) comdMalloc((nTotalBoxes+1)*sizeof(int));
+
+   int grow = 0;
+   newOffset[0] = 0;
+   for (int iBox=0; iBox<nTotalBoxes; ++iBox)
+   {
+      int capacity = oldOffset[iBox+1] - oldOffset[iBox];
+      if (need[iBox] > capacity)
+      {
+         capacity = slackCapacity(need[iBox]);
+         grow = 1;
+      }
+      newOffset[iBox+1] = newOffset[iBox] + capacity;
+   }
+   if (! grow)
+   {
+      comdFree(newOffset);
+      return 0;
+   }
+
+   Atoms old = *atoms;
+   setBoxOffsets(boxes, newOffset);
+   allocAtomArrays(atoms, boxes);
+
+   #pragma omp parallel for
+   for (int iBox=0; iBox<nTotalBoxes; ++iBox)
+   {
+      int iOld = oldOffset[iBox];
+      int iNew = newOffset[iBox];
+      int n = boxes->nAtoms[iBox];
+      memcpy(atoms->gid+iNew,      old.gid+iOld,      n*sizeof(int));
+      memcpy(atoms->iSpecies+iNew, old.iSpecies+iOld, n*sizeof(int));
+      memcpy(atoms->r+iNew*3,      old.r+iOld*3,      n*sizeof(real3));
+      memcpy(atoms->p+iNew*3,      old.p+iOld*3,      n*sizeof(real3));
+      memcpy(atoms->f+iNew*3,      old.f+iOld*3,      n*sizeof(real3));
+      memcpy(atoms->U+iNew,        old.U+iOld,        n*sizeof(real_t));
+   }
+
+   comdFree(old.gid);
+   comdFree(old.iSpecies);
+   comdFree(old.r);
+   comdFree(old.p);
+   comdFree(old.f);
+   comdFree(old.U);
+   comdFree(old.gidSpare);
+   comdFree(old.iSpeciesSpare);
+   comdFree(old.rSpare);
+   comdFree(old.pSpare);
+   comdFree(oldOffset);
+
+   // the SoA arrays hold nothing between uses
+   if (atoms->rx)
+   {
+      freeMe(atoms,rx);
+      freeMe(atoms,ry);
+      freeMe(atoms,rz);
+      freeMe(atoms,fx);
+      freeMe(atoms,fy);
+      freeMe(atoms,fz);
+      initAtomsSoa(atoms, boxes);
+   }
+
+   return 1;
+}
+
+/// Make sure box iBox has a free slot for one more atom.
+void makeRoom(LinkCell* boxes, Atoms* atoms, int iBox)
 {
-   const int iOff = MAXATOMS*iBox+iAtom;
-   const int jOff = MAXATOMS*jBox+jAtom;
-   atoms->gid[jOff] = atoms->gid[iOff];
-   atoms->iSpecies[jOff] = atoms->iSpecies[iOff];
-   memcpy(atoms->r+jOff*3, atoms->r+iOff*3, sizeof(real_t)*3);
-   memcpy(atoms->p+jOff*3, atoms->p+iOff*3, sizeof(real_t)*3);
-   memcpy(atoms->f+jOff*3, atoms->f+iOff*3, sizeof(real_t)*3);
-   memcpy(atoms->U+jOff,  atoms->U+iOff,  sizeof(real_t));
+   if (boxes->nAtoms[iBox] < boxes->boxOffset[iBox+1] - boxes->boxOffset[iBox])
+      return;
+
+   int* need = (int*) comdMalloc(boxes->nTotalBoxes*sizeof(int));
+   memcpy(need, boxes->nAtoms, boxes->nTotalBoxes*sizeof(int));
+   need[iBox]++;
+   reserveLinkCells(boxes, atoms, need);
+   comdFree(need);
+}
+
+/// \return The box that owns atom slot iOff.
+int getBoxFromSlot(LinkCell* boxes, int iOff)
+{
+   int lo = 0;
+   int hi = boxes->nTotalBoxes;
+   while (hi - lo > 1)
+   {
+      int mid = (lo + hi)/2;
+      if (boxes->boxOffset[mid] <= iOff)
+         lo = mid;
+      else
+         hi = mid;
+   }
+   return lo;
+}
+
+/// Find the link cell of every local atom from its position.  dest is
+/// indexed by atom slot.
+void findDestBoxes(LinkCell* boxes, Atoms* atoms, int* dest)
+{
+   #pragma omp parallel for
+   for (int iBox=0; iBox<boxes->nLocalBoxes; ++iBox)
+   {
+      for (int iOff=boxes->boxOffset[iBox],ii=0; ii<boxes->nAtoms[iBox]; ii++,iOff++)
+         dest[iOff] = getBoxFromCoord(boxes, atoms->r[iOff*3 + 0],
+                                      atoms->r[iOff*3 + 1], atoms->r[iOff*3 + 2]);
+   }
 }
 
 /// Get the index of the link cell that contains the specified
@@ -447,6 +977,8 @@ void getTuple(LinkCell* boxes, int iBox, int* ixp, int* iyp, int* izp)
    // If a local box
    if( iBox < boxes->nLocalBoxes)
    {
+      if (boxes->boxToLex)
+         iBox = boxes->boxToLex[iBox];
       ix = iBox % gridSize[0];
       iBox /= gridSize[0];
       iy = iBox % gridSize[1];
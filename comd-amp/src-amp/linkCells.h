@@ -37,19 +37,35 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "mytype.h"
 
-/// The maximum number of atoms that can be stored in a link cell.
-#define MAXATOMS 64
+/// Box capacities are multiples of this many atom slots, so every box
+/// starts on a 64 byte boundary of the structure of arrays copies.
+#define BOX_ALIGN 8
+
+/// Number of threads in the tile that the device kernels give to each
+/// box, the wavefront size.  The threads of a tile step through the
+/// slots of a larger box BOX_TILE at a time.
+#define BOX_TILE 64
+
+/// The number of box colors.  Two local boxes of the same color are at
+/// least three boxes apart along some axis, so their neighbor shells
+/// never overlap.
+#define NBOXCOLORS 27
+
+/// Numbering of the local link cells, see initBoxOrder.
+enum BoxOrder {BOX_ORDER_LEX, BOX_ORDER_MORTON, BOX_ORDER_HILBERT};
 
 #ifdef ARRAY_VIEW
 #define HCC_ARRAY_STRUC(type, name, size, ptr) array_view<type> name(size, ptr)
 #define HCC_ARRAY_OBJECT(type, name) array_view<type> &name
 #define HCC_ID(name)
 #define HCC_SYNC(name, ptr) name.synchronize()
+#define HCC_ARRAY_TYPE(type) hc::array_view<type>
 #else
 #define HCC_ARRAY_STRUC(type, name, size, ptr) array<type> name(size); copy(ptr, name)
 #define HCC_ARRAY_OBJECT(type, name) array<type> &name
 #define HCC_ID(name) ,&name
 #define HCC_SYNC(name, ptr) copy(name, ptr)
+#define HCC_ARRAY_TYPE(type) hc::array<type>
 #endif
 
 
@@ -71,10 +87,21 @@ typedef struct LinkCellSt
    real3 invBoxSize;    //!< inverse size of box in each dimension
 
    int* nAtoms;         //!< total number of atoms in each box
+   int* boxOffset;      //!< first atom slot of each box, nTotalBoxes+1 entries
+   int nLocalSlots;     //!< atom slots of the local boxes, boxOffset[nLocalBoxes]
+   int nTotalSlots;     //!< atom slots of all boxes, boxOffset[nTotalBoxes]
+   int maxCapacity;     //!< largest number of slots of any box
    int* nbrBoxes;      //!< neighbor boxes for each box
+
+   int* colorBoxes;     //!< local boxes grouped by color
+   int* boundary;       //!< 1 for local boxes with a halo neighbor, else 0
+   int* lexToBox;       //!< local box at lexicographic index ix+nx*(iy+ny*iz), or NULL
+   int* boxToLex;       //!< lexicographic index of each local box, or NULL
+   int colorStart[NBOXCOLORS+1]; //!< first entry of each color in colorBoxes
 } LinkCell;
 
-LinkCell* initLinkCells(const struct DomainSt* domain, real_t cutoff);
+LinkCell* initLinkCells(const struct DomainSt* domain, real_t cutoff, real_t density,
+                        int boxOrder);
 void destroyLinkCells(LinkCell** boxes);
 
 int getNeighborBoxes(LinkCell* boxes, int iBox, int* nbrBoxes);
@@ -84,12 +111,16 @@ void putAtomInBox(LinkCell* boxes, struct AtomsSt* atoms,
                   const real_t px, const real_t py, const real_t pz);
 int getBoxFromTuple(LinkCell* boxes, int x, int y, int z);
 
-void moveAtom(LinkCell* boxes, struct AtomsSt* atoms, int iId, int iBox, int jBox);
-
 /// Update link cell data structures when the atoms have moved.
 void updateLinkCells(LinkCell* boxes, struct AtomsSt* atoms);
 
+/// Sort the atoms of every link cell by gid.
+void sortAtomsByGid(LinkCell* boxes, struct AtomsSt* atoms);
+
 int maxOccupancy(LinkCell* boxes);
 
+/// Sum a per atom quantity over the local atoms, in a reproducible order.
+real_t sumLocalAtoms(LinkCell* boxes, const real_t* data);
+
 
 #endif
@@ -99,6 +99,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "parallel.h"
 #include "linkCells.h"
 #include "memUtils.h"
+#include "initAtoms.h"
+#include "deviceState.h"
+#include "neighborList.h"
 
 #include <hc.hpp>
 using namespace hc;
@@ -106,6 +109,10 @@ using namespace hc;
 #define POT_SHIFT 1.0
 
 static int ljForce(SimFlat* s);
+static int ljForceHalf(SimFlat* s);
+static int ljForceList(SimFlat* s);
+static int ljForceHalfList(SimFlat* s);
+static int ljForceHalfSoa(SimFlat* s);
 static void ljPrint(FILE* file, BasePotential* pot);
 
 void ljDestroy(BasePotential** inppot)
@@ -120,10 +127,16 @@ void ljDestroy(BasePotential** inppot)
 }
 
 /// Initialize an Lennard Jones potential for Copper.
-BasePotential* initLjPot(void)
+/// \param [in] halfShell Compute the forces on the CPU with a half
+///                       neighbor shell instead of on the device.
+/// \param [in] soa       Use the vectorized version of the half shell
+///                       forces on the structure of arrays copies.
+BasePotential* initLjPot(int halfShell, int soa)
 {
    LjPotential *pot = (LjPotential*)comdMalloc(sizeof(LjPotential));
-   pot->force = ljForce;
+   pot->force = halfShell ? ljForceHalf : ljForce;
+   if (soa)
+      pot->force = ljForceHalfSoa;
    pot->print = ljPrint;
    pot->destroy = ljDestroy;
    pot->sigma = 2.315;	                  // Angstrom
@@ -156,6 +169,9 @@ void ljPrint(FILE* file, BasePotential* pot)
 
 int ljForce(SimFlat* s)
 {
+   if (s->nbrList)
+      return ljForceList(s);
+
    LjPotential* pot = (LjPotential *) s->pot;
    real_t sigma = pot->sigma;
    real_t epsilon = pot->epsilon;
@@ -167,34 +183,27 @@ int ljForce(SimFlat* s)
    real_t eShift = POT_SHIFT * rCut6 * (rCut6 - 1.0);
    int nNbrBoxes = 27;
    
-   // zero forces and energy
+   // zero energy; forces and per atom energies are zeroed by the kernel
    real_t ePot = 0.0;
    s->ePotential = 0.0;
-   int fSize = s->boxes->nTotalBoxes*MAXATOMS;
-   int nBoxes = s->boxes->nTotalBoxes;
-   extent<1> boxesExt(s->boxes->nLocalBoxes * MAXATOMS);
-   tiled_extent<1> tBoxesExt(boxesExt, MAXATOMS);
+   extent<1> boxesExt(s->boxes->nLocalBoxes * BOX_TILE);
+   tiled_extent<1> tBoxesExt(boxesExt, BOX_TILE);
    completion_future fut;   
    
-   for (int ii=0; ii<fSize; ++ii)
-   {
-     s->atoms->f[ii*3 + 0] = 0.;
-     s->atoms->f[ii*3 + 1] = 0.;
-     s->atoms->f[ii*3 + 2] = 0.;     
-     s->atoms->U[ii] = 0.;
-   }
-
-   HCC_ARRAY_STRUC(real_t, U, fSize, s->atoms->U);
-   HCC_ARRAY_STRUC(real_t, f, fSize*3, s->atoms->f);
-   HCC_ARRAY_STRUC(real_t, r, fSize*3, s->atoms->r);
-   HCC_ARRAY_STRUC(int, nAtoms, nBoxes, s->boxes->nAtoms);
-   HCC_ARRAY_STRUC(int, nbrBoxes, nBoxes * nNbrBoxes, s->boxes->nbrBoxes);
+   // persistent device copies, see deviceState.h
+   HCC_ARRAY_OBJECT(real_t, U) = *s->device->U;
+   HCC_ARRAY_OBJECT(real_t, f) = *s->device->f;
+   HCC_ARRAY_OBJECT(real_t, r) = *s->device->r;
+   HCC_ARRAY_OBJECT(int, nAtoms) = *s->device->nAtoms;
+   HCC_ARRAY_OBJECT(int, boxOffset) = *s->device->boxOffset;
+   HCC_ARRAY_OBJECT(int, nbrBoxes) = *s->device->nbrBoxes;
 
 	/* With tiling, each i-th box works in one tile each with several threads. 
 	 * Each thread in the tile works on each i-th atom.
 	 * Number of threads in a tile is equal to 64, i.e., the wavefront size.
 	 * This means that some threads can be left ideal if an i-th box does not
-	 * contain #MAXATOMS atoms.
+	 * contain #BOX_TILE atoms, and that the threads go through the slots of
+	 * a box with more atoms BOX_TILE at a time.
 	 * Important to mention that no data-copy is required with CPP AMP and 
 	 * host pointers are directly passed to the GPU without the need to create 
 	 * different data containers.
@@ -209,19 +218,24 @@ int ljForce(SimFlat* s)
 				       HCC_ID(f)
 				       HCC_ID(r)
 				       HCC_ID(nAtoms)
+				       HCC_ID(boxOffset)
 				       HCC_ID(nbrBoxes)](tiled_index<1> t_idx) restrict(amp){
-       int nIBox = nAtoms[t_idx.tile[0]];
+       int iBox = t_idx.tile[0];
+       int nIBox = nAtoms[iBox];
+       int iOff = boxOffset[iBox];
+       int nSlots = boxOffset[iBox+1] - iOff;
+       for (int ii=t_idx.local[0]; ii<nSlots; ii+=BOX_TILE){
+       real_t fi[3] = {0.0, 0.0, 0.0};
+       real_t ui = 0.0;
        // loop over neighbors of iBox
        for (int jTmp=0; jTmp<nNbrBoxes; jTmp++){
-	 int jBox = nbrBoxes[t_idx.tile[0]*nNbrBoxes + jTmp];
+	 int jBox = nbrBoxes[iBox*nNbrBoxes + jTmp];
 	 if(jBox >= 0){
 	   int nJBox = nAtoms[jBox];
-	   int iOff = t_idx.tile[0] * MAXATOMS;
-	   int ii = t_idx.local[0];
 	   // loop over atoms in iBox
 	   if(ii < nIBox){
 	     // loop over atoms in jBox
-	     for (int jOff=MAXATOMS*jBox,ij=0; ij<nJBox; ij++,jOff++){
+	     for (int jOff=boxOffset[jBox],ij=0; ij<nJBox; ij++,jOff++){
 	       real_t dr[3];
 	       real_t r2 = 0.0;
 	       for (int m=0; m<3; m++){
@@ -235,36 +249,437 @@ int ljForce(SimFlat* s)
 		 r2 = 1.0/r2;
 		 real_t r6 = s6 * (r2*r2*r2);
 		 real_t eLocal = r6 * (r6 - 1.0) - eShift;
-		 U[iOff + ii] += 0.5*eLocal;
+		 ui += 0.5*eLocal;
 
 		 // different formulation to avoid sqrt computation
 		 real_t fr = - 4.0*epsilon*r6*r2*(12.0*r6 - 6.0);
 		 for (int m=0; m<3; m++){
-		   f[(iOff + ii)*3 + m] -= dr[m]*fr;
+		   fi[m] -= dr[m]*fr;
 		 }
 	       }
 	     } // loop over atoms in jBox
 	   } // close if ii < nIBox
 	 } // close if jBox >= 0
        } // loop over neighbor boxes
+
+       // every slot of the box is written, empty ones with zero
+       U[iOff + ii] = ui;
+       for (int m=0; m<3; m++){
+	 f[(iOff + ii)*3 + m] = fi[m];
+       }
+       } // loop over slots of iBox
      } // loop over local boxes in system
      );
    fut.wait();
 
-   HCC_SYNC(U,s->atoms->U);
-   HCC_SYNC(f,s->atoms->f);   
+   deviceDownloadForces(s);
    
 
    /* A loop over all the atoms is requrired to reduce the ePot value.
     * Otherwise, update to ePot is required to be atomic which will 
     * lead to slow performance. 
     */
-   for (int iBox=0; iBox<s->boxes->nLocalBoxes; iBox++){
-     for(int iAtom = 0; iAtom < s->boxes->nAtoms[iBox]; iAtom++){
-       int iOff = iBox * MAXATOMS + iAtom;
-       ePot += s->atoms->U[iOff];
-     }
-   }
+   ePot = sumLocalAtoms(s->boxes, s->atoms->U);
+   ePot = ePot*4.0*epsilon;
+   s->ePotential = ePot;
+
+   return 0;
+}
+
+/// CPU version of ljForce that evaluates every pair of local atoms once.
+///
+/// Neighbors 14 to 26 of a box are its forward half shell (see
+/// getNeighborBoxes).  Pairs between a local box and a local forward
+/// neighbor, and pairs j>i within a box, apply equal and opposite
+/// forces to both atoms.  The backward local neighbors are skipped
+/// since those pairs are found from the other box.  Halo boxes are
+/// different: forces on halo atoms are never sent back to their owner,
+/// so every halo neighbor, forward or backward, is visited and only the
+/// local atom is updated.
+///
+/// A box writes to itself and its forward neighbors, so the boxes are
+/// processed by color (see initBoxColors) and the boxes of one color
+/// can run concurrently.
+int ljForceHalf(SimFlat* s)
+{
+   if (s->nbrList)
+      return ljForceHalfList(s);
+
+   LjPotential* pot = (LjPotential *) s->pot;
+   real_t sigma = pot->sigma;
+   real_t epsilon = pot->epsilon;
+   real_t rCut = pot->cutoff;
+   real_t rCut2 = rCut*rCut;
+
+   real_t s6 = sigma*sigma*sigma*sigma*sigma*sigma;
+   real_t rCut6 = s6 / (rCut2*rCut2*rCut2);
+   real_t eShift = POT_SHIFT * rCut6 * (rCut6 - 1.0);
+   int nNbrBoxes = 27;
+
+   LinkCell* boxes = s->boxes;
+   int nLocalBoxes = boxes->nLocalBoxes;
+   real_t* r = s->atoms->r;
+   real_t* f = s->atoms->f;
+   real_t* U = s->atoms->U;
+
+   // zero forces and energy
+   real_t ePot = 0.0;
+   s->ePotential = 0.0;
+   memset(f, 0, boxes->nLocalSlots*sizeof(real3));
+   memset(U, 0, boxes->nLocalSlots*sizeof(real_t));
+
+   for (int iColor=0; iColor<NBOXCOLORS; iColor++)
+   {
+      #pragma omp parallel for
+      for (int iC=boxes->colorStart[iColor]; iC<boxes->colorStart[iColor+1]; iC++)
+      {
+         int iBox = boxes->colorBoxes[iC];
+         int nIBox = boxes->nAtoms[iBox];
+
+         for (int jTmp=0; jTmp<nNbrBoxes; jTmp++)
+         {
+            int jBox = boxes->nbrBoxes[iBox*nNbrBoxes + jTmp];
+            int newton = (jBox < nLocalBoxes);
+            // a local box behind iBox finds these pairs from its side
+            if (newton && jTmp < nNbrBoxes/2) continue;
+            int nJBox = boxes->nAtoms[jBox];
+
+            for (int iOff=boxes->boxOffset[iBox],ii=0; ii<nIBox; ii++,iOff++)
+            {
+               int ij = (jBox == iBox) ? ii+1 : 0;
+               for (int jOff=boxes->boxOffset[jBox]+ij; ij<nJBox; ij++,jOff++)
+               {
+                  real_t dr[3];
+                  real_t r2 = 0.0;
+                  for (int m=0; m<3; m++)
+                  {
+                     dr[m] = r[iOff*3 + m] - r[jOff*3 + m];
+                     r2+=dr[m]*dr[m];
+                  }
+
+                  if ( r2 > rCut2 || r2 <= 0.0) continue;
+
+                  // from this point on r2 actually refers to 1.0/r2
+                  r2 = 1.0/r2;
+                  real_t r6 = s6 * (r2*r2*r2);
+                  real_t eLocal = r6 * (r6 - 1.0) - eShift;
+                  real_t fr = - 4.0*epsilon*r6*r2*(12.0*r6 - 6.0);
+
+                  U[iOff] += 0.5*eLocal;
+                  for (int m=0; m<3; m++)
+                     f[iOff*3 + m] -= dr[m]*fr;
+
+                  if (newton)
+                  {
+                     U[jOff] += 0.5*eLocal;
+                     for (int m=0; m<3; m++)
+                        f[jOff*3 + m] += dr[m]*fr;
+                  }
+               } // loop over atoms in jBox
+            } // loop over atoms in iBox
+         } // loop over neighbor boxes
+      } // loop over boxes of one color
+   } // loop over colors
+
+   ePot = sumLocalAtoms(boxes, U);
+
+   ePot = ePot*4.0*epsilon;
+   s->ePotential = ePot;
+
+   return 0;
+}
+
+/// Version of ljForce that reads the neighbors of each atom from the
+/// Verlet list.  Each thread handles one atom slot, so the kernel no
+/// longer needs the box counts or the neighbor box table.
+///
+/// \see NeighborListSt
+int ljForceList(SimFlat* s)
+{
+   LjPotential* pot = (LjPotential *) s->pot;
+   real_t sigma = pot->sigma;
+   real_t epsilon = pot->epsilon;
+   real_t rCut = pot->cutoff;
+   real_t rCut2 = rCut*rCut;
+
+   real_t s6 = sigma*sigma*sigma*sigma*sigma*sigma;
+   real_t rCut6 = s6 / (rCut2*rCut2*rCut2);
+   real_t eShift = POT_SHIFT * rCut6 * (rCut6 - 1.0);
+   int nLocalAtoms = s->device->nLocalAtoms;
+
+   real_t ePot = 0.0;
+   s->ePotential = 0.0;
+   extent<1> atomsExt(nLocalAtoms);
+   completion_future fut;
+
+   // persistent device copies, see deviceState.h
+   HCC_ARRAY_OBJECT(real_t, U) = *s->device->U;
+   HCC_ARRAY_OBJECT(real_t, f) = *s->device->f;
+   HCC_ARRAY_OBJECT(real_t, r) = *s->device->r;
+   HCC_ARRAY_OBJECT(int, nNbrs) = *s->device->nNbrs;
+   HCC_ARRAY_OBJECT(int, nbrList) = *s->device->nbrList;
+
+   fut = parallel_for_each(atomsExt, [=
+                                      HCC_ID(U)
+                                      HCC_ID(f)
+                                      HCC_ID(r)
+                                      HCC_ID(nNbrs)
+                                      HCC_ID(nbrList)](index<1> idx) restrict(amp){
+      int iOff = idx[0];
+      real_t fi[3] = {0.0, 0.0, 0.0};
+      real_t ui = 0.0;
+      for (int k=0; k<nNbrs[iOff]; k++){
+         int jOff = nbrList[k*nLocalAtoms + iOff];
+         real_t dr[3];
+         real_t r2 = 0.0;
+         for (int m=0; m<3; m++){
+            dr[m] = r[iOff*3 + m] - r[jOff*3 + m];
+            r2+=dr[m]*dr[m];
+         }
+
+         // the list holds pairs out to the cutoff plus the skin
+         if ( r2 <= rCut2){
+            // from this point on r2 actually refers to 1.0/r2
+            r2 = 1.0/r2;
+            real_t r6 = s6 * (r2*r2*r2);
+            real_t eLocal = r6 * (r6 - 1.0) - eShift;
+            ui += 0.5*eLocal;
+
+            real_t fr = - 4.0*epsilon*r6*r2*(12.0*r6 - 6.0);
+            for (int m=0; m<3; m++){
+               fi[m] -= dr[m]*fr;
+            }
+         }
+      } // loop over neighbors
+
+      // empty slots have no neighbors and are written with zero
+      U[iOff] = ui;
+      for (int m=0; m<3; m++){
+         f[iOff*3 + m] = fi[m];
+      }
+   });
+   fut.wait();
+
+   deviceDownloadForces(s);
+
+   ePot = sumLocalAtoms(s->boxes, s->atoms->U);
+   ePot = ePot*4.0*epsilon;
+   s->ePotential = ePot;
+
+   return 0;
+}
+
+/// Version of ljForceHalf that reads the neighbors of each atom from a
+/// half Verlet list.  The list was built from the same half shell, so
+/// the boxes are still processed by color and a neighbor in a local
+/// box gets the equal and opposite force.
+///
+/// \see NeighborListSt
+int ljForceHalfList(SimFlat* s)
+{
+   LjPotential* pot = (LjPotential *) s->pot;
+   real_t sigma = pot->sigma;
+   real_t epsilon = pot->epsilon;
+   real_t rCut = pot->cutoff;
+   real_t rCut2 = rCut*rCut;
+
+   real_t s6 = sigma*sigma*sigma*sigma*sigma*sigma;
+   real_t rCut6 = s6 / (rCut2*rCut2*rCut2);
+   real_t eShift = POT_SHIFT * rCut6 * (rCut6 - 1.0);
+
+   LinkCell* boxes = s->boxes;
+   int nLocalAtoms = s->nbrList->nLocalAtoms;
+   int* nNbrs = s->nbrList->nNbrs;
+   int* list = s->nbrList->list;
+   real_t* r = s->atoms->r;
+   real_t* f = s->atoms->f;
+   real_t* U = s->atoms->U;
+
+   // zero forces and energy
+   real_t ePot = 0.0;
+   s->ePotential = 0.0;
+   memset(f, 0, boxes->nLocalSlots*sizeof(real3));
+   memset(U, 0, boxes->nLocalSlots*sizeof(real_t));
+
+   for (int iColor=0; iColor<NBOXCOLORS; iColor++)
+   {
+      #pragma omp parallel for
+      for (int iC=boxes->colorStart[iColor]; iC<boxes->colorStart[iColor+1]; iC++)
+      {
+         int iBox = boxes->colorBoxes[iC];
+         for (int iOff=boxes->boxOffset[iBox],ii=0; ii<boxes->nAtoms[iBox]; ii++,iOff++)
+         {
+            for (int k=0; k<nNbrs[iOff]; k++)
+            {
+               int jOff = list[k*nLocalAtoms + iOff];
+               real_t dr[3];
+               real_t r2 = 0.0;
+               for (int m=0; m<3; m++)
+               {
+                  dr[m] = r[iOff*3 + m] - r[jOff*3 + m];
+                  r2+=dr[m]*dr[m];
+               }
+
+               if ( r2 > rCut2) continue;
+
+               // from this point on r2 actually refers to 1.0/r2
+               r2 = 1.0/r2;
+               real_t r6 = s6 * (r2*r2*r2);
+               real_t eLocal = r6 * (r6 - 1.0) - eShift;
+               real_t fr = - 4.0*epsilon*r6*r2*(12.0*r6 - 6.0);
+
+               U[iOff] += 0.5*eLocal;
+               for (int m=0; m<3; m++)
+                  f[iOff*3 + m] -= dr[m]*fr;
+
+               if (jOff < nLocalAtoms)
+               {
+                  U[jOff] += 0.5*eLocal;
+                  for (int m=0; m<3; m++)
+                     f[jOff*3 + m] += dr[m]*fr;
+               }
+            } // loop over neighbors
+         } // loop over atoms in iBox
+      } // loop over boxes of one color
+   } // loop over colors
+
+   ePot = sumLocalAtoms(boxes, U);
+
+   ePot = ePot*4.0*epsilon;
+   s->ePotential = ePot;
+
+   return 0;
+}
+
+/// Energy and force factor of one pair inside the cutoff.  The helper
+/// only does arithmetic, so it inlines into the vector loops of
+/// ljForceHalfSoa as a single body.
+static inline void ljPairSoa(real_t r2, real_t s6, real_t epsilon, real_t eShift,
+                             real_t* eLocal, real_t* fr)
+{
+   real_t ir2 = 1.0/r2;
+   real_t r6 = s6 * (ir2*ir2*ir2);
+   *eLocal = r6 * (r6 - 1.0) - eShift;
+   *fr = - 4.0*epsilon*r6*ir2*(12.0*r6 - 6.0);
+}
+
+/// Version of ljForceHalf that works on the structure of arrays copies
+/// of the positions and forces (see initAtomsSoa).
+///
+/// For each atom i the neighbors inside the cutoff are packed into two
+/// index lists by packSoaNeighbors, and the pair terms are computed by
+/// vector loops over the lists.  Every lane of the loop over the atoms
+/// of local boxes has a different j, so the updates of the j atoms do
+/// not conflict.
+///
+/// \see ljForceHalf for the neighbor shell and the box coloring.
+int ljForceHalfSoa(SimFlat* s)
+{
+   if (s->nbrList)
+      return ljForceHalfList(s);
+
+   LjPotential* pot = (LjPotential *) s->pot;
+   real_t sigma = pot->sigma;
+   real_t epsilon = pot->epsilon;
+   real_t rCut = pot->cutoff;
+   real_t rCut2 = rCut*rCut;
+
+   real_t s6 = sigma*sigma*sigma*sigma*sigma*sigma;
+   real_t rCut6 = s6 / (rCut2*rCut2*rCut2);
+   real_t eShift = POT_SHIFT * rCut6 * (rCut6 - 1.0);
+
+   LinkCell* boxes = s->boxes;
+   Atoms* atoms = s->atoms;
+   real_t* rx = atoms->rx;
+   real_t* ry = atoms->ry;
+   real_t* rz = atoms->rz;
+   real_t* fx = atoms->fx;
+   real_t* fy = atoms->fy;
+   real_t* fz = atoms->fz;
+   real_t* U = atoms->U;
+
+   gatherSoaPositions(atoms, boxes);
+
+   // zero forces and energy
+   real_t ePot = 0.0;
+   s->ePotential = 0.0;
+   memset(fx, 0, boxes->nLocalSlots*sizeof(real_t));
+   memset(fy, 0, boxes->nLocalSlots*sizeof(real_t));
+   memset(fz, 0, boxes->nLocalSlots*sizeof(real_t));
+   memset(U,  0, boxes->nLocalSlots*sizeof(real_t));
+
+   for (int iColor=0; iColor<NBOXCOLORS; iColor++)
+   {
+      #pragma omp parallel for
+      for (int iC=boxes->colorStart[iColor]; iC<boxes->colorStart[iColor+1]; iC++)
+      {
+         int iBox = boxes->colorBoxes[iC];
+         int nIBox = boxes->nAtoms[iBox];
+         int jNewton[27*boxes->maxCapacity];
+         int jHalo[27*boxes->maxCapacity];
+
+         for (int iOff=boxes->boxOffset[iBox],ii=0; ii<nIBox; ii++,iOff++)
+         {
+            int nNewton, nHalo;
+            packSoaNeighbors(atoms, boxes, iBox, iOff, rCut2,
+                             jNewton, &nNewton, jHalo, &nHalo);
+
+            real_t xi = rx[iOff];
+            real_t yi = ry[iOff];
+            real_t zi = rz[iOff];
+            real_t fxi = 0.0;
+            real_t fyi = 0.0;
+            real_t fzi = 0.0;
+            real_t ui = 0.0;
+
+            #pragma omp simd reduction(+:fxi,fyi,fzi,ui)
+            for (int k=0; k<nNewton; k++)
+            {
+               int jOff = jNewton[k];
+               real_t dx = xi - rx[jOff];
+               real_t dy = yi - ry[jOff];
+               real_t dz = zi - rz[jOff];
+               real_t eLocal, fr;
+               ljPairSoa(dx*dx + dy*dy + dz*dz, s6, epsilon, eShift, &eLocal, &fr);
+
+               ui += 0.5*eLocal;
+               fxi -= dx*fr;
+               fyi -= dy*fr;
+               fzi -= dz*fr;
+               U[jOff] += 0.5*eLocal;
+               fx[jOff] += dx*fr;
+               fy[jOff] += dy*fr;
+               fz[jOff] += dz*fr;
+            }
+
+            #pragma omp simd reduction(+:fxi,fyi,fzi,ui)
+            for (int k=0; k<nHalo; k++)
+            {
+               int jOff = jHalo[k];
+               real_t dx = xi - rx[jOff];
+               real_t dy = yi - ry[jOff];
+               real_t dz = zi - rz[jOff];
+               real_t eLocal, fr;
+               ljPairSoa(dx*dx + dy*dy + dz*dz, s6, epsilon, eShift, &eLocal, &fr);
+
+               ui += 0.5*eLocal;
+               fxi -= dx*fr;
+               fyi -= dy*fr;
+               fzi -= dz*fr;
+            }
+
+            U[iOff] += ui;
+            fx[iOff] += fxi;
+            fy[iOff] += fyi;
+            fz[iOff] += fzi;
+         } // loop over atoms in iBox
+      } // loop over boxes of one color
+   } // loop over colors
+
+   scatterSoaForces(atoms, boxes);
+
+   ePot = sumLocalAtoms(boxes, U);
+
    ePot = ePot*4.0*epsilon;
    s->ePotential = ePot;
 
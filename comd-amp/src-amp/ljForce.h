@@ -27,7 +27,7 @@ typedef struct LjPotentialSt
 } LjPotential;
 
 struct BasePotentialSt;
-struct BasePotentialSt* initLjPot(void);
+struct BasePotentialSt* initLjPot(int halfShell, int soa);
 
 #endif
 
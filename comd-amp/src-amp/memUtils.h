@@ -19,6 +19,15 @@ static void* comdCalloc(size_t num, size_t iSize)
    return calloc(num, iSize);
 }
 
+/// Memory from comdAlignedMalloc is released with comdFree.
+static void* comdAlignedMalloc(size_t alignment, size_t iSize)
+{
+   void* ptr = NULL;
+   if (posix_memalign(&ptr, alignment, iSize) != 0)
+      return NULL;
+   return ptr;
+}
+
 static void* comdRealloc(void* ptr, size_t iSize)
 {
    return realloc(ptr, iSize);
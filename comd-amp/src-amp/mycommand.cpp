@@ -74,6 +74,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /// | \--lat        | -l          | -1            | lattice parameter (Angstroms)
 /// | \--temp       | -T          | 600           | initial temperature (K)
 /// | \--delta      | -r          | 0             | initial delta (Angstroms)
+/// | \--halfShell  | -H          | N/A           | half neighbor shell forces on the CPU
+/// | \--skin       | -s          | 0             | Verlet list skin (Angstroms)
+/// | \--soa        | -S          | N/A           | SIMD forces on a structure of arrays layout
+/// | \--overlap    | -O          | N/A           | overlap the EAM force exchange with computation
+/// | \--boxOrder   | -b          | 0             | link cell order (0 lexicographic, 1 Morton, 2 Hilbert)
+/// | \--fusedEam   | -F          | N/A           | fused EAM device passes with cached pairs
+/// | \--checkpoint | -c          | 0             | number of steps between checkpoints (0 for none)
+/// | \--checkpointName | -C      | comd.ckpt     | checkpoint file name prefix
+/// | \--restart    | -R          | N/A           | restart from a checkpoint
 ///
 /// Notes: 
 /// 
@@ -91,6 +100,65 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /// of entries (500 vs. 10,000 points, respectively) This may give very
 /// different performance, depending on the hardware.
 ///
+/// By default the forces are computed by the C++ AMP kernels, which
+/// visit all 27 neighbor boxes and evaluate every pair twice.
+/// \--halfShell computes them on the CPU instead and evaluates each
+/// pair of local atoms once, applying equal and opposite forces.  Pairs
+/// with halo atoms are still evaluated from the local side only.
+///
+/// A positive \--skin makes the force routines read Verlet neighbor
+/// lists built with the cutoff plus the skin, instead of searching the
+/// neighbor boxes every step.  The lists and the atom layout are kept
+/// until some atom has moved more than half the skin; in between only
+/// the halo positions are exchanged.  The link cells are sized to the
+/// list radius.  Around 0.3 Angstroms is a reasonable choice for the
+/// supplied copper potentials.
+///
+/// \--soa copies the positions and forces into separate x, y and z
+/// arrays and computes the half shell forces with loops the compiler
+/// can vectorize (build with OPENMP=ON so the simd pragmas are
+/// honored).  It implies \--halfShell.  The interleaved layout is still
+/// used everywhere else, so running with and without \--soa compares
+/// the two.  The Verlet list routines do not have an SoA version and
+/// take precedence when \--skin is set.
+///
+/// \--overlap posts the exchange of the EAM embedding energy
+/// derivatives with nonblocking messages and computes the embedding
+/// force of the interior boxes, which have no halo neighbors, while the
+/// messages are in flight.  The boundary boxes follow once the exchange
+/// completes.  The results are the same as without it.  It has no
+/// effect on the LJ potential.
+///
+/// \--boxOrder numbers the local link cells along a Morton (1) or
+/// Hilbert (2) space filling curve instead of lexicographically (0).
+/// The neighbor boxes of a box are then closer in memory, and the
+/// boxes a thread gets from a static loop are a compact region whose
+/// atoms were placed on its socket by first touch.  Compare the force
+/// timer with and without it.  Energies are summed in box order, so
+/// the last digits of the energies can change with the order.
+///
+/// \--fusedEam replaces the three EAM device kernels with two.  The
+/// first computes the pair terms and the density of an atom, then its
+/// embedding energy, and keeps the index and the density derivative of
+/// each pair inside the cutoff.  After the exchange of the embedding
+/// derivatives the second reads the kept pairs instead of searching
+/// the neighbor boxes again.  It applies to the device forces only;
+/// \--halfShell and \--skin take precedence.
+///
+/// \--checkpoint writes the positions and momenta of the atoms every
+/// given number of steps, which must be a multiple of \--printRate.
+/// Each rank writes its own file, checkpointName.<step>.<rank>, on a
+/// background thread while the run continues.  Once all ranks have
+/// written theirs, checkpointName.latest is updated to name the new
+/// checkpoint and the files of the previous one are removed.
+/// \--restart continues a run from the checkpoint named by
+/// name.latest, at the step it was written, instead of creating a
+/// lattice.  \--nSteps is still the last step of the run and must be
+/// past the checkpoint step.  The restarted run may use a different
+/// number of ranks, but the unit cells and lattice parameter must give
+/// the same global box.
+/// \--temp and \--delta are ignored.
+///
 /// The default temperature is 600K.  However, when using a perfect
 /// lattice the system will rapidly cool to 300K due to equipartition of
 /// energy.
@@ -221,6 +289,8 @@ Command parseCommandLine(int argc, char** argv)
    memset(cmd.potDir, 0, 1024);
    memset(cmd.potName, 0, 1024);
    memset(cmd.potType, 0, 1024);
+   memset(cmd.checkpointName, 0, 1024);
+   memset(cmd.restart, 0, 1024);
    strcpy(cmd.potDir,  "pots");
    strcpy(cmd.potName, "\0"); // default depends on potType
    strcpy(cmd.potType, "funcfl");
@@ -237,6 +307,14 @@ Command parseCommandLine(int argc, char** argv)
    cmd.lat = -1.0;
    cmd.temperature = 600.0;
    cmd.initialDelta = 0.0;
+   cmd.halfShell = 0;
+   cmd.skin = 0.0;
+   cmd.soa = 0;
+   cmd.overlap = 0;
+   cmd.boxOrder = 0;
+   cmd.fusedEam = 0;
+   cmd.checkpointRate = 0;
+   strcpy(cmd.checkpointName, "comd.ckpt");
 
    int help=0;
    // add arguments for processing.  Please update the html documentation too!
@@ -257,9 +335,22 @@ Command parseCommandLine(int argc, char** argv)
    addArg("lat",        'l', 1, 'd',  &(cmd.lat),          0,             "lattice parameter (Angstroms)");
    addArg("temp",       'T', 1, 'd',  &(cmd.temperature),  0,             "initial temperature (K)");
    addArg("delta",      'r', 1, 'd',  &(cmd.initialDelta), 0,             "initial delta (Angstroms)");
+   addArg("halfShell",  'H', 0, 'i',  &(cmd.halfShell),    0,             "half neighbor shell forces on the CPU");
+   addArg("skin",       's', 1, 'd',  &(cmd.skin),         0,             "Verlet list skin (Angstroms)");
+   addArg("soa",        'S', 0, 'i',  &(cmd.soa),          0,             "SIMD forces on a structure of arrays layout");
+   addArg("overlap",    'O', 0, 'i',  &(cmd.overlap),      0,             "overlap the EAM force exchange with computation");
+   addArg("boxOrder",   'b', 1, 'i',  &(cmd.boxOrder),     0,             "link cell order (0 lexicographic, 1 Morton, 2 Hilbert)");
+   addArg("fusedEam",   'F', 0, 'i',  &(cmd.fusedEam),     0,             "fused EAM device passes with cached pairs");
+   addArg("checkpoint", 'c', 1, 'i',  &(cmd.checkpointRate), 0,             "number of steps between checkpoints (0 for none)");
+   addArg("checkpointName", 'C', 1, 's', cmd.checkpointName, sizeof(cmd.checkpointName), "checkpoint file name prefix");
+   addArg("restart",    'R', 1, 's',  cmd.restart,   sizeof(cmd.restart), "restart from a checkpoint");
 
    processArgs(argc,argv);
 
+   // the SoA kernels are versions of the half shell kernels
+   if (cmd.soa)
+      cmd.halfShell = 1;
+
    // If user didn't set potName, set type dependent default.
    if (strlen(cmd.potName) == 0) 
    {
@@ -302,6 +393,15 @@ void printCmdYaml(FILE* file, Command* cmd)
            "  Time step: %g fs\n"
            "  Initial Temperature: %g K\n"
            "  Initial Delta: %g Angstroms\n"
+           "  Half shell: %d\n"
+           "  Skin: %g Angstroms\n"
+           "  SoA: %d\n"
+           "  Overlap: %d\n"
+           "  Box order: %d\n"
+           "  Fused EAM: %d\n"
+           "  Checkpoint rate: %d\n"
+           "  Checkpoint name: %s\n"
+           "  Restart: %s\n"
            "\n",
            cmd->doeam,
            cmd->potDir,
@@ -314,7 +414,16 @@ void printCmdYaml(FILE* file, Command* cmd)
            cmd->printRate,
            cmd->dt,
            cmd->temperature,
-           cmd->initialDelta
+           cmd->initialDelta,
+           cmd->halfShell,
+           cmd->skin,
+           cmd->soa,
+           cmd->overlap,
+           cmd->boxOrder,
+           cmd->fusedEam,
+           cmd->checkpointRate,
+           cmd->checkpointName,
+           cmd->restart
    );
    fflush(file);
 }
@@ -27,6 +27,15 @@ typedef struct CommandSt
    double lat;         //!< lattice constant (in Angstroms)
    double temperature; //!< simulation initial temperature (in Kelvin)
    double initialDelta; //!< magnitude of initial displacement from lattice (in Angstroms)
+   int halfShell;      //!< compute forces on the CPU with a half neighbor shell
+   double skin;        //!< Verlet list skin (in Angstroms), 0 for no list
+   int soa;            //!< SIMD half shell forces on a structure of arrays layout
+   int overlap;        //!< overlap the EAM force exchange with computation
+   int boxOrder;       //!< numbering of the local link cells, a BoxOrder
+   int fusedEam;       //!< fused EAM device passes with cached pairs
+   int checkpointRate; //!< number of steps between checkpoints, 0 for none
+   char checkpointName[1024]; //!< checkpoint files are checkpointName.<rank>
+   char restart[1024]; //!< checkpoint to restart from, empty to start a new run
 } Command;
 
 /// Process command line arguments into an easy to handle structure.
@@ -0,0 +1,213 @@
+/*******************************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. 
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/// \file
+/// Verlet neighbor lists built from the link cells.
+///
+/// The link cells are sized to the list radius (cutoff plus skin), so
+/// the 27 neighbor boxes of a box still hold every candidate neighbor.
+/// The lists are rebuilt only when the displacement test fails, which
+/// replaces the per step rebinning, atom exchange and sort with a much
+/// cheaper position exchange on most steps.
+
+#include "neighborList.h"
+
+#include <string.h>
+#include <assert.h>
+
+#include "CoMDTypes.h"
+#include "linkCells.h"
+#include "parallel.h"
+#include "memUtils.h"
+#include "performanceTimers.h"
+
+#define MAX(A,B) ((A) > (B) ? (A) : (B))
+
+static int fillNeighborList(NeighborList* nbrList, LinkCell* boxes, real_t* r);
+
+NeighborList* initNeighborList(LinkCell* boxes, real_t cutoff, real_t skin, int half)
+{
+   NeighborList* nbrList = (NeighborList*) comdMalloc(sizeof(NeighborList));
+   assert(nbrList);
+
+   nbrList->skin = skin;
+   nbrList->cutoff2 = (cutoff + skin)*(cutoff + skin);
+   nbrList->half = half;
+   nbrList->nLocalAtoms = boxes->nLocalSlots;
+   nbrList->maxNbrs = 0;
+   nbrList->nNbrs = (int*) comdCalloc(nbrList->nLocalAtoms, sizeof(int));
+   nbrList->list = NULL;
+   nbrList->r0 = (real_t*) comdCalloc(nbrList->nLocalAtoms*3, sizeof(real_t));
+   nbrList->nBuilds = 0;
+
+   return nbrList;
+}
+
+void destroyNeighborList(NeighborList** nbrList)
+{
+   if (! nbrList) return;
+   if (! *nbrList) return;
+
+   comdFree((*nbrList)->nNbrs);
+   comdFree((*nbrList)->list);
+   comdFree((*nbrList)->r0);
+   comdFree(*nbrList);
+   *nbrList = NULL;
+}
+
+/// The test must give the same answer on every rank since a rebuild
+/// starts with a collective atom exchange.
+int neighborListIsStale(SimFlat* sim)
+{
+   NeighborList* nbrList = sim->nbrList;
+   LinkCell* boxes = sim->boxes;
+   real_t* r = sim->atoms->r;
+   real_t* r0 = nbrList->r0;
+   real_t maxDisp2 = 0.25*nbrList->skin*nbrList->skin;
+
+   int stale = (nbrList->nBuilds == 0);
+   #pragma omp parallel for reduction(max:stale)
+   for (int iBox=0; iBox<boxes->nLocalBoxes; iBox++)
+   {
+      for (int iOff=boxes->boxOffset[iBox],ii=0; ii<boxes->nAtoms[iBox]; ii++,iOff++)
+      {
+         real_t d2 = 0.0;
+         for (int m=0; m<3; m++)
+         {
+            real_t dr = r[iOff*3 + m] - r0[iOff*3 + m];
+            d2 += dr*dr;
+         }
+         if (d2 > maxDisp2)
+            stale = 1;
+      }
+   }
+
+   int anyStale;
+   startTimer(commReduceTimer);
+   maxIntParallel(&stale, &anyStale, 1);
+   stopTimer(commReduceTimer);
+
+   return anyStale;
+}
+
+/// Fill the list and grow it if some slot has more neighbors than it
+/// can hold.  The capacity gets some headroom so a small increase in
+/// the density doesn't force another pass on the next build.
+///
+/// The list is indexed by atom slot, so it is reallocated when the link
+/// cells have grown.
+void buildNeighborList(SimFlat* sim)
+{
+   NeighborList* nbrList = sim->nbrList;
+   LinkCell* boxes = sim->boxes;
+
+   if (nbrList->nLocalAtoms != boxes->nLocalSlots)
+   {
+      nbrList->nLocalAtoms = boxes->nLocalSlots;
+      nbrList->maxNbrs = 0;
+      freeMe(nbrList,list);
+      comdFree(nbrList->nNbrs);
+      comdFree(nbrList->r0);
+      nbrList->nNbrs = (int*) comdCalloc(nbrList->nLocalAtoms, sizeof(int));
+      nbrList->r0 = (real_t*) comdCalloc(nbrList->nLocalAtoms*3, sizeof(real_t));
+   }
+
+   int maxCount = fillNeighborList(nbrList, boxes, sim->atoms->r);
+   if (maxCount > nbrList->maxNbrs)
+   {
+      nbrList->maxNbrs = maxCount + maxCount/8 + 1;
+      comdFree(nbrList->list);
+      nbrList->list = (int*) comdMalloc(nbrList->maxNbrs*nbrList->nLocalAtoms*sizeof(int));
+      maxCount = fillNeighborList(nbrList, boxes, sim->atoms->r);
+      assert(maxCount <= nbrList->maxNbrs);
+   }
+
+   memcpy(nbrList->r0, sim->atoms->r, nbrList->nLocalAtoms*sizeof(real3));
+   nbrList->nBuilds++;
+}
+
+/// Store the neighbors of every local atom that fit in the current
+/// capacity.
+///
+/// \return The largest number of neighbors of any slot, including the
+/// ones that did not fit.
+int fillNeighborList(NeighborList* nbrList, LinkCell* boxes, real_t* r)
+{
+   int nNbrBoxes = 27;
+   int nLocalBoxes = boxes->nLocalBoxes;
+   int nLocalAtoms = nbrList->nLocalAtoms;
+   int maxNbrs = nbrList->maxNbrs;
+   int half = nbrList->half;
+   real_t cutoff2 = nbrList->cutoff2;
+   int* nNbrs = nbrList->nNbrs;
+   int* list = nbrList->list;
+
+   memset(nNbrs, 0, nLocalAtoms*sizeof(int));
+
+   int maxCount = 0;
+   #pragma omp parallel for reduction(max:maxCount)
+   for (int iBox=0; iBox<nLocalBoxes; iBox++)
+   {
+      int nIBox = boxes->nAtoms[iBox];
+      for (int iOff=boxes->boxOffset[iBox],ii=0; ii<nIBox; ii++,iOff++)
+      {
+         int count = 0;
+         for (int jTmp=0; jTmp<nNbrBoxes; jTmp++)
+         {
+            int jBox = boxes->nbrBoxes[iBox*nNbrBoxes + jTmp];
+            // see ljForceHalf for the half shell
+            if (half && jBox < nLocalBoxes && jTmp < nNbrBoxes/2) continue;
+            int nJBox = boxes->nAtoms[jBox];
+
+            int ij = (half && jBox == iBox) ? ii+1 : 0;
+            for (int jOff=boxes->boxOffset[jBox]+ij; ij<nJBox; ij++,jOff++)
+            {
+               if (jOff == iOff) continue;
+               real_t r2 = 0.0;
+               for (int m=0; m<3; m++)
+               {
+                  real_t dr = r[iOff*3 + m] - r[jOff*3 + m];
+                  r2 += dr*dr;
+               }
+               if (r2 > cutoff2) continue;
+
+               if (count < maxNbrs)
+                  list[count*nLocalAtoms + iOff] = jOff;
+               count++;
+            }
+         }
+         nNbrs[iOff] = count;
+         maxCount = MAX(maxCount, count);
+      }
+   }
+
+   return maxCount;
+}
@@ -0,0 +1,83 @@
+/*******************************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. 
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/// \file
+/// Verlet neighbor lists built from the link cells.
+
+#ifndef __NEIGHBOR_LIST_H_
+#define __NEIGHBOR_LIST_H_
+
+#include "mytype.h"
+
+struct SimFlatSt;
+struct LinkCellSt;
+
+/// Neighbor list of every local atom slot.  The list holds every atom
+/// within the potential cutoff plus a skin distance, so it stays valid
+/// until some atom has moved more than half the skin.  Until then the
+/// atoms keep their link cell slots and only the positions of the halo
+/// atoms are exchanged.
+///
+/// The neighbors of slot i are list[k*nLocalAtoms + i] for k <
+/// nNbrs[i], so the threads of a wavefront that handle consecutive
+/// slots read consecutive words.  Empty slots have no neighbors.
+///
+/// A half list stores each pair of local atoms once, using the same
+/// half shell as ljForceHalf, and every pair with a halo atom from the
+/// local side.  A neighbor j < nLocalAtoms is then a local atom that
+/// gets the equal and opposite force.
+///
+/// \see redistributeAtoms
+typedef struct NeighborListSt
+{
+   real_t skin;      //!< list radius beyond the potential cutoff
+   real_t cutoff2;   //!< square of the list radius
+   int half;         //!< store each pair of local atoms once
+   int nLocalAtoms;  //!< atom slots in local boxes
+   int maxNbrs;      //!< capacity of the list of each slot
+   int* nNbrs;       //!< number of neighbors of each slot
+   int* list;        //!< neighbor slots
+   real_t* r0;       //!< local positions when the list was built
+   int nBuilds;      //!< number of times the list has been built
+} NeighborList;
+
+NeighborList* initNeighborList(struct LinkCellSt* boxes, real_t cutoff, real_t skin, int half);
+void destroyNeighborList(NeighborList** nbrList);
+
+/// Returns 1 on every rank if any atom on any rank has moved more than
+/// half the skin since the list was built, or if it was never built.
+int neighborListIsStale(struct SimFlatSt* sim);
+
+/// Rebuild the list from the link cells.  The atoms must have been
+/// redistributed and sorted.
+void buildNeighborList(struct SimFlatSt* sim);
+
+#endif
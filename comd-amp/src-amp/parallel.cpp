@@ -47,9 +47,27 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <assert.h>
 
+#include "memUtils.h"
+
 static int myRank = 0;
 static int nRanks = 1;
 
+/// Without MPI a send is copied straight into the receive posted with
+/// the same tag, so the receives have to be posted first.
+struct CommRequestsSt
+{
+   int n;                  //!< number of slots
+#ifdef DO_MPI
+   MPI_Request* requests;  //!< one request per slot
+   MPI_Status* statuses;   //!< status of each slot once complete
+#else
+   char** recvBufs;        //!< buffer of each posted receive
+   int* recvLens;          //!< capacity of each posted receive
+   int* tags;              //!< tag of each posted receive, -1 if none
+   int* counts;            //!< bytes copied into each receive
+#endif
+};
+
 #ifdef DO_MPI
 #ifdef SINGLE
 #define REAL_MPI_TYPE MPI_FLOAT
@@ -141,6 +159,107 @@ int sendReceiveParallel(void* sendBuf, int sendLen, int dest,
 #endif
 }
 
+CommRequests* initCommRequests(int n)
+{
+   CommRequests* req = (CommRequests*) comdMalloc(sizeof(CommRequests));
+   req->n = n;
+#ifdef DO_MPI
+   req->requests = (MPI_Request*) comdMalloc(n*sizeof(MPI_Request));
+   req->statuses = (MPI_Status*) comdMalloc(n*sizeof(MPI_Status));
+   for (int ii=0; ii<n; ++ii)
+      req->requests[ii] = MPI_REQUEST_NULL;
+#else
+   req->recvBufs = (char**) comdMalloc(n*sizeof(char*));
+   req->recvLens = (int*) comdMalloc(n*sizeof(int));
+   req->tags = (int*) comdMalloc(n*sizeof(int));
+   req->counts = (int*) comdMalloc(n*sizeof(int));
+   for (int ii=0; ii<n; ++ii)
+      req->tags[ii] = -1;
+#endif
+   return req;
+}
+
+void destroyCommRequests(CommRequests** requests)
+{
+   if (! requests) return;
+   CommRequests* req = *requests;
+   if (! req) return;
+#ifdef DO_MPI
+   comdFree(req->requests);
+   comdFree(req->statuses);
+#else
+   comdFree(req->recvBufs);
+   comdFree(req->recvLens);
+   comdFree(req->tags);
+   comdFree(req->counts);
+#endif
+   comdFree(req);
+   *requests = NULL;
+}
+
+void irecvParallel(void* recvBuf, int recvLen, int source, int tag,
+                   CommRequests* requests, int iReq)
+{
+   assert(iReq < requests->n);
+#ifdef DO_MPI
+   MPI_Irecv(recvBuf, recvLen, MPI_BYTE, source, tag, MPI_COMM_WORLD,
+             &requests->requests[iReq]);
+#else
+   requests->recvBufs[iReq] = (char*) recvBuf;
+   requests->recvLens[iReq] = recvLen;
+   requests->tags[iReq] = tag;
+   requests->counts[iReq] = 0;
+#endif
+}
+
+void isendParallel(void* sendBuf, int sendLen, int dest, int tag,
+                   CommRequests* requests, int iReq)
+{
+   assert(iReq < requests->n);
+#ifdef DO_MPI
+   MPI_Isend(sendBuf, sendLen, MPI_BYTE, dest, tag, MPI_COMM_WORLD,
+             &requests->requests[iReq]);
+#else
+   int jReq = 0;
+   while (jReq < requests->n && requests->tags[jReq] != tag)
+      ++jReq;
+   assert(jReq < requests->n);
+   assert(sendLen <= requests->recvLens[jReq]);
+   memcpy(requests->recvBufs[jReq], sendBuf, sendLen);
+   requests->counts[jReq] = sendLen;
+   requests->tags[jReq] = -1;
+#endif
+}
+
+int testAllParallel(CommRequests* requests)
+{
+#ifdef DO_MPI
+   int done;
+   MPI_Testall(requests->n, requests->requests, &done, requests->statuses);
+   return done;
+#else
+   return 1;
+#endif
+}
+
+void waitAllParallel(CommRequests* requests)
+{
+#ifdef DO_MPI
+   MPI_Waitall(requests->n, requests->requests, requests->statuses);
+#endif
+}
+
+int recvCountParallel(CommRequests* requests, int iReq)
+{
+#ifdef DO_MPI
+   int bytesReceived;
+   MPI_Get_count(&requests->statuses[iReq], MPI_BYTE, &bytesReceived);
+   return bytesReceived;
+#else
+   return requests->counts[iReq];
+#endif
+}
+
 void addIntParallel(int* sendBuf, int* recvBuf, int count)
 {
 #ifdef DO_MPI
@@ -39,6 +39,31 @@ void barrierParallel(void);
 int sendReceiveParallel(void* sendBuf, int sendLen, int dest,
                         void* recvBuf, int recvLen, int source);
 
+/// Pending nonblocking messages, see initCommRequests.
+typedef struct CommRequestsSt CommRequests;
+
+/// Allocate room to track n nonblocking messages.
+CommRequests* initCommRequests(int n);
+void destroyCommRequests(CommRequests** requests);
+
+/// Wrapper for MPI_Irecv.  The message is tracked in slot iReq.
+void irecvParallel(void* recvBuf, int recvLen, int source, int tag,
+                   CommRequests* requests, int iReq);
+
+/// Wrapper for MPI_Isend.  The message is tracked in slot iReq.
+void isendParallel(void* sendBuf, int sendLen, int dest, int tag,
+                   CommRequests* requests, int iReq);
+
+/// Wrapper for MPI_Testall.  Returns non-zero once every posted message
+/// has completed.
+int testAllParallel(CommRequests* requests);
+
+/// Wrapper for MPI_Waitall.
+void waitAllParallel(CommRequests* requests);
+
+/// Number of bytes received by the completed receive in slot iReq.
+int recvCountParallel(CommRequests* requests, int iReq);
+
 /// Wrapper for MPI_Allreduce integer sum.
 void addIntParallel(int* sendBuf, int* recvBuf, int count);
 
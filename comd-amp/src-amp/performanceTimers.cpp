@@ -55,10 +55,12 @@ const char* timerName[numberOfTimers] = {
    "  velocity",
    "  redistribute",
    "    atomHalo",
+   "    neighborList",
    "  force",
    "    eamHalo",
    "commHalo",
-   "commReduce"
+   "commReduce",
+   "checkpoint"
 };
 
 /// Timer data collected.  Also facilitates computing averages and
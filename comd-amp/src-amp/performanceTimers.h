@@ -15,10 +15,12 @@ enum TimerHandle{
    velocityTimer,  
    redistributeTimer, 
    atomHaloTimer, 
+   neighborListTimer, 
    computeForceTimer, 
    eamHaloTimer, 
    commHaloTimer, 
    commReduceTimer, 
+   checkpointTimer, 
    numberOfTimers};
 
 /// Use the startTimer and stopTimer macros for timers in code regions
@@ -38,6 +38,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "linkCells.h"
 #include "parallel.h"
 #include "performanceTimers.h"
+#include "memUtils.h"
+#include "deviceState.h"
+#include "neighborList.h"
+#include "haloExchange.h"
 
 #include <hc.hpp>
 using namespace hc;
@@ -109,9 +113,10 @@ void advanceVelocity(SimFlat* s, int nBoxes, real_t dt)
   completion_future fut;
   
 #if 1 // Run on CPU
+   #pragma omp parallel for
    for (int iBox=0; iBox<nBoxes; iBox++)
    {
-      for (int iOff=MAXATOMS*iBox,ii=0; ii<s->boxes->nAtoms[iBox]; ii++,iOff++)
+      for (int iOff=s->boxes->boxOffset[iBox],ii=0; ii<s->boxes->nAtoms[iBox]; ii++,iOff++)
       {
          s->atoms->p[iOff*3 + 0] += dt*s->atoms->f[iOff*3 + 0];
          s->atoms->p[iOff*3 + 1] += dt*s->atoms->f[iOff*3 + 1];
@@ -122,17 +127,16 @@ void advanceVelocity(SimFlat* s, int nBoxes, real_t dt)
 #else // Run on GPU
 
    // C++ AMP with tiling. At present 4x slower than single-threaded CPU
-   extent<1> boxesExt(nBoxes * MAXATOMS);
-   tiled_extent<1> tBoxesExt(boxesExt, MAXATOMS);
+   extent<1> boxesExt(nBoxes * BOX_TILE);
+   tiled_extent<1> tBoxesExt(boxesExt, BOX_TILE);
 
    fut = parallel_for_each(
 		   tBoxesExt, [=](tiled_index<1> t_idx) restrict(amp)
 		{
 			int iBox = t_idx.tile[0];
-			int iOff = iBox * MAXATOMS;
-			int ii = t_idx.local[0];
+			int iOff = s->boxes->boxOffset[iBox];
 
-			if(ii < s->boxes->nAtoms[iBox])
+			for (int ii = t_idx.local[0]; ii < s->boxes->nAtoms[iBox]; ii += BOX_TILE)
 			{
 				s->atoms->p[(iOff + ii)*3 + 0] += dt * s->atoms->f[(iOff + ii)*3 + 0];
 				s->atoms->p[(iOff + ii)*3 + 1] += dt * s->atoms->f[(iOff + ii)*3 + 1];
@@ -153,9 +157,10 @@ void advancePosition(SimFlat* s, int nBoxes, real_t dt)
 */
   completion_future fut;
 #if 1 // Run on CPU
+   #pragma omp parallel for
    for (int iBox=0; iBox<nBoxes; iBox++)
    {
-      for (int iOff=MAXATOMS*iBox,ii=0; ii<s->boxes->nAtoms[iBox]; ii++,iOff++)
+      for (int iOff=s->boxes->boxOffset[iBox],ii=0; ii<s->boxes->nAtoms[iBox]; ii++,iOff++)
       {
          int iSpecies = s->atoms->iSpecies[iOff];
          real_t invMass = 1.0/s->species[iSpecies].mass;
@@ -168,17 +173,16 @@ void advancePosition(SimFlat* s, int nBoxes, real_t dt)
 #else
    
    // C++ AMP with tiling. At present 4x slower than single-threaded CPU
-    extent<1> boxesExt(nBoxes * MAXATOMS);
-    tiled_extent<1> tBoxesExt(boxesExt, MAXATOMS);
+    extent<1> boxesExt(nBoxes * BOX_TILE);
+    tiled_extent<1> tBoxesExt(boxesExt, BOX_TILE);
 
    fut = parallel_for_each(
 		   tBoxesExt, [=](tiled_index<1> t_idx) restrict(amp)
 		{
 			int iBox = t_idx.tile[0];
-			int iOff = iBox * MAXATOMS;
-			int ii = t_idx.local[0];
+			int iOff = s->boxes->boxOffset[iBox];
 
-			if(ii < s->boxes->nAtoms[iBox])
+			for (int ii = t_idx.local[0]; ii < s->boxes->nAtoms[iBox]; ii += BOX_TILE)
 			{
 				int iSpecies = s->atoms->iSpecies[iOff + ii];
 			    real_t invMass = 1.0/s->species[iSpecies].mass;
@@ -195,23 +199,37 @@ void advancePosition(SimFlat* s, int nBoxes, real_t dt)
 
 /// Calculates total kinetic and potential energy across all tasks.  The
 /// local potential energy is a by-product of the force routine.
+///
+/// Each box is summed in parallel and the box sums are added in box
+/// order, as in sumLocalAtoms, so the energy does not depend on the
+/// number of threads.
 void kineticEnergy(SimFlat* s)
 {
-   real_t eLocal[2];
-   eLocal[0] = s->ePotential;
-   eLocal[1] = 0;
-   for (int iBox=0; iBox<s->boxes->nLocalBoxes; iBox++)
+   int nLocalBoxes = s->boxes->nLocalBoxes;
+   real_t* boxSum = (real_t*) comdMalloc(nLocalBoxes*sizeof(real_t));
+
+   #pragma omp parallel for
+   for (int iBox=0; iBox<nLocalBoxes; iBox++)
    {
-      for (int iOff=MAXATOMS*iBox,ii=0; ii<s->boxes->nAtoms[iBox]; ii++,iOff++)
+      real_t sum = 0.0;
+      for (int iOff=s->boxes->boxOffset[iBox],ii=0; ii<s->boxes->nAtoms[iBox]; ii++,iOff++)
       {
          int iSpecies = s->atoms->iSpecies[iOff];
          real_t invMass = 0.5/s->species[iSpecies].mass;
-         eLocal[1] += ( s->atoms->p[iOff*3 + 0] * s->atoms->p[iOff*3 + 0] +
+         sum += ( s->atoms->p[iOff*3 + 0] * s->atoms->p[iOff*3 + 0] +
          s->atoms->p[iOff*3 + 1] * s->atoms->p[iOff*3 + 1] +
          s->atoms->p[iOff*3 + 2] * s->atoms->p[iOff*3 + 2] )*invMass;
       }
+      boxSum[iBox] = sum;
    }
 
+   real_t eLocal[2];
+   eLocal[0] = s->ePotential;
+   eLocal[1] = 0;
+   for (int iBox=0; iBox<nLocalBoxes; iBox++)
+      eLocal[1] += boxSum[iBox];
+   comdFree(boxSum);
+
    real_t eSum[2];
    startTimer(commReduceTimer);
    addRealParallel(eLocal, eSum, 2);
@@ -229,19 +247,49 @@ void kineticEnergy(SimFlat* s)
 /// - updateLinkCells: Since atoms have moved, some may be in the wrong
 ///   link cells.
 /// - haloExchange (atom version): Sends atom data to remote tasks. 
-/// - sort: Sort the atoms.
+/// - sortAtomsByGid: Sort the atoms.
+/// - buildNeighborList: Rebuild the Verlet list, if there is one.
+/// - deviceUploadAtoms: Refresh the device copies of the positions and
+///   box counts for the force kernels.
+///
+/// With a Verlet list all of this is only done when the list is stale.
+/// On the other steps the atoms stay in their link cells, even if they
+/// have drifted out of them or out of the local domain, since the list
+/// refers to their slots.  Only the positions of the halo atoms are
+/// refreshed.
 ///
 /// \see updateLinkCells
 /// \see initAtomHaloExchange
-/// \see sortAtomsInCell
+/// \see sortAtomsByGid
+/// \see neighborListIsStale
+/// \see initPositionHaloExchange
 void redistributeAtoms(SimFlat* sim)
 {
+   if (sim->nbrList && ! neighborListIsStale(sim))
+   {
+      startTimer(atomHaloTimer);
+      haloExchange(sim->positionExchange, sim);
+      stopTimer(atomHaloTimer);
+
+      deviceUploadAtoms(sim);
+      return;
+   }
+
    updateLinkCells(sim->boxes, sim->atoms);
 
    startTimer(atomHaloTimer);
    haloExchange(sim->atomExchange, sim);
    stopTimer(atomHaloTimer);
 
-   for (int ii=0; ii<sim->boxes->nTotalBoxes; ++ii)
-      sortAtomsInCell(sim->atoms, sim->boxes, ii);
+   sortAtomsByGid(sim->boxes, sim->atoms);
+
+   if (sim->nbrList)
+   {
+      startTimer(neighborListTimer);
+      buildNeighborList(sim);
+      stopTimer(neighborListTimer);
+      deviceUploadNeighborList(sim);
+   }
+
+   deviceUploadAtoms(sim);
 }
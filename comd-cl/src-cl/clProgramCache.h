@@ -0,0 +1,63 @@
+/*******************************************************************************
+Copyright (c) 2015 Advanced Micro Devices, Inc.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+#ifndef __CL_PROGRAM_CACHE__
+#define __CL_PROGRAM_CACHE__
+
+#if defined (__APPLE__) || defined(MACOSX)
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* On-disk cache of built OpenCL program binaries.
+ *
+ * Entries live in $CL_PROGRAM_CACHE (default ./.clcache) as <key>.bin,
+ * where the key hashes the kernel source, the build options and the
+ * device name, vendor and driver version.  Setting CL_PROGRAM_CACHE to
+ * an empty string disables the cache. */
+
+/* Returns a program built for dev, loaded from the cache when a matching
+ * binary exists and built from source (then stored) otherwise.  On a
+ * build failure the program is still returned with *err set, so the
+ * caller can fetch the build log before releasing it. */
+cl_program clCachedProgram(cl_context context, cl_device_id dev,
+			   const char *src, size_t len,
+			   const char *options, cl_int *err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -25,6 +25,7 @@
 #endif
 
 #include "cl_utils.h"
+#include "clProgramCache.h"
 #include "yamlOutput.h"
 
 #define GPU 1
@@ -118,18 +119,7 @@ int buildProgramFromFile(cl_program* program,
    printf("Replaced %d instances of %s with %s in %s\n", rep_count, srcPrec, myPrec, filename);
    rep_count = 0;
 
-   // Create the compute program from the source buffer
-   //
-
-   *program = clCreateProgramWithSource(context, 1, (const char **) &source, NULL, &err);
-   if (!program || err != CL_SUCCESS)
-   {
-      printf("%s\n", source);
-      printf("Failed to create compute program!\n");
-      return EXIT_FAILURE;
-   }
-
-   // Build the program executable
+   // Build the program executable, reusing a cached binary if one matches
    //
    char* OPT_STRING;
 #if (USE_CHEBY)
@@ -137,7 +127,15 @@ int buildProgramFromFile(cl_program* program,
 #else
    OPT_STRING = "-DUSE_CHEBY=0";
 #endif
-   err = clBuildProgram(*program, 0, NULL, OPT_STRING, NULL, NULL);
+   *program = clCachedProgram(context, deviceId, source, strlen(source), OPT_STRING, &err);
+   if (!*program)
+   {
+      printf("%s\n", source);
+      printf("Failed to create compute program!\n");
+      return EXIT_FAILURE;
+   }
+   free(source);
+
    if (err != CL_SUCCESS)
    {
       size_t len;
@@ -379,19 +377,17 @@ int oclBuildProgramFromFile(char* filename)
       return EXIT_FAILURE;    
    }
 
-   // Create the compute program from the source buffer
+   // Build the program executable, reusing a cached binary if one matches
    //
-   program = clCreateProgramWithSource(context, 1, (const char **) & source, NULL, &err);
-   if (!program || err != CL_SUCCESS)
+   program = clCachedProgram(context, deviceId, source, strlen(source), NULL, &err);
+   if (!program)
    {
       printf("%s\n", source);
       printf("Failed to create compute program!\n");
       return EXIT_FAILURE;
    }
+   free(source);
 
-   // Build the program executable
-   //
-   err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
    if (err != CL_SUCCESS)
    {
       size_t len;
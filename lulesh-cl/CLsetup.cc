@@ -35,6 +35,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sstream>
 #include <CL/cl.h>
 #include "CLsetup.hpp"
+#include "clProgramCache.h"
 
 using namespace std;
 
@@ -111,10 +112,6 @@ CLsetup::init(string kernelFile, unsigned int pl, unsigned int dev, int blockSiz
             (std::istreambuf_iterator<char>())
             );
 
-    const char *kernelsString = kernels.c_str();
-    program = clCreateProgramWithSource(context, 1, &kernelsString, NULL, &err);
-    checkErr(err, "clCreateProgramWithSource()");
-
     string args = "-D BLOCKSIZE=";
     stringstream s;
     s << blockSize;
@@ -129,7 +126,8 @@ CLsetup::init(string kernelFile, unsigned int pl, unsigned int dev, int blockSiz
 #else
     cout << "double precision" << endl;
 #endif
-    err = clBuildProgram(program, numDevices, devices, args.c_str(), NULL, NULL);
+    // Only the selected device runs kernels, so build (and cache) for it alone
+    program = clCachedProgram(context, device, kernels.c_str(), kernels.size(), args.c_str(), &err);
     checkErr(err, "clBuildProgram()");
 
     size_t paramValueSize = 0;
@@ -0,0 +1,276 @@
+/*******************************************************************************
+Copyright (c) 2015 Advanced Micro Devices, Inc.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "clProgramCache.h"
+
+#define CACHE_MAGIC "CLPCACHE"
+#define CACHE_DEFAULT_DIR "./.clcache"
+
+typedef struct {
+  char magic[8];
+  unsigned long long key;
+  unsigned long long size;
+} CacheHeader;
+
+static unsigned long long fnv1a(unsigned long long h, const void *data, size_t len)
+{
+  const unsigned char *p = (const unsigned char *) data;
+  for (size_t i = 0; i < len; i++)
+    {
+      h ^= p[i];
+      h *= 1099511628211ULL;
+    }
+  return h;
+}
+
+static unsigned long long hash_device_info(unsigned long long h, cl_device_id dev,
+					   cl_device_info param)
+{
+  char buf[1024];
+  size_t len = 0;
+
+  if (clGetDeviceInfo(dev, param, sizeof(buf), buf, &len) != CL_SUCCESS)
+    len = 0;
+  if (len > sizeof(buf))
+    len = sizeof(buf);
+
+  /* Terminate every field so "ab"+"c" and "a"+"bc" differ */
+  h = fnv1a(h, buf, len);
+  return fnv1a(h, "", 1);
+}
+
+static unsigned long long cache_key(cl_device_id dev, const char *src, size_t len,
+				    const char *options)
+{
+  unsigned long long h = 14695981039346656037ULL;
+
+  h = fnv1a(h, src, len);
+  h = fnv1a(h, "", 1);
+  if (options)
+    h = fnv1a(h, options, strlen(options));
+  h = fnv1a(h, "", 1);
+  h = hash_device_info(h, dev, CL_DEVICE_NAME);
+  h = hash_device_info(h, dev, CL_DEVICE_VENDOR);
+  h = hash_device_info(h, dev, CL_DEVICE_VERSION);
+  h = hash_device_info(h, dev, CL_DRIVER_VERSION);
+
+  return h;
+}
+
+// Fills path with the cache file for key, or returns 0 if the cache is off
+static int cache_path(char *path, size_t n, unsigned long long key)
+{
+  const char *dir = getenv("CL_PROGRAM_CACHE");
+
+  if (dir == NULL)
+    dir = CACHE_DEFAULT_DIR;
+  if (dir[0] == '\0')
+    return 0;
+
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+    return 0;
+
+  return snprintf(path, n, "%s/%016llx.bin", dir, key) < (int) n;
+}
+
+static unsigned char *cache_load(const char *path, unsigned long long key, size_t *size)
+{
+  CacheHeader hdr;
+  unsigned char *bin;
+  FILE *fp = fopen(path, "rb");
+
+  if (fp == NULL)
+    return NULL;
+
+  if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+      memcmp(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic)) != 0 ||
+      hdr.key != key || hdr.size == 0)
+    {
+      fclose(fp);
+      return NULL;
+    }
+
+  bin = (unsigned char *) malloc(hdr.size);
+  if (bin == NULL || fread(bin, hdr.size, 1, fp) != 1)
+    {
+      free(bin);
+      fclose(fp);
+      return NULL;
+    }
+
+  fclose(fp);
+  *size = hdr.size;
+  return bin;
+}
+
+// Writes to a temporary name first so concurrent runs never see a partial file
+static void cache_store(const char *path, unsigned long long key,
+			const unsigned char *bin, size_t size)
+{
+  CacheHeader hdr;
+  char tmp[4096];
+  FILE *fp;
+
+  if (snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long) getpid()) >= (int) sizeof(tmp))
+    return;
+
+  fp = fopen(tmp, "wb");
+  if (fp == NULL)
+    return;
+
+  memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+  hdr.key = key;
+  hdr.size = size;
+
+  if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 || fwrite(bin, size, 1, fp) != 1)
+    {
+      fclose(fp);
+      remove(tmp);
+      return;
+    }
+
+  if (fclose(fp) != 0 || rename(tmp, path) != 0)
+    remove(tmp);
+}
+
+// Copies out the binary of a built program for dev
+static unsigned char *program_binary(cl_program program, cl_device_id dev, size_t *size)
+{
+  cl_uint n_devs = 0;
+  cl_device_id *devs;
+  size_t *sizes;
+  unsigned char **bins;
+  unsigned char *bin = NULL;
+  cl_uint d;
+
+  if (clGetProgramInfo(program, CL_PROGRAM_NUM_DEVICES, sizeof(n_devs), &n_devs, NULL) != CL_SUCCESS ||
+      n_devs == 0)
+    return NULL;
+
+  devs = (cl_device_id *) malloc(n_devs * sizeof(cl_device_id));
+  sizes = (size_t *) calloc(n_devs, sizeof(size_t));
+  bins = (unsigned char **) calloc(n_devs, sizeof(unsigned char *));
+
+  if (clGetProgramInfo(program, CL_PROGRAM_DEVICES, n_devs * sizeof(cl_device_id), devs, NULL) != CL_SUCCESS ||
+      clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, n_devs * sizeof(size_t), sizes, NULL) != CL_SUCCESS)
+    goto out;
+
+  for (d = 0; d < n_devs; d++)
+    if (devs[d] == dev)
+      break;
+  if (d == n_devs || sizes[d] == 0)
+    goto out;
+
+  // CL_PROGRAM_BINARIES fills every non-NULL slot, so only ask for ours
+  bins[d] = (unsigned char *) malloc(sizes[d]);
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, n_devs * sizeof(unsigned char *), bins, NULL) != CL_SUCCESS)
+    {
+      free(bins[d]);
+      goto out;
+    }
+
+  bin = bins[d];
+  *size = sizes[d];
+
+ out:
+  free(devs);
+  free(sizes);
+  free(bins);
+  return bin;
+}
+
+cl_program clCachedProgram(cl_context context, cl_device_id dev,
+			   const char *src, size_t len,
+			   const char *options, cl_int *err)
+{
+  char path[4096];
+  unsigned long long key = cache_key(dev, src, len, options);
+  int cached = cache_path(path, sizeof(path), key);
+  cl_program program;
+  cl_int errNum;
+
+  if (cached)
+    {
+      size_t size;
+      unsigned char *bin = cache_load(path, key, &size);
+
+      if (bin != NULL)
+	{
+	  cl_int status;
+	  program = clCreateProgramWithBinary(context, 1, &dev, &size,
+					      (const unsigned char **) &bin, &status, &errNum);
+	  free(bin);
+
+	  if (program != NULL && errNum == CL_SUCCESS && status == CL_SUCCESS)
+	    {
+	      errNum = clBuildProgram(program, 1, &dev, options, NULL, NULL);
+	      if (errNum == CL_SUCCESS)
+		{
+		  if (err) *err = CL_SUCCESS;
+		  return program;
+		}
+	    }
+
+	  // Stale or foreign binary: fall through and rebuild from source
+	  if (program != NULL)
+	    clReleaseProgram(program);
+	}
+    }
+
+  program = clCreateProgramWithSource(context, 1, &src, &len, &errNum);
+  if (program == NULL || errNum != CL_SUCCESS)
+    {
+      if (err) *err = errNum;
+      return program;
+    }
+
+  errNum = clBuildProgram(program, 1, &dev, options, NULL, NULL);
+  if (errNum == CL_SUCCESS && cached)
+    {
+      size_t size;
+      unsigned char *bin = program_binary(program, dev, &size);
+
+      if (bin != NULL)
+	{
+	  cache_store(path, key, bin, size);
+	  free(bin);
+	}
+    }
+
+  if (err) *err = errNum;
+  return program;
+}
@@ -0,0 +1,459 @@
+/*******************************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. 
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+// CPU lookup engine. These routines mirror the lookup kernel in Main.cpp
+// and give the same results on the same data.
+
+#include "XSbench_header.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Binary search for energy on unionized energy grid, followed by the same
+// linear fix-up as the lookup kernel. Returns lower index.
+long grid_search( long n, double quarry, double * A )
+{
+  long lowerLimit = 0;
+  long upperLimit = n - 1;
+  long examinationPoint;
+  long length = upperLimit - lowerLimit;
+
+  while( length > 1 )
+    {
+      examinationPoint = lowerLimit + ( length / 2 );
+
+      if( A[examinationPoint] > quarry )
+	upperLimit = examinationPoint;
+      else
+	lowerLimit = examinationPoint;
+
+      length = upperLimit - lowerLimit;
+    }
+
+  long index = lowerLimit;
+  for( long k = lowerLimit; k < upperLimit; k++ )
+    {
+      if( A[k] <= quarry )
+	index = k;
+      else
+	break;
+    }
+
+  return index;
+}
+
+// Index into the search structure of the selected grid type: the
+// unionized gridpoint below p_energy, or the hash bin of p_energy
+static inline long search_index( LookupData * D, double p_energy )
+{
+  if( D->grid_type == HASH )
+    {
+      // Must match the binning in generate_hash_grid()
+      long bin = (long) (p_energy * D->hash_bins);
+      if( bin > D->hash_bins - 1 )
+	bin = D->hash_bins - 1;
+      if( bin < 0 )
+	bin = 0;
+      return bin;
+    }
+
+  return grid_search( D->n_isotopes * D->n_gridpoints, p_energy,
+		      D->energy_grid_energy );
+}
+
+// Returns the gridpoint of nuclide nuc that starts the interpolation
+// interval of p_energy. energy points at the nuclide's first energy and
+// step is the distance in doubles between two of its energies, so both
+// grid layouts can be searched.
+static inline long nuclide_grid_ptr( LookupData * D, int nuc, long index,
+				     double p_energy, double * energy,
+				     long step )
+{
+  long n_isotopes = D->n_isotopes;
+  long ptr;
+
+  if( D->grid_type == HASH )
+    {
+      // Bounded search for the last gridpoint <= p_energy in the bin
+      long lo = D->hash_index[index*n_isotopes + nuc];
+      long hi = D->hash_index[(index+1)*n_isotopes + nuc];
+      while( lo < hi )
+	{
+	  long mid = lo + (hi - lo) / 2;
+	  if( energy[mid*step] <= p_energy )
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+      ptr = (lo > 0) ? lo - 1 : 0;
+    }
+  else
+    {
+#ifdef COMPACT_INDEX
+      ptr = D->grid_index.base[(index / INDEX_BLOCK)*n_isotopes + nuc] +
+	D->grid_index.delta[index*n_isotopes + nuc];
+#else
+      ptr = D->energy_grid_xs[index*n_isotopes + nuc];
+#endif
+    }
+
+  // make sure we're not reading off the end of the nuclide's grid
+  if( ptr == D->n_gridpoints - 1 )
+    ptr--;
+
+  return ptr;
+}
+
+// Interpolates the macroscopic XS from AoS gridpoints of type T, either
+// NuclideGridPoint or the mixed precision NuclideGridPointF. The XS are
+// widened to double before any arithmetic.
+template <typename T>
+static inline void macro_xs_aos( double p_energy, int mat, LookupData * D,
+				 T * nuclide_grids, double * macro_xs_vector )
+{
+  int * mats = &D->mats[D->num_nucs_idx[mat]];
+  double * concs = &D->concs[D->num_nucs_idx[mat]];
+  long index = search_index( D, p_energy );
+  long step = sizeof(T) / sizeof(double);
+
+  for( int k = 0; k < 5; k++ )
+    macro_xs_vector[k] = 0;
+
+  for( int j = 0; j < D->num_nucs[mat]; j++ )
+    {
+      int p_nuc = mats[j];
+      double conc = concs[j];
+      T * grid = &nuclide_grids[p_nuc*D->n_gridpoints];
+      long ptr = nuclide_grid_ptr( D, p_nuc, index, p_energy,
+				   &grid[0].energy, step );
+      T * low = &grid[ptr];
+      T * high = low + 1;
+      double low_xs[5] = { low->total_xs, low->elastic_xs, low->absorbtion_xs,
+			   low->fission_xs, low->nu_fission_xs };
+      double high_xs[5] = { high->total_xs, high->elastic_xs,
+			    high->absorbtion_xs, high->fission_xs,
+			    high->nu_fission_xs };
+
+      double f = (high->energy - p_energy) / (high->energy - low->energy);
+      for( int k = 0; k < 5; k++ )
+	macro_xs_vector[k] += (high_xs[k] - f * (high_xs[k] - low_xs[k])) * conc;
+    }
+}
+
+// Calculates macroscopic cross section based on a given material & energy,
+// reading the AoS nuclide grids
+void calculate_macro_xs( double p_energy, int mat, LookupData * D,
+			 double * macro_xs_vector )
+{
+  if( D->precision == XS_FLOAT )
+    macro_xs_aos( p_energy, mat, D, D->nuclide_grids_f, macro_xs_vector );
+  else
+    macro_xs_aos( p_energy, mat, D, D->nuclide_grids, macro_xs_vector );
+}
+
+// Loads the XS channels of one SoA gridpoint, widened to double
+#if defined(__AVX__)
+static inline void load_xs( const double * p, __m256d * a, __m256d * b )
+{
+  *a = _mm256_load_pd(p);
+  *b = _mm256_load_pd(p + 4);
+}
+
+static inline void load_xs( const float * p, __m256d * a, __m256d * b )
+{
+  __m256 x = _mm256_load_ps(p);
+  *a = _mm256_cvtps_pd(_mm256_castps256_ps128(x));
+  *b = _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1));
+}
+#elif defined(__SSE2__)
+static inline void load_xs( const double * p, __m128d * a, __m128d * b,
+			    __m128d * c )
+{
+  *a = _mm_load_pd(p);
+  *b = _mm_load_pd(p + 2);
+  *c = _mm_load_pd(p + 4);
+}
+
+static inline void load_xs( const float * p, __m128d * a, __m128d * b,
+			    __m128d * c )
+{
+  __m128 x = _mm_load_ps(p);
+  *a = _mm_cvtps_pd(x);
+  *b = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+  *c = _mm_cvtps_pd(_mm_load_ps(p + 4));
+}
+#endif
+
+// SoA interpolation over XS arrays of type T (double or float)
+template <typename T>
+static inline void macro_xs_soa( double p_energy, int mat, LookupData * D,
+				 T * soa_xs, double * macro_xs_vector )
+{
+  int * mats = &D->mats[D->num_nucs_idx[mat]];
+  double * concs = &D->concs[D->num_nucs_idx[mat]];
+  long index = search_index( D, p_energy );
+  long stride = D->soa.stride;
+
+#if defined(__AVX__)
+  __m256d acc0 = _mm256_setzero_pd();
+  __m256d acc1 = _mm256_setzero_pd();
+#elif defined(__SSE2__)
+  __m128d acc0 = _mm_setzero_pd();
+  __m128d acc1 = _mm_setzero_pd();
+  __m128d acc2 = _mm_setzero_pd();
+#else
+  double acc[5] = {0, 0, 0, 0, 0};
+#endif
+
+  for( int j = 0; j < D->num_nucs[mat]; j++ )
+    {
+      int p_nuc = mats[j];
+      double * energy = &D->soa.energy[p_nuc*stride];
+      long ptr = nuclide_grid_ptr( D, p_nuc, index, p_energy, energy, 1 );
+      T * low = &soa_xs[(p_nuc*stride + ptr) * XS_STRIDE];
+      T * high = low + XS_STRIDE;
+
+      double f = (energy[ptr+1] - p_energy) / (energy[ptr+1] - energy[ptr]);
+
+#if defined(__AVX__)
+      __m256d vf = _mm256_set1_pd(f);
+      __m256d vc = _mm256_set1_pd(concs[j]);
+      __m256d h0, h1, l0, l1;
+      load_xs(high, &h0, &h1);
+      load_xs(low, &l0, &l1);
+      __m256d xs0 = _mm256_sub_pd(h0, _mm256_mul_pd(vf, _mm256_sub_pd(h0, l0)));
+      __m256d xs1 = _mm256_sub_pd(h1, _mm256_mul_pd(vf, _mm256_sub_pd(h1, l1)));
+      acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(xs0, vc));
+      acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(xs1, vc));
+#elif defined(__SSE2__)
+      __m128d vf = _mm_set1_pd(f);
+      __m128d vc = _mm_set1_pd(concs[j]);
+      __m128d h0, h1, h2, l0, l1, l2;
+      load_xs(high, &h0, &h1, &h2);
+      load_xs(low, &l0, &l1, &l2);
+      __m128d xs0 = _mm_sub_pd(h0, _mm_mul_pd(vf, _mm_sub_pd(h0, l0)));
+      __m128d xs1 = _mm_sub_pd(h1, _mm_mul_pd(vf, _mm_sub_pd(h1, l1)));
+      __m128d xs2 = _mm_sub_pd(h2, _mm_mul_pd(vf, _mm_sub_pd(h2, l2)));
+      acc0 = _mm_add_pd(acc0, _mm_mul_pd(xs0, vc));
+      acc1 = _mm_add_pd(acc1, _mm_mul_pd(xs1, vc));
+      acc2 = _mm_add_pd(acc2, _mm_mul_pd(xs2, vc));
+#else
+      for( int k = 0; k < 5; k++ )
+	{
+	  double h = high[k];
+	  double l = low[k];
+	  acc[k] += (h - f * (h - l)) * concs[j];
+	}
+#endif
+    }
+
+#if defined(__AVX__)
+  double out[8] __attribute__((aligned(32)));
+  _mm256_store_pd(out, acc0);
+  _mm256_store_pd(out + 4, acc1);
+#elif defined(__SSE2__)
+  double out[6] __attribute__((aligned(16)));
+  _mm_store_pd(out, acc0);
+  _mm_store_pd(out + 2, acc1);
+  _mm_store_pd(out + 4, acc2);
+#else
+  double * out = acc;
+#endif
+
+  for( int k = 0; k < 5; k++ )
+    macro_xs_vector[k] = out[k];
+}
+
+// Calculates macroscopic cross section based on a given material & energy,
+// reading the SoA nuclide grids. The five channels of a gridpoint are
+// interpolated together in SIMD registers and the macroscopic XS stays in
+// registers across all nuclides of the material. The operations are the
+// same, in the same order, as in calculate_macro_xs().
+void calculate_macro_xs_soa( double p_energy, int mat, LookupData * D,
+			     double * macro_xs_vector )
+{
+  if( D->precision == XS_FLOAT )
+    macro_xs_soa( p_energy, mat, D, D->soa.xs_f, macro_xs_vector );
+  else
+    macro_xs_soa( p_energy, mat, D, D->soa.xs, macro_xs_vector );
+}
+
+// Verification hash of a line of lookup results. This method provides a
+// consistent hash across architectures and compilers.
+static inline unsigned int hash_xs_vector( double p_energy, int mat,
+					   double * macro_xs_vector )
+{
+  char line[256];
+  sprintf(line, "%.5lf %d %.5lf %.5lf %.5lf %.5lf %.5lf",
+	  p_energy, mat,
+	  macro_xs_vector[0],
+	  macro_xs_vector[1],
+	  macro_xs_vector[2],
+	  macro_xs_vector[3],
+	  macro_xs_vector[4]);
+  return hash((unsigned char*)line, 10000);
+}
+
+// Returns the verification hash of lookups whose macroscopic XS vectors
+// are stored in xs (or, without VERIFICATION, the non-zero check of the
+// first one)
+unsigned long long hash_xs_vectors( long lookups, int * mats,
+				    double * p_energies, double * xs )
+{
+  unsigned long long vhash = 0;
+
+#ifdef VERIFICATION
+#pragma omp parallel for schedule(static) reduction(+:vhash)
+  for( long i = 0; i < lookups; i++ )
+    vhash += hash_xs_vector( p_energies[i], mats[i], &xs[i*5] );
+#else
+  (void) mats;
+  (void) p_energies;
+  if( lookups > 0 )
+    vhash = xs[0] + xs[1] + xs[2] + xs[3] + xs[4];
+#endif
+
+  return vhash;
+}
+
+// Runs the lookups on the host with OpenMP and returns the verification
+// hash (or, without VERIFICATION, the non-zero check of the first lookup).
+// If mats is NULL the lookups are sampled on the fly: they are split into
+// blocks handed out dynamically to the threads, and each block jumps its
+// own copy of the RNG stream to its first lookup, so every lookup draws
+// the same numbers as in a serial run starting from seed.
+// If xs_out is given the macroscopic XS vectors are stored there instead
+// of being hashed, and 0 is returned.
+unsigned long long run_cpu_lookups( LookupData * D, long lookups, int * mats,
+				    double * p_energies, unsigned long seed,
+				    double * xs_out )
+{
+  unsigned long long vhash = 0;
+  long n_blocks = (lookups + CPU_LOOKUP_BLOCK - 1) / CPU_LOOKUP_BLOCK;
+
+#pragma omp parallel for schedule(dynamic) reduction(+:vhash)
+  for( long b = 0; b < n_blocks; b++ )
+    {
+      long start = b * CPU_LOOKUP_BLOCK;
+      long stop = start + CPU_LOOKUP_BLOCK;
+      if( stop > lookups )
+	stop = lookups;
+
+      // two draws per lookup: energy, then material
+      unsigned long block_seed = rn_skip( seed, 2 * start );
+
+      for( long i = start; i < stop; i++ )
+	{
+	  double p_energy;
+	  int mat;
+	  double macro_xs_vector[5];
+
+	  if( mats == NULL )
+	    {
+	      p_energy = rn(&block_seed);
+	      mat = pick_mat(&block_seed);
+	    }
+	  else
+	    {
+	      p_energy = p_energies[i];
+	      mat = mats[i];
+	    }
+
+	  if( D->layout == SOA )
+	    calculate_macro_xs_soa( p_energy, mat, D, macro_xs_vector );
+	  else
+	    calculate_macro_xs( p_energy, mat, D, macro_xs_vector );
+
+	  if( xs_out != NULL )
+	    {
+	      for( int k = 0; k < 5; k++ )
+		xs_out[i*5 + k] = macro_xs_vector[k];
+	      continue;
+	    }
+
+#ifdef VERIFICATION
+	  vhash += hash_xs_vector( p_energy, mat, macro_xs_vector );
+#else
+	  if( i == 0 )
+	    vhash += macro_xs_vector[0] + macro_xs_vector[1] +
+	      macro_xs_vector[2] + macro_xs_vector[3] +
+	      macro_xs_vector[4];
+#endif
+	}
+    }
+
+  return vhash;
+}
+
+// Measures the error of the float XS tables in D against the double
+// tables in ref over lookups lookups drawn from their own RNG stream.
+// Reports the largest and the mean relative error of the five
+// macroscopic XS channels.
+void precision_error( LookupData * D, LookupData * ref, long lookups,
+		      double * max_error, double * mean_error )
+{
+  double max_err = 0;
+  double sum_err = 0;
+  long n_err = 0;
+
+#pragma omp parallel for schedule(static) reduction(max:max_err) reduction(+:sum_err,n_err)
+  for( long i = 0; i < lookups; i++ )
+    {
+      // two draws per lookup, as in the simulation
+      unsigned long seed = rn_skip( 42, 2 * i );
+      double p_energy = rn(&seed);
+      int mat = pick_mat(&seed);
+      double xs[5], xs_ref[5];
+
+      if( D->layout == SOA )
+	calculate_macro_xs_soa( p_energy, mat, D, xs );
+      else
+	calculate_macro_xs( p_energy, mat, D, xs );
+      calculate_macro_xs( p_energy, mat, ref, xs_ref );
+
+      for( int k = 0; k < 5; k++ )
+	{
+	  if( xs_ref[k] == 0 )
+	    continue;
+	  double err = fabs( xs[k] - xs_ref[k] ) / fabs( xs_ref[k] );
+	  if( err > max_err )
+	    max_err = err;
+	  sum_err += err;
+	  n_err++;
+	}
+    }
+
+  *max_error = max_err;
+  *mean_error = (n_err > 0) ? sum_err / n_err : 0;
+}
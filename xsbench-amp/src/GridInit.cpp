@@ -88,8 +88,117 @@ void sort_nuclide_grids( NuclideGridPoint * nuclide_grids, long n_isotopes,
   */
 }
 
+// Returns the index of the first point in A whose energy is >= quarry
+static long lower_bound_energy( NuclideGridPoint * A, double quarry, long n )
+{
+  long lo = 0;
+  long hi = n;
+  while( lo < hi )
+    {
+      long mid = lo + (hi - lo) / 2;
+      if( A[mid].energy < quarry )
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+// Restores the min-heap property below slot pos. The heap holds nuclide
+// i.d.'s keyed by the energy of their next unmerged gridpoint.
+static void heap_sift_down( int * heap, long n_heap, long pos, double * head )
+{
+  int nuc = heap[pos];
+  while( 2*pos + 1 < n_heap )
+    {
+      long child = 2*pos + 1;
+      if( child + 1 < n_heap && head[heap[child+1]] < head[heap[child]] )
+	child++;
+      if( head[heap[child]] >= head[nuc] )
+	break;
+      heap[pos] = heap[child];
+      pos = child;
+    }
+  heap[pos] = nuc;
+}
+
+// Picks the energy bounds of each thread's slab of the unionized grid.
+// Splitter t is the median over all nuclides of their t/n_slabs energy
+// quantile, which keeps the slabs roughly equal in size.
+static double * choose_slab_bounds( NuclideGridPoint * nuclide_grids,
+				    long n_isotopes, long n_gridpoints,
+				    int n_slabs )
+{
+  double * bounds = new double[n_slabs + 1];
+  double * quantiles = new double[n_isotopes];
+
+  bounds[0] = -HUGE_VAL;
+  bounds[n_slabs] = HUGE_VAL;
+  for( int t = 1; t < n_slabs; t++ )
+    {
+      long q = (n_gridpoints * t) / n_slabs;
+      for( long j = 0; j < n_isotopes; j++ )
+	quantiles[j] = nuclide_grids[j*n_gridpoints + q].energy;
+      qsort( quantiles, n_isotopes, sizeof(double), double_compare );
+      bounds[t] = quantiles[n_isotopes / 2];
+    }
+
+  delete[] quantiles;
+  return bounds;
+}
+
+// k-way merges the energies in [lo, hi) of every (sorted) nuclide grid
+// into their slot of the unionized grid.
+static void merge_energy_slab( GridPoint * energy_grid,
+			       NuclideGridPoint * nuclide_grids,
+			       long n_isotopes, long n_gridpoints,
+			       double lo, double hi )
+{
+  long * cur  = new long[n_isotopes];
+  long * end  = new long[n_isotopes];
+  double * head = new double[n_isotopes];
+  int * heap  = new int[n_isotopes];
+  long n_heap = 0;
+  long out = 0;
+
+  // Points below lo belong to earlier slabs, so they fix our offset
+  for( long j = 0; j < n_isotopes; j++ )
+    {
+      NuclideGridPoint * A = &nuclide_grids[j*n_gridpoints];
+      cur[j] = lower_bound_energy( A, lo, n_gridpoints );
+      end[j] = lower_bound_energy( A, hi, n_gridpoints );
+      out += cur[j];
+      if( cur[j] < end[j] )
+	{
+	  head[j] = A[cur[j]].energy;
+	  heap[n_heap++] = j;
+	}
+    }
+
+  for( long pos = n_heap / 2 - 1; pos >= 0; pos-- )
+    heap_sift_down( heap, n_heap, pos, head );
+
+  while( n_heap > 0 )
+    {
+      int j = heap[0];
+      energy_grid[out++].energy = head[j];
+      if( ++cur[j] < end[j] )
+	head[j] = nuclide_grids[j*n_gridpoints + cur[j]].energy;
+      else
+	heap[0] = heap[--n_heap];
+      heap_sift_down( heap, n_heap, 0, head );
+    }
+
+  delete[] cur;
+  delete[] end;
+  delete[] head;
+  delete[] heap;
+}
+
 // Allocates unionized energy grid, and assigns union of energy levels
-// from nuclide grids to it.
+// from nuclide grids to it. The nuclide grids are already sorted, so
+// rather than sorting a copy of every gridpoint the grids are k-way
+// merged, one energy slab per thread.
 GridPoint * generate_energy_grid( long n_isotopes, long n_gridpoints,
                                   NuclideGridPoint * nuclide_grids) {
   int mype = 0;
@@ -101,31 +210,32 @@ GridPoint * generate_energy_grid( long n_isotopes, long n_gridpoints,
   if( mype == 0 ) printf("Generating Unionized Energy Grid...\n");
 	
   long n_unionized_grid_points = n_isotopes*n_gridpoints;
-  int (*cmp) (const void *, const void *);
-  cmp = NGP_compare;
 	
   GridPoint * energy_grid = (GridPoint *)malloc( n_unionized_grid_points
 						 * sizeof( GridPoint ) );
-  if( mype == 0 ) printf("Copying and Sorting all nuclide grids...\n");
-	
-  NuclideGridPoint * n_grid_sorted = gpmatrix( n_isotopes, n_gridpoints );
-	  	
-  memcpy( n_grid_sorted, nuclide_grids, n_isotopes*n_gridpoints*
-	  sizeof( NuclideGridPoint ) );
-	
-  qsort( &n_grid_sorted[0], n_unionized_grid_points, sizeof(NuclideGridPoint), cmp);
-	
-  if( mype == 0 ) printf("Assigning energies to unionized grid...\n");
-	
+  if( mype == 0 ) printf("Merging all nuclide grids...\n");
+
+  int n_slabs = omp_get_max_threads();
+  double * bounds = choose_slab_bounds( nuclide_grids, n_isotopes,
+					n_gridpoints, n_slabs );
+
+#pragma omp parallel for schedule(dynamic, 1)
+  for( int t = 0; t < n_slabs; t++ )
+    merge_energy_slab( energy_grid, nuclide_grids, n_isotopes, n_gridpoints,
+		       bounds[t], bounds[t+1] );
+
+  delete[] bounds;
+
+#ifdef COMPACT_INDEX
+  // The index is built directly in compact form by compact_grid_ptrs()
   for( long i = 0; i < n_unionized_grid_points; i++ )
-    energy_grid[i].energy = n_grid_sorted[i].energy;
-	
-  delete n_grid_sorted;
-	
+    energy_grid[i].xs_ptrs = NULL;
+#else
   int * full = new int[n_isotopes * n_unionized_grid_points];
 	
   for( long i = 0; i < n_unionized_grid_points; i++ )
     energy_grid[i].xs_ptrs = &full[n_isotopes * i];
+#endif
 	
   // debug error checking
   /*
@@ -136,10 +246,43 @@ GridPoint * generate_energy_grid( long n_isotopes, long n_gridpoints,
   return energy_grid;
 }
 
-// Searches each nuclide grid for the closest energy level and assigns
-// pointer from unionized grid to the correct spot in the nuclide grid.
-// This process is time consuming, as the number of binary searches
-// required is:  binary searches = n_gridpoints * n_isotopes^2
+// Converts p, the lower bound of quarry in nuclide grid A, into the index
+// binary_search() returns for quarry. Runs of equal energies are handed
+// to binary_search() itself, since its answer depends on its probe path.
+static inline int grid_ptr_from_lower_bound( NuclideGridPoint * A,
+					     double quarry, long p, long n )
+{
+  if( p == n )
+    return n - 2;
+  if( A[p].energy == quarry )
+    {
+      if( p + 1 < n && A[p+1].energy == quarry )
+	return binary_search( A, quarry, n );
+      return p;
+    }
+  if( p == 0 )
+    return 0;
+  return p - 1;
+}
+
+// Moves the cursor of nuclide grid A up to the lower bound of quarry and
+// returns the unionized grid pointer for it. Quarries must be visited in
+// increasing order.
+static inline int advance_grid_ptr( NuclideGridPoint * A, double quarry,
+				    long * cur, long n )
+{
+  long p = *cur;
+  while( p < n && A[p].energy < quarry )
+    p++;
+  *cur = p;
+  return grid_ptr_from_lower_bound( A, quarry, p, n );
+}
+
+// Assigns pointer from unionized grid to the correct spot in each nuclide
+// grid. As the unionized grid is sorted, each thread takes a contiguous
+// block of it, binary searches once for the start of its block, and then
+// sweeps a cursor per nuclide forward. The result is identical to doing
+// n_gridpoints * n_isotopes^2 binary searches, in O(N * n_isotopes).
 void set_grid_ptrs( GridPoint * energy_grid, NuclideGridPoint * nuclide_grids,
                     long n_isotopes, long n_gridpoints )
 {
@@ -150,21 +293,43 @@ void set_grid_ptrs( GridPoint * energy_grid, NuclideGridPoint * nuclide_grids,
 #endif
 	
   if( mype == 0 ) printf("Assigning pointers to Unionized Energy Grid...\n");
-  for( long i = 0; i < n_isotopes * n_gridpoints ; i++ )
-    {
-      double quarry = energy_grid[i].energy;
-      if( INFO && mype == 0 && i % 200 == 0 )
-	printf("\rAligning Unionized Grid...(%.0lf%% complete)",
-	       100.0 * (double) i / (n_isotopes*n_gridpoints));
+
+  long n_unionized_grid_points = n_isotopes * n_gridpoints;
+
+#pragma omp parallel
+  {
+    int nthreads = omp_get_num_threads();
+    int thread = omp_get_thread_num();
+    long chunk = (n_unionized_grid_points + nthreads - 1) / nthreads;
+    long start = thread * chunk;
+    long stop = start + chunk;
+    if( stop > n_unionized_grid_points )
+      stop = n_unionized_grid_points;
+
+    long * cur = new long[n_isotopes];
+    if( start < stop )
       for( long j = 0; j < n_isotopes; j++ )
-	{
-	  // j is the nuclide i.d.
-	  // log n binary search
-	  energy_grid[i].xs_ptrs[j] = 
-	    binary_search( &nuclide_grids[j*n_gridpoints], quarry, n_gridpoints);
-	}
-    }
-  if( mype == 0 ) printf("\n");
+	cur[j] = lower_bound_energy( &nuclide_grids[j*n_gridpoints],
+				     energy_grid[start].energy, n_gridpoints );
+
+    for( long i = start; i < stop; i++ )
+      {
+	double quarry = energy_grid[i].energy;
+	if( INFO && mype == 0 && thread == 0 && (i - start) % 200 == 0 )
+	  printf("\rAligning Unionized Grid...(%.0lf%% complete)",
+		 100.0 * (double) (i - start) / (stop - start));
+	for( long j = 0; j < n_isotopes; j++ )
+	  {
+	    // j is the nuclide i.d.
+	    energy_grid[i].xs_ptrs[j] =
+	      advance_grid_ptr( &nuclide_grids[j*n_gridpoints], quarry,
+				&cur[j], n_gridpoints );
+	  }
+      }
+
+    delete[] cur;
+  }
+  if( mype == 0 ) printf("\rAligning Unionized Grid...(100%% complete)\n");
 
   //test
   /*
@@ -178,3 +343,228 @@ void set_grid_ptrs( GridPoint * energy_grid, NuclideGridPoint * nuclide_grids,
     );
   */
 }
+
+#ifdef COMPACT_INDEX
+// Builds the unionized grid index in compact form. Along the unionized
+// axis each nuclide's pointer only grows (apart from the n-1 -> n-2 step at
+// the very top of the grid), and over INDEX_BLOCK gridpoints it can grow by
+// at most INDEX_BLOCK. Each block therefore stores one int base per nuclide
+// (the pointer at the first gridpoint of the block, less one) and a narrow
+// IndexDelta per gridpoint, which is about 1/4 (8-bit) or 1/2 (16-bit) of
+// the memory of the full int index.
+CompactIndex compact_grid_ptrs( GridPoint * energy_grid,
+				NuclideGridPoint * nuclide_grids,
+				long n_isotopes, long n_gridpoints )
+{
+  int mype = 0;
+
+#ifdef DOMPI
+  MPI_Comm_rank(MPI_COMM_WORLD, &mype);
+#endif
+
+  if( mype == 0 ) printf("Assigning compact pointers to Unionized Energy Grid...\n");
+
+  long n_unionized_grid_points = n_isotopes * n_gridpoints;
+  CompactIndex index;
+  index.n_blocks = (n_unionized_grid_points + INDEX_BLOCK - 1) / INDEX_BLOCK;
+  index.base = new int[index.n_blocks * n_isotopes];
+  index.delta = new IndexDelta[n_unionized_grid_points * n_isotopes];
+
+  long overflow = 0;
+
+#pragma omp parallel reduction(+:overflow)
+  {
+    long * cur = new long[n_isotopes];
+    long next_block = -1;
+
+#pragma omp for schedule(static)
+    for( long b = 0; b < index.n_blocks; b++ )
+      {
+	long start = b * INDEX_BLOCK;
+	long stop = start + INDEX_BLOCK;
+	if( stop > n_unionized_grid_points )
+	  stop = n_unionized_grid_points;
+
+	// Cursors carry over between consecutive blocks of this thread
+	if( b != next_block )
+	  for( long j = 0; j < n_isotopes; j++ )
+	    cur[j] = lower_bound_energy( &nuclide_grids[j*n_gridpoints],
+					 energy_grid[start].energy,
+					 n_gridpoints );
+	next_block = b + 1;
+
+	int * base = &index.base[b * n_isotopes];
+	for( long i = start; i < stop; i++ )
+	  {
+	    double quarry = energy_grid[i].energy;
+	    IndexDelta * delta = &index.delta[i * n_isotopes];
+	    for( long j = 0; j < n_isotopes; j++ )
+	      {
+		int ptr = advance_grid_ptr( &nuclide_grids[j*n_gridpoints],
+					    quarry, &cur[j], n_gridpoints );
+		if( i == start )
+		  base[j] = ptr > 0 ? ptr - 1 : 0;
+		long d = ptr - base[j];
+		if( d < 0 || d > (IndexDelta) ~0 )
+		  overflow++;
+		delta[j] = (IndexDelta) d;
+	      }
+	  }
+      }
+
+    delete[] cur;
+  }
+
+  if( overflow )
+    {
+      fprintf(stderr, "Compact index overflow at %ld pointers, "
+	      "rebuild with a wider COMPACT_INDEX\n", overflow);
+      exit(1);
+    }
+
+  return index;
+}
+#endif
+
+// Builds the hash grid. The [0,1] energy range is split into hash_bins
+// equal bins, and entry (b, j) holds the index of the first gridpoint of
+// nuclide j that falls in bin b or above, with an extra closing row at
+// b = hash_bins. A lookup in bin b then only needs to search nuclide j
+// between entries (b, j) and (b+1, j).
+int * generate_hash_grid( NuclideGridPoint * nuclide_grids,
+			  long n_isotopes, long n_gridpoints, long hash_bins )
+{
+  int mype = 0;
+
+#ifdef DOMPI
+  MPI_Comm_rank(MPI_COMM_WORLD, &mype);
+#endif
+
+  if( mype == 0 ) printf("Generating Hash Grid (%ld bins)...\n", hash_bins);
+
+  int * hash_index = new int[(hash_bins + 1) * n_isotopes];
+
+#pragma omp parallel for schedule(dynamic)
+  for( long j = 0; j < n_isotopes; j++ )
+    {
+      NuclideGridPoint * A = &nuclide_grids[j*n_gridpoints];
+      long cur = 0;
+      for( long b = 0; b <= hash_bins; b++ )
+	{
+	  // The bin of a point must be computed exactly as in the lookup
+	  // kernel, so that the bounds always bracket the lookup energy
+	  while( cur < n_gridpoints )
+	    {
+	      long bin = (long) (A[cur].energy * hash_bins);
+	      if( bin > hash_bins - 1 )
+		bin = hash_bins - 1;
+	      if( bin < 0 )
+		bin = 0;
+	      if( bin >= b )
+		break;
+	      cur++;
+	    }
+	  hash_index[b*n_isotopes + j] = cur;
+	}
+    }
+
+  return hash_index;
+}
+
+// Copies the nuclide grids into mixed precision gridpoints: energies stay
+// double, the XS channels are rounded to float
+NuclideGridPointF * float_nuclide_grids( NuclideGridPoint * nuclide_grids,
+					 long n_isotopes, long n_gridpoints )
+{
+  int mype = 0;
+
+#ifdef DOMPI
+  MPI_Comm_rank(MPI_COMM_WORLD, &mype);
+#endif
+
+  if( mype == 0 ) printf("Converting Nuclide Grids to float XS...\n");
+
+  long n = n_isotopes * n_gridpoints;
+  NuclideGridPointF * grids = new NuclideGridPointF[n];
+
+#pragma omp parallel for schedule(static)
+  for( long i = 0; i < n; i++ )
+    {
+      NuclideGridPoint * p = &nuclide_grids[i];
+      grids[i].energy = p->energy;
+      grids[i].total_xs = p->total_xs;
+      grids[i].elastic_xs = p->elastic_xs;
+      grids[i].absorbtion_xs = p->absorbtion_xs;
+      grids[i].fission_xs = p->fission_xs;
+      grids[i].nu_fission_xs = p->nu_fission_xs;
+      grids[i].pad = 0;
+    }
+
+  return grids;
+}
+
+// Copies the nuclide grids into the structure-of-arrays layout read by the
+// SIMD CPU lookups, with the XS channels in xs (XS_DOUBLE) or xs_f
+// (XS_FLOAT). Padding lanes are zeroed so they interpolate to 0.
+NuclideGridsSoA soa_nuclide_grids( NuclideGridPoint * nuclide_grids,
+				   long n_isotopes, long n_gridpoints,
+				   int precision )
+{
+  int mype = 0;
+
+#ifdef DOMPI
+  MPI_Comm_rank(MPI_COMM_WORLD, &mype);
+#endif
+
+  if( mype == 0 ) printf("Converting Nuclide Grids to SoA layout...\n");
+
+  NuclideGridsSoA soa;
+  soa.stride = (n_gridpoints + 7) / 8 * 8;
+  soa.xs = NULL;
+  soa.xs_f = NULL;
+
+  size_t xs_size = (precision == XS_FLOAT) ? sizeof(float) : sizeof(double);
+  void * xs;
+  if( posix_memalign( (void **) &soa.energy, 64,
+		      n_isotopes * soa.stride * sizeof(double) ) ||
+      posix_memalign( &xs, 64, n_isotopes * soa.stride * XS_STRIDE * xs_size ) )
+    {
+      fprintf(stderr, "Could not allocate SoA nuclide grids\n");
+      exit(1);
+    }
+  if( precision == XS_FLOAT )
+    soa.xs_f = (float *) xs;
+  else
+    soa.xs = (double *) xs;
+
+#pragma omp parallel for schedule(static)
+  for( long j = 0; j < n_isotopes; j++ )
+    for( long k = 0; k < soa.stride; k++ )
+      {
+	double * e = &soa.energy[j*soa.stride + k];
+	double xs[XS_STRIDE];
+	for( int c = 0; c < XS_STRIDE; c++ )
+	  xs[c] = 0;
+	if( k >= n_gridpoints )
+	  *e = 0;
+	else
+	  {
+	    NuclideGridPoint * p = &nuclide_grids[j*n_gridpoints + k];
+	    *e = p->energy;
+	    xs[0] = p->total_xs;
+	    xs[1] = p->elastic_xs;
+	    xs[2] = p->absorbtion_xs;
+	    xs[3] = p->fission_xs;
+	    xs[4] = p->nu_fission_xs;
+	  }
+
+	long first = (j*soa.stride + k) * XS_STRIDE;
+	for( int c = 0; c < XS_STRIDE; c++ )
+	  if( precision == XS_FLOAT )
+	    soa.xs_f[first + c] = xs[c];
+	  else
+	    soa.xs[first + c] = xs[c];
+      }
+
+  return soa;
+}
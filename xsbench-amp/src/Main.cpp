@@ -34,6 +34,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include<mpi.h>
 #endif
 
+#ifdef HAVE_AMP
 #ifdef ARRAY_VIEW
 #define HCC_ARRAY_STRUC(type, name, size, ptr) array_view<type> name(size, ptr)
 #define HCC_ID(name)
@@ -47,6 +48,55 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <hc.hpp>
 using namespace hc;
 
+static inline NuclideGridPoint widen_gridpoint( NuclideGridPointF p ) restrict(amp)
+{
+  NuclideGridPoint q;
+  q.energy = p.energy;
+  q.total_xs = p.total_xs;
+  q.elastic_xs = p.elastic_xs;
+  q.absorbtion_xs = p.absorbtion_xs;
+  q.fission_xs = p.fission_xs;
+  q.nu_fission_xs = p.nu_fission_xs;
+  return q;
+}
+#endif
+
+// Samples the next batch of lookups from the RNG stream. Event based
+// batches are then ordered by material and energy.
+static void sample_batch( Inputs in, Profile * prof, int * mats,
+			  double * p_energy, int lookups, unsigned long * seed )
+{
+  profile_begin( prof, PHASE_SAMPLE );
+  for( int j = 0; j < lookups; j++ ){
+    p_energy[j] = rn(seed);
+    mats[j] = pick_mat(seed);
+  }
+  profile_end( prof, PHASE_SAMPLE );
+
+  if( in.simulation_method == EVENT ){
+    profile_begin( prof, PHASE_EVENT_SORT );
+    sort_lookups( mats, p_energy, lookups );
+    profile_end( prof, PHASE_EVENT_SORT );
+  }
+}
+
+// Sums the partial macroscopic XS of a batch over the ranks of the
+// nuclide decomposition, on rank 0
+#ifdef DOMPI
+static void exchange_partial_xs( Profile * prof, double * xs, int lookups,
+				 int mype )
+{
+  profile_begin( prof, PHASE_EXCHANGE );
+  MPI_Reduce( mype == 0 ? MPI_IN_PLACE : xs, xs, 5 * lookups, MPI_DOUBLE,
+	      MPI_SUM, 0, MPI_COMM_WORLD );
+  profile_end( prof, PHASE_EXCHANGE );
+}
+#else
+static void exchange_partial_xs( Profile *, double *, int, int )
+{
+}
+#endif
+
 int main( int argc, char* argv[] )
 {
   // =====================================================================
@@ -54,11 +104,9 @@ int main( int argc, char* argv[] )
   // =====================================================================
   int version = 13;
   int mype = 0;
-  int i;
-  unsigned long seed;
-  double timer_start, timer_end;
+  double timer_start, timer_end = 0.0;
   unsigned long long vhash = 0;
-  int nprocs;
+  int nprocs = 1;
   int nuc_size = 0;  
 	
 #ifdef DOMPI
@@ -73,69 +121,151 @@ int main( int argc, char* argv[] )
 #ifdef VERIFICATION
   srand(26);
 #else
-  srand(time(NULL));
+  // All ranks generate the same data
+  unsigned int rand_seed = time(NULL);
+#ifdef DOMPI
+  MPI_Bcast(&rand_seed, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+#endif
+  srand(rand_seed);
 #endif
 
   // Process CLI Fields -- store in "Inputs" structure
   Inputs in = read_CLI( argc, argv );
+
+  // Set number of OpenMP threads
+  omp_set_num_threads(in.nthreads);
 	
+  // Lookups of the whole run. The replicated decomposition splits them
+  // between the ranks, the nuclide decomposition splits the nuclides.
+  long total_lookups = (in.scaling == WEAK) ? in.lookups * nprocs : in.lookups;
+  long first_lookup = 0;
+  long my_lookups = total_lookups;
+  long first_nuc = 0;
+  long my_nucs = in.n_isotopes;
+  if( in.decomp == NUCLIDE ){
+    first_nuc = mype * in.n_isotopes / nprocs;
+    my_nucs = (mype + 1) * in.n_isotopes / nprocs - first_nuc;
+  }
+  else{
+    first_lookup = mype * total_lookups / nprocs;
+    my_lookups = (mype + 1) * total_lookups / nprocs - first_lookup;
+  }
+  if( my_nucs < 1 || my_lookups < 1 ){
+    if( mype == 0 )
+      printf("Too many MPI ranks (%d) for the %s decomposition\n", nprocs,
+	     in.decomp == NUCLIDE ? "nuclide" : "replicated");
+#ifdef DOMPI
+    MPI_Abort(MPI_COMM_WORLD, 4);
+#endif
+    exit(4);
+  }
+
   // Print-out of Input Summary
   if( mype == 0 )
     print_inputs( in, nprocs, version );
 
+  // Phase times (and PAPI counters) for the report. The counters are
+  // started here, before the first parallel region.
+  Results r;
+  memset( &r, 0, sizeof(r) );
+  Profile * prof = &r.profile;
+  profile_init( prof );
+
   // =====================================================================
   // Prepare Nuclide Energy Grids, Unionized Energy Grid, & Material Data
   // =====================================================================
-  NuclideGridPoint * nuclide_grids = NULL;
+  LookupData D;
+  memset( &D, 0, sizeof(D) );
+  D.n_isotopes = my_nucs;
+  D.n_gridpoints = in.n_gridpoints;
+  D.grid_type = in.grid_type;
+  D.hash_bins = in.hash_bins;
+  D.layout = in.layout;
+  D.precision = in.precision;
 
+#ifdef BINARY_READ
+  // The grids are used in place from the mapped file
+  if( mype == 0 ) printf("Mapping data from \"%s\" file...\n",
+			 in.filename);
+  profile_begin( prof, PHASE_GRID_GEN );
+  binary_read( in.filename, &D );
+  profile_end( prof, PHASE_GRID_GEN );
+#else
   // Allocate & fill energy grids
-#ifndef BINARY_READ
   if( mype == 0) printf("Generating Nuclide Energy Grids...\n");
+  profile_begin( prof, PHASE_GRID_GEN );
 	
-  nuclide_grids = gpmatrix(in.n_isotopes,in.n_gridpoints);
+  D.nuclide_grids = gpmatrix(in.n_isotopes,in.n_gridpoints);
 	
 #ifdef VERIFICATION
-  generate_grids_v( nuclide_grids, in.n_isotopes, in.n_gridpoints );	
+  generate_grids_v( D.nuclide_grids, in.n_isotopes, in.n_gridpoints );	
 #else
-  generate_grids( nuclide_grids, in.n_isotopes, in.n_gridpoints );	
+  generate_grids( D.nuclide_grids, in.n_isotopes, in.n_gridpoints );	
 #endif
+
+  // All grids are drawn from the RNG stream, then each rank of the
+  // nuclide decomposition keeps its own
+  if( in.decomp == NUCLIDE ){
+    NuclideGridPoint * all_grids = D.nuclide_grids;
+    D.nuclide_grids = slice_nuclide_grids( all_grids, in.n_gridpoints,
+					   first_nuc, my_nucs );
+    gpmatrix_free( all_grids );
+  }
+  profile_end( prof, PHASE_GRID_GEN );
 	
   // Sort grids by energy
   if( mype == 0) printf("Sorting Nuclide Energy Grids...\n");
-  sort_nuclide_grids( nuclide_grids, in.n_isotopes, in.n_gridpoints );
-#endif
-
-  // Prepare Unionized Energy Grid Framework
-#ifndef BINARY_READ
-  GridPoint * energy_grid = generate_energy_grid( in.n_isotopes,
-						  in.n_gridpoints, nuclide_grids ); 	
+  profile_begin( prof, PHASE_GRID_SORT );
+  sort_nuclide_grids( D.nuclide_grids, D.n_isotopes, in.n_gridpoints );
+  profile_end( prof, PHASE_GRID_SORT );
+
+  profile_begin( prof, PHASE_UNIONIZE );
+
+  // The hash grid replaces the unionized grid with per-nuclide bounds
+  // for each of in.hash_bins energy bins
+  if( in.grid_type == HASH )
+    D.hash_index = generate_hash_grid( D.nuclide_grids, D.n_isotopes,
+				       in.n_gridpoints, in.hash_bins );
+  else {
+    // Prepare Unionized Energy Grid Framework
+    GridPoint * energy_grid = generate_energy_grid( D.n_isotopes,
+						    in.n_gridpoints,
+						    D.nuclide_grids );
+
+    // Double Indexing. Filling in energy_grid with pointers to the
+    // nuclide_energy_grids.
+#ifdef COMPACT_INDEX
+    D.grid_index = compact_grid_ptrs( energy_grid, D.nuclide_grids,
+				      D.n_isotopes, in.n_gridpoints );
 #else
-  nuclide_grids = gpmatrix(in.n_isotopes,in.n_gridpoints);
-
-  GridPoint * energy_grid = new GridPoint[in.n_isotopes * in.n_gridpoints];
-  int * index_data = new int[in.n_isotopes * in.n_gridpoints * in.n_isotopes];
-	
-  for( i = 0; i < in.n_isotopes*in.n_gridpoints; i++ )
-    energy_grid[i].xs_ptrs = &index_data[i*in.n_isotopes];
-  
+    set_grid_ptrs( energy_grid, D.nuclide_grids, D.n_isotopes,
+		   in.n_gridpoints );
+    // The rows of xs_ptrs are contiguous, so the index is used in place
+    D.energy_grid_xs = energy_grid[0].xs_ptrs;
 #endif
 
-  // Double Indexing. Filling in energy_grid with pointers to the
-  // nuclide_energy_grids.
-#ifndef BINARY_READ
-  set_grid_ptrs( energy_grid, nuclide_grids, in.n_isotopes, in.n_gridpoints );
+    // Lookups search a flat array of the unionized energies
+    long n_union = D.n_isotopes * in.n_gridpoints;
+    D.energy_grid_energy = new double[n_union];
+    for( long i = 0; i < n_union; i++ )
+      D.energy_grid_energy[i] = energy_grid[i].energy;
+    free( energy_grid );
+  }
+  profile_end( prof, PHASE_UNIONIZE );
 #endif
 
-#ifdef BINARY_READ
-  if( mype == 0 ) printf("Reading data from \"%s\" file...\n",
+#ifdef BINARY_DUMP
+  if( mype == 0 ) printf("Dumping data to binary file...\n");
+  binary_dump( in.filename, &D );
+  if( mype == 0 ) printf("Binary file \"%s\" written! Exiting...\n",
 			 in.filename);
-  binary_read(in.n_isotopes, in.n_gridpoints, nuclide_grids, energy_grid,
-	      in.filename);
+  return 0;
 #endif
-	
+
   // Get material data
   if( mype == 0 )
     printf("Loading Mats...\n");
+  profile_begin( prof, PHASE_SETUP );
 
   int *num_nucs  = load_num_nucs(in.n_isotopes);
 	
@@ -153,12 +283,44 @@ int main( int argc, char* argv[] )
   double *concs = load_concs(num_nucs);
 #endif
 
-#ifdef BINARY_DUMP
-  if( mype == 0 ) printf("Dumping data to binary file...\n");
-  binary_dump(in.n_isotopes, in.n_gridpoints, nuclide_grids, energy_grid);
-  if( mype == 0 ) printf("Binary file \"XS_data.dat\" written! Exiting...\n");
-  return 0;
+  // The material lists of a nuclide decomposition rank only name the
+  // rank's nuclides
+  if( in.decomp == NUCLIDE )
+    nuc_size = partition_mats( num_nucs, num_nucs_idx, mats, concs,
+			       first_nuc, my_nucs );
+
+  D.num_nucs = num_nucs;
+  D.num_nucs_idx = num_nucs_idx;
+  D.mats = mats;
+  D.concs = concs;
+
+  // The SIMD CPU lookups read a structure-of-arrays copy of the grids,
+  // float XS tables a mixed precision copy. The double grids are kept
+  // until the error of the float tables has been measured.
+  NuclideGridPoint * double_grids = D.nuclide_grids;
+  if( in.engine == CPU && in.layout == SOA )
+    D.soa = soa_nuclide_grids( double_grids, D.n_isotopes,
+			       in.n_gridpoints, in.precision );
+  else if( in.precision == XS_FLOAT )
+    D.nuclide_grids_f = float_nuclide_grids( double_grids, D.n_isotopes,
+					     in.n_gridpoints );
+
+  if( in.precision == XS_FLOAT ){
+    LookupData ref = D;
+    ref.layout = AOS;
+    ref.precision = XS_DOUBLE;
+    ref.nuclide_grids = double_grids;
+    long n = (in.lookups < PRECISION_SAMPLE) ? in.lookups : PRECISION_SAMPLE;
+    precision_error( &D, &ref, n, &r.xs_max_error, &r.xs_mean_error );
+  }
+
+  if( D.layout == SOA || D.precision == XS_FLOAT ){
+#ifndef BINARY_READ
+    gpmatrix_free( double_grids );
 #endif
+    D.nuclide_grids = NULL;
+  }
+  profile_end( prof, PHASE_SETUP );
 
   // =====================================================================
   // Cross Section (XS) Parallel Lookup Simulation Begins
@@ -171,239 +333,397 @@ int main( int argc, char* argv[] )
     border_print();
   }
 
-  //initialize papi with one thread (master) here
-#ifdef PAPI
-  if ( PAPI_library_init(PAPI_VER_CURRENT) != PAPI_VER_CURRENT){
-    fprintf(stderr, "PAPI library init error!\n");
-    exit(1);
-  }
+  // Lookups draw from one RNG stream, two numbers per lookup. The
+  // verification stream continues from grid generation.
+#ifdef VERIFICATION
+  unsigned long * lookup_seed = rn_v_seed();
+#else
+  unsigned long seed = 13;
+  unsigned long * lookup_seed = &seed;
 #endif
-
-			
-  // Initialize parallel PAPI counters
-#ifdef PAPI
-  int eventset = PAPI_NULL; 
-  int num_papi_events;
-  {
-    counter_init(&eventset, &num_papi_events);
-  }
+  // A rank of the replicated decomposition starts at its first lookup
+  *lookup_seed = rn_skip( *lookup_seed, 2 * (unsigned long) first_lookup );
+
+  // Only the search structures of the selected grid type are filled in,
+  // the other ones are single element placeholders for the kernel.
+  if( in.precision == XS_FLOAT )
+    D.nuclide_grids = new NuclideGridPoint[1];
+  else
+    D.nuclide_grids_f = new NuclideGridPointF[1];
+  if( in.grid_type != HASH )
+    D.hash_index = new int[1];
+  else{
+    D.energy_grid_energy = new double[1];
+#ifdef COMPACT_INDEX
+    D.grid_index.n_blocks = 1;
+    D.grid_index.base = new int[1];
+    D.grid_index.delta = new IndexDelta[1];
+#else
+    D.energy_grid_xs = new int[D.n_isotopes];
 #endif
-	
-  seed = 13; 
-  int n_isotopes_t = in.n_isotopes;
-  int n_gridpoints_t = in.n_gridpoints;
-	
-  int * pickedMats = new int[in.lookups];
-  double * pickedP_energy = new double[in.lookups];
-  double * energy_grid_energy = new double[in.n_isotopes*in.n_gridpoints];
-  int * energy_grid_xs = new int[in.n_isotopes*in.n_gridpoints*in.n_isotopes];
+  }
 
   timer_start = timer();
-	
-  for(int i = 0; i< in.n_isotopes*in.n_gridpoints; ++i){
-    energy_grid_energy[i] = energy_grid[i].energy;
-    for(int j = 0; j < in.n_isotopes; ++j){
-      energy_grid_xs[i*in.n_isotopes + j] = energy_grid[i].xs_ptrs[j];
+
+  // History based CPU lookups are sampled on the fly. Everything else
+  // works on batches of at most in.batch lookups (all of them by
+  // default), sampled into a pair of buffers so that the AMP engine can
+  // sample the next batch while the kernel works on the current one.
+  // The nuclide decomposition exchanges the partial XS of each batch, so
+  // its batches are bounded by default.
+  long max_batch = in.batch;
+  if( in.decomp == NUCLIDE && max_batch == 0 )
+    max_batch = NUCLIDE_BATCH;
+  long batch = (max_batch > 0 && max_batch < my_lookups) ? max_batch : my_lookups;
+  if( batch > INT_MAX / 5 )
+    batch = INT_MAX / 5;
+  long n_batches = (my_lookups + batch - 1) / batch;
+  int * pickedMats[2] = { NULL, NULL };
+  double * pickedP_energy[2] = { NULL, NULL };
+  if( in.engine != CPU || in.simulation_method == EVENT ||
+      in.decomp == NUCLIDE ){
+    int n_buffers = (in.engine != CPU && n_batches > 1) ? 2 : 1;
+    for( int k = 0; k < n_buffers; k++ ){
+      pickedMats[k] = new int[batch];
+      pickedP_energy[k] = new double[batch];
     }
+    sample_batch( in, prof, pickedMats[0], pickedP_energy[0], batch,
+		  lookup_seed );
   }
-		
-#ifdef VERIFICATION
-  double * verify_p_energy = new double[in.lookups];
-  int * verify_mat = new int[in.lookups];
-  double * verify_macro_xs_vector = new double[in.lookups * 5];
 
-  HCC_ARRAY_STRUC(double, verify_p_energy_t, in.lookups, verify_p_energy);
-  HCC_ARRAY_STRUC(int, verify_mat_t, in.lookups, verify_mat);
-  HCC_ARRAY_STRUC(double, verify_macro_xs_vector_t, in.lookups*5, verify_macro_xs_vector);
-  
-  for(int j = 0; j < in.lookups; ++j){	  
-    pickedP_energy[j] = rn_v();
-    pickedMats[j] = pick_mat(&seed); 
-  }
-	
+  if( in.engine == CPU ){
+    if( pickedMats[0] == NULL ){
+      profile_begin( prof, PHASE_KERNEL );
+      vhash = run_cpu_lookups( &D, my_lookups, NULL, NULL, *lookup_seed,
+			       NULL );
+      profile_end( prof, PHASE_KERNEL );
+      *lookup_seed = rn_skip( *lookup_seed, 2 * (unsigned long) my_lookups );
+    }
+    else{
+      double * partial_xs = NULL;
+      if( in.decomp == NUCLIDE )
+	partial_xs = new double[batch * 5];
+
+      for( long b = 0; b < n_batches; b++ ){
+	int n = (int) ((b + 1 < n_batches) ? batch : my_lookups - b * batch);
+	if( b > 0 )
+	  sample_batch( in, prof, pickedMats[0], pickedP_energy[0], n,
+			lookup_seed );
+	profile_begin( prof, PHASE_KERNEL );
+	unsigned long long h = run_cpu_lookups( &D, n, pickedMats[0],
+						pickedP_energy[0], 0,
+						partial_xs );
+	profile_end( prof, PHASE_KERNEL );
+	if( partial_xs != NULL ){
+	  exchange_partial_xs( prof, partial_xs, n, mype );
+	  profile_begin( prof, PHASE_VERIFY );
+	  h = (mype == 0) ? hash_xs_vectors( n, pickedMats[0],
+					     pickedP_energy[0], partial_xs ) : 0;
+	  profile_end( prof, PHASE_VERIFY );
+	}
+#ifdef VERIFICATION
+	vhash += h;
 #else
-  double * check = new double[1];  
-  HCC_ARRAY_STRUC(double, check_t, 1, check);
-  
-  for(int j = 0; j < in.lookups; ++j){
-    pickedP_energy[j] = rn(&seed);
-    pickedMats[j] = pick_mat(&seed); 
+	if( b == 0 )
+	  vhash = h;
+#endif
+      }
+      delete[] partial_xs;
+    }
+    timer_end = timer();
   }
+#ifdef HAVE_AMP
+  else{
+    // The grids and material data are set up once for all batches
+    profile_begin( prof, PHASE_COPY );
+    // Sizes of the search structures, 1 for the placeholders
+    long n_union = (in.grid_type == UNIONIZED) ? D.n_isotopes*in.n_gridpoints : 1;
+    long n_hash = (in.grid_type == HASH) ? (in.hash_bins+1)*D.n_isotopes : 1;
+    long n_double = (in.precision == XS_DOUBLE) ? D.n_isotopes*in.n_gridpoints : 1;
+    long n_float = (in.precision == XS_FLOAT) ? D.n_isotopes*in.n_gridpoints : 1;
+    HCC_ARRAY_STRUC(double, energy_grid_energy_t, n_union, D.energy_grid_energy);
+#ifdef COMPACT_INDEX
+    HCC_ARRAY_STRUC(int, index_base_t, D.grid_index.n_blocks*D.n_isotopes, D.grid_index.base);
+    HCC_ARRAY_STRUC(IndexDelta, index_delta_t, n_union*D.n_isotopes, D.grid_index.delta);
+#else
+    HCC_ARRAY_STRUC(int, energy_grid_xs_t, n_union*D.n_isotopes, D.energy_grid_xs);
+#endif
+    HCC_ARRAY_STRUC(int, hash_index_t, n_hash, D.hash_index);
+    HCC_ARRAY_STRUC(NuclideGridPoint, nuclide_grids_t, n_double, D.nuclide_grids);
+    HCC_ARRAY_STRUC(NuclideGridPointF, nuclide_grids_f_t, n_float, D.nuclide_grids_f);
+    HCC_ARRAY_STRUC(int, num_nucs_t, 12, num_nucs);
+    HCC_ARRAY_STRUC(int, num_nucs_idx_t, 12, num_nucs_idx);
+    // A nuclide decomposition rank may hold none of the material nuclides
+    int n_mat_nucs = (nuc_size > 0) ? nuc_size : 1;
+    HCC_ARRAY_STRUC(double, concs_t, n_mat_nucs, concs);
+    HCC_ARRAY_STRUC(int, mats_t, n_mat_nucs, mats);  
+    profile_end( prof, PHASE_COPY );
 	
-#endif //VERIFICATION
-
-  HCC_ARRAY_STRUC(int, pickedMats_t, in.lookups, pickedMats);
-  HCC_ARRAY_STRUC(double, pickedP_energy_t, in.lookups, pickedP_energy);
-  HCC_ARRAY_STRUC(double, energy_grid_energy_t, in.n_isotopes*in.n_gridpoints, energy_grid_energy);
-  HCC_ARRAY_STRUC(int, energy_grid_xs_t, in.n_isotopes*in.n_gridpoints*in.n_isotopes, energy_grid_xs);
-  HCC_ARRAY_STRUC(NuclideGridPoint, nuclide_grids_t, in.n_isotopes*in.n_gridpoints, nuclide_grids);
-  HCC_ARRAY_STRUC(int, num_nucs_t, 12, num_nucs);
-  HCC_ARRAY_STRUC(int, num_nucs_idx_t, 12, num_nucs_idx);
-  HCC_ARRAY_STRUC(double, concs_t, nuc_size, concs);
-  HCC_ARRAY_STRUC(int, mats_t, nuc_size, mats);  
-	
-  completion_future fut = parallel_for_each(extent<1>(in.lookups),[=
-                                                                   HCC_ID(pickedMats_t)
-								   HCC_ID(pickedP_energy_t)
-								   HCC_ID(energy_grid_energy_t)
-								   HCC_ID(energy_grid_xs_t)
-								   HCC_ID(nuclide_grids_t)
-								   HCC_ID(num_nucs_t)
-								   HCC_ID(num_nucs_idx_t)
-								   HCC_ID(concs_t)
-								   HCC_ID(mats_t)
-                                                                   #ifdef VERIFICATION
-                                                                   HCC_ID(verify_p_energy_t)
-								   HCC_ID(verify_mat_t)
-								   HCC_ID(verify_macro_xs_vector_t)
-								   #else
-								   HCC_ID(check_t)
-								   #endif
-								   ] (index<1> idx) restrict(amp){
-      int i = idx[0];
-      int mat;
-      double p_energy;
-      double macro_xs_vector[5];	    
-
-      long index = 0;	
-      double xs_vector[5];
-      int p_nuc; 
-      double conc; 
-
-      long lowerLimit = 0;
-      long upperLimit = n_isotopes_t*n_gridpoints_t - 1;
-      long examinationPoint;
-      long length = upperLimit - lowerLimit;
+#ifdef VERIFICATION
+    double * verify_p_energy = new double[batch];
+    int * verify_mat = new int[batch];
+    double * verify_macro_xs_vector = new double[batch * 5];
+#else
+    // The check of the first lookup, or the partial XS of the nuclide
+    // decomposition
+    long n_check = (in.decomp == NUCLIDE) ? batch * 5 : 1;
+    double * check = new double[n_check];  
+#endif
+    int n_isotopes_t = D.n_isotopes;
+    int n_gridpoints_t = in.n_gridpoints;
+    int decomp_t = in.decomp;
+    int hash_bins_t = in.hash_bins;
+    int grid_type_t = in.grid_type;
+    int precision_t = in.precision;
+
+    for( long b = 0; b < n_batches; b++ ){
+      int cur = b % 2;
+      int n = (int) ((b + 1 < n_batches) ? batch : my_lookups - b * batch);
+
+      profile_begin( prof, PHASE_COPY );
+#ifdef VERIFICATION
+      HCC_ARRAY_STRUC(double, verify_p_energy_t, n, verify_p_energy);
+      HCC_ARRAY_STRUC(int, verify_mat_t, n, verify_mat);
+      HCC_ARRAY_STRUC(double, verify_macro_xs_vector_t, n*5, verify_macro_xs_vector);
+#else
+      HCC_ARRAY_STRUC(double, check_t, (decomp_t == NUCLIDE) ? n*5 : 1, check);
+#endif
+      HCC_ARRAY_STRUC(int, pickedMats_t, n, pickedMats[cur]);
+      HCC_ARRAY_STRUC(double, pickedP_energy_t, n, pickedP_energy[cur]);
+      profile_end( prof, PHASE_COPY );
+
+      profile_begin( prof, PHASE_KERNEL );
+      completion_future fut = parallel_for_each(extent<1>(n),[=
+								       HCC_ID(pickedMats_t)
+								       HCC_ID(pickedP_energy_t)
+								       HCC_ID(energy_grid_energy_t)
+								       #ifdef COMPACT_INDEX
+								       HCC_ID(index_base_t)
+								       HCC_ID(index_delta_t)
+								       #else
+								       HCC_ID(energy_grid_xs_t)
+								       #endif
+								       HCC_ID(hash_index_t)
+								       HCC_ID(nuclide_grids_t)
+								       HCC_ID(nuclide_grids_f_t)
+								       HCC_ID(num_nucs_t)
+								       HCC_ID(num_nucs_idx_t)
+								       HCC_ID(concs_t)
+								       HCC_ID(mats_t)
+								       #ifdef VERIFICATION
+								       HCC_ID(verify_p_energy_t)
+								       HCC_ID(verify_mat_t)
+								       HCC_ID(verify_macro_xs_vector_t)
+								       #else
+								       HCC_ID(check_t)
+								       #endif
+								       ] (index<1> idx) restrict(amp){
+	  int i = idx[0];
+	  int mat;
+	  double p_energy;
+	  double macro_xs_vector[5];	    
+
+	  long index = 0;	
+	  double xs_vector[5];
+	  int p_nuc; 
+	  double conc; 
+
+	  long lowerLimit = 0;
+	  long upperLimit = n_union - 1;
+	  long examinationPoint;
+	  long length = upperLimit - lowerLimit;
 	    
-      mat = pickedMats_t[i];
-      p_energy = pickedP_energy_t[i];
-
-      for( int k = 0; k < 5; k++ )
-	macro_xs_vector[k] = 0;
-
-      //idx = grid_search( n_isotopes * n_gridpoints, p_energy,
-      //		 energy_grid_energy);
-
-      while( length > 1 ){
-	examinationPoint = lowerLimit + ( length / 2 );
+	  mat = pickedMats_t[i];
+	  p_energy = pickedP_energy_t[i];
+
+	  for( int k = 0; k < 5; k++ )
+	    macro_xs_vector[k] = 0;
+
+	  //idx = grid_search( n_isotopes * n_gridpoints, p_energy,
+	  //		 energy_grid_energy);
+
+	  if( grid_type_t == HASH ){
+	    // Must match the binning in generate_hash_grid()
+	    index = (long) (p_energy * hash_bins_t);
+	    if( index > hash_bins_t - 1 )
+	      index = hash_bins_t - 1;
+	    if( index < 0 )
+	      index = 0;
+	  }
+	  else{
+	    while( length > 1 ){
+	      examinationPoint = lowerLimit + ( length / 2 );
 		    
-	if( energy_grid_energy_t[examinationPoint] > p_energy )
-	  upperLimit = examinationPoint;
-	else
-	  lowerLimit = examinationPoint;
+	      if( energy_grid_energy_t[examinationPoint] > p_energy )
+		upperLimit = examinationPoint;
+	      else
+		lowerLimit = examinationPoint;
 		    
-	length = upperLimit - lowerLimit;
-      }
-      index = lowerLimit;
-
-      for( int k = lowerLimit; k < upperLimit; k++ ){
-	if( energy_grid_energy_t[k] <= p_energy )
-	  index = k;
-	else
-	  break;
-      }
-
-      for( int j = 0; j < num_nucs_t[mat]; j++ ){
-	p_nuc = mats_t[num_nucs_idx_t[mat] + j];
-	conc = concs_t[num_nucs_idx_t[mat] + j];
-	//calculate_micro_xs( p_energy, p_nuc, n_isotopes,
-	//		      n_gridpoints, energy_grid_energy,
-	//		      energy_grid_xs,
-	//		      nuclide_grids, index, xs_vector );
+	      length = upperLimit - lowerLimit;
+	    }
+	    index = lowerLimit;
+
+	    for( int k = lowerLimit; k < upperLimit; k++ ){
+	      if( energy_grid_energy_t[k] <= p_energy )
+		index = k;
+	      else
+		break;
+	    }
+	  }
+
+	  for( int j = 0; j < num_nucs_t[mat]; j++ ){
+	    p_nuc = mats_t[num_nucs_idx_t[mat] + j];
+	    conc = concs_t[num_nucs_idx_t[mat] + j];
+	    //calculate_micro_xs( p_energy, p_nuc, n_isotopes,
+	    //		      n_gridpoints, energy_grid_energy,
+	    //		      energy_grid_xs,
+	    //		      nuclide_grids, index, xs_vector );
+
+	    double f;
+	    NuclideGridPoint low, high;
+
+	    int grid_ptr;
+	    if( grid_type_t == HASH ){
+	      // Bounded search for the last gridpoint <= p_energy, among the
+	      // points of this nuclide that fall in the energy bin
+	      int lo = hash_index_t[index*n_isotopes_t + p_nuc];
+	      int hi = hash_index_t[(index+1)*n_isotopes_t + p_nuc];
+	      while( lo < hi ){
+		int mid = lo + (hi - lo) / 2;
+		double e = (precision_t == XS_FLOAT) ?
+		  nuclide_grids_f_t[p_nuc*n_gridpoints_t + mid].energy :
+		  nuclide_grids_t[p_nuc*n_gridpoints_t + mid].energy;
+		if( e <= p_energy )
+		  lo = mid + 1;
+		else
+		  hi = mid;
+	      }
+	      grid_ptr = (lo > 0) ? lo - 1 : 0;
+	    }
+	    else{
+#ifdef COMPACT_INDEX
+	      grid_ptr = index_base_t[(index / INDEX_BLOCK)*n_isotopes_t + p_nuc] +
+		index_delta_t[index*n_isotopes_t + p_nuc];
+#else
+	      grid_ptr = energy_grid_xs_t[index*n_isotopes_t + p_nuc];
+#endif
+	    }
+
+	    if( grid_ptr == n_gridpoints_t - 1 )
+	      grid_ptr--;
+
+	    // Float XS are widened, so the interpolation is done in double
+	    long g = p_nuc*n_gridpoints_t + grid_ptr;
+	    if( precision_t == XS_FLOAT ){
+	      low = widen_gridpoint( nuclide_grids_f_t[g] );
+	      high = widen_gridpoint( nuclide_grids_f_t[g + 1] );
+	    }
+	    else{
+	      low = nuclide_grids_t[g];
+	      high = nuclide_grids_t[g + 1];
+	    }
+
+	    f = (high.energy - p_energy) /
+		(high.energy - low.energy);
+	    xs_vector[0] = high.total_xs - f *
+		(high.total_xs - low.total_xs);	
+	    xs_vector[1] = high.elastic_xs - f *
+		(high.elastic_xs - low.elastic_xs);
+	    xs_vector[2] = high.absorbtion_xs - f *
+		(high.absorbtion_xs - low.absorbtion_xs);
+	    xs_vector[3] = high.fission_xs - f *
+		(high.fission_xs - low.fission_xs);
+	    xs_vector[4] = high.nu_fission_xs - f *
+	      (high.nu_fission_xs - low.nu_fission_xs);
+
+	    for( int k = 0; k < 5; k++ )
+	      macro_xs_vector[k] += xs_vector[k] * conc;
+	  }
 
-	double f;
-	NuclideGridPoint low, high;
+#ifndef VERIFICATION
+	  if( decomp_t == NUCLIDE )
+	    for( int k = 0; k < 5; k++ )
+	      check_t[i*5 + k] = macro_xs_vector[k];
+	  else if (i == 0)
+	    check_t[0] = macro_xs_vector[0] + macro_xs_vector[1] +
+	      macro_xs_vector[2] + macro_xs_vector[3] +
+	      macro_xs_vector[4];
+#else
+	  // Verification hash calculation
+	  // This method provides a consistent hash across
+	  // architectures and compilers.
+	  verify_p_energy_t[i] = p_energy;
+	  verify_mat_t[i] = mat;
+	  verify_macro_xs_vector_t[i*5 + 0] = macro_xs_vector[0];
+	  verify_macro_xs_vector_t[i*5 + 1] = macro_xs_vector[1];
+	  verify_macro_xs_vector_t[i*5 + 2] = macro_xs_vector[2];
+	  verify_macro_xs_vector_t[i*5 + 3] = macro_xs_vector[3];
+	  verify_macro_xs_vector_t[i*5 + 4] = macro_xs_vector[4];
+#endif
 
-	if( energy_grid_xs_t[index*n_isotopes_t + p_nuc] == n_gridpoints_t - 1 ){
-	  low = nuclide_grids_t[p_nuc*n_gridpoints_t + energy_grid_xs_t[index*n_isotopes_t + p_nuc] - 1];
-	  high = nuclide_grids_t[p_nuc*n_gridpoints_t + energy_grid_xs_t[index*n_isotopes_t + p_nuc]];
-	}
-	else{
-	  low = nuclide_grids_t[p_nuc*n_gridpoints_t + energy_grid_xs_t[index*n_isotopes_t + p_nuc]];
-	  high = nuclide_grids_t[p_nuc*n_gridpoints_t + energy_grid_xs_t[index*n_isotopes_t + p_nuc] + 1];
-	}
+	});
 
-	f = (high.energy - p_energy) /
-	    (high.energy - low.energy);
-	xs_vector[0] = high.total_xs - f *
-	    (high.total_xs - low.total_xs);	
-	xs_vector[1] = high.elastic_xs - f *
-	    (high.elastic_xs - low.elastic_xs);
-	xs_vector[2] = high.absorbtion_xs - f *
-	    (high.absorbtion_xs - low.absorbtion_xs);
-	xs_vector[3] = high.fission_xs - f *
-	    (high.fission_xs - low.fission_xs);
-	xs_vector[4] = high.nu_fission_xs - f *
-	  (high.nu_fission_xs - low.nu_fission_xs);
-
-	for( int k = 0; k < 5; k++ )
-	  macro_xs_vector[k] += xs_vector[k] * conc;
+      // Sample the next batch while the kernel runs
+      if( b + 1 < n_batches ){
+	int n_next = (int) ((b + 2 < n_batches) ? batch
+			    : my_lookups - (b + 1) * batch);
+	sample_batch( in, prof, pickedMats[1 - cur], pickedP_energy[1 - cur],
+		      n_next, lookup_seed );
       }
 
+      fut.wait();  
+      profile_end( prof, PHASE_KERNEL );
+  
 #ifndef VERIFICATION
-      if (i == 0)
-	check_t[0] = macro_xs_vector[0] + macro_xs_vector[1] +
-	  macro_xs_vector[2] + macro_xs_vector[3] +
-	  macro_xs_vector[4];
+      if( decomp_t == NUCLIDE ){
+	HCC_SYNC(check_t, check);
+	exchange_partial_xs( prof, check, n, mype );
+	if( b == 0 && mype == 0 )
+	  vhash = hash_xs_vectors( n, pickedMats[cur], pickedP_energy[cur],
+				   check );
+      }
+      else if( b == 0 ){
+	HCC_SYNC(check_t, check);
+	vhash = check[0];
+      }
 #else
-      // Verification hash calculation
-      // This method provides a consistent hash across
-      // architectures and compilers.
-      verify_p_energy_t[i] = p_energy;
-      verify_mat_t[i] = mat;
-      verify_macro_xs_vector_t[i*5 + 0] = macro_xs_vector[0];
-      verify_macro_xs_vector_t[i*5 + 1] = macro_xs_vector[1];
-      verify_macro_xs_vector_t[i*5 + 2] = macro_xs_vector[2];
-      verify_macro_xs_vector_t[i*5 + 3] = macro_xs_vector[3];
-      verify_macro_xs_vector_t[i*5 + 4] = macro_xs_vector[4];
+      profile_begin( prof, PHASE_VERIFY );
+      HCC_SYNC(verify_p_energy_t, verify_p_energy);
+      HCC_SYNC(verify_mat_t, verify_mat);
+      HCC_SYNC(verify_macro_xs_vector_t, verify_macro_xs_vector);
+      profile_end( prof, PHASE_VERIFY );
+
+      if( decomp_t == NUCLIDE )
+	exchange_partial_xs( prof, verify_macro_xs_vector, n, mype );
+
+      profile_begin( prof, PHASE_VERIFY );
+      if( mype == 0 || decomp_t != NUCLIDE )
+	vhash += hash_xs_vectors( n, verify_mat, verify_p_energy,
+				  verify_macro_xs_vector );
+      profile_end( prof, PHASE_VERIFY );
 #endif
+    }
+    timer_end = timer();
+  }
+#endif // HAVE_AMP
 
-    });
-  fut.wait();  
-  timer_end = timer();
-  
-  // Prints out thread local PAPI counters
 #ifdef PAPI
-  if( mype == 0 && thread == 0 ){
-    printf("\n");
-    border_print();
-    center_print("PAPI COUNTER RESULTS", 79);
-    border_print();
-    printf("Count          \tSmybol      \tDescription\n");
-  }
-  counter_stop(&eventset, num_papi_events);
+  counter_stop();
 #endif
-	
-#ifndef VERIFICATION
-  HCC_SYNC(check_t, check);
-  vhash = check[0];
-#else
-  HCC_SYNC(verify_p_energy_t, verify_p_energy);
-  HCC_SYNC(verify_mat_t, verify_mat);
-  HCC_SYNC(verify_macro_xs_vector_t, verify_macro_xs_vector);
-  
-  for(int i = 0; i < in.lookups; ++i){
-    char line[256];
-    sprintf(line, "%.5lf %d %.5lf %.5lf %.5lf %.5lf %.5lf",
-	    verify_p_energy[i], verify_mat[i],
-	    verify_macro_xs_vector[i*5 + 0],
-	    verify_macro_xs_vector[i*5 + 1],
-	    verify_macro_xs_vector[i*5 + 2],
-	    verify_macro_xs_vector[i*5 + 3],
-	    verify_macro_xs_vector[i*5 + 4]);
-    vhash += hash((unsigned char*)line, 10000);
-  }
-#endif
-	
-#ifndef PAPI
+
   if( mype == 0)	{	
     printf("\n" );
     printf("Simulation complete.\n" );
   }
-#endif
 	
   // Print / Save Results and Exit
-  print_results( in, mype, timer_end-timer_start, nprocs, vhash );
+  r.runtime = timer_end - timer_start;
+  r.lookups = total_lookups;
+  r.vhash = vhash;
+  reduce_results( &r );
+  print_results( in, mype, nprocs, &r );
+  if( in.json_file != NULL && mype == 0 )
+    write_json( in.json_file, in, nprocs, version, &r );
 
 #ifdef DOMPI
   MPI_Finalize();
@@ -177,6 +177,36 @@ double * load_concs_v( int * num_nucs )
   return concs;
 }
 
+// Keeps only the nuclides first .. first+count-1 in the material lists,
+// renumbered from 0, for a rank of the nuclide decomposition. The lists
+// are compacted in place and the new total length is returned.
+int partition_mats( int * num_nucs, int * num_nucs_idx, int * mats,
+		    double * concs, int first, int count )
+{
+  int size = 0;
+
+  for( int m = 0; m < 12; m++ )
+    {
+      int start = num_nucs_idx[m];
+      int n = 0;
+
+      num_nucs_idx[m] = size;
+      for( int j = 0; j < num_nucs[m]; j++ )
+	{
+	  int nuc = mats[start + j];
+	  if( nuc < first || nuc >= first + count )
+	    continue;
+	  mats[size + n] = nuc - first;
+	  concs[size + n] = concs[start + j];
+	  n++;
+	}
+      num_nucs[m] = n;
+      size += n;
+    }
+
+  return size;
+}
+
 // picks a material based on a probabilistic distribution
 int pick_mat( unsigned long * seed )
 {
@@ -203,11 +233,8 @@ int pick_mat( unsigned long * seed )
   dist[11] = 0.013;	// bottom of fuel assemblies
 	
   //double roll = (double) rand() / (double) RAND_MAX;
-#ifdef VERIFICATION
-  double roll = rn_v();
-#else
+  // (the verification stream is passed in as rn_v_seed())
   double roll = rn(seed);
-#endif
 
   // makes a pick based on the distro
   for( int i = 0; i < 12; i++ )
@@ -221,3 +248,35 @@ int pick_mat( unsigned long * seed )
 
   return 0;
 }
+
+// Reorders a batch of lookups for the event based simulation method.
+// Lookups are bucketed by material with a counting sort, and each bucket
+// is then sorted by energy, so that neighbouring lookups read the same
+// nuclides at nearby gridpoints.
+void sort_lookups( int * mats, double * p_energy, int lookups )
+{
+  int offset[13] = {0};
+  for( int i = 0; i < lookups; i++ )
+    offset[mats[i] + 1]++;
+  for( int m = 0; m < 12; m++ )
+    offset[m + 1] += offset[m];
+
+  double * sorted = new double[lookups];
+  int next[12];
+  for( int m = 0; m < 12; m++ )
+    next[m] = offset[m];
+  for( int i = 0; i < lookups; i++ )
+    sorted[next[mats[i]]++] = p_energy[i];
+
+#pragma omp parallel for schedule(dynamic, 1)
+  for( int m = 0; m < 12; m++ )
+    {
+      for( int i = offset[m]; i < offset[m + 1]; i++ )
+	mats[i] = m;
+      qsort( &sorted[offset[m]], offset[m + 1] - offset[m], sizeof(double),
+	     double_compare );
+    }
+
+  memcpy( p_energy, sorted, lookups * sizeof(double) );
+  delete[] sorted;
+}
@@ -38,10 +38,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include<string.h>
 #include<strings.h>
 #include<omp.h>
+#include<limits.h>
 
 #include<math.h>
 #include<unistd.h>
 #include<sys/time.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<fcntl.h>
 
 // Papi Header
 #ifdef PAPI
@@ -53,6 +57,66 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define DEBUG 1
 #define SAVE 1
 
+// Grid types
+#define UNIONIZED 0
+#define HASH 1
+
+// Simulation methods
+#define HISTORY 0
+#define EVENT 1
+
+// Lookup engines
+#define AMP 0
+#define CPU 1
+
+// Nuclide grid layouts (CPU engine)
+#define AOS 0
+#define SOA 1
+
+// XS table precisions
+#define XS_DOUBLE 0
+#define XS_FLOAT 1
+
+// MPI decompositions: every rank holds all nuclides and runs a share of
+// the lookups, or every rank holds a share of the nuclides and runs all
+// lookups, the partial macroscopic XS being summed on rank 0
+#define REPLICATED 0
+#define NUCLIDE 1
+
+// MPI scaling: the lookups are the total of the run (strong) or per rank
+// (weak)
+#define STRONG 0
+#define WEAK 1
+
+// Lookups per batch of the nuclide decomposition when -b is not given
+#define NUCLIDE_BATCH 1048576
+
+// Lookups sampled to measure the error of the float XS tables
+#define PRECISION_SAMPLE 100000
+
+// Doubles per gridpoint in the SoA XS arrays: the five XS channels padded
+// to one 64 byte line, so that both interpolation points are aligned loads
+#define XS_STRIDE 8
+
+// Phases of a run timed for the report
+#define PHASE_GRID_GEN 0
+#define PHASE_GRID_SORT 1
+#define PHASE_UNIONIZE 2
+#define PHASE_SETUP 3
+#define PHASE_SAMPLE 4
+#define PHASE_EVENT_SORT 5
+#define PHASE_COPY 6
+#define PHASE_KERNEL 7
+#define PHASE_VERIFY 8
+#define PHASE_EXCHANGE 9
+#define N_PHASES 10
+
+// Most hardware counters read per phase
+#define MAX_COUNTERS 8
+
+// Lookups per block handed to a thread by the CPU engine
+#define CPU_LOOKUP_BLOCK 1000
+
 // Structures
 typedef struct{
 	double energy;
@@ -63,19 +127,144 @@ typedef struct{
 	double nu_fission_xs;
 } NuclideGridPoint;
 
+// Mixed precision gridpoint: the energy stays double for the search, the
+// XS channels are float. Padded to 32 bytes, two gridpoints per line.
+typedef struct{
+	double energy;
+	float total_xs;
+	float elastic_xs;
+	float absorbtion_xs;
+	float fission_xs;
+	float nu_fission_xs;
+	float pad;
+} NuclideGridPointF;
+
 typedef struct{
 	double energy;
 	int * xs_ptrs;
 } GridPoint;
 
+#ifdef COMPACT_INDEX
+// Compact unionized grid index. Pointer (i, j) of the unionized grid is
+// base[(i / INDEX_BLOCK) * n_isotopes + j] + delta[i * n_isotopes + j].
+#if COMPACT_INDEX == 16
+typedef unsigned short IndexDelta;
+#define INDEX_BLOCK 16384
+#else
+typedef unsigned char IndexDelta;
+#define INDEX_BLOCK 128
+#endif
+
+typedef struct{
+	long n_blocks;
+	int * base;
+	IndexDelta * delta;
+} CompactIndex;
+#endif
+
 typedef struct{
 	int nthreads;
 	long n_isotopes;
 	long n_gridpoints;
-	int lookups;
+	long lookups;
+	long batch;
 	char * HM;
+	int grid_type;
+	int hash_bins;
+	int simulation_method;
+	int engine;
+	int layout;
+	int precision;
+	int decomp;
+	int scaling;
+	char * filename;
+	char * json_file;
 } Inputs;
 
+// Structure-of-arrays copy of the nuclide grids for the CPU engine.
+// Nuclide j's energies start at energy[j*stride] and its XS channels at
+// xs[j*stride*XS_STRIDE]; stride is n_gridpoints rounded up so that every
+// nuclide starts on a 64 byte boundary. Float XS tables use xs_f instead.
+typedef struct{
+	long stride;
+	double * energy;
+	double * xs;
+	float * xs_f;
+} NuclideGridsSoA;
+
+// Everything the CPU lookups read, gathered in one place
+typedef struct{
+	long n_isotopes;
+	long n_gridpoints;
+	int grid_type;
+	int hash_bins;
+	int layout;
+	int precision;
+	double * energy_grid_energy;
+#ifdef COMPACT_INDEX
+	CompactIndex grid_index;
+#else
+	int * energy_grid_xs;
+#endif
+	int * hash_index;
+	NuclideGridPoint * nuclide_grids;
+	NuclideGridPointF * nuclide_grids_f;
+	NuclideGridsSoA soa;
+	int * num_nucs;
+	int * num_nucs_idx;
+	int * mats;
+	double * concs;
+} LookupData;
+
+// Wall time and hardware counter totals of each phase. A phase may be
+// entered many times (once per batch) and phases may overlap.
+typedef struct{
+	double time[N_PHASES];
+	long calls[N_PHASES];
+	double start[N_PHASES];
+	int n_counters;
+	long long counters[N_PHASES][MAX_COUNTERS];
+	long long counter_start[N_PHASES][MAX_COUNTERS];
+} Profile;
+
+// Everything the report is made of, besides the inputs
+typedef struct{
+	double runtime;         // of the slowest rank once reduced
+	double runtime_min;     // of the fastest rank
+	long lookups;           // of all ranks
+	unsigned long long vhash;
+	double xs_max_error;
+	double xs_mean_error;
+	Profile profile;
+} Results;
+
+// Binary grid file. A header page is followed by the nuclide grids and
+// then either the unionized grid (energies, index) or the hash index,
+// each section starting on an XS_FILE_ALIGN boundary so that it can be
+// used in place from the mapping.
+#define XS_FILE_MAGIC "XSBENCH"
+#define XS_FILE_VERSION 1
+#define XS_FILE_ALIGN 4096
+
+typedef struct{
+	char magic[8];
+	int version;
+	int grid_type;
+	long n_isotopes;
+	long n_gridpoints;
+	long hash_bins;
+	int index_bits;         // 32 for the full index, else the delta width
+	int verification;
+	unsigned long rn_v_state; // verification seed after initialization
+	long nuclide_offset;
+	long energy_offset;
+	long index_offset;      // full index, or compact deltas
+	long base_offset;       // compact bases
+	long hash_offset;
+	long file_size;
+	unsigned long long checksum; // of all sections, in file order
+} XSFileHeader;
+
 // Function Prototypes
 void logo(int version);
 void center_print(const char *s, int width);
@@ -85,8 +274,12 @@ void fancy_int(long a);
 NuclideGridPoint * gpmatrix(size_t m, size_t n);
 
 void gpmatrix_free( NuclideGridPoint * M );
+NuclideGridPoint * slice_nuclide_grids( NuclideGridPoint * nuclide_grids,
+					long n_gridpoints, long first,
+					long count );
 
 int NGP_compare( const void * a, const void * b );
+int double_compare( const void * a, const void * b );
 
 void generate_grids( NuclideGridPoint * nuclide_grids,
 		     long n_isotopes, long n_gridpoints );
@@ -102,17 +295,54 @@ GridPoint * generate_energy_grid( long n_isotopes, long n_gridpoints,
 void set_grid_ptrs( GridPoint * energy_grid, NuclideGridPoint * nuclide_grids,
                     long n_isotopes, long n_gridpoints );
 
+int * generate_hash_grid( NuclideGridPoint * nuclide_grids,
+			  long n_isotopes, long n_gridpoints, long hash_bins );
+
+#ifdef COMPACT_INDEX
+CompactIndex compact_grid_ptrs( GridPoint * energy_grid,
+				NuclideGridPoint * nuclide_grids,
+				long n_isotopes, long n_gridpoints );
+#endif
+
+NuclideGridPointF * float_nuclide_grids( NuclideGridPoint * nuclide_grids,
+					 long n_isotopes, long n_gridpoints );
+NuclideGridsSoA soa_nuclide_grids( NuclideGridPoint * nuclide_grids,
+				   long n_isotopes, long n_gridpoints,
+				   int precision );
+
 int binary_search( NuclideGridPoint * A, double quarry, int n );
 
+long grid_search( long n, double quarry, double * A );
+void calculate_macro_xs( double p_energy, int mat, LookupData * D,
+			 double * macro_xs_vector );
+void calculate_macro_xs_soa( double p_energy, int mat, LookupData * D,
+			     double * macro_xs_vector );
+unsigned long long run_cpu_lookups( LookupData * D, long lookups, int * mats,
+				    double * p_energies, unsigned long seed,
+				    double * xs_out );
+unsigned long long hash_xs_vectors( long lookups, int * mats,
+				    double * p_energies, double * xs );
+void precision_error( LookupData * D, LookupData * ref, long lookups,
+		      double * max_error, double * mean_error );
+
 int * load_num_nucs(long n_isotopes);
 int * load_mats( int * num_nucs, long n_isotopes , int * num_nucs_idx);
 double * load_concs( int * num_nucs );
 double * load_concs_v( int * num_nucs );
+int partition_mats( int * num_nucs, int * num_nucs_idx, int * mats,
+		    double * concs, int first, int count );
 int pick_mat(unsigned long * seed);
+void sort_lookups( int * mats, double * p_energy, int lookups );
 double rn(unsigned long * seed);
 int rn_int(unsigned long * seed);
-void counter_stop( int * eventset, int num_papi_events );
-void counter_init( int * eventset, int * num_papi_events );
+int counter_init( void );
+void counter_read( long long * values );
+const char * counter_name( int i );
+void counter_stop( void );
+void profile_init( Profile * prof );
+void profile_begin( Profile * prof, int phase );
+void profile_end( Profile * prof, int phase );
+const char * phase_name( int phase );
 void do_flops(void);
 void do_loads( int nuc,
                NuclideGridPoint * __restrict__ nuclide_grids,
@@ -120,13 +350,18 @@ void do_loads( int nuc,
 Inputs read_CLI( int argc, char * argv[] );
 void print_CLI_error(void);
 double rn_v(void);
+unsigned long * rn_v_seed(void);
+unsigned long rn_skip(unsigned long seed, unsigned long n);
 double round_double( double input );
 unsigned int hash(unsigned char *str, int nbins);
-size_t estimate_mem_usage( Inputs in );
+size_t estimate_mem_usage( Inputs in, int nprocs );
 void print_inputs(Inputs in, int nprocs, int version);
-void print_results( Inputs in, int mype, double runtime, int nprocs, unsigned long long vhash );
-void binary_dump(long n_isotopes, long n_gridpoints, NuclideGridPoint * nuclide_grids, GridPoint * energy_grid);
-void binary_read(long n_isotopes, long n_gridpoints, NuclideGridPoint * nuclide_grids, GridPoint * energy_grid);
+void reduce_results( Results * r );
+void print_results( Inputs in, int mype, int nprocs, Results * r );
+void write_json( const char * filename, Inputs in, int nprocs, int version,
+		 Results * r );
+void binary_dump( const char * filename, LookupData * D );
+void binary_read( const char * filename, LookupData * D );
 double timer();
 
 typedef struct _verifyStruct{
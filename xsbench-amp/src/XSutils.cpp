@@ -44,7 +44,18 @@ NuclideGridPoint * gpmatrix(size_t m, size_t n)
 // Frees nuclide matrix
 void gpmatrix_free( NuclideGridPoint * M )
 {
-  delete M;
+  delete[] M;
+}
+
+// Copies the grids of nuclides first .. first+count-1 into a new matrix
+NuclideGridPoint * slice_nuclide_grids( NuclideGridPoint * nuclide_grids,
+					long n_gridpoints, long first,
+					long count )
+{
+  NuclideGridPoint * slice = gpmatrix( count, n_gridpoints );
+  memcpy( slice, &nuclide_grids[first*n_gridpoints],
+	  count * n_gridpoints * sizeof(NuclideGridPoint) );
+  return slice;
 }
 
 // Compare function for two grid points. Used for sorting during init
@@ -63,7 +74,19 @@ int NGP_compare( const void * a, const void * b )
     return 0;
 }
 
+// Compare function for two doubles
+int double_compare( const void * a, const void * b )
+{
+  double i = *(const double *) a;
+  double j = *(const double *) b;
 
+  if( i > j )
+    return 1;
+  else if( i < j )
+    return -1;
+  else
+    return 0;
+}
 
 // Binary Search function for nuclide grid
 // Returns ptr to energy less than the quarry that is closest to the quarry
@@ -109,21 +132,41 @@ double rn(unsigned long * seed)
 
 
 
-// RNG Used for Verification Option.
+// Seed of the RNG used for verification option.
 // This one has a static seed (must be set manually in source).
+static unsigned long verification_seed = 1337;
+
+// RNG Used for Verification Option.
 // Park & Miller Multiplicative Conguential Algorithm
 // From "Numerical Recipes" Second Edition
 double rn_v(void)
 {
-  static unsigned long seed = 1337;
-  double ret;
-  unsigned long n1;
+  return rn(&verification_seed);
+}
+
+// Current state of the verification RNG stream, so that it can be drawn
+// from with rn() or jumped ahead with rn_skip()
+unsigned long * rn_v_seed(void)
+{
+  return &verification_seed;
+}
+
+// Returns the seed rn() would reach after n draws from seed, i.e.
+// seed * a^n mod m, in O(log n). Lets each thread start its own stream at
+// any point of the serial sequence.
+unsigned long rn_skip(unsigned long seed, unsigned long n)
+{
   unsigned long a = 16807;
   unsigned long m = 2147483647;
-  n1 = ( a * (seed) ) % m;
-  seed = n1;
-  ret = (double) n1 / m;
-  return ret;
+  unsigned long an = 1;
+  while( n > 0 )
+    {
+      if( n & 1 )
+	an = ( an * a ) % m;
+      a = ( a * a ) % m;
+      n >>= 1;
+    }
+  return ( an * seed ) % m;
 }
 
 unsigned int hash(unsigned char *str, int nbins)
@@ -137,14 +180,32 @@ unsigned int hash(unsigned char *str, int nbins)
   return hash % nbins;
 }
 
-size_t estimate_mem_usage( Inputs in )
+size_t estimate_mem_usage( Inputs in, int nprocs )
 {
-  size_t single_nuclide_grid = in.n_gridpoints * sizeof( NuclideGridPoint );
+  // A rank of the nuclide decomposition holds at most this many nuclides
+  if( in.decomp == NUCLIDE )
+    in.n_isotopes = (in.n_isotopes + nprocs - 1) / nprocs;
+
+  size_t xs_size = (in.precision == XS_FLOAT) ? sizeof(float) : sizeof(double);
+  size_t single_nuclide_grid = in.n_gridpoints * (in.precision == XS_FLOAT ?
+						  sizeof( NuclideGridPointF ) :
+						  sizeof( NuclideGridPoint ));
+  if( in.engine == CPU && in.layout == SOA )
+    single_nuclide_grid = in.n_gridpoints * (sizeof(double) + XS_STRIDE * xs_size);
   size_t all_nuclide_grids   = in.n_isotopes * single_nuclide_grid;
+#ifdef COMPACT_INDEX
+  size_t size_GridPoint      = sizeof(GridPoint) + in.n_isotopes*sizeof(IndexDelta);
+  size_t size_UEG            = in.n_isotopes*in.n_gridpoints * size_GridPoint
+    + (in.n_isotopes*in.n_gridpoints / INDEX_BLOCK + 1) * in.n_isotopes*sizeof(int);
+#else
   size_t size_GridPoint      = sizeof(GridPoint) + in.n_isotopes*sizeof(int);
   size_t size_UEG            = in.n_isotopes*in.n_gridpoints * size_GridPoint;
+#endif
   size_t memtotal;
 
+  if( in.grid_type == HASH )
+    size_UEG = (in.hash_bins + 1) * in.n_isotopes * sizeof(int);
+
   memtotal          = all_nuclide_grids + size_UEG;
   all_nuclide_grids = all_nuclide_grids / 1048576;
   size_UEG          = size_UEG / 1048576;
@@ -152,44 +213,260 @@ size_t estimate_mem_usage( Inputs in )
   return memtotal;
 }
 
-void binary_dump(long n_isotopes, long n_gridpoints, NuclideGridPoint * nuclide_grids, GridPoint * energy_grid)
+// Width of a unionized index entry in this build
+static int index_bits(void)
 {
-  FILE * fp = fopen("XS_data.dat", "wb");
-  // Dump Nuclide Grid Data
-  //for( long i = 0; i < n_isotopes; i++ )
-  fwrite(nuclide_grids, sizeof(NuclideGridPoint), n_isotopes * n_gridpoints, fp);
-  // Dump UEG Data
-  for( long i = 0; i < n_isotopes * n_gridpoints; i++ )
-    {
-      // Write energy level
-      fwrite(&energy_grid[i].energy, sizeof(double), 1, fp);
+#ifdef COMPACT_INDEX
+  return 8 * sizeof(IndexDelta);
+#else
+  return 32;
+#endif
+}
+
+#define CHECKSUM_BASIS 14695981039346656037ULL
+#define CHECKSUM_PRIME 1099511628211ULL
+#define CHECKSUM_BLOCK (1L << 17)
 
-      // Write index data array (xs_ptrs array)
-      fwrite(energy_grid[i].xs_ptrs, sizeof(int), n_isotopes, fp);
+// Order dependent 64 bit hash of a buffer. Blocks of words are hashed in
+// parallel and folded in order, so the result does not depend on the
+// number of threads.
+static unsigned long long checksum( const void * data, long bytes )
+{
+  const unsigned char * b = (const unsigned char *) data;
+  long n_words = bytes / 8;
+  long n_blocks = (n_words + CHECKSUM_BLOCK - 1) / CHECKSUM_BLOCK;
+  unsigned long long * h = new unsigned long long[n_blocks + 1];
+
+#pragma omp parallel for schedule(static)
+  for( long k = 0; k < n_blocks; k++ ){
+    long end = (k + 1) * CHECKSUM_BLOCK;
+    if( end > n_words )
+      end = n_words;
+    unsigned long long x = CHECKSUM_BASIS;
+    for( long w = k * CHECKSUM_BLOCK; w < end; w++ ){
+      unsigned long long v;
+      memcpy( &v, b + 8 * w, 8 );
+      x = (x ^ v) * CHECKSUM_PRIME;
+      x ^= x >> 32;
     }
+    h[k] = x;
+  }
+
+  unsigned long long sum = CHECKSUM_BASIS;
+  for( long k = 0; k < n_blocks; k++ )
+    sum = (sum ^ h[k]) * CHECKSUM_PRIME;
+  for( long i = 8 * n_words; i < bytes; i++ )
+    sum = (sum ^ b[i]) * CHECKSUM_PRIME;
 
-  fclose(fp);
+  delete[] h;
+  return sum;
 }
 
-void binary_read(long n_isotopes, long n_gridpoints, NuclideGridPoint ** nuclide_grids, GridPoint * energy_grid)
+#define XS_FILE_SECTIONS 5
+
+// Address, size and header offset field of each section of the binary
+// file, in file order. Sections the grid type does not use have size 0.
+static void file_sections( LookupData * D, XSFileHeader * h, void ** data,
+			   long * bytes, long ** offset )
 {
-  int stat;
-  FILE * fp = fopen("XS_data.dat", "rb");
-  // Read Nuclide Grid Data
-  //for( long i = 0; i < n_isotopes; i++ )
-  stat = fread(nuclide_grids, sizeof(NuclideGridPoint), n_isotopes * n_gridpoints, fp);
-  // Dump UEG Data
-  for( long i = 0; i < n_isotopes * n_gridpoints; i++ )
-    {
-      // Write energy level
-      stat = fread(&energy_grid[i].energy, sizeof(double), 1, fp);
+  long n_points = D->n_isotopes * D->n_gridpoints;
+  int unionized = (D->grid_type == UNIONIZED);
+
+  data[0] = D->nuclide_grids;
+  bytes[0] = n_points * sizeof(NuclideGridPoint);
+  offset[0] = &h->nuclide_offset;
+
+  data[1] = D->energy_grid_energy;
+  bytes[1] = unionized ? n_points * sizeof(double) : 0;
+  offset[1] = &h->energy_offset;
+
+#ifdef COMPACT_INDEX
+  data[2] = D->grid_index.delta;
+  bytes[2] = unionized ? n_points * D->n_isotopes * sizeof(IndexDelta) : 0;
+  data[3] = D->grid_index.base;
+  bytes[3] = unionized ? D->grid_index.n_blocks * D->n_isotopes * sizeof(int) : 0;
+#else
+  data[2] = D->energy_grid_xs;
+  bytes[2] = unionized ? n_points * D->n_isotopes * sizeof(int) : 0;
+  data[3] = NULL;
+  bytes[3] = 0;
+#endif
+  offset[2] = &h->index_offset;
+  offset[3] = &h->base_offset;
+
+  data[4] = D->hash_index;
+  bytes[4] = unionized ? 0 : (D->hash_bins + 1) * D->n_isotopes * sizeof(int);
+  offset[4] = &h->hash_offset;
+}
 
-      // Write index data array (xs_ptrs array)
-      stat = fread(energy_grid[i].xs_ptrs, sizeof(int), n_isotopes, fp);
-    }
+static unsigned long long file_checksum( void ** data, long * bytes )
+{
+  unsigned long long sum = CHECKSUM_BASIS;
+  for( int k = 0; k < XS_FILE_SECTIONS; k++ )
+    if( bytes[k] > 0 )
+      sum = (sum ^ checksum( data[k], bytes[k] )) * CHECKSUM_PRIME;
+  return sum;
+}
 
-  fclose(fp);
+static long file_align( long bytes )
+{
+  return (bytes + XS_FILE_ALIGN - 1) / XS_FILE_ALIGN * XS_FILE_ALIGN;
+}
 
+// Writes the nuclide grids and the search structure of D to filename
+void binary_dump( const char * filename, LookupData * D )
+{
+  static const char zeros[XS_FILE_ALIGN] = { 0 };
+  XSFileHeader h;
+  void * data[XS_FILE_SECTIONS];
+  long bytes[XS_FILE_SECTIONS];
+  long * offset[XS_FILE_SECTIONS];
+
+  memset( &h, 0, sizeof(h) );
+  strcpy( h.magic, XS_FILE_MAGIC );
+  h.version = XS_FILE_VERSION;
+  h.grid_type = D->grid_type;
+  h.n_isotopes = D->n_isotopes;
+  h.n_gridpoints = D->n_gridpoints;
+  h.hash_bins = D->hash_bins;
+  h.index_bits = index_bits();
+#ifdef VERIFICATION
+  h.verification = 1;
+  h.rn_v_state = *rn_v_seed();
+#endif
+
+  file_sections( D, &h, data, bytes, offset );
+  long pos = XS_FILE_ALIGN;
+  for( int k = 0; k < XS_FILE_SECTIONS; k++ ){
+    if( bytes[k] == 0 )
+      continue;
+    *offset[k] = pos;
+    pos += file_align( bytes[k] );
+  }
+  h.file_size = pos;
+  h.checksum = file_checksum( data, bytes );
+
+  // Written under a temporary name and renamed, so that a partially
+  // written file is never mapped by another run
+  char * tmp = new char[strlen(filename) + 5];
+  sprintf( tmp, "%s.tmp", filename );
+  FILE * fp = fopen( tmp, "wb" );
+  if( fp == NULL ){
+    fprintf(stderr, "Could not open \"%s\" for writing\n", tmp);
+    exit(1);
+  }
+
+  fwrite( &h, sizeof(h), 1, fp );
+  fwrite( zeros, 1, XS_FILE_ALIGN - sizeof(h), fp );
+  for( int k = 0; k < XS_FILE_SECTIONS; k++ ){
+    if( bytes[k] == 0 )
+      continue;
+    fwrite( data[k], 1, bytes[k], fp );
+    fwrite( zeros, 1, file_align( bytes[k] ) - bytes[k], fp );
+  }
+
+  if( ferror(fp) | fclose(fp) || rename( tmp, filename ) != 0 ){
+    fprintf(stderr, "Could not write \"%s\"\n", filename);
+    exit(1);
+  }
+  delete[] tmp;
+}
+
+// Maps a file written by binary_dump() and points D at its sections,
+// which are used in place. Exits if the file does not match the problem
+// described by D.
+void binary_read( const char * filename, LookupData * D )
+{
+  int fd = open( filename, O_RDONLY );
+  if( fd < 0 ){
+    fprintf(stderr, "Could not open \"%s\"\n", filename);
+    exit(1);
+  }
+
+  struct stat st;
+  if( fstat( fd, &st ) != 0 || st.st_size < XS_FILE_ALIGN ){
+    fprintf(stderr, "\"%s\" is not an XSBench grid file\n", filename);
+    exit(1);
+  }
+
+  char * map = (char *) mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if( map == MAP_FAILED ){
+    fprintf(stderr, "Could not map \"%s\"\n", filename);
+    exit(1);
+  }
+
+  XSFileHeader h;
+  memcpy( &h, map, sizeof(h) );
+  if( strncmp( h.magic, XS_FILE_MAGIC, sizeof(h.magic) ) != 0 ||
+      h.version != XS_FILE_VERSION ){
+    fprintf(stderr, "\"%s\" is not a version %d XSBench grid file\n",
+	    filename, XS_FILE_VERSION);
+    exit(1);
+  }
+  if( h.file_size != st.st_size ){
+    fprintf(stderr, "\"%s\" is truncated\n", filename);
+    exit(1);
+  }
+
+#ifdef VERIFICATION
+  int verification = 1;
+#else
+  int verification = 0;
+#endif
+  if( h.n_isotopes != D->n_isotopes || h.n_gridpoints != D->n_gridpoints ||
+      h.grid_type != D->grid_type ||
+      (h.grid_type == HASH && h.hash_bins != D->hash_bins) ||
+      h.index_bits != index_bits() || h.verification != verification ){
+    fprintf(stderr, "\"%s\" holds a different problem: %ld nuclides, "
+	    "%ld gridpoints, %s grid, %d bit index%s\n", filename,
+	    h.n_isotopes, h.n_gridpoints,
+	    h.grid_type == HASH ? "hash" : "unionized", h.index_bits,
+	    h.verification ? ", verification data" : "");
+    exit(1);
+  }
+
+  void * data[XS_FILE_SECTIONS];
+  long bytes[XS_FILE_SECTIONS];
+  long * offset[XS_FILE_SECTIONS];
+#ifdef COMPACT_INDEX
+  D->grid_index.n_blocks = (D->n_isotopes * D->n_gridpoints
+			    + INDEX_BLOCK - 1) / INDEX_BLOCK;
+#endif
+  file_sections( D, &h, data, bytes, offset );
+  for( int k = 0; k < XS_FILE_SECTIONS; k++ ){
+    if( bytes[k] > 0 && (*offset[k] < XS_FILE_ALIGN ||
+			 *offset[k] + bytes[k] > h.file_size) ){
+      fprintf(stderr, "\"%s\" has a corrupt header\n", filename);
+      exit(1);
+    }
+    data[k] = map + *offset[k];
+  }
+
+  D->nuclide_grids = (NuclideGridPoint *) data[0];
+  if( D->grid_type == UNIONIZED ){
+    D->energy_grid_energy = (double *) data[1];
+#ifdef COMPACT_INDEX
+    D->grid_index.delta = (IndexDelta *) data[2];
+    D->grid_index.base = (int *) data[3];
+#else
+    D->energy_grid_xs = (int *) data[2];
+#endif
+  }
+  else
+    D->hash_index = (int *) data[4];
+
+  // Reading every page defeats the lazy mapping, so the data is only
+  // checked when verifying
+#ifdef VERIFICATION
+  if( file_checksum( data, bytes ) != h.checksum ){
+    fprintf(stderr, "\"%s\" fails its checksum\n", filename);
+    exit(1);
+  }
+
+  // Material data is drawn next from the verification stream
+  *rn_v_seed() = h.rn_v_state;
+#endif
 }
 
 double timer()
@@ -198,3 +475,39 @@ double timer()
   gettimeofday(&time, 0);
   return time.tv_sec + time.tv_usec / 1000000.0;
 }
+
+void profile_init( Profile * prof )
+{
+  memset( prof, 0, sizeof(Profile) );
+#ifdef PAPI
+  prof->n_counters = counter_init();
+#endif
+}
+
+void profile_begin( Profile * prof, int phase )
+{
+#ifdef PAPI
+  counter_read( prof->counter_start[phase] );
+#endif
+  prof->start[phase] = timer();
+}
+
+void profile_end( Profile * prof, int phase )
+{
+  prof->time[phase] += timer() - prof->start[phase];
+  prof->calls[phase]++;
+#ifdef PAPI
+  long long now[MAX_COUNTERS];
+  counter_read( now );
+  for( int i = 0; i < prof->n_counters; i++ )
+    prof->counters[phase][i] += now[i] - prof->counter_start[phase][i];
+#endif
+}
+
+const char * phase_name( int phase )
+{
+  static const char * names[N_PHASES] = {
+    "grid_gen", "grid_sort", "unionize", "setup", "sample", "event_sort",
+    "copy", "kernel", "verify", "exchange" };
+  return names[phase];
+}
@@ -67,19 +67,58 @@ void center_print(const char *s, int width)
   fputs("\n", stdout);
 }
 
-void print_results( Inputs in, int mype, double runtime, int nprocs,
-	unsigned long long vhash )
+// Prints the time, calls and (with PAPI) counter totals of every phase
+// that ran
+static void print_phases( Profile * prof )
 {
-  // Calculate Lookups per sec
-  int lookups_per_sec = (int) ((double) in.lookups / runtime);
-	
-  // If running in MPI, reduce timing statistics and calculate average
+  printf("Phase        Time (s)   Calls");
+#ifdef PAPI
+  for( int i = 0; i < prof->n_counters; i++ )
+    printf(" %15s", counter_name(i));
+#endif
+  printf("\n");
+  for( int p = 0; p < N_PHASES; p++ )
+    {
+      if( prof->calls[p] == 0 )
+	continue;
+      printf("%-12s %8.3lf %7ld", phase_name(p), prof->time[p],
+	     prof->calls[p]);
+#ifdef PAPI
+      for( int i = 0; i < prof->n_counters; i++ )
+	printf(" %15lld", prof->counters[p][i]);
+#endif
+      printf("\n");
+    }
+}
+
+// Combines the results of all ranks: the run takes as long as the
+// slowest rank, and the verification hashes of the ranks' lookups add up.
+// Without VERIFICATION rank 0 keeps the check of its first lookup.
+void reduce_results( Results * r )
+{
+  r->runtime_min = r->runtime;
 #ifdef DOMPI
-  int total_lookups = 0;
-  MPI_Barrier(MPI_COMM_WORLD);
-  MPI_Reduce(&lookups_per_sec, &total_lookups, 1, MPI_INT,
-	     MPI_SUM, 0, MPI_COMM_WORLD);
+  double runtime = r->runtime;
+  MPI_Allreduce(&runtime, &r->runtime, 1, MPI_DOUBLE, MPI_MAX,
+		MPI_COMM_WORLD);
+  MPI_Allreduce(&runtime, &r->runtime_min, 1, MPI_DOUBLE, MPI_MIN,
+		MPI_COMM_WORLD);
+#ifdef VERIFICATION
+  unsigned long long vhash = r->vhash;
+  MPI_Allreduce(&vhash, &r->vhash, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM,
+		MPI_COMM_WORLD);
 #endif
+#endif
+}
+
+void print_results( Inputs in, int mype, int nprocs, Results * r )
+{
+  double runtime = r->runtime;
+  double sort_runtime = r->profile.time[PHASE_EVENT_SORT];
+
+  // Calculate Lookups per sec. In event mode the sort is reported on its
+  // own and left out of the lookup rate.
+  long lookups_per_sec = (long) ((double) r->lookups / (runtime - sort_runtime));
 	
   // Print output
   if( mype == 0 )
@@ -90,46 +129,152 @@ void print_results( Inputs in, int mype, double runtime, int nprocs,
 
       // Print the results
       printf("Threads:     %d\n", in.nthreads);
+      printf("MPI ranks:   %d", nprocs);
 #ifdef DOMPI
-      printf("MPI ranks:   %d\n", nprocs);
+      printf(" (%s, %s scaling)",
+	     in.decomp == NUCLIDE ? "nuclide" : "replicated",
+	     in.scaling == WEAK ? "weak" : "strong");
 #endif
-#ifdef DOMPI
-      printf("Total Lookups/s:            ");
-      fancy_int(total_lookups);
-      printf("Avg Lookups/s per MPI rank: ");
-      fancy_int(total_lookups / nprocs);
-#else
+      printf("\n");
       printf("Runtime:     %.3lf seconds\n", runtime);
-      printf("Lookups:     "); fancy_int(in.lookups);
+#ifdef DOMPI
+      printf("Fastest rank: %.3lf seconds\n", r->runtime_min);
+#endif
+      if( in.simulation_method == EVENT )
+	printf("Sort time:   %.3lf seconds\n", sort_runtime);
+      printf("Lookups:     "); fancy_int(r->lookups);
       printf("Lookups/s:   ");
       fancy_int(lookups_per_sec);
+#ifdef DOMPI
+      printf("Lookups/s per MPI rank: ");
+      fancy_int(lookups_per_sec / nprocs);
 #endif
+      if( in.simulation_method == EVENT )
+	{
+	  printf("Lookups/s (incl. sort): ");
+	  fancy_int((long) (r->lookups / runtime));
+	}
+      if( in.precision == XS_FLOAT )
+	{
+	  printf("Float XS error vs double (relative, %ld lookups):\n",
+		 in.lookups < PRECISION_SAMPLE ? in.lookups : PRECISION_SAMPLE);
+	  printf("  max %.3e, mean %.3e\n", r->xs_max_error, r->xs_mean_error);
+	}
 #ifndef VERIFICATION
-      printf("Non-zero Check: %llu\n", vhash);
+      printf("Non-zero Check: %llu\n", r->vhash);
 #else
-      printf("Verification checksum: %llu\n", vhash);
+      printf("Verification checksum: %llu\n", r->vhash);
 #endif
       border_print();
+      print_phases( &r->profile );
+      border_print();
 
       // For bechmarking, output lookup/s data to file
       if( SAVE )
 	{
 	  FILE * out = fopen( "results.txt", "a" );
-	  fprintf(out, "%d\t%d\n", in.nthreads, lookups_per_sec);
+	  fprintf(out, "%d\t%ld\n", in.nthreads, lookups_per_sec);
 	  fclose(out);
 	}
     }
 }
 
+// Writes the inputs, results and per-phase profile as one JSON object
+void write_json( const char * filename, Inputs in, int nprocs, int version,
+		 Results * r )
+{
+  FILE * out = fopen( filename, "w" );
+  if( out == NULL )
+    {
+      fprintf(stderr, "Could not open \"%s\" for writing\n", filename);
+      return;
+    }
+
+  double sort_runtime = r->profile.time[PHASE_EVENT_SORT];
+#ifdef VERIFICATION
+  int verification = 1;
+#else
+  int verification = 0;
+#endif
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"version\": %d,\n", version);
+  fprintf(out, "  \"inputs\": {\n");
+  fprintf(out, "    \"size\": \"%s\",\n", in.HM);
+  fprintf(out, "    \"nuclides\": %ld,\n", in.n_isotopes);
+  fprintf(out, "    \"gridpoints\": %ld,\n", in.n_gridpoints);
+  fprintf(out, "    \"lookups\": %ld,\n", in.lookups);
+  fprintf(out, "    \"batch\": %ld,\n", in.batch);
+  fprintf(out, "    \"grid_type\": \"%s\",\n",
+	  in.grid_type == HASH ? "hash" : "unionized");
+  fprintf(out, "    \"hash_bins\": %d,\n", in.hash_bins);
+  fprintf(out, "    \"method\": \"%s\",\n",
+	  in.simulation_method == EVENT ? "event" : "history");
+  fprintf(out, "    \"engine\": \"%s\",\n", in.engine == CPU ? "cpu" : "amp");
+  fprintf(out, "    \"layout\": \"%s\",\n", in.layout == SOA ? "soa" : "aos");
+  fprintf(out, "    \"precision\": \"%s\",\n",
+	  in.precision == XS_FLOAT ? "float" : "double");
+#ifdef COMPACT_INDEX
+  fprintf(out, "    \"index_bits\": %d,\n", (int) (8*sizeof(IndexDelta)));
+#else
+  fprintf(out, "    \"index_bits\": 32,\n");
+#endif
+  fprintf(out, "    \"threads\": %d,\n", in.nthreads);
+  fprintf(out, "    \"ranks\": %d,\n", nprocs);
+  fprintf(out, "    \"decomposition\": \"%s\",\n",
+	  in.decomp == NUCLIDE ? "nuclide" : "replicated");
+  fprintf(out, "    \"scaling\": \"%s\"\n", in.scaling == WEAK ? "weak" : "strong");
+  fprintf(out, "  },\n");
+  fprintf(out, "  \"results\": {\n");
+  fprintf(out, "    \"runtime\": %.6lf,\n", r->runtime);
+  fprintf(out, "    \"runtime_min\": %.6lf,\n", r->runtime_min);
+  fprintf(out, "    \"lookups\": %ld,\n", r->lookups);
+  fprintf(out, "    \"lookups_per_sec\": %.1lf,\n",
+	  r->lookups / (r->runtime - sort_runtime));
+  fprintf(out, "    \"lookups_per_sec_per_rank\": %.1lf,\n",
+	  r->lookups / (r->runtime - sort_runtime) / nprocs);
+  fprintf(out, "    \"verification\": %s,\n", verification ? "true" : "false");
+  fprintf(out, "    \"checksum\": %llu", r->vhash);
+  if( in.precision == XS_FLOAT )
+    fprintf(out, ",\n    \"xs_max_error\": %.6e,\n"
+	    "    \"xs_mean_error\": %.6e", r->xs_max_error, r->xs_mean_error);
+  fprintf(out, "\n  },\n");
+  fprintf(out, "  \"phases\": {");
+  int first = 1;
+  for( int p = 0; p < N_PHASES; p++ )
+    {
+      Profile * prof = &r->profile;
+      if( prof->calls[p] == 0 )
+	continue;
+      fprintf(out, "%s\n    \"%s\": { \"time\": %.6lf, \"calls\": %ld",
+	      first ? "" : ",", phase_name(p), prof->time[p], prof->calls[p]);
+#ifdef PAPI
+      fprintf(out, ", \"counters\": {");
+      for( int i = 0; i < prof->n_counters; i++ )
+	fprintf(out, "%s \"%s\": %lld", i ? "," : "", counter_name(i),
+		prof->counters[p][i]);
+      fprintf(out, " }");
+#endif
+      fprintf(out, " }");
+      first = 0;
+    }
+  fprintf(out, "\n  }\n");
+  fprintf(out, "}\n");
+  fclose(out);
+}
+
 void print_inputs(Inputs in, int nprocs, int version )
 {
   // Calculate Estimate of Memory Usage
-  int mem_tot = estimate_mem_usage( in );
+  int mem_tot = estimate_mem_usage( in, nprocs );
   logo(version);
   center_print("INPUT SUMMARY", 79);
   border_print();
 #ifdef VERIFICATION
   printf("Verification Mode:            on\n");
+#endif
+#ifdef COMPACT_INDEX
+  printf("Compact Grid Index:           %d-bit deltas\n", (int) (8*sizeof(IndexDelta)));
 #endif
   printf("Materials:                    %d\n", 12);
   printf("H-M Benchmark Size:           %s\n", in.HM);
@@ -139,8 +284,34 @@ void print_inputs(Inputs in, int nprocs, int version )
   printf("Unionized Energy Gridpoints:  ");
   fancy_int(in.n_isotopes*in.n_gridpoints);
   printf("XS Lookups:                   "); fancy_int(in.lookups);
+  if( in.batch > 0 && in.batch < in.lookups )
+    {
+      printf("Lookups per Batch:            "); fancy_int(in.batch);
+    }
+  if( in.grid_type == HASH )
+    {
+      printf("Grid Type:                    Hash\n");
+      printf("Hash Bins:                    "); fancy_int(in.hash_bins);
+    }
+  else
+    printf("Grid Type:                    Unionized\n");
+  if( in.simulation_method == EVENT )
+    printf("Simulation Method:            Event\n");
+  else
+    printf("Simulation Method:            History\n");
+  if( in.engine == CPU )
+    printf("Lookup Engine:                CPU (%s grids)\n",
+	   in.layout == SOA ? "SoA" : "AoS");
+  else
+    printf("Lookup Engine:                AMP\n");
+  if( in.precision == XS_FLOAT )
+    printf("XS Precision:                 Float (double energies)\n");
 #ifdef DOMPI
   printf("MPI Ranks:                    %d\n", nprocs);
+  printf("MPI Decomposition:            %s\n",
+	 in.decomp == NUCLIDE ? "Nuclide" : "Replicated");
+  printf("MPI Scaling:                  %s\n",
+	 in.scaling == WEAK ? "Weak (lookups per rank)" : "Strong");
   printf("OMP Threads per MPI Rank:     %d\n", in.nthreads);
   printf("Mem Usage per MPI Rank (MB):  "); fancy_int(mem_tot);
 #else
@@ -189,7 +360,26 @@ void print_CLI_error(void)
   printf("  -s <size>        Size of H-M Benchmark to run (small, large, XL, XXL)\n");
   printf("  -g <gridpoints>  Number of gridpoints per nuclide (overrides -s defaults)\n");
   printf("  -l <lookups>     Number of Cross-section (XS) lookups\n");
-  printf("Default is equivalent to: -s large -l 15000000\n");
+  printf("  -b <batch>       Lookups sampled per batch (default: all of them)\n");
+  printf("  -G <grid type>   Energy search grid (unionized, hash)\n");
+  printf("  -p <hash bins>   Number of hash bins (only with -G hash)\n");
+  printf("  -m <method>      Simulation method (history, event)\n");
+#ifdef HAVE_AMP
+  printf("  -e <engine>      Lookup engine (amp, cpu)\n");
+#else
+  printf("  -e <engine>      Lookup engine (cpu, amp needs the hcc build)\n");
+#endif
+  printf("  -L <layout>      Nuclide grid layout of the cpu engine (aos, soa)\n");
+  printf("  -P <precision>   Precision of the stored XS (double, float)\n");
+  printf("  -d <decomp>      MPI decomposition (replicated, nuclide)\n");
+  printf("  -S <scaling>     MPI scaling, lookups in total or per rank (strong, weak)\n");
+  printf("  -f <file>        Binary grid file of the binary dump/read modes\n");
+  printf("  -j <file>        Also write the results and phase profile as JSON\n");
+#ifdef HAVE_AMP
+  printf("Default is equivalent to: -s large -l 15000000 -G unionized -m history -e amp\n");
+#else
+  printf("Default is equivalent to: -s large -l 15000000 -G unionized -m history -e cpu\n");
+#endif
   printf("See readme for full description of default run values\n");
   exit(4);
 }
@@ -209,6 +399,9 @@ Inputs read_CLI( int argc, char * argv[] )
 	
   // defaults to 15,000,000
   input.lookups = 15000000;
+
+  // defaults to sampling all lookups in one batch
+  input.batch = 0;
 	
   // defaults to H-M Large benchmark
   input.HM = (char *) malloc( 6 * sizeof(char) );
@@ -218,6 +411,37 @@ Inputs read_CLI( int argc, char * argv[] )
   input.HM[3] = 'g' ; 
   input.HM[4] = 'e' ; 
   input.HM[5] = '\0';
+
+  // defaults to the unionized energy grid
+  input.grid_type = UNIONIZED;
+
+  // defaults to 10,000 hash bins
+  input.hash_bins = 10000;
+
+  // defaults to history based lookups (random order)
+  input.simulation_method = HISTORY;
+
+  // defaults to the AMP lookup kernel where available, reading the AoS
+  // nuclide grids
+#ifdef HAVE_AMP
+  input.engine = AMP;
+#else
+  input.engine = CPU;
+#endif
+  input.layout = AOS;
+
+  // defaults to double precision XS tables
+  input.precision = XS_DOUBLE;
+
+  // defaults to replicated data and a fixed total of lookups across ranks
+  input.decomp = REPLICATED;
+  input.scaling = STRONG;
+
+  // defaults to XS_data.dat in the working directory
+  input.filename = (char *) "XS_data.dat";
+
+  // defaults to no JSON report
+  input.json_file = NULL;
 	
   // Check if user sets these
   int user_g = 0;
@@ -250,7 +474,144 @@ Inputs read_CLI( int argc, char * argv[] )
       else if( strcmp(arg, "-l") == 0 )
 	{
 	  if( ++i < argc )
-	    input.lookups = atoi(argv[i]);
+	    input.lookups = atol(argv[i]);
+	  else
+	    print_CLI_error();
+	}
+      // lookups per batch (-b)
+      else if( strcmp(arg, "-b") == 0 )
+	{
+	  if( ++i < argc )
+	    input.batch = atol(argv[i]);
+	  else
+	    print_CLI_error();
+	}
+      // grid type (-G)
+      else if( strcmp(arg, "-G") == 0 )
+	{
+	  if( ++i < argc )
+	    {
+	      if( strcasecmp(argv[i], "unionized") == 0 )
+		input.grid_type = UNIONIZED;
+	      else if( strcasecmp(argv[i], "hash") == 0 )
+		input.grid_type = HASH;
+	      else
+		print_CLI_error();
+	    }
+	  else
+	    print_CLI_error();
+	}
+      // hash bins (-p)
+      else if( strcmp(arg, "-p") == 0 )
+	{
+	  if( ++i < argc )
+	    input.hash_bins = atoi(argv[i]);
+	  else
+	    print_CLI_error();
+	}
+      // simulation method (-m)
+      else if( strcmp(arg, "-m") == 0 )
+	{
+	  if( ++i < argc )
+	    {
+	      if( strcasecmp(argv[i], "history") == 0 )
+		input.simulation_method = HISTORY;
+	      else if( strcasecmp(argv[i], "event") == 0 )
+		input.simulation_method = EVENT;
+	      else
+		print_CLI_error();
+	    }
+	  else
+	    print_CLI_error();
+	}
+      // lookup engine (-e)
+      else if( strcmp(arg, "-e") == 0 )
+	{
+	  if( ++i < argc )
+	    {
+	      if( strcasecmp(argv[i], "amp") == 0 )
+		input.engine = AMP;
+	      else if( strcasecmp(argv[i], "cpu") == 0 )
+		input.engine = CPU;
+	      else
+		print_CLI_error();
+	    }
+	  else
+	    print_CLI_error();
+	}
+      // nuclide grid layout (-L)
+      else if( strcmp(arg, "-L") == 0 )
+	{
+	  if( ++i < argc )
+	    {
+	      if( strcasecmp(argv[i], "aos") == 0 )
+		input.layout = AOS;
+	      else if( strcasecmp(argv[i], "soa") == 0 )
+		input.layout = SOA;
+	      else
+		print_CLI_error();
+	    }
+	  else
+	    print_CLI_error();
+	}
+      // XS precision (-P)
+      else if( strcmp(arg, "-P") == 0 )
+	{
+	  if( ++i < argc )
+	    {
+	      if( strcasecmp(argv[i], "double") == 0 )
+		input.precision = XS_DOUBLE;
+	      else if( strcasecmp(argv[i], "float") == 0 )
+		input.precision = XS_FLOAT;
+	      else
+		print_CLI_error();
+	    }
+	  else
+	    print_CLI_error();
+	}
+      // MPI decomposition (-d)
+      else if( strcmp(arg, "-d") == 0 )
+	{
+	  if( ++i < argc )
+	    {
+	      if( strcasecmp(argv[i], "replicated") == 0 )
+		input.decomp = REPLICATED;
+	      else if( strcasecmp(argv[i], "nuclide") == 0 )
+		input.decomp = NUCLIDE;
+	      else
+		print_CLI_error();
+	    }
+	  else
+	    print_CLI_error();
+	}
+      // MPI scaling (-S)
+      else if( strcmp(arg, "-S") == 0 )
+	{
+	  if( ++i < argc )
+	    {
+	      if( strcasecmp(argv[i], "strong") == 0 )
+		input.scaling = STRONG;
+	      else if( strcasecmp(argv[i], "weak") == 0 )
+		input.scaling = WEAK;
+	      else
+		print_CLI_error();
+	    }
+	  else
+	    print_CLI_error();
+	}
+      // binary grid file (-f)
+      else if( strcmp(arg, "-f") == 0 )
+	{
+	  if( ++i < argc )
+	    input.filename = argv[i];
+	  else
+	    print_CLI_error();
+	}
+      // JSON report (-j)
+      else if( strcmp(arg, "-j") == 0 )
+	{
+	  if( ++i < argc )
+	    input.json_file = argv[i];
 	  else
 	    print_CLI_error();
 	}
@@ -283,6 +644,32 @@ Inputs read_CLI( int argc, char * argv[] )
   // Validate lookups
   if( input.lookups < 1 )
     print_CLI_error();
+
+  // Validate batch size (0 means all lookups at once)
+  if( input.batch < 0 )
+    print_CLI_error();
+
+  // The AMP engine needs an hcc build
+#ifndef HAVE_AMP
+  if( input.engine == AMP )
+    print_CLI_error();
+#endif
+
+  // The SoA layout is only read by the CPU engine
+  if( input.layout == SOA && input.engine != CPU )
+    print_CLI_error();
+
+  // Validate hash bins
+  if( input.hash_bins < 1 )
+    print_CLI_error();
+
+  // The nuclide decomposition builds each rank's grids from its own
+  // nuclides, which a binary grid file does not hold
+#if defined(BINARY_DUMP) || defined(BINARY_READ)
+  if( input.decomp == NUCLIDE )
+    print_CLI_error();
+#endif
+
 	
   // Validate HM size
   if( strcasecmp(input.HM, "small") != 0 &&
@@ -31,64 +31,100 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "XSbench_header.h"
 
-void counter_init( int *eventset, int *num_papi_events )
+// Events counted in every phase
+//  static int events[] = {PAPI_TOT_INS,PAPI_BR_INS,PAPI_SR_INS};
+static int events[] = {PAPI_TOT_CYC,PAPI_L3_TCM};
+static int num_papi_events = sizeof(events) / sizeof(int);
+
+// One event set per OpenMP thread, each started and read by its thread
+static int * eventsets = NULL;
+static int n_threads = 0;
+
+// Initializes PAPI and starts the counters on every OpenMP thread. Must be
+// called before the first parallel region. Returns the number of events.
+int counter_init( void )
 {
-	char error_str[PAPI_MAX_STR_LEN];
-	//  int events[] = {PAPI_TOT_INS,PAPI_BR_INS,PAPI_SR_INS};
-	int events[] = {PAPI_TOT_CYC,PAPI_L3_TCM};
 	int stat;
 
-	int thread = omp_get_thread_num();
-	if( thread == 0 )
-		printf("Initializing PAPI counters...\n");
+	printf("Initializing PAPI counters...\n");
 
-	*num_papi_events = sizeof(events) / sizeof(int);
+	if ( PAPI_library_init(PAPI_VER_CURRENT) != PAPI_VER_CURRENT){
+		fprintf(stderr, "PAPI library init error!\n");
+		exit(1);
+	}
 
 	if ((stat = PAPI_thread_init((long unsigned int (*)(void)) omp_get_thread_num)) != PAPI_OK){
 		PAPI_perror("PAPI_thread_init");
 		exit(1);
 	}
 
-	if ( (stat= PAPI_create_eventset(eventset)) != PAPI_OK){
-		PAPI_perror("PAPI_create_eventset");
-		exit(1);
-	}
+	if( num_papi_events > MAX_COUNTERS )
+		num_papi_events = MAX_COUNTERS;
+
+	n_threads = omp_get_max_threads();
+	eventsets = new int[n_threads];
+
+	#pragma omp parallel num_threads(n_threads) private(stat)
+	{
+		int thread = omp_get_thread_num();
+		eventsets[thread] = PAPI_NULL;
+
+		if ( (stat= PAPI_create_eventset(&eventsets[thread])) != PAPI_OK){
+			PAPI_perror("PAPI_create_eventset");
+			exit(1);
+		}
+
+		for( int i = 0; i < num_papi_events; i++ ){
+			if ((stat=PAPI_add_event(eventsets[thread],events[i])) != PAPI_OK){
+				PAPI_perror("PAPI_add_event");
+				exit(1);
+			}
+		}
 
-	for( int i = 0; i < *num_papi_events; i++ ){
-		if ((stat=PAPI_add_event(*eventset,events[i])) != PAPI_OK){
-			PAPI_perror("PAPI_add_event");
+		if ((stat=PAPI_start(eventsets[thread])) != PAPI_OK){
+			PAPI_perror("PAPI_start");
 			exit(1);
 		}
 	}
 
-	if ((stat=PAPI_start(*eventset)) != PAPI_OK){
-		PAPI_perror("PAPI_start");
-		exit(1);
+	return num_papi_events;
+}
+
+// Current counts summed over all threads. Relies on the OpenMP runtime
+// keeping the same threads for every parallel region.
+void counter_read( long long * values )
+{
+	long long * thread_values = new long long[n_threads * MAX_COUNTERS];
+
+	#pragma omp parallel num_threads(n_threads)
+	{
+		int thread = omp_get_thread_num();
+		PAPI_read(eventsets[thread], &thread_values[thread * MAX_COUNTERS]);
 	}
+
+	for( int i = 0; i < num_papi_events; i++ ){
+		values[i] = 0;
+		for( int t = 0; t < n_threads; t++ )
+			values[i] += thread_values[t * MAX_COUNTERS + i];
+	}
+	delete[] thread_values;
+}
+
+// PAPI symbol of event i, e.g. PAPI_TOT_CYC
+const char * counter_name( int i )
+{
+	static char names[MAX_COUNTERS][PAPI_MAX_STR_LEN];
+	PAPI_event_code_to_name(events[i], names[i]);
+	return names[i];
 }
 
-// Stops the papi counters and prints results
-void counter_stop( int * eventset, int num_papi_events )
+// Stops the counters of every thread
+void counter_stop( void )
 {
-	int * events = malloc(num_papi_events * sizeof(int));
-	int n = num_papi_events;
-	PAPI_list_events( *eventset, events, &n );
-	PAPI_event_info_t info;
-
-	long_long * values = malloc( num_papi_events * sizeof(long_long));
-	PAPI_stop(*eventset, values);
-	int thread = omp_get_thread_num();
-	#ifndef HAVE_AMP
-	#pragma omp critical (papi)
-	#endif
+	#pragma omp parallel num_threads(n_threads)
 	{
-		printf("Thread %d\n", thread);
-		for( int i = 0; i < num_papi_events; i++ )
-		{
-			PAPI_get_event_info(events[i], &info);
-			printf("%-15lld\t%s\t%s\n", values[i],info.symbol,info.long_descr);
-		}
-		free(events);
-		free(values);	
+		long long values[MAX_COUNTERS];
+		PAPI_stop(eventsets[omp_get_thread_num()], values);
 	}
+	delete[] eventsets;
 }
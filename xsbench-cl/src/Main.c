@@ -133,6 +133,10 @@ int main( int argc, char* argv[] )
 		printf("Unionized Energy Gridpoints:  ");
 		fancy_int(n_isotopes*n_gridpoints);
 		printf("XS Lookups:                   "); fancy_int(lookups);
+		if( input.chunk > 0 )
+		{
+			printf("Pipeline Chunk (lookups):     "); fancy_int(input.chunk);
+		}
 		#ifdef MPI
 		printf("MPI Ranks:                    %d\n", nprocs);
 		//printf("OMP Threads per MPI Rank:     %d\n", nthreads);
@@ -245,6 +249,11 @@ const char * krnl_param_nm =
 	krnl_param.lookups = input.lookups;
 	krnl_param.n_isotopes =   input.n_isotopes;
 	krnl_param.n_gridpoints = input.n_gridpoints;
+	if( input.chunk > 0 && SetupPipeline(input.chunk) != CL_SUCCESS )
+	{
+		CleanupOpenCL();
+		exit(1);
+	}
 	AllocOutput(&krnl_param);
 	AllocArrangeCopyConst(&krnl_param, (const int *)num_nucs, (const int **)mats, (const double **)concs);
 	AllocCopyInputs(&krnl_param, pp_energy, pmat);
@@ -30,6 +30,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 *******************************************************************************/
 #include "XSbench_header.h"
 #include "XSBench_OCL.h"
+#include "clProgramCache.h"
 
 int CreateContext(struct OCL_ConfigS *config)
 {
@@ -102,8 +103,18 @@ int CreateProgram(struct OCL_ConfigS *config)
   memset(srcStr, '\0', size+1);
 
   fread(srcStr, size, 1, fp);
+  fclose(fp);
 
-  config->program = clCreateProgramWithSource(config->context, 1, (const char**)&srcStr, NULL, NULL);
+char *p_build_options = NULL;
+#ifdef VERIFICATION_BUFFER
+    p_build_options = "-DVERIFICATION_BUFFER";
+#endif
+
+  /* Reuses a binary built by an earlier run when source, options and
+     device all match (see clProgramCache.h) */
+  config->program = clCachedProgram(config->context, config->dev_id, srcStr, size,
+				    p_build_options, &errNum);
+  free(srcStr);
 
   if(config->program == NULL)
     {
@@ -111,12 +122,6 @@ int CreateProgram(struct OCL_ConfigS *config)
       return -99999999;
     }
 
-char *p_build_options = NULL;
-#ifdef VERIFICATION_BUFFER
-    p_build_options = "-DVERIFICATION_BUFFER";
-#endif
-
-  errNum = clBuildProgram(config->program, 0, NULL, p_build_options, NULL, NULL);
   if(errNum != CL_SUCCESS)
     {
       char buildLog[16384];
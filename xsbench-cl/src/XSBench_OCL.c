@@ -72,11 +72,41 @@ int SetupOpenCL(char *kernel_filename)
   return(CL_SUCCESS);
 }
 
+// Creates the extra in-order queues used to pipeline the sorted path in
+// chunks of chunk_lookups lookups
+int SetupPipeline(uint chunk_lookups)
+{
+  cl_int err = CL_SUCCESS;
+
+  if(instances == 0) return -1;
+
+  for (int q = 0; q < __N_PIPE_QUEUES__ && err == CL_SUCCESS; q++)
+  {
+     OCLConfigs->pipe_queues[q] = clCreateCommandQueue(OCLConfigs->context, OCLConfigs->dev_id, 0, &err);
+  }
+  if(err != CL_SUCCESS)
+  {
+     printf("Could not create pipeline queues: error = %d\n", err);
+     return(err);
+  }
+
+  OCLConfigs->chunk_lookups = chunk_lookups;
+  return(CL_SUCCESS);
+}
+
 int CleanupOpenCL()
 {
   if(instances == 0) return 0;
   ReleaseOCLBuffer(OCLConfigs->consts.mat_concs);
   ReleaseOCLBuffer(OCLConfigs->outputs.xs_output);
+  for (int q = 0; q < __N_PIPE_QUEUES__; q++)
+  {
+     if ( OCLConfigs->pipe_queues[q] )
+     {
+        clReleaseCommandQueue(OCLConfigs->pipe_queues[q]);
+        OCLConfigs->pipe_queues[q] = 0;
+     }
+  }
   for (int i = 0; i < __MAX_N_KERNELS__; i++)
   {
      if ( OCLConfigs->OCL_kernels[i] )
@@ -291,6 +321,13 @@ int AllocArrangeCopyNucGrid(OCLKernelParamsMacroXSS *kern_params, const NuclideG
 
 typedef int (*cmp_func)(const void * a, const void * b );
 
+// NDRange sizes must be a multiple of the work-group size
+static
+size_t round_up(size_t n, size_t block)
+{
+   return ((n + block - 1) / block) * block;
+}
+
 typedef struct _double_index{
    double d;
    uint   i;
@@ -411,10 +448,7 @@ int AllocCopyInputs(OCLKernelParamsMacroXSS *kern_params, double *pp_energy, int
  OCLBuffer *index_buf2 = &config->inputs.xs_input[2]  ;
  OCLBuffer *index_buf3 = &config->inputs.xs_input[3]  ;
  OCLBuffer *index_buf4 = &config->inputs.xs_input[4]  ;
- uint actual_len = (kern_params->lookups > e_sort_block) ? kern_params->lookups : e_sort_block;
- double log_len = ceil(log((double)actual_len) / log(2.));
- uint ilog_len = (uint)log_len;
- uint len = (1 << ilog_len) * sizeof(double);
+ uint len = kern_params->lookups * sizeof(double);
 
      eng_buf->len = len; //kern_params->lookups * sizeof(double);
 
@@ -435,27 +469,15 @@ int AllocCopyInputs(OCLKernelParamsMacroXSS *kern_params, double *pp_energy, int
 	 }
      }
 
-     uint rem;
-     uint blocked_lookups = ( (actual_len + kern_params->e_sort_tile - 1)/ kern_params->e_sort_tile) * kern_params->e_sort_tile;
-// padding last sorted block with big values
-// to push non-used entry into the end
-     if ((rem = (blocked_lookups - kern_params->lookups)) > 0 )
-     {
-	 for (int i = blocked_lookups - 1, k = rem - 1; k >= 0; k--, i--)
-	 {
-		 ((double*)eng_buf->sys)[i] = 1.0;
-	 }
-     }
-
-
-
      printf("\n");
 
-     kern_params->enlarged_lookups = blocked_lookups;
+// whole number of sort tiles; the sort handles a short last tile itself,
+// so the buffers are not padded
+     kern_params->enlarged_lookups = ( (kern_params->lookups + kern_params->e_sort_tile - 1)/ kern_params->e_sort_tile) * kern_params->e_sort_tile;
 
 // send it to device
      CopyToDevice(config->command_queue, eng_buf);
-     mat_buf->len = sizeof(int) * (1 << ilog_len); // kern_params->lookups;
+     mat_buf->len = sizeof(int) * kern_params->lookups;
      if (CL_SUCCESS != (err = CreateOCLBuffer(config->context, mat_buf, CL_MEM_READ_WRITE)))
      {
 	printf("Error allocating OCLBuffer in AllocCopyInputs2, size = %d\n",mat_buf->len);
@@ -471,28 +493,18 @@ int AllocCopyInputs(OCLKernelParamsMacroXSS *kern_params, double *pp_energy, int
      }
      printf("\n");
 
-     uint m_sort_block = e_sort_block;
-     blocked_lookups = ( (actual_len + kern_params->e_sort_tile - 1)/ kern_params->e_sort_tile) * kern_params->e_sort_tile;
-// padding last sorted block with big values
-     if ((rem = (blocked_lookups - kern_params->lookups)) > 0 )
-     {
-	 for (int i = blocked_lookups - 1, k = rem - 1; k >= 0; k--, i--)
-	 {
-		 ((uint*)mat_buf->sys)[i] = 0x7fffffff;
-	 }
-     }
 // send it to device
      CopyToDevice(config->command_queue, mat_buf);
 
 // temp buffer keeping unsorted indexes
-     index_buf2->len = sizeof(int) * (1 << ilog_len); // kern_params->lookups;
+     index_buf2->len = sizeof(int) * kern_params->lookups;
      if (CL_SUCCESS != (err = CreateOCLBuffer(config->context, index_buf2, CL_MEM_READ_WRITE)))
      {
 	printf("Error allocating OCLBuffer in AllocCopyInputs3, size = %d\n",index_buf2->len);
         exit(0);
      }
 // temp buffer keeping indexes into unionized energy array
-     index_buf3->len = sizeof(int) * (1 << ilog_len); // kern_params->lookups;
+     index_buf3->len = sizeof(int) * kern_params->lookups;
      if (CL_SUCCESS != (err = CreateOCLBuffer(config->context, index_buf3, CL_MEM_READ_WRITE)))
      {
 	printf("Error allocating OCLBuffer in AllocCopyInputs4, size = %d\n",index_buf3->len);
@@ -836,7 +848,6 @@ void sort_input_energy(OCLKernelParamsMacroXSS *kern_params, const char * kernel
   cl_context context = GetXSBenchContext();
   cl_command_queue commandQueue = GetXSBenchCommandQueue();
   cl_kernel sort_kernel = GetXSBenchOCLKernel( kernel_nm);
-  uint acs = 1;
   uint n_stages = 0;
   uint n_groups = kern_params->enlarged_lookups / kern_params->e_sort_tile;
   size_t sort_local_work_size[2] = {256, 0};
@@ -847,17 +858,17 @@ void sort_input_energy(OCLKernelParamsMacroXSS *kern_params, const char * kernel
         ++n_stages;
 
 #if VERIFICATION
-  DOUBLE_INDEX *d_i = (DOUBLE_INDEX*)malloc(sizeof(DOUBLE_INDEX) * kern_params->enlarged_lookups);
-  double *d2 = (double*)malloc(sizeof(double) * kern_params->enlarged_lookups);
+  DOUBLE_INDEX *d_i = (DOUBLE_INDEX*)malloc(sizeof(DOUBLE_INDEX) * kern_params->lookups);
+  double *d2 = (double*)malloc(sizeof(double) * kern_params->lookups);
   double * in_energy = (double*)config->inputs.xs_input[0].sys;
-  for ( uint i = 0; i < kern_params->enlarged_lookups; i++ )
+  for ( uint i = 0; i < kern_params->lookups; i++ )
   {
 	  d2[i] = d_i[i].d = in_energy[i];
 	  d_i[i].i = i;
 
   }
  
-  block_qsort(d_i, sizeof(DOUBLE_INDEX), kern_params->enlarged_lookups, kern_params->e_sort_tile, double_index_compare );
+  block_qsort(d_i, sizeof(DOUBLE_INDEX), kern_params->lookups, kern_params->e_sort_tile, double_index_compare );
 #endif
 
   n_arg = 0;
@@ -870,7 +881,6 @@ void sort_input_energy(OCLKernelParamsMacroXSS *kern_params, const char * kernel
   err |= clSetKernelArg(sort_kernel, n_arg++, sizeof(uint), &kern_params->lookups);
   err |= clSetKernelArg(sort_kernel, n_arg++, sizeof(uint), &kern_params->e_sort_tile);
   err |= clSetKernelArg(sort_kernel, n_arg++, sizeof(uint), &n_stages);
-  err |= clSetKernelArg(sort_kernel, n_arg++, sizeof(uint), &acs);
 
     err = CL_SUCCESS;
 
@@ -942,17 +952,17 @@ void sort_input_material(OCLKernelParamsMacroXSS *kern_params, const char * kern
         ++n_stages;
 
 #if VERIFICATION
-  unsigned long long *ui_i = (unsigned long long *)malloc(sizeof(unsigned long long) * kern_params->enlarged_lookups);
-  uint *i2 = (uint*)malloc(sizeof(uint) * kern_params->enlarged_lookups);
+  unsigned long long *ui_i = (unsigned long long *)malloc(sizeof(unsigned long long) * kern_params->lookups);
+  uint *i2 = (uint*)malloc(sizeof(uint) * kern_params->lookups);
   uint * in_mat = (uint*)config->inputs.xs_input[1].sys;
-  for ( uint i = 0; i < kern_params->enlarged_lookups; i++ )
+  for ( uint i = 0; i < kern_params->lookups; i++ )
   {
 	  i2[i] = in_mat[i];
 	  ui_i[i] = ((unsigned long long)in_mat[i] << 32 ) | (unsigned long long)i;
 
   }
  
-  block_qsort(ui_i, sizeof(unsigned long long), kern_params->enlarged_lookups, kern_params->e_sort_tile, ulonglong_compare );
+  block_qsort(ui_i, sizeof(unsigned long long), kern_params->lookups, kern_params->e_sort_tile, ulonglong_compare );
 #endif
 
   n_arg = 0;
@@ -1036,6 +1046,7 @@ void unionized_grid_search(OCLKernelParamsMacroXSS *kern_params, const char * ke
   err |= clSetKernelArg(kernel, n_arg++, sizeof(cl_mem), &config->enGripPoints.enGP[0].mem);
 // unsorted energy indexes
   err |= clSetKernelArg(kernel, n_arg++, sizeof(cl_mem), &config->inputs.xs_input[3].mem);
+  err |= clSetKernelArg(kernel, n_arg++, sizeof(uint), &kern_params->lookups);
 
 
   if(err != CL_SUCCESS)
@@ -1044,8 +1055,8 @@ void unionized_grid_search(OCLKernelParamsMacroXSS *kern_params, const char * ke
       exit(1);
   }
 
-  size_t global_work_size[2] = {kern_params->lookups, 0};
   size_t local_work_size[2] = {256, 0};
+  size_t global_work_size[2] = {round_up(kern_params->lookups, local_work_size[0]), 0};
 
  
   err = CL_SUCCESS;
@@ -1148,6 +1159,7 @@ void calculate_xs_sorted(OCLKernelParamsMacroXSS *kern_params, const char * kern
   err |= clSetKernelArg(kernel, n_arg++, sizeof(cl_mem), &config->nuGripPoints.nucGP[0].mem);
 // xs vector(s)
   err |= clSetKernelArg(kernel, n_arg++, sizeof(cl_mem), &config->outputs.xs_output[0].mem);
+  err |= clSetKernelArg(kernel, n_arg++, sizeof(uint), &kern_params->lookups);
 
 
   if(err != CL_SUCCESS)
@@ -1156,8 +1168,8 @@ void calculate_xs_sorted(OCLKernelParamsMacroXSS *kern_params, const char * kern
       exit(1);
   }
 
-  size_t global_work_size[2] = {kern_params->lookups, 0};
   size_t local_work_size[2] = {64, 0};
+  size_t global_work_size[2] = {round_up(kern_params->lookups, local_work_size[0]), 0};
 
  
   err = CL_SUCCESS;
@@ -1176,6 +1188,189 @@ void calculate_xs_sorted(OCLKernelParamsMacroXSS *kern_params, const char * kern
 }
 
 
+// Sub-buffer covering elements [off, off + n) of an n-element-wide buffer
+static
+cl_mem chunk_buffer(OCLBuffer *buf, size_t elem_sz, uint off, uint n)
+{
+  int err;
+  cl_buffer_region region = {off * elem_sz, n * elem_sz};
+  cl_mem mem = clCreateSubBuffer(buf->mem, 0, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+
+  if(err != CL_SUCCESS)
+  {
+      printf("chunk_buffer: failed to create sub-buffer with error %d\n", err);
+      exit(1);
+  }
+  return(mem);
+}
+
+typedef struct {
+  uint off;
+  uint n;
+// energy, material, unsorted index, energy grid index, sorted energy
+  cl_mem in[5];
+  cl_mem out;
+} OCLChunk;
+
+// Enqueues upload -> sort -> search -> lookup -> readback of one chunk on
+// an in-order queue, the first command waiting on wait_ev
+static
+void enqueue_chunk(OCLKernelParamsMacroXSS *kern_params, cl_command_queue queue, OCLChunk *chunk,
+		   uint n_stages, cl_event *wait_ev, cl_event *done_ev)
+{
+  int err;
+  int n_arg;
+  struct OCL_ConfigS * config =  GetOCLConfig();
+  cl_kernel sort_kernel = GetXSBenchOCLKernel("bitonicSortTiled3");
+  cl_kernel search_kernel = GetXSBenchOCLKernel("unionized_grid_search");
+  cl_kernel xs_kernel = GetXSBenchOCLKernel("calculate_xs_sorted");
+  uint n_groups = (chunk->n + kern_params->e_sort_tile - 1) / kern_params->e_sort_tile;
+  size_t sort_local_work_size[2] = {256, 0};
+  size_t sort_global_work_size[2] = {n_groups*sort_local_work_size[0], 0};
+  size_t search_local_work_size[2] = {256, 0};
+  size_t search_global_work_size[2] = {round_up(chunk->n, search_local_work_size[0]), 0};
+  size_t xs_local_work_size[2] = {64, 0};
+  size_t xs_global_work_size[2] = {round_up(chunk->n, xs_local_work_size[0]), 0};
+
+  err = clEnqueueWriteBuffer(queue, chunk->in[0], CL_FALSE, 0, chunk->n * sizeof(double),
+			     (double*)config->inputs.xs_input[0].sys + chunk->off,
+			     wait_ev ? 1 : 0, wait_ev, NULL);
+  err |= clEnqueueWriteBuffer(queue, chunk->in[1], CL_FALSE, 0, chunk->n * sizeof(int),
+			      (int*)config->inputs.xs_input[1].sys + chunk->off, 0, NULL, NULL);
+
+// arguments are captured at enqueue time, so the kernels can be shared by all chunks
+  n_arg = 0;
+  err |= clSetKernelArg(sort_kernel, n_arg++, sizeof(cl_mem), &chunk->in[0]);
+  err |= clSetKernelArg(sort_kernel, n_arg++, sizeof(cl_mem), &chunk->in[4]);
+  err |= clSetKernelArg(sort_kernel, n_arg++, sizeof(cl_mem), &chunk->in[2]);
+  err |= clSetKernelArg(sort_kernel, n_arg++, sizeof(uint), &chunk->n);
+  err |= clSetKernelArg(sort_kernel, n_arg++, sizeof(uint), &kern_params->e_sort_tile);
+  err |= clSetKernelArg(sort_kernel, n_arg++, sizeof(uint), &n_stages);
+  err |= clEnqueueNDRangeKernel(queue, sort_kernel, 1, NULL, sort_global_work_size, sort_local_work_size,
+				0, NULL, NULL);
+
+  n_arg = 0;
+  err |= clSetKernelArg(search_kernel, n_arg++, sizeof(cl_mem), &config->consts.mat_concs[0].mem);
+  err |= clSetKernelArg(search_kernel, n_arg++, sizeof(cl_mem), &chunk->in[4]);
+  err |= clSetKernelArg(search_kernel, n_arg++, sizeof(cl_mem), &chunk->in[2]);
+  err |= clSetKernelArg(search_kernel, n_arg++, sizeof(cl_mem), &config->enGripPoints.enGP[0].mem);
+  err |= clSetKernelArg(search_kernel, n_arg++, sizeof(cl_mem), &chunk->in[3]);
+  err |= clSetKernelArg(search_kernel, n_arg++, sizeof(uint), &chunk->n);
+  err |= clEnqueueNDRangeKernel(queue, search_kernel, 1, NULL, search_global_work_size, search_local_work_size,
+				0, NULL, NULL);
+
+  n_arg = 0;
+  err |= clSetKernelArg(xs_kernel, n_arg++, sizeof(cl_mem), &config->consts.mat_concs[0].mem);
+  err |= clSetKernelArg(xs_kernel, n_arg++, sizeof(cl_mem), &chunk->in[4]);
+  err |= clSetKernelArg(xs_kernel, n_arg++, sizeof(cl_mem), &chunk->in[3]);
+  err |= clSetKernelArg(xs_kernel, n_arg++, sizeof(cl_mem), &chunk->in[1]);
+  err |= clSetKernelArg(xs_kernel, n_arg++, sizeof(cl_mem), &chunk->in[2]);
+  err |= clSetKernelArg(xs_kernel, n_arg++, sizeof(cl_mem), &config->enGripPoints.enGP[1].mem);
+  err |= clSetKernelArg(xs_kernel, n_arg++, sizeof(cl_mem), &config->nuGripPoints.nucGP[0].mem);
+  err |= clSetKernelArg(xs_kernel, n_arg++, sizeof(cl_mem), &chunk->out);
+  err |= clSetKernelArg(xs_kernel, n_arg++, sizeof(uint), &chunk->n);
+#ifdef VERIFICATION_BUFFER
+  err |= clEnqueueNDRangeKernel(queue, xs_kernel, 1, NULL, xs_global_work_size, xs_local_work_size,
+				0, NULL, NULL);
+  err |= clEnqueueReadBuffer(queue, chunk->out, CL_FALSE, 0, chunk->n * 5 * sizeof(double),
+			     (double*)config->outputs.xs_output[0].sys + (size_t)chunk->off * 5,
+			     0, NULL, done_ev);
+#else
+  err |= clEnqueueNDRangeKernel(queue, xs_kernel, 1, NULL, xs_global_work_size, xs_local_work_size,
+				0, NULL, done_ev);
+#endif
+
+  if(err != CL_SUCCESS)
+  {
+      printf("enqueue_chunk: failed to enqueue chunk at %u with error %d\n", chunk->off, err);
+      exit(1);
+  }
+}
+
+// Runs the sorted path in chunks of whole sort tiles, round-robin over the
+// pipeline queues, so that the upload and sort of one chunk overlap the
+// lookups and readback of the previous one.  Tiles are sorted independently,
+// so the result matches the unchunked path.
+static
+void calculate_xs_pipelined(OCLKernelParamsMacroXSS *kern_params, uint t_loops)
+{
+  int err;
+  struct OCL_ConfigS * config =  GetOCLConfig();
+  uint tile = kern_params->e_sort_tile;
+  uint chunk_sz = ((config->chunk_lookups + tile - 1) / tile) * tile;
+  uint n_chunks = (kern_params->lookups + chunk_sz - 1) / chunk_sz;
+  OCLChunk *chunks = (OCLChunk*)malloc(n_chunks * sizeof(OCLChunk));
+  cl_event ready;
+  cl_event done[__N_PIPE_QUEUES__];
+  int started[__N_PIPE_QUEUES__];
+  uint n_stages = 0;
+
+  for(uint temp = tile; temp > 1; temp >>= 1)
+        ++n_stages;
+
+  for (uint c = 0; c < n_chunks; c++)
+  {
+      OCLChunk *chunk = &chunks[c];
+      chunk->off = c * chunk_sz;
+      chunk->n = (kern_params->lookups - chunk->off < chunk_sz) ? kern_params->lookups - chunk->off : chunk_sz;
+      chunk->in[0] = chunk_buffer(&config->inputs.xs_input[0], sizeof(double), chunk->off, chunk->n);
+      chunk->in[1] = chunk_buffer(&config->inputs.xs_input[1], sizeof(int), chunk->off, chunk->n);
+      chunk->in[2] = chunk_buffer(&config->inputs.xs_input[2], sizeof(int), chunk->off, chunk->n);
+      chunk->in[3] = chunk_buffer(&config->inputs.xs_input[3], sizeof(int), chunk->off, chunk->n);
+      chunk->in[4] = chunk_buffer(&config->inputs.xs_input[4], sizeof(double), chunk->off, chunk->n);
+#ifdef VERIFICATION_BUFFER
+      chunk->out = chunk_buffer(&config->outputs.xs_output[0], 5 * sizeof(double), chunk->off, chunk->n);
+#else
+      chunk->out = config->outputs.xs_output[0].mem;
+      clRetainMemObject(chunk->out);
+#endif
+  }
+
+// the pipeline queues must not start before the tables uploaded on the main queue
+  err = clEnqueueMarkerWithWaitList(config->command_queue, 0, NULL, &ready);
+  if(err != CL_SUCCESS)
+  {
+      printf("calculate_xs_pipelined: failed to enqueue marker with error %d\n", err);
+      exit(1);
+  }
+  clFlush(config->command_queue);
+
+  for (int q = 0; q < __N_PIPE_QUEUES__; q++)
+      started[q] = 0;
+
+  for (int i = 0; i < (int)t_loops; i++)
+  {
+      for (uint c = 0; c < n_chunks; c++)
+      {
+	  int q = c % __N_PIPE_QUEUES__;
+
+	  if(started[q]) clReleaseEvent(done[q]);
+	  enqueue_chunk(kern_params, config->pipe_queues[q], &chunks[c], n_stages,
+			started[q] ? NULL : &ready, &done[q]);
+	  started[q] = 1;
+	  clFlush(config->pipe_queues[q]);
+      }
+  }
+
+  for (int q = 0; q < __N_PIPE_QUEUES__; q++)
+  {
+      if(started[q])
+      {
+	  clWaitForEvents(1, &done[q]);
+	  clReleaseEvent(done[q]);
+      }
+  }
+  clReleaseEvent(ready);
+
+  for (uint c = 0; c < n_chunks; c++)
+  {
+      for (int b = 0; b < 5; b++)
+	  clReleaseMemObject(chunks[c].in[b]);
+      clReleaseMemObject(chunks[c].out);
+  }
+  free(chunks);
+}
+
 static
 void calculate_xs_withsort(OCLKernelParamsMacroXSS *kern_params, const char * kernel_nm, uint t_loops)
 {
@@ -1187,6 +1382,11 @@ void calculate_xs_withsort(OCLKernelParamsMacroXSS *kern_params, const char * ke
   cl_context context = GetXSBenchContext();
   cl_command_queue commandQueue = GetXSBenchCommandQueue();
 
+  if (config->chunk_lookups > 0)
+  {
+      calculate_xs_pipelined(kern_params, t_loops);
+      return;
+  }
 
 // run the three kernels
   sort_input_energy(kern_params, "bitonicSortTiled3", t_loops);
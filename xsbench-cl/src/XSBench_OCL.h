@@ -67,6 +67,7 @@ typedef struct{
 
 #endif
 #define __MAX_N_KERNELS__ 64
+#define __N_PIPE_QUEUES__ 2
 struct OCL_ConfigS
 {
   cl_context context;
@@ -84,6 +85,8 @@ struct OCL_ConfigS
   OCLXSConsts consts;
   OCLXSOutput outputs;
   OCLXSInput inputs;
+  cl_command_queue pipe_queues[__N_PIPE_QUEUES__];
+  uint chunk_lookups;
 #endif
 };
 
@@ -74,6 +74,7 @@ typedef unsigned int uint;
 // OpenCL configuration and getter routines
 int SetupOpenCL(char *kernel_filename);
 int CleanupOpenCL();
+int SetupPipeline(uint chunk_lookups);
 cl_context GetXSBenchContext();
 cl_command_queue GetXSBenchCommandQueue();
 cl_kernel GetXSBenchKernel();
@@ -116,6 +117,7 @@ typedef struct{
 	char * HM;
 #ifdef __USE_AMD_OCL__
 	int tloops;
+	int chunk;
 	bool run_cpu;
 #endif
 	bool savegrids;
@@ -210,6 +210,7 @@ Inputs read_CLI( int argc, char * argv[] )
 	
 #ifdef __USE_AMD_OCL__
 	input.tloops = 1;
+	input.chunk = 0;
 	input.run_cpu = false;
 #endif
         input.savegrids = false;
@@ -271,6 +272,14 @@ Inputs read_CLI( int argc, char * argv[] )
 		{
 			input.run_cpu = true;
 		}
+		// lookups per pipelined chunk (-p)
+		else if( strcmp(arg, "-p") == 0 )
+		{
+			if( ++i < argc )
+				input.chunk = atoi(argv[i]);
+			else
+				print_CLI_error();
+		}
 
 #endif
                 else if( strcmp(arg, "-v") == 0 )
@@ -311,6 +320,12 @@ Inputs read_CLI( int argc, char * argv[] )
 	// Validate lookups
 	if( input.lookups < 1 )
 		print_CLI_error();
+
+#ifdef __USE_AMD_OCL__
+	// Validate pipeline chunk
+	if( input.chunk < 0 )
+		print_CLI_error();
+#endif
 	
 	// Validate HM size
 	if( strcasecmp(input.HM, "small") != 0 &&
@@ -340,6 +355,7 @@ void print_CLI_error(void)
 	printf("  -s <size>        Size of H-M Benchmark to run (small, large, XL, XXL)\n");
 	printf("  -g <gridpoints>  Number of gridpoints per nuclide (overrides -s defaults)\n");
 	printf("  -l <lookups>     Number of Cross-section (XS) lookups\n");
+	printf("  -p <lookups>     Pipeline the sorted OpenCL path in chunks of this many lookups\n");
 	printf("Default is equivalent to: -s large -l 15000000\n");
 	printf("See readme for full description of default run values\n");
         printf("  -v               Save grids to disk for restore\n");
@@ -198,7 +198,8 @@ void unionized_grid_search(__global const char *params_in,
                 __global const double *sorted_energy,
 		__global const uint* unsorted_eng_index,
                 __global const double *energyGrid,
-		__global uint *energyGripIndxes
+		__global uint *energyGripIndxes,
+		uint n_lookups
 			     )
 {
   int i = get_global_id(0);
@@ -208,7 +209,7 @@ void unionized_grid_search(__global const char *params_in,
   uint unsorted_id;
   uint n_unionized_grid_points = params->n_isotopes*params->n_gridpoints;
 
-  if(i >= params->lookups) return; 
+  if(i >= n_lookups) return; 
 
   energy = sorted_energy[i];
 
@@ -311,7 +312,8 @@ void calculate_xs_sorted(__global const char *params_in,
 			 __global const int *unsorted_eng_indx,
 			 __global const uint *xs_nucGridPtrs,
 			 __global const NuclideGridPoint *xs_nucGrid,
-			 __global double *macro_xs_vector
+			 __global double *macro_xs_vector,
+			 uint n_lookups
 			     )
 {
   int i = get_global_id(0);
@@ -330,7 +332,7 @@ void calculate_xs_sorted(__global const char *params_in,
   for( int i = 0; i < 5; i++) { 
     xs_vector_out[i] = 0.;
   }
-  if(i >= params->lookups) return;
+  if(i >= n_lookups) return;
 
 // find original usorted position of the energy/index pair
   uint unsorted_mat_i = unsorted_eng_indx[i];
@@ -418,48 +420,38 @@ void bitonicSort(__global double * tiledArray,
     }
 }
 
+// Left and right slots of comparator threadId in one pass of a bitonic
+// stage.  The first pass of every stage pairs mirrored slots of its block,
+// so all comparators sort ascending and slots past the end of a short tile
+// behave as +inf: they never move and need no storage.
+void bitonicPair(uint threadId,
+                 uint stage,
+                 uint passOfStage,
+                 uint *leftId,
+                 uint *rightId)
+{
+    uint pairDistance = 1 << (stage - passOfStage);
+    uint offset = threadId % pairDistance;
+
+    *leftId = offset + (threadId / pairDistance) * 2 * pairDistance;
+    if(passOfStage == 0)
+        *rightId = *leftId - offset + 2 * pairDistance - 1 - offset;
+    else
+        *rightId = *leftId + pairDistance;
+}
+
 void bitonicSortLcl(__local double * tiledArray,
                   __local uint *indexArray,
-                  uint stage, 
-                  uint passOfStage,
-                  uint direction,
-		  uint threadId,
 		  uint leftId,
 		  uint rightId)
 {
-    uint sortIncreasing = direction;   
     double leftElement = tiledArray[leftId];
     double rightElement = tiledArray[rightId];
 
-    uint sameDirectionBlockWidth = (1 << stage);
-    
-    if((threadId/sameDirectionBlockWidth) % 2 == 1) {
-        sortIncreasing = 1 - sortIncreasing;
-    }
-
-    double greater;
-    double lesser;
     if(leftElement > rightElement) {
-        greater = leftElement;
-        lesser  = rightElement;
-    }
-    else {
-        greater = rightElement;
-        lesser  = leftElement;
-    }
-    
-    double newLeftElement;
-    if(sortIncreasing) {
-        tiledArray[leftId]  = lesser;
-        tiledArray[rightId] = greater;
-	newLeftElement = lesser;
-    }
-    else {
-        tiledArray[leftId]  = greater;
-        tiledArray[rightId] = lesser;
-	newLeftElement = greater;
-    }
-    if ( newLeftElement != leftElement ) {
+        tiledArray[leftId]  = rightElement;
+        tiledArray[rightId] = leftElement;
+
 	uint tindex = indexArray[leftId];
 	indexArray[leftId] = indexArray[rightId];
 	indexArray[rightId] = tindex;
@@ -468,46 +460,16 @@ void bitonicSortLcl(__local double * tiledArray,
 
 void bitonicSortGlbl(__global double * tiledArray,
                   __global uint *indexArray,
-                  uint stage, 
-                  uint passOfStage,
-                  uint direction,
-		  uint threadId,
 		  uint leftId,
 		  uint rightId)
 {
-    uint sortIncreasing = direction; 
     double leftElement = tiledArray[leftId];
     double rightElement = tiledArray[rightId];
 
-    uint sameDirectionBlockWidth = (1 << stage);
-    
-    if((threadId/sameDirectionBlockWidth) % 2 == 1) {
-        sortIncreasing = 1 - sortIncreasing;
-    }
-
-    double greater;
-    double lesser;
     if(leftElement > rightElement) {
-        greater = leftElement;
-        lesser  = rightElement;
-    }
-    else {
-        greater = rightElement;
-        lesser  = leftElement;
-    }
-    
-    double newLeftElement;
-    if(sortIncreasing) {
-        tiledArray[leftId]  = lesser;
-        tiledArray[rightId] = greater;
-	newLeftElement = lesser;
-    }
-    else {
-        tiledArray[leftId]  = greater;
-        tiledArray[rightId] = lesser;
-	newLeftElement = greater;
-    }
-    if ( newLeftElement != leftElement ) {
+        tiledArray[leftId]  = rightElement;
+        tiledArray[rightId] = leftElement;
+
 	uint tindex = indexArray[leftId];
 	indexArray[leftId] = indexArray[rightId];
 	indexArray[rightId] = tindex;
@@ -551,83 +513,77 @@ void bitonicSortTiled(__global double * theArray,
 #define LOG2_BLOCK_SIZE 17
 #define LG_MAX_LOCAL_DISTANCE 9
 #define MAX_LOCAL_DISTANCE (1<<LG_MAX_LOCAL_DISTANCE)
+#define SORT_WG_SIZE 256
 
+// Runs stages [start_stage, end_stage) of the first count slots, the first
+// of them from start_pass on, one local memory chunk at a time.  Only the
+// passes whose pairs fit inside a chunk may be run here.
 void bitonicSort256(__global double *tiledArray, __local double * left_right, __global uint* indexArray, __local uint *lr_indexes,
-			uint n_stages,
-			uint direction,
+			uint count,
 			uint start_stage, uint end_stage,
-	                uint start_pass, uint end_pass
+	                uint start_pass
 			)
 {
    uint lcl_id = get_local_id(0);
-   uint pairDistance = MAX_LOCAL_DISTANCE;
-   uint blockWidth = pairDistance*2;
-// loop over local memory-size buffers
-   for( uint threadId = lcl_id; threadId < (1 << (n_stages-1)); threadId += MAX_LOCAL_DISTANCE) {
-// read into local memory once
-	uint leftId0 = (threadId % pairDistance) + (threadId / pairDistance) * blockWidth;
-
-	for(uint l = lcl_id; l < blockWidth; l += 256) {
-
-		left_right[l] = tiledArray[leftId0 + l - lcl_id];
-		lr_indexes[l] = indexArray[leftId0 + l - lcl_id];
 
+   for( uint base = 0; base < count; base += 2*MAX_LOCAL_DISTANCE) {
+// read into local memory once, padding a short tile with +inf
+	for(uint l = lcl_id; l < 2*MAX_LOCAL_DISTANCE; l += SORT_WG_SIZE) {
+		uint g = base + l;
+		left_right[l] = (g < count) ? tiledArray[g] : INFINITY;
+		lr_indexes[l] = (g < count) ? indexArray[g] : 0;
 	}
 	barrier(CLK_LOCAL_MEM_FENCE);
-	uint loop_counter = 0;
-	for(uint stage = start_stage; stage < end_stage; ++stage) {
-// all passes needed
-           for(uint passOfStage = start_pass; passOfStage < stage+1; ++passOfStage, loop_counter++) {
-	       uint pairDistance = 1 << (stage - passOfStage);
-               uint blockWidth   = 2 * pairDistance;
-	
-               for( uint l = lcl_id, lcl_threadId = threadId; l < MAX_LOCAL_DISTANCE; l+=256, lcl_threadId+=256) {
-
-	            uint leftId = (l % pairDistance) + (l / pairDistance) * blockWidth;
-	            uint rightId = leftId + pairDistance;
-
-                    bitonicSortLcl(left_right, lr_indexes,
-                                    stage, 
-                                    passOfStage,
-                                    direction,
-			            lcl_threadId,
-				    leftId,
-				    rightId);
-	 	    }
-		    barrier(CLK_LOCAL_MEM_FENCE);
-	    	}
-	   }
-           for(uint l = lcl_id; l < blockWidth; l += 256) {
-
-		    tiledArray[leftId0 + l - lcl_id] = left_right[l];
-		    indexArray[leftId0 + l - lcl_id] = lr_indexes[l];
 
+	for(uint stage = start_stage; stage < end_stage; ++stage) {
+           for(uint passOfStage = (stage == start_stage) ? start_pass : 0; passOfStage < stage+1; ++passOfStage) {
+               for( uint threadId = lcl_id; threadId < MAX_LOCAL_DISTANCE; threadId += SORT_WG_SIZE) {
+	            uint leftId, rightId;
+
+	            bitonicPair(threadId, stage, passOfStage, &leftId, &rightId);
+                    bitonicSortLcl(left_right, lr_indexes, leftId, rightId);
+	       }
+	       barrier(CLK_LOCAL_MEM_FENCE);
 	   }
-           barrier(CLK_GLOBAL_MEM_FENCE);
-       }
+	}
 
+	for(uint l = lcl_id; l < 2*MAX_LOCAL_DISTANCE; l += SORT_WG_SIZE) {
+		uint g = base + l;
+		if(g < count) {
+			tiledArray[g] = left_right[l];
+			indexArray[g] = lr_indexes[l];
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
+   }
 }
 
 
+// Sorts every tile_length slice of theArray into sortedArray, keeping the
+// original positions in theIndexArray.  total_length need not be a multiple
+// of tile_length: the last tile only sorts the power of two covering it.
 __kernel 
 void bitonicSortTiled3(__global const double * theArray,
                       __global double * sortedArray,
                       __global uint *theIndexArray,
                       uint total_length, 
                       uint tile_length,
-                      uint n_stages,
-                      uint direction)
+                      uint n_stages)
 {
 	uint groupID = get_group_id(0);
 	uint lcl_id = get_local_id(0);
-	__global double* origArray = &theArray[groupID * tile_length];
+	__global const double* origArray = &theArray[groupID * tile_length];
 	__global double* tiledArray = &sortedArray[groupID * tile_length];
 	__global uint *indexArray = &theIndexArray[groupID * tile_length];
 	__local double left_right[MAX_LOCAL_DISTANCE*2];
 	__local uint lr_indexes[MAX_LOCAL_DISTANCE*2];
+	uint count = min(tile_length, total_length - groupID * tile_length);
 	uint passOfStage;
-	uint index = lcl_id;	
-	for(uint index = lcl_id; index < (1 << n_stages); index += 256)
+
+	while(n_stages > 1 && (1u << (n_stages - 1)) >= count)
+		n_stages--;
+
+	for(uint index = lcl_id; index < count; index += SORT_WG_SIZE)
 	{
 	   indexArray[index] = index + groupID * tile_length;
 	   tiledArray[index] = origArray[index];
@@ -635,28 +591,22 @@ void bitonicSortTiled3(__global const double * theArray,
 
 	barrier(CLK_GLOBAL_MEM_FENCE);
 
-	bitonicSort256(tiledArray, left_right, indexArray, lr_indexes, n_stages,direction, 0, LG_MAX_LOCAL_DISTANCE + 1, 0, LG_MAX_LOCAL_DISTANCE + 1 );
+	bitonicSort256(tiledArray, left_right, indexArray, lr_indexes, count, 0, min(n_stages, (uint)(LG_MAX_LOCAL_DISTANCE + 1)), 0);
 
 	for(uint stage = LG_MAX_LOCAL_DISTANCE + 1; stage < n_stages; ++stage) {
         
-        // Every stage has stage + 1 passes
-           for(passOfStage = 0; (passOfStage < stage + 1) && ((stage - passOfStage ) > LG_MAX_LOCAL_DISTANCE); ++passOfStage) {
-		uint pairDistance = 1 << (stage - passOfStage);
-        	uint blockWidth   = 2 * pairDistance;
-		// group
-		for(uint threadId = lcl_id; threadId < (1 << (n_stages - 1)); threadId += 256) {
-
-                   // left ID
-                   uint leftId = (threadId % pairDistance) + (threadId / pairDistance) * blockWidth;	
-                   // + global right distance
-
-                   bitonicSortGlbl(tiledArray, indexArray, stage, passOfStage, direction, threadId, leftId, (leftId + pairDistance));
-
+        // passes with pairs further apart than a local chunk run in global memory
+           for(passOfStage = 0; (stage - passOfStage) > LG_MAX_LOCAL_DISTANCE; ++passOfStage) {
+		for(uint threadId = lcl_id; threadId < (1u << (n_stages - 1)); threadId += SORT_WG_SIZE) {
+                   uint leftId, rightId;
+
+                   bitonicPair(threadId, stage, passOfStage, &leftId, &rightId);
+                   if(rightId < count)
+                      bitonicSortGlbl(tiledArray, indexArray, leftId, rightId);
 		}
 		barrier(CLK_GLOBAL_MEM_FENCE);
 	   }
-	   bitonicSort256(tiledArray, left_right, indexArray, lr_indexes, n_stages, direction, stage, stage+1, passOfStage, stage+1);
+	   bitonicSort256(tiledArray, left_right, indexArray, lr_indexes, count, stage, stage+1, passOfStage);
 
 	}
 }
-